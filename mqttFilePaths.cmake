@@ -8,7 +8,9 @@
 # MQTT library source files.
 set( MQTT_SOURCES
      "${CMAKE_CURRENT_LIST_DIR}/source/core_mqtt.c"
-     "${CMAKE_CURRENT_LIST_DIR}/source/core_mqtt_state.c" )
+     "${CMAKE_CURRENT_LIST_DIR}/source/core_mqtt_state.c"
+     "${CMAKE_CURRENT_LIST_DIR}/source/core_mqtt_router.c"
+     "${CMAKE_CURRENT_LIST_DIR}/source/core_mqtt_retransmit_store.c" )
 
 # MQTT Serializer library source files.
 set( MQTT_SERIALIZER_SOURCES
@@ -82,6 +82,53 @@
  */
 #define CORE_MQTT_UNSUBSCRIBE_PER_TOPIC_VECTOR_LENGTH    ( 2U )
 
+/**
+ * @brief Number of bytes read ahead while receiving the CONNACK fixed header.
+ * The largest fixed header is also the size of the smallest valid CONNACK, so
+ * reading this much never consumes bytes of the packet following the CONNACK.
+ */
+#define CORE_MQTT_CONNACK_STAGING_BUFFER_SIZE            ( MQTT_FIXED_HEADER_MAX_SIZE )
+
+/**
+ * @brief Largest number of vectors required to send one PUBLISH packet.
+ * The fields are: 1. Fixed header (including topic length); 2. Topic name;
+ * 3. Packet ID; 4. Property length; 5. Properties; and 6. Payload.
+ */
+#define CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH              ( 6U )
+
+/**
+ * @brief Smallest number of vectors required to send one PUBLISH packet:
+ * the fixed header, the topic name and the property length.
+ */
+#define CORE_MQTT_PUBLISH_MIN_VECTOR_LENGTH              ( 3U )
+
+/**
+ * @brief Size of a Topic Alias property: the property identifier and the
+ * 2-byte alias.
+ */
+#define CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE              ( 3U )
+
+/**
+ * @brief Largest size of a Subscription Identifier property: the property
+ * identifier and the identifier, a variable byte integer of up to 4 bytes.
+ */
+#define CORE_MQTT_SUBSCRIPTION_ID_PROPERTY_MAX_SIZE      ( 5U )
+
+#if ( MQTT_PUBLISH_BATCH_MAX_VECTORS < CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH )
+    #error MQTT_PUBLISH_BATCH_MAX_VECTORS must be large enough to hold one PUBLISH packet.
+#endif
+
+#if ( MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS < 1 )
+    #error MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS must be at least 1.
+#endif
+
+/**
+ * @brief Maximum number of vectors of a PUBLISH packet sent by
+ * #MQTT_Publish or #MQTT_PublishSegmented, whose payload takes up to
+ * #MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS vectors instead of one.
+ */
+#define CORE_MQTT_PUBLISH_MAX_SEGMENTED_VECTOR_LENGTH    ( CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH - 1U + MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS )
+
 /**
  * @brief Set flag in the packet ID just beyond the actual packet ID.
  */
@@ -93,6 +140,33 @@ struct MQTTVec
     size_t vectorLen;               /**< Length of the transport vector. USER SHOULD NOT ACCESS THIS DIRECTLY - IT IS AN INTERNAL DETAIL AND CAN CHANGE. */
 };
 
+/**
+ * @brief Tracks the state of building a scatter-gather IO vector list.
+ *
+ * Groups the iterator, vector count, and accumulated message length
+ * that are always passed together when appending to an IO vector.
+ */
+typedef struct IoVecState
+{
+    TransportOutVector_t * pIterator; /**< Current position in the IO vector array. */
+    size_t ioVectorLength;            /**< Number of vectors added so far. */
+    uint32_t totalMessageLength;      /**< Accumulated byte count across all vectors. */
+} IoVecState_t;
+
+/**
+ * @brief Encoded fields of one PUBLISH packet of a batch sent by
+ * #MQTT_PublishBatch.
+ *
+ * The vectors of a batch point into these buffers, so they must stay valid
+ * until the batch is sent.
+ */
+typedef struct PublishBatchEntry
+{
+    uint8_t header[ 7U ];         /**< Fixed header and topic length, see #MQTT_Publish. */
+    uint8_t packetId[ 2U ];       /**< Encoded packet identifier. */
+    uint8_t propertyLength[ 4U ]; /**< Encoded property length. */
+} PublishBatchEntry_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -172,6 +246,65 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
                                   TransportOutVector_t * pIoVec,
                                   size_t ioVecCount );
 
+/**
+ * @brief Send the bytes kept by non-blocking sends.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] timeoutMs Time to wait for the transport to accept the bytes, or
+ * 0 to return as soon as the transport would block.
+ *
+ * @return #MQTTSendFailed if the transport failed, in which case the kept
+ * bytes are dropped;
+ * #MQTTSendWouldBlock if some bytes are still kept;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t sendPendingBytes( MQTTContext_t * pContext,
+                                      uint32_t timeoutMs );
+
+/**
+ * @brief Keep the bytes of a packet not yet sent, if non-blocking sends are
+ * enabled and the bytes fit in the pending send buffer.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pIoVec The vectors of the packet not yet sent.
+ * @param[in] ioVecCount The number of elements in @p pIoVec.
+ *
+ * @return true if the bytes were kept, false otherwise.
+ */
+static bool keepPendingBytes( MQTTContext_t * pContext,
+                              const TransportOutVector_t * pIoVec,
+                              size_t ioVecCount );
+
+/**
+ * @brief Before a packet is sent, send the bytes kept by non-blocking sends
+ * so that the packet follows them.
+ *
+ * The kept bytes are sent without blocking. If some remain, the packet is kept
+ * behind them, or if it does not fit, they are sent blocking.
+ *
+ * @param[in] pContext Initialized MQTT context with kept bytes.
+ * @param[in] pIoVec The vectors of the packet.
+ * @param[in] ioVecCount The number of elements in @p pIoVec.
+ * @param[out] pPacketKept Whether the packet was kept behind the kept bytes.
+ *
+ * @return #MQTTSendFailed if the kept bytes could not be sent;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t sendBehindPendingBytes( MQTTContext_t * pContext,
+                                            const TransportOutVector_t * pIoVec,
+                                            size_t ioVecCount,
+                                            bool * pPacketKept );
+
+/**
+ * @brief Send the bytes kept by non-blocking sends without blocking, with the
+ * mutex taken.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return The same values as #sendPendingBytes.
+ */
+static MQTTStatus_t flushPendingBytes( MQTTContext_t * pContext );
+
 /**
  * @brief Add a string and its length after serializing it in a manner outlined by
  * the MQTT specification.
@@ -248,6 +381,31 @@ static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
                                                 uint32_t remainingLength,
                                                 const MQTTPropBuilder_t * pPropertyBuilder );
 
+/**
+ * @brief Serialize a SUBSCRIBE or UNSUBSCRIBE packet in
+ * #MQTTContext_t.subscribeBuffer and send it with one transport write.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pSubscriptionList List of MQTT subscription info.
+ * @param[in] subscriptionCount Number of elements in pSubscriptionList.
+ * @param[in] packetId Packet identifier.
+ * @param[in] remainingLength Remaining length of the packet.
+ * @param[in] packetSize Size of the packet, which must fit in the buffer.
+ * @param[in] pPropertyBuilder MQTT property builder.
+ * @param[in] packetType #MQTT_PACKET_TYPE_SUBSCRIBE or
+ * #MQTT_PACKET_TYPE_UNSUBSCRIBE.
+ *
+ * @return #MQTTSendFailed, #MQTTBadParameter or #MQTTSuccess.
+ */
+static MQTTStatus_t sendSerializedSubUnsub( MQTTContext_t * pContext,
+                                            const MQTTSubscribeInfo_t * pSubscriptionList,
+                                            size_t subscriptionCount,
+                                            uint16_t packetId,
+                                            uint32_t remainingLength,
+                                            uint32_t packetSize,
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint8_t packetType );
+
 /**
  * @brief Calculate the interval between two millisecond timestamps, including
  * when the later value has overflowed.
@@ -277,6 +435,7 @@ static MQTTPubAckType_t getAckFromPacketType( uint8_t packetType );
  * @brief Receive bytes into the network buffer.
  *
  * @param[in] pContext Initialized MQTT Context.
+ * @param[in] offset Offset in the network buffer to receive the bytes at.
  * @param[in] bytesToRecv Number of bytes to receive.
  *
  * @note This operation calls the transport receive function
@@ -292,6 +451,7 @@ static MQTTPubAckType_t getAckFromPacketType( uint8_t packetType );
  * @return Number of bytes received, or negative number on network error.
  */
 static int32_t recvExact( MQTTContext_t * pContext,
+                          size_t offset,
                           size_t bytesToRecv );
 
 /**
@@ -299,11 +459,16 @@ static int32_t recvExact( MQTTContext_t * pContext,
  *
  * @param[in] pContext MQTT Connection context.
  * @param[in] incomingPacket packet struct with remaining length.
+ * @param[in] pStagedData Bytes of the remaining data already read along with
+ * the fixed header.
+ * @param[in] stagedLength Number of bytes in @p pStagedData.
  *
- * @return #MQTTSuccess or #MQTTRecvFailed.
+ * @return #MQTTSuccess, #MQTTBadResponse or #MQTTRecvFailed.
  */
 static MQTTStatus_t receiveConnackPacket( MQTTContext_t * pContext,
-                                          MQTTPacketInfo_t incomingPacket );
+                                          MQTTPacketInfo_t incomingPacket,
+                                          const uint8_t * pStagedData,
+                                          size_t stagedLength );
 
 /**
  * @brief Get the correct ack type to send.
@@ -338,6 +503,28 @@ static MQTTStatus_t sendPublishAcks( MQTTContext_t * pContext,
  */
 static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext );
 
+/**
+ * @brief Get the time left until #handleKeepAlive has to send a PINGREQ or
+ * report a missing PINGRESP.
+ *
+ * @param[in] pContext Initialized MQTT Context.
+ *
+ * @return Time in milliseconds, 0 if the keep alive action is already due.
+ */
+static uint32_t getKeepAliveWaitTimeMs( MQTTContext_t * pContext );
+
+/**
+ * @brief Block until the transport has data to receive, if a wait readable
+ * function was provided by #MQTT_InitWaitReadable.
+ *
+ * @param[in] pContext Initialized MQTT Context.
+ * @param[in] timeoutMs Maximum time to wait in milliseconds.
+ *
+ * @return #MQTTRecvFailed if the wait failed, otherwise #MQTTSuccess.
+ */
+static MQTTStatus_t waitForReadable( MQTTContext_t * pContext,
+                                     uint32_t timeoutMs );
+
 /**
  * @brief Handle received MQTT PUBLISH packet.
  *
@@ -349,6 +536,28 @@ static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext );
 static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
                                            MQTTPacketInfo_t * pIncomingPacket );
 
+/**
+ * @brief Deserialize a received MQTT PUBLISH packet into the properties
+ * attached to the context, and resolve its topic alias.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pIncomingPacket Incoming PUBLISH packet.
+ * @param[out] pPacketIdentifier Packet identifier of the PUBLISH.
+ * @param[out] pPublishInfo Deserialized PUBLISH.
+ * @param[out] pPropBuffer Properties of the PUBLISH.
+ *
+ * A PUBLISH with a topic alias the broker never set is a protocol error,
+ * and the connection is closed with a DISCONNECT.
+ *
+ * @return The return value of the deserializer, or #MQTTBadResponse if the
+ * topic alias is invalid.
+ */
+static MQTTStatus_t deserializeIncomingPublish( MQTTContext_t * pContext,
+                                                const MQTTPacketInfo_t * pIncomingPacket,
+                                                uint16_t * pPacketIdentifier,
+                                                MQTTPublishInfo_t * pPublishInfo,
+                                                MQTTPropBuilder_t * pPropBuffer );
+
 /**
  * @brief Handle received MQTT publish acks.
  *
@@ -374,6 +583,90 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
                                        MQTTPacketInfo_t * pIncomingPacket,
                                        bool manageKeepAlive );
 
+/**
+ * @brief Handle a complete incoming packet.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pIncomingPacket Incoming packet.
+ * @param[in] manageKeepAlive Flag indicating if PINGRESPs should not be given
+ * to the application
+ *
+ * @return MQTTSuccess, MQTTIllegalState, MQTTStatusNotConnected or
+ * deserialization error.
+ */
+static MQTTStatus_t handleIncomingPacket( MQTTContext_t * pContext,
+                                          MQTTPacketInfo_t * pIncomingPacket,
+                                          bool manageKeepAlive );
+
+/**
+ * @brief Get the length of the variable header of an incoming PUBLISH from
+ * the bytes received so far.
+ *
+ * @param[in] pIncomingPacket Incoming PUBLISH packet.
+ * @param[in] availableLength Number of bytes of the variable header and
+ * payload available at #MQTTPacketInfo_t.pRemainingData.
+ * @param[out] pVariableHeaderLength Length of the variable header, including
+ * the properties.
+ *
+ * @return #MQTTNeedMoreBytes if the variable header has not been fully
+ * received; #MQTTBadResponse if the property length is malformed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t getPublishVariableHeaderLength( const MQTTPacketInfo_t * pIncomingPacket,
+                                                    size_t availableLength,
+                                                    size_t * pVariableHeaderLength );
+
+/**
+ * @brief Stream the payload of an incoming PUBLISH larger than the network
+ * buffer to the application's #MQTTPublishChunkCallback_t.
+ *
+ * The fixed and variable headers are kept at the start of the network buffer
+ * and each received piece of the payload is dropped once it is delivered. The
+ * headers are deserialized once, when they have all been received, and kept
+ * in the #MQTTPublishStream_t of the context for the following pieces. The
+ * payload of a duplicate QoS 2 PUBLISH is dropped without being delivered.
+ * The PUBLISH is handled by #handleIncomingPublish once the last piece has
+ * been received.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pIncomingPacket Incoming PUBLISH packet.
+ * @param[out] pConsumedLength Number of bytes of the network buffer used by
+ * the PUBLISH once it has been fully received.
+ *
+ * @return #MQTTNeedMoreBytes if more of the payload is expected;
+ * #MQTTRecvFailed if the headers do not fit in the network buffer;
+ * #MQTTEventCallbackFailed if the chunk callback fails; otherwise the
+ * return value of #handleIncomingPublish.
+ */
+static MQTTStatus_t receiveStreamedPublish( MQTTContext_t * pContext,
+                                            MQTTPacketInfo_t * pIncomingPacket,
+                                            uint32_t * pConsumedLength );
+
+/**
+ * @brief Abandon the PUBLISH being streamed, if any, when the connection it
+ * was received on is closed or replaced.
+ *
+ * The headers of a streamed PUBLISH are kept at the start of the network
+ * buffer, so the buffered bytes are dropped along with the stream state.
+ *
+ * @param[in] pContext MQTT Connection context.
+ */
+static void resetPublishStream( MQTTContext_t * pContext );
+
+/**
+ * @brief Move the unprocessed bytes of the network buffer to its start if the
+ * packet at the head would not fit in the space left before the end of the
+ * buffer.
+ *
+ * This is a no-op unless ring receive mode is enabled, since the head is
+ * always at the start of the buffer otherwise.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] requiredLength Number of bytes the packet at the head needs.
+ */
+static void linearizeNetworkBuffer( MQTTContext_t * pContext,
+                                    size_t requiredLength );
+
 /**
  * @brief Run a single iteration of the receive loop.
  *
@@ -392,6 +685,48 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
 static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                                             bool manageKeepAlive );
 
+/**
+ * @brief Handle the packets held in the network buffer, completing them with
+ * bytes from a buffer lent by the transport.
+ *
+ * When receiving through #TransportRecvLease_t, the network buffer only holds
+ * packets that span two leases, or that could not be handled before their
+ * lease was handed back.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] pLease Buffer lent by the transport.
+ * @param[in] leasedBytes Number of bytes in @p pLease.
+ * @param[in,out] pOffset Offset of the first byte of @p pLease that has not
+ * been copied to the network buffer.
+ * @param[in] manageKeepAlive Flag indicating if PINGRESPs should not be given
+ * to the application
+ *
+ * @return #MQTTNeedMoreBytes if the lease ends before the buffered packet;
+ * #MQTTRecvFailed if the buffered packet is larger than the network buffer;
+ * otherwise the return value of #handleIncomingPacket.
+ */
+static MQTTStatus_t completeBufferedPackets( MQTTContext_t * pContext,
+                                             const uint8_t * pLease,
+                                             size_t leasedBytes,
+                                             size_t * pOffset,
+                                             bool manageKeepAlive );
+
+/**
+ * @brief Run a single iteration of the receive loop using a buffer lent by
+ * the transport.
+ *
+ * Packets fully contained in the lent buffer are handled in place. Only the
+ * bytes of a packet spanning two lent buffers are copied to the network
+ * buffer.
+ *
+ * @param[in] pContext MQTT Connection context.
+ * @param[in] manageKeepAlive Flag indicating if keep alive should be handled.
+ *
+ * @return Same as #receiveSingleIteration.
+ */
+static MQTTStatus_t receiveLeasedIteration( MQTTContext_t * pContext,
+                                            bool manageKeepAlive );
+
 /**
  * @brief Validates parameters of #MQTT_Subscribe or #MQTT_Unsubscribe.
  *
@@ -441,6 +776,53 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
  */
 static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext );
 
+/**
+ * @brief Resend the stored PUBREL and PUBLISH packets of a re-established
+ * MQTT session, retrieving and sending them in batches.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return #MQTTPublishRetrieveFailed if the packets could not be retrieved;
+ * #MQTTBadParameter if a retrieved packet is invalid;
+ * #MQTTSendFailed if transport send during resend failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t resendStoredPacketBatches( MQTTContext_t * pContext );
+
+/**
+ * @brief Retrieve a stored PUBLISH in parts and send it with one transport
+ * write.
+ *
+ * @param[in] pContext Initialized MQTT context with a reference retrieve
+ * function.
+ * @param[in] packetId Packet ID of the PUBLISH.
+ *
+ * @return #MQTTPublishRetrieveFailed if the packet could not be retrieved;
+ * #MQTTBadParameter if the retrieved packet is invalid;
+ * #MQTTSendFailed if transport send failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t resendPublishByReference( MQTTContext_t * pContext,
+                                              uint16_t packetId );
+
+/**
+ * @brief Retrieve a batch of stored packets and send them, with as few
+ * transport writes as #MQTT_MAX_PACKET_SIZE allows.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pHandles Handles of the packets to resend.
+ * @param[in] handleCount Number of handles, at most
+ * #MQTT_PUBLISH_BATCH_MAX_VECTORS.
+ *
+ * @return #MQTTPublishRetrieveFailed if the packets could not be retrieved;
+ * #MQTTBadParameter if a retrieved packet is invalid;
+ * #MQTTSendFailed if transport send failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t resendPacketBatch( MQTTContext_t * pContext,
+                                       const uint32_t * pHandles,
+                                       size_t handleCount );
+
 /**
  * @brief Clears existing state records for a clean session.
  *
@@ -461,6 +843,12 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext );
  * @param[in] headerSize Size of the serialized PUBLISH header.
  * @param[in] packetId Packet Id of the publish packet.
  * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] topicAlias Topic Alias to add to the properties, or 0 for none.
+ * @param[in] pPayloadSegments The segments the payload is sent from instead of
+ * @p pPublishInfo, or NULL.
+ * @param[in] payloadSegmentCount Number of entries in @p pPayloadSegments.
+ * @param[in] pPayloadReference The reference keeping the payload valid in the
+ * retransmit store, or NULL to copy the payload.
  *
  * @return #MQTTSendFailed if transport send during resend failed;
  * #MQTTPublishStoreFailed if storing the outgoing publish failed in the case of QoS 1/2
@@ -471,95 +859,539 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
                                             uint8_t * pMqttHeader,
                                             size_t headerSize,
                                             uint16_t packetId,
-                                            const MQTTPropBuilder_t * pPropertyBuilder );
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint16_t topicAlias,
+                                            const TransportOutVector_t * pPayloadSegments,
+                                            size_t payloadSegmentCount,
+                                            const MQTTPayloadReference_t * pPayloadReference );
 
 /**
- * @brief Function to validate #MQTT_Publish parameters.
+ * @brief Add the segments of a payload to the IO vector of a PUBLISH packet.
  *
- * @param[in] pContext Initialized MQTT context.
- * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
- * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[in] pPayloadSegments The segments of the payload.
+ * @param[in] payloadSegmentCount Number of entries in @p pPayloadSegments, at
+ * most #MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS.
+ * @param[in,out] pVecState The IO vector to add to.
  *
- * @return #MQTTBadParameter if invalid parameters are passed;
+ * @return #MQTTBadParameter if the packet is too large;
  * #MQTTSuccess otherwise.
  */
-static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
-                                           const MQTTPublishInfo_t * pPublishInfo,
-                                           uint16_t packetId );
+static MQTTStatus_t appendPayloadSegments( const TransportOutVector_t * pPayloadSegments,
+                                           size_t payloadSegmentCount,
+                                           IoVecState_t * pVecState );
 
 /**
- * @brief Performs matching for special cases when a topic filter ends
- * with a wildcard character.
+ * @brief Validate and send a PUBLISH packet, for #MQTT_Publish,
+ * #MQTT_PublishSegmented and #MQTT_PublishByReference.
  *
- * When the topic name has been consumed but there are remaining characters to
- * to match in topic filter, this function handles the following 2 cases:
- * - When the topic filter ends with "/+" or "/#" characters, but the topic
- * name only ends with '/'.
- * - When the topic filter ends with "/#" characters, but the topic name
- * ends at the parent level.
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] pPayloadSegments The segments the payload is sent from instead of
+ * @p pPublishInfo, or NULL.
+ * @param[in] payloadSegmentCount Number of entries in @p pPayloadSegments.
+ * @param[in] pPayloadReference The reference keeping the payload valid in the
+ * retransmit store, or NULL to copy the payload.
  *
- * @note This function ASSUMES that the topic name been consumed in linear
- * matching with the topic filer, but the topic filter has remaining characters
- * to be matched.
+ * @return The same values as #MQTT_Publish.
+ */
+static MQTTStatus_t publishPacket( MQTTContext_t * pContext,
+                                   const MQTTPublishInfo_t * pPublishInfo,
+                                   uint16_t packetId,
+                                   const MQTTPropBuilder_t * pPropertyBuilder,
+                                   const TransportOutVector_t * pPayloadSegments,
+                                   size_t payloadSegmentCount,
+                                   const MQTTPayloadReference_t * pPayloadReference );
+
+/**
+ * @brief Validate the arguments of #MQTT_PublishPrepared, and the template
+ * against the current connection.
  *
- * @param[in] pTopicFilter The topic filter containing the wildcard.
- * @param[in] topicFilterLength Length of the topic filter being examined.
- * @param[in] filterIndex Index of the topic filter being examined.
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pTemplate Template prepared by #MQTT_PreparePublish.
+ * @param[in] pPayload The payload of the packet.
+ * @param[in] payloadLength Length of @p pPayload.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[out] pRemainingLength The remaining length of the packet.
  *
- * @return Returns whether the topic filter and the topic name match.
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
  */
-static bool matchEndWildcardsSpecialCases( const char * pTopicFilter,
-                                           uint16_t topicFilterLength,
-                                           uint16_t filterIndex );
+static MQTTStatus_t validatePreparedPublish( const MQTTContext_t * pContext,
+                                             const MQTTPublishTemplate_t * pTemplate,
+                                             const void * pPayload,
+                                             size_t payloadLength,
+                                             uint16_t packetId,
+                                             uint32_t * pRemainingLength );
 
 /**
- * @brief Attempt to match topic name with a topic filter starting with a wildcard.
+ * @brief Send a PUBLISH packet from a template prepared by
+ * #MQTT_PreparePublish.
  *
- * If the topic filter starts with a '+' (single-level) wildcard, the function
- * advances the @a pNameIndex by a level in the topic name.
- * If the topic filter starts with a '#' (multi-level) wildcard, the function
- * concludes that both the topic name and topic filter match.
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pTemplate Template prepared by #MQTT_PreparePublish.
+ * @param[in] pMqttHeader the serialized MQTT header with the header byte;
+ * the encoded length of the packet; and the encoded length of the topic string.
+ * @param[in] headerSize Size of the serialized PUBLISH header.
+ * @param[in] pPayload The payload of the packet.
+ * @param[in] payloadLength Length of @p pPayload.
+ * @param[in] packetId Packet Id of the publish packet.
  *
- * @param[in] pTopicName The topic name to match.
- * @param[in] topicNameLength Length of the topic name.
- * @param[in] pTopicFilter The topic filter to match.
- * @param[in] topicFilterLength Length of the topic filter.
- * @param[in,out] pNameIndex Current index in the topic name being examined. It is
- * advanced by one level for `+` wildcards.
- * @param[in, out] pFilterIndex Current index in the topic filter being examined.
- * It is advanced to position of '/' level separator for '+' wildcard.
- * @param[out] pMatch Whether the topic filter and topic name match.
+ * @return #MQTTSendFailed if transport send failed;
+ * #MQTTPublishStoreFailed if storing the outgoing publish failed in the case of QoS 1/2
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t sendPreparedPublish( MQTTContext_t * pContext,
+                                         const MQTTPublishTemplate_t * pTemplate,
+                                         uint8_t * pMqttHeader,
+                                         size_t headerSize,
+                                         const void * pPayload,
+                                         size_t payloadLength,
+                                         uint16_t packetId );
+
+/**
+ * @brief Add a vector of a PUBLISH packet prepared by #MQTT_PreparePublish
+ * to an IO vector.
  *
- * @return `true` if the caller of this function should exit; `false` if the
- * caller should continue parsing the topics.
+ * @param[in] pData The data of the vector.
+ * @param[in] length Length of @p pData.
+ * @param[in,out] pVecState The IO vector.
  */
-static bool matchWildcards( const char * pTopicName,
-                            uint16_t topicNameLength,
-                            const char * pTopicFilter,
-                            uint16_t topicFilterLength,
-                            uint16_t * pNameIndex,
-                            uint16_t * pFilterIndex,
-                            bool * pMatch );
+static void appendPreparedVector( const void * pData,
+                                  size_t length,
+                                  IoVecState_t * pVecState );
 
 /**
- * @brief Match a topic name and topic filter allowing the use of wildcards.
+ * @brief Store a QoS 1 or QoS 2 PUBLISH packet for retransmission, if a store
+ * function is set, and send it.
  *
- * @param[in] pTopicName The topic name to check.
- * @param[in] topicNameLength Length of the topic name.
- * @param[in] pTopicFilter The topic filter to check.
- * @param[in] topicFilterLength Length of topic filter.
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id of the publish packet.
+ * @param[in] pMqttHeader The serialized MQTT header of the packet.
+ * @param[in] pIoVector The vectors of the packet.
+ * @param[in] pVecState The number of vectors and length of the packet.
+ * @param[in] pPayloadReference The reference keeping the payload valid in the
+ * retransmit store, or NULL to copy the payload.
  *
- * @return `true` if the topic name and topic filter match; `false` otherwise.
+ * @return #MQTTSendFailed if transport send failed;
+ * #MQTTPublishStoreFailed if storing the outgoing publish failed;
+ * #MQTTSuccess otherwise.
  */
-static bool matchTopicFilter( const char * pTopicName,
-                              uint16_t topicNameLength,
-                              const char * pTopicFilter,
-                              uint16_t topicFilterLength );
+static MQTTStatus_t storeAndSendPublish( MQTTContext_t * pContext,
+                                         const MQTTPublishInfo_t * pPublishInfo,
+                                         uint16_t packetId,
+                                         uint8_t * pMqttHeader,
+                                         TransportOutVector_t * pIoVector,
+                                         const IoVecState_t * pVecState,
+                                         const MQTTPayloadReference_t * pPayloadReference );
 
 /**
- * @brief Validate the topic filter in a subscription.
+ * @brief Add the vectors of a PUBLISH packet to an IO vector.
  *
- * @param[in] pContext MQTT Connection context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] pMqttHeader the serialized MQTT header with the header byte;
+ * the encoded length of the packet; and the encoded length of the topic string.
+ * @param[in] headerSize Size of the serialized PUBLISH header.
+ * @param[in] packetId Packet Id of the publish packet.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] topicAlias Topic Alias to add to the properties, or 0 for none.
+ * @param[out] pSerializedPacketId Buffer of 2 bytes to encode the packet ID in.
+ * @param[out] pPropertyLength Buffer of 4 bytes to encode the property length
+ * in, followed by #CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE bytes for the Topic
+ * Alias if @p topicAlias is not 0.
+ * @param[in,out] pVecState The IO vector to add to. At least
+ * #CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH vectors must be free.
+ *
+ * @return #MQTTBadParameter if the packet is too large;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t appendPublishVectors( const MQTTPublishInfo_t * pPublishInfo,
+                                          uint8_t * pMqttHeader,
+                                          size_t headerSize,
+                                          uint16_t packetId,
+                                          const MQTTPropBuilder_t * pPropertyBuilder,
+                                          uint16_t topicAlias,
+                                          uint8_t * pSerializedPacketId,
+                                          uint8_t * pPropertyLength,
+                                          IoVecState_t * pVecState );
+
+/**
+ * @brief Store a copy of an outgoing QoS 1 or QoS 2 PUBLISH packet, with the
+ * DUP flag set, for retransmission.
+ *
+ * @param[in] pContext Initialized MQTT context with a store function.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id of the publish packet.
+ * @param[in] pMqttHeader The serialized MQTT header of the packet.
+ * @param[in] pIoVector The vectors of the packet.
+ * @param[in] ioVectorLength The number of vectors of the packet.
+ * @param[in] pPayloadReference The reference keeping the payload valid in the
+ * retransmit store, or NULL to copy the payload.
+ *
+ * @return #MQTTPublishStoreFailed if the store function failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t storeOutgoingPublish( MQTTContext_t * pContext,
+                                          const MQTTPublishInfo_t * pPublishInfo,
+                                          uint16_t packetId,
+                                          uint8_t * pMqttHeader,
+                                          TransportOutVector_t * pIoVector,
+                                          size_t ioVectorLength,
+                                          const MQTTPayloadReference_t * pPayloadReference );
+
+/**
+ * @brief Send the PUBLISH packets of #MQTT_PublishBatch, gathering as many as
+ * fit in #MQTT_PUBLISH_BATCH_MAX_VECTORS vectors in each transport write.
+ *
+ * Packets whose status is not #MQTTSuccess on entry are skipped. On return,
+ * the status of each packet holds its result.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo Array of MQTT PUBLISH packet parameters.
+ * @param[in] pPacketIds Array of packet IDs, or NULL if all packets are QoS 0.
+ * @param[in] pPropertyBuilders Array of property builders, or NULL.
+ * @param[in] publishCount Number of packets in the batch.
+ * @param[in,out] pPublishStatus Array of per packet statuses.
+ */
+static void sendPublishBatch( MQTTContext_t * pContext,
+                              const MQTTPublishInfo_t * pPublishInfo,
+                              const uint16_t * pPacketIds,
+                              const MQTTPropBuilder_t * const * pPropertyBuilders,
+                              size_t publishCount,
+                              MQTTStatus_t * pPublishStatus );
+
+/**
+ * @brief Send the PUBLISH packets gathered by #sendPublishBatch and update
+ * the state of the QoS 1 and QoS 2 packets among them.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo Array of MQTT PUBLISH packet parameters.
+ * @param[in] pPacketIds Array of packet IDs, or NULL.
+ * @param[in] firstIndex Index of the first packet gathered.
+ * @param[in] endIndex Index just past the last packet gathered.
+ * @param[in] pIoVector The first of the gathered vectors.
+ * @param[in] pVecState The state of the gathered vectors.
+ * @param[in,out] pPublishStatus Array of per packet statuses.
+ *
+ * @return #MQTTSendFailed if the transport write failed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t flushPublishBatch( MQTTContext_t * pContext,
+                                       const MQTTPublishInfo_t * pPublishInfo,
+                                       const uint16_t * pPacketIds,
+                                       size_t firstIndex,
+                                       size_t endIndex,
+                                       TransportOutVector_t * pIoVector,
+                                       const IoVecState_t * pVecState,
+                                       MQTTStatus_t * pPublishStatus );
+
+/**
+ * @brief Check whether the properties of a builder were validated for a
+ * packet type by #MQTTPropertyBuilder_Seal and were not changed since.
+ *
+ * @param[in] pPropertyBuilder The property builder.
+ * @param[in] packetType The packet type the properties are sent with.
+ *
+ * @return `true` if the properties do not need to be validated again; `false`
+ * otherwise.
+ */
+static bool isPropertyBuilderSealed( const MQTTPropBuilder_t * pPropertyBuilder,
+                                     uint8_t packetType );
+
+/**
+ * @brief Validate the parameters and properties of a PUBLISH packet
+ * against the limits of the connection.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] payloadInSegments Whether the payload is sent from segments
+ * rather than from the payload of @p pPublishInfo.
+ * @param[out] pTopicAlias The Topic Alias in the properties, or 0 if there is
+ * none.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t validatePublish( const MQTTContext_t * pContext,
+                                     const MQTTPublishInfo_t * pPublishInfo,
+                                     uint16_t packetId,
+                                     const MQTTPropBuilder_t * pPropertyBuilder,
+                                     bool payloadInSegments,
+                                     uint16_t * pTopicAlias );
+
+/**
+ * @brief Serialize the fixed part of the header of a PUBLISH packet.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] pPropertyBuilder MQTT Publish property builder.
+ * @param[in] topicAlias Topic Alias that is added to the properties when the
+ * packet is sent, or 0 for none.
+ * @param[out] pMqttHeader Buffer of 7 bytes for the header.
+ * @param[out] pHeaderSize Size of the serialized header.
+ *
+ * @return #MQTTBadParameter if the packet is invalid or too large;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t serializePublishHeader( const MQTTContext_t * pContext,
+                                            const MQTTPublishInfo_t * pPublishInfo,
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint16_t topicAlias,
+                                            uint8_t * pMqttHeader,
+                                            size_t * pHeaderSize );
+
+/**
+ * @brief Unset all outgoing topic aliases, and limit their number to what the
+ * broker accepts.
+ *
+ * @param[in] pContext Initialized MQTT context with outgoing topic aliases.
+ */
+static void resetOutgoingTopicAliases( MQTTContext_t * pContext );
+
+/**
+ * @brief Hash a topic name with 32-bit FNV-1a.
+ *
+ * @param[in] pTopicName The topic name.
+ * @param[in] topicNameLength Length of the topic name.
+ *
+ * @return The hash.
+ */
+static uint32_t hashTopicName( const char * pTopicName,
+                               size_t topicNameLength );
+
+/**
+ * @brief Find the outgoing topic alias of a topic, or the alias to assign to
+ * it: an alias which is not set, else the least recently used one.
+ *
+ * @param[in] pContext Initialized MQTT context with outgoing topic aliases.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[out] pIsSet Whether the alias is already set to the topic.
+ *
+ * @return The topic alias.
+ */
+static uint16_t findOutgoingTopicAlias( const MQTTContext_t * pContext,
+                                        const MQTTPublishInfo_t * pPublishInfo,
+                                        bool * pIsSet );
+
+/**
+ * @brief Record the use of an outgoing topic alias in a PUBLISH packet that
+ * was sent. If the packet contains a topic name, the broker now maps the
+ * alias to that topic.
+ *
+ * @param[in] pContext Initialized MQTT context with outgoing topic aliases.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters as sent.
+ * @param[in] topicAlias The topic alias of the packet.
+ */
+static void recordOutgoingTopicAlias( MQTTContext_t * pContext,
+                                      const MQTTPublishInfo_t * pPublishInfo,
+                                      uint16_t topicAlias );
+
+/**
+ * @brief Unset all incoming topic aliases, and limit their number to what
+ * was sent to the broker.
+ *
+ * @param[in] pContext Initialized MQTT context with incoming topic aliases.
+ */
+static void resetIncomingTopicAliases( MQTTContext_t * pContext );
+
+/**
+ * @brief Lower the Topic Alias Maximum of the CONNECT properties to the
+ * number of incoming topic aliases kept, so that the broker never uses an
+ * alias which cannot be resolved.
+ *
+ * @param[in] pContext Initialized MQTT context with incoming topic aliases.
+ * @param[in,out] pPropertyBuilder CONNECT properties.
+ *
+ * @return #MQTTBadParameter if the properties are invalid;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t limitIncomingTopicAliasMax( const MQTTContext_t * pContext,
+                                                MQTTPropBuilder_t * pPropertyBuilder );
+
+/**
+ * @brief Keep the topic name of an incoming PUBLISH packet for its topic
+ * alias, or set the topic name of a PUBLISH packet without one from its
+ * topic alias.
+ *
+ * @param[in] pContext Initialized MQTT context with incoming topic aliases.
+ * @param[in,out] pPublishInfo Deserialized incoming PUBLISH packet.
+ *
+ * @return #MQTTBadResponse if the PUBLISH has neither a topic name nor an
+ * alias set by the broker; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t resolveIncomingTopicAlias( MQTTContext_t * pContext,
+                                               MQTTPublishInfo_t * pPublishInfo );
+
+/**
+ * @brief Call the handler registered for a Subscription Identifier of an
+ * incoming PUBLISH packet.
+ *
+ * @param[in] pContext Initialized MQTT context with subscription handlers.
+ * @param[in] pDeserializedInfo Deserialized incoming PUBLISH packet.
+ * @param[in] subscriptionId The Subscription Identifier.
+ */
+static void callSubscriptionHandler( MQTTContext_t * pContext,
+                                     MQTTDeserializedInfo_t * pDeserializedInfo,
+                                     uint32_t subscriptionId );
+
+/**
+ * @brief Call the handlers registered for all Subscription Identifiers of an
+ * incoming PUBLISH packet.
+ *
+ * @param[in] pContext Initialized MQTT context with subscription handlers.
+ * @param[in] pDeserializedInfo Deserialized incoming PUBLISH packet with at
+ * least one Subscription Identifier.
+ * @param[in] pPropBuffer Properties of the incoming PUBLISH packet.
+ */
+static void dispatchToSubscriptionHandlers( MQTTContext_t * pContext,
+                                            MQTTDeserializedInfo_t * pDeserializedInfo,
+                                            const MQTTPropBuilder_t * pPropBuffer );
+
+/**
+ * @brief Unregister the handlers kept by #MQTT_SubscribeWithHandler for a
+ * SUBSCRIBE which failed after part of it was sent.
+ *
+ * @param[in] pContext Initialized MQTT context with subscription handlers.
+ * @param[in] packetId Packet ID of the SUBACK received, or
+ * #MQTT_PACKET_ID_INVALID to unregister the handlers of all such SUBSCRIBEs.
+ */
+static void releaseFailedSubscriptionHandlers( MQTTContext_t * pContext,
+                                               uint16_t packetId );
+
+/**
+ * @brief Check the memory given for an index of state records.
+ *
+ * @param[in] recordCount Number of records to index.
+ * @param[in] pBuckets Memory for the buckets of the index.
+ * @param[in] bucketCount Number of buckets pointed to by @p pBuckets.
+ *
+ * @return `true` if the records can be indexed in the buckets, else `false`.
+ */
+static bool validateStateIndex( size_t recordCount,
+                                const uint16_t * pBuckets,
+                                size_t bucketCount );
+
+/**
+ * @brief Function to validate #MQTT_Publish parameters.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId Packet Id for the MQTT PUBLISH packet.
+ * @param[in] payloadInSegments Whether the payload is sent from segments
+ * rather than from the payload of @p pPublishInfo.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
+                                           const MQTTPublishInfo_t * pPublishInfo,
+                                           uint16_t packetId,
+                                           bool payloadInSegments );
+
+/**
+ * @brief Performs matching for special cases when a topic filter ends
+ * with a wildcard character.
+ *
+ * When the topic name has been consumed but there are remaining characters to
+ * to match in topic filter, this function handles the following 2 cases:
+ * - When the topic filter ends with "/+" or "/#" characters, but the topic
+ * name only ends with '/'.
+ * - When the topic filter ends with "/#" characters, but the topic name
+ * ends at the parent level.
+ *
+ * @note This function ASSUMES that the topic name been consumed in linear
+ * matching with the topic filer, but the topic filter has remaining characters
+ * to be matched.
+ *
+ * @param[in] pTopicFilter The topic filter containing the wildcard.
+ * @param[in] topicFilterLength Length of the topic filter being examined.
+ * @param[in] filterIndex Index of the topic filter being examined.
+ *
+ * @return Returns whether the topic filter and the topic name match.
+ */
+static bool matchEndWildcardsSpecialCases( const char * pTopicFilter,
+                                           uint16_t topicFilterLength,
+                                           uint16_t filterIndex );
+
+/**
+ * @brief Attempt to match topic name with a topic filter starting with a wildcard.
+ *
+ * If the topic filter starts with a '+' (single-level) wildcard, the function
+ * advances the @a pNameIndex by a level in the topic name.
+ * If the topic filter starts with a '#' (multi-level) wildcard, the function
+ * concludes that both the topic name and topic filter match.
+ *
+ * @param[in] pTopicName The topic name to match.
+ * @param[in] topicNameLength Length of the topic name.
+ * @param[in] pTopicFilter The topic filter to match.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in,out] pNameIndex Current index in the topic name being examined. It is
+ * advanced by one level for `+` wildcards.
+ * @param[in, out] pFilterIndex Current index in the topic filter being examined.
+ * It is advanced to position of '/' level separator for '+' wildcard.
+ * @param[out] pMatch Whether the topic filter and topic name match.
+ *
+ * @return `true` if the caller of this function should exit; `false` if the
+ * caller should continue parsing the topics.
+ */
+static bool matchWildcards( const char * pTopicName,
+                            uint16_t topicNameLength,
+                            const char * pTopicFilter,
+                            uint16_t topicFilterLength,
+                            uint16_t * pNameIndex,
+                            uint16_t * pFilterIndex,
+                            bool * pMatch );
+
+/**
+ * @brief Match a topic name and topic filter allowing the use of wildcards.
+ *
+ * @param[in] pTopicName The topic name to check.
+ * @param[in] topicNameLength Length of the topic name.
+ * @param[in] pTopicFilter The topic filter to check.
+ * @param[in] topicFilterLength Length of topic filter.
+ *
+ * @return `true` if the topic name and topic filter match; `false` otherwise.
+ */
+static bool matchTopicFilter( const char * pTopicName,
+                              uint16_t topicNameLength,
+                              const char * pTopicFilter,
+                              uint16_t topicFilterLength );
+
+/**
+ * @brief Compile a level of a topic filter.
+ *
+ * @param[in] pLevel The level, pointing into the topic filter.
+ * @param[in] levelLength Length of the level.
+ * @param[out] pCompiledLevel The compiled level.
+ *
+ * @return #MQTTBadParameter if a wildcard shares the level with other
+ * characters; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t compileTopicLevel( const char * pLevel,
+                                       uint16_t levelLength,
+                                       MQTTTopicFilterLevel_t * pCompiledLevel );
+
+/**
+ * @brief Match a topic name with the levels of a compiled topic filter.
+ *
+ * @param[in] pTopicName The topic name to check.
+ * @param[in] topicNameLength Length of the topic name.
+ * @param[in] pCompiledFilter The compiled topic filter.
+ *
+ * @return `true` if the topic name and topic filter match; `false` otherwise.
+ */
+static bool matchCompiledLevels( const char * pTopicName,
+                                 uint16_t topicNameLength,
+                                 const MQTTCompiledTopicFilter_t * pCompiledFilter );
+
+/**
+ * @brief Validate the topic filter in a subscription.
+ *
+ * @param[in] pContext MQTT Connection context.
  * @param[in] pSubscriptionList List of MQTT subscription info.
  * @param[in] iterator The iterator pointing to a topic filter in pSubscriptionList.
  * @param[in] subscriptionType The type of subscription, either #MQTT_TYPE_SUBSCRIBE or #MQTT_TYPE_UNSUBSCRIBE.
@@ -662,6 +1494,47 @@ static MQTTStatus_t sendPublishAcksWithProperty( MQTTContext_t * pContext,
                                                  MQTTPublishState_t publishState,
                                                  MQTTSuccessFailReasonCode_t reasonCode );
 
+/**
+ * @brief Gather a serialized ack in the ack staging buffer.
+ *
+ * An ack of the same type and packet identifier as one already gathered is
+ * not added again.
+ *
+ * @param[in] pContext Initialized MQTT Context with ack coalescing enabled.
+ * @param[in] pAck Serialized ack of #MQTT_PUBLISH_ACK_PACKET_SIZE bytes.
+ *
+ * @return true if the ack was added, false if it is already gathered.
+ */
+static bool stageAck( MQTTContext_t * pContext,
+                      const uint8_t * pAck );
+
+/**
+ * @brief Send the acks gathered in the ack staging buffer with one transport
+ * call and update the state of their publishes.
+ *
+ * The staging buffer is emptied even if sending fails, in which case the
+ * publishes stay in the state they were in before their ack was gathered.
+ *
+ * @param[in] pContext Initialized MQTT Context.
+ *
+ * @return #MQTTSuccess, #MQTTStatusNotConnected, #MQTTStatusDisconnectPending,
+ * #MQTTSendFailed, or the error of the state update.
+ */
+static MQTTStatus_t flushStagedAcks( MQTTContext_t * pContext );
+
+/**
+ * @brief Send the acks gathered while processing received data, at the end of
+ * a receive iteration.
+ *
+ * @param[in] pContext Initialized MQTT Context.
+ * @param[in] receiveStatus Status of the receive iteration.
+ *
+ * @return @p receiveStatus, unless it indicates normal operation and the acks
+ * could not be sent, in which case the error of #flushStagedAcks.
+ */
+static MQTTStatus_t flushStagedAcksAfterReceive( MQTTContext_t * pContext,
+                                                 MQTTStatus_t receiveStatus );
+
 /**
  * @brief Validate Publish Ack Reason Code
  *
@@ -923,38 +1796,165 @@ static bool matchTopicFilter( const char * pTopicName,
 
 /*-----------------------------------------------------------*/
 
-static int32_t sendMessageVector( MQTTContext_t * pContext,
-                                  TransportOutVector_t * pIoVec,
-                                  size_t ioVecCount )
+static MQTTStatus_t compileTopicLevel( const char * pLevel,
+                                       uint16_t levelLength,
+                                       MQTTTopicFilterLevel_t * pCompiledLevel )
 {
-    int32_t sendResult;
-    uint32_t startTime;
-    TransportOutVector_t * pIoVectIterator;
-    size_t vectorsToBeSent = ioVecCount;
-    uint32_t bytesToSend = 0U;
-    int32_t bytesSentOrError = 0;
+    MQTTStatus_t status = MQTTSuccess;
+    uint16_t index = 0U;
 
-    assert( pContext != NULL );
-    assert( pIoVec != NULL );
-    assert( pContext->getTime != NULL );
-    /* Send must always be defined */
-    assert( pContext->transportInterface.send != NULL );
+    assert( pLevel != NULL );
+    assert( pCompiledLevel != NULL );
 
-    /* Count the total number of bytes to be sent as outlined in the vector. */
-    for( pIoVectIterator = pIoVec; pIoVectIterator <= &( pIoVec[ ioVecCount - 1U ] ); pIoVectIterator++ )
-    {
-        /* Before calling this function, the caller has checked that these below conditions
-         * are true. */
-        assert( !CHECK_SIZE_T_OVERFLOWS_32BIT( pIoVectIterator->iov_len ) );
-        assert( !ADDITION_WILL_OVERFLOW_U32( bytesToSend, pIoVectIterator->iov_len ) );
-        assert( pIoVectIterator->iov_len <= ( MQTT_MAX_PACKET_SIZE - bytesToSend ) );
+    pCompiledLevel->pLevel = pLevel;
+    pCompiledLevel->levelLength = levelLength;
+    pCompiledLevel->type = MQTTTopicLevelLiteral;
 
-        bytesToSend += ( uint32_t ) pIoVectIterator->iov_len;
+    if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '+' ) )
+    {
+        pCompiledLevel->type = MQTTTopicLevelSingleWild;
     }
-
+    else if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '#' ) )
+    {
+        pCompiledLevel->type = MQTTTopicLevelMultiWild;
+    }
+    else
+    {
+        /* Wildcards are only allowed to occupy a whole level. */
+        while( ( status == MQTTSuccess ) && ( index < levelLength ) )
+        {
+            if( ( pLevel[ index ] == '+' ) || ( pLevel[ index ] == '#' ) )
+            {
+                LogError( ( "Invalid topic filter: Wildcard %c must occupy a whole level.",
+                            pLevel[ index ] ) );
+                status = MQTTBadParameter;
+            }
+
+            index++;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool matchCompiledLevels( const char * pTopicName,
+                                 uint16_t topicNameLength,
+                                 const MQTTCompiledTopicFilter_t * pCompiledFilter )
+{
+    bool matchFound = false, mismatchFound = false;
+    const MQTTTopicFilterLevel_t * pLevel;
+    size_t levelIndex = 0U;
+    uint16_t levelStart = 0U, nameIndex = 0U;
+
+    assert( pTopicName != NULL );
+    assert( pCompiledFilter != NULL );
+    assert( pCompiledFilter->pLevels != NULL );
+
+    /* Compare the topic name with the topic filter a level at a time. A topic
+     * name ending with '/' ends with an empty level. */
+    while( ( matchFound == false ) && ( mismatchFound == false ) &&
+           ( levelStart <= topicNameLength ) )
+    {
+        if( levelIndex == pCompiledFilter->levelCount )
+        {
+            /* The topic name has more levels than the topic filter. */
+            mismatchFound = true;
+        }
+        else if( pCompiledFilter->pLevels[ levelIndex ].type == MQTTTopicLevelMultiWild )
+        {
+            /* '#' matches all the remaining levels. */
+            matchFound = true;
+        }
+        else
+        {
+            pLevel = &( pCompiledFilter->pLevels[ levelIndex ] );
+            nameIndex = levelStart;
+
+            while( ( nameIndex < topicNameLength ) && ( pTopicName[ nameIndex ] != '/' ) )
+            {
+                nameIndex++;
+            }
+
+            /* '+' matches any level, so only literal levels are compared. */
+            if( ( pLevel->type == MQTTTopicLevelLiteral ) &&
+                ( ( pLevel->levelLength != ( nameIndex - levelStart ) ) ||
+                  ( memcmp( pLevel->pLevel, &( pTopicName[ levelStart ] ), pLevel->levelLength ) != 0 ) ) )
+            {
+                mismatchFound = true;
+            }
+
+            levelIndex++;
+            levelStart = nameIndex + 1U;
+        }
+    }
+
+    if( ( matchFound == false ) && ( mismatchFound == false ) )
+    {
+        /* The topic name has been consumed. It matches if the topic filter has
+         * been consumed too, or only has a '#' left, which also matches its
+         * parent level. */
+        matchFound = ( levelIndex == pCompiledFilter->levelCount ) ||
+                     ( ( levelIndex == ( pCompiledFilter->levelCount - 1U ) ) &&
+                       ( pCompiledFilter->pLevels[ levelIndex ].type == MQTTTopicLevelMultiWild ) );
+    }
+
+    return matchFound;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t sendMessageVector( MQTTContext_t * pContext,
+                                  TransportOutVector_t * pIoVec,
+                                  size_t ioVecCount )
+{
+    int32_t sendResult;
+    uint32_t startTime;
+    TransportOutVector_t * pIoVectIterator;
+    size_t vectorsToBeSent = ioVecCount;
+    uint32_t bytesToSend = 0U;
+    int32_t bytesSentOrError = 0;
+    bool packetKept = false;
+
+    assert( pContext != NULL );
+    assert( pIoVec != NULL );
+    assert( pContext->getTime != NULL );
+    /* Send must always be defined */
+    assert( pContext->transportInterface.send != NULL );
+
+    /* Count the total number of bytes to be sent as outlined in the vector. */
+    for( pIoVectIterator = pIoVec; pIoVectIterator <= &( pIoVec[ ioVecCount - 1U ] ); pIoVectIterator++ )
+    {
+        /* Before calling this function, the caller has checked that these below conditions
+         * are true. */
+        assert( !CHECK_SIZE_T_OVERFLOWS_32BIT( pIoVectIterator->iov_len ) );
+        assert( !ADDITION_WILL_OVERFLOW_U32( bytesToSend, pIoVectIterator->iov_len ) );
+        assert( pIoVectIterator->iov_len <= ( MQTT_MAX_PACKET_SIZE - bytesToSend ) );
+
+        bytesToSend += ( uint32_t ) pIoVectIterator->iov_len;
+    }
+
     /* Reset the iterator to point to the first entry in the array. */
     pIoVectIterator = pIoVec;
 
+    /* Packets must follow the bytes kept by earlier non-blocking sends. */
+    if( pContext->pendingSendLength > 0U )
+    {
+        if( sendBehindPendingBytes( pContext, pIoVec, ioVecCount, &packetKept ) != MQTTSuccess )
+        {
+            bytesSentOrError = -1;
+        }
+        else if( packetKept == true )
+        {
+            bytesSentOrError = ( int32_t ) bytesToSend;
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+    }
+
     /* Note the start time. */
     startTime = pContext->getTime();
 
@@ -983,6 +1983,7 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
 
             /* Set last transmission time. */
             pContext->lastPacketTxTime = pContext->getTime();
+            pContext->packetBytesSent = true;
 
             LogDebug( ( "sendMessageVector: Bytes Sent=%ld, Bytes Remaining=%lu",
                         ( long int ) sendResult,
@@ -998,6 +1999,11 @@ static int32_t sendMessageVector( MQTTContext_t * pContext,
                 pContext->connectStatus = MQTTDisconnectPending;
             }
         }
+        else if( keepPendingBytes( pContext, pIoVectIterator, vectorsToBeSent ) == true )
+        {
+            /* The rest of the packet is sent once the transport accepts it. */
+            bytesSentOrError = ( int32_t ) bytesToSend;
+        }
         else
         {
             /* MISRA Empty body */
@@ -1051,6 +2057,8 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
     int32_t bytesSentOrError = 0;
     const uint8_t * pIndex = pBufferToSend;
     int32_t localCopyBytesToSend;
+    TransportOutVector_t unsentVector;
+    bool packetKept = false;
 
     assert( pContext != NULL );
     assert( pContext->getTime != NULL );
@@ -1066,6 +2074,26 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
     * MQTT max packet length, it can comfortably fit in an int32_t. */
     localCopyBytesToSend = ( int32_t ) bytesToSend;
 
+    /* Packets must follow the bytes kept by earlier non-blocking sends. */
+    if( pContext->pendingSendLength > 0U )
+    {
+        unsentVector.iov_base = pBufferToSend;
+        unsentVector.iov_len = bytesToSend;
+
+        if( sendBehindPendingBytes( pContext, &unsentVector, 1U, &packetKept ) != MQTTSuccess )
+        {
+            bytesSentOrError = -1;
+        }
+        else if( packetKept == true )
+        {
+            bytesSentOrError = localCopyBytesToSend;
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+    }
+
     /* Set the timeout. */
     startTime = pContext->getTime();
 
@@ -1102,6 +2130,7 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
 
             /* Set last transmission time. */
             pContext->lastPacketTxTime = pContext->getTime();
+            pContext->packetBytesSent = true;
 
             LogDebug( ( "sendBuffer: Bytes Sent=%ld, Bytes Remaining=%lu",
                         ( long int ) sendResult,
@@ -1119,7 +2148,14 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
         }
         else
         {
-            /* MISRA Empty body */
+            unsentVector.iov_base = pIndex;
+            unsentVector.iov_len = ( size_t ) localCopyBytesToSend - ( size_t ) bytesSentOrError;
+
+            if( keepPendingBytes( pContext, &unsentVector, 1U ) == true )
+            {
+                /* The rest of the packet is sent once the transport accepts it. */
+                bytesSentOrError = localCopyBytesToSend;
+            }
         }
 
         /* Check for timeout. */
@@ -1135,6 +2171,169 @@ static int32_t sendBuffer( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static MQTTStatus_t sendPendingBytes( MQTTContext_t * pContext,
+                                      uint32_t timeoutMs )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    int32_t sendResult;
+    uint32_t startTime;
+
+    assert( pContext != NULL );
+    assert( pContext->getTime != NULL );
+
+    startTime = pContext->getTime();
+
+    while( ( status == MQTTSuccess ) && ( pContext->pendingSendLength > 0U ) )
+    {
+        sendResult = pContext->transportInterface.send( pContext->transportInterface.pNetworkContext,
+                                                        &( pContext->pendingSendBuffer.pBuffer[ pContext->pendingSendOffset ] ),
+                                                        pContext->pendingSendLength );
+
+        if( sendResult > 0 )
+        {
+            /* It is a bug in the application's transport send implementation if
+             * more bytes than expected are sent. */
+            assert( ( size_t ) sendResult <= pContext->pendingSendLength );
+
+            pContext->pendingSendOffset += ( size_t ) sendResult;
+            pContext->pendingSendLength -= ( size_t ) sendResult;
+            pContext->lastPacketTxTime = pContext->getTime();
+
+            LogDebug( ( "sendPendingBytes: Bytes Sent=%ld, Bytes Remaining=%lu",
+                        ( long int ) sendResult,
+                        ( unsigned long ) pContext->pendingSendLength ) );
+        }
+        else if( sendResult < 0 )
+        {
+            LogError( ( "sendPendingBytes: Unable to send packet: Network Error." ) );
+            status = MQTTSendFailed;
+
+            /* The rest of the packets cannot be sent on this connection. */
+            pContext->pendingSendLength = 0U;
+
+            if( pContext->connectStatus == MQTTConnected )
+            {
+                pContext->connectStatus = MQTTDisconnectPending;
+            }
+        }
+        else if( calculateElapsedTime( pContext->getTime(), startTime ) >= timeoutMs )
+        {
+            status = MQTTSendWouldBlock;
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+    }
+
+    if( pContext->pendingSendLength == 0U )
+    {
+        pContext->pendingSendOffset = 0U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool keepPendingBytes( MQTTContext_t * pContext,
+                              const TransportOutVector_t * pIoVec,
+                              size_t ioVecCount )
+{
+    bool kept = false;
+    size_t bytesToKeep = 0U;
+    size_t index;
+    uint8_t * pDestination;
+
+    assert( pContext != NULL );
+
+    /* Packets sent while not connected, such as CONNECT and DISCONNECT, are
+     * always sent blocking. */
+    if( ( pContext->pendingSendBuffer.pBuffer != NULL ) &&
+        ( pContext->connectStatus == MQTTConnected ) )
+    {
+        for( index = 0U; index < ioVecCount; index++ )
+        {
+            bytesToKeep += pIoVec[ index ].iov_len;
+        }
+
+        kept = ( bytesToKeep <= ( pContext->pendingSendBuffer.size - pContext->pendingSendLength ) );
+    }
+
+    if( kept == true )
+    {
+        /* Move the kept bytes to the start of the buffer when the new bytes do
+         * not fit after them. */
+        if( bytesToKeep > ( pContext->pendingSendBuffer.size -
+                            pContext->pendingSendOffset -
+                            pContext->pendingSendLength ) )
+        {
+            ( void ) memmove( pContext->pendingSendBuffer.pBuffer,
+                              &( pContext->pendingSendBuffer.pBuffer[ pContext->pendingSendOffset ] ),
+                              pContext->pendingSendLength );
+            pContext->pendingSendOffset = 0U;
+        }
+
+        pDestination = &( pContext->pendingSendBuffer.pBuffer[ pContext->pendingSendOffset +
+                                                                pContext->pendingSendLength ] );
+
+        for( index = 0U; index < ioVecCount; index++ )
+        {
+            if( pIoVec[ index ].iov_len > 0U )
+            {
+                ( void ) memcpy( pDestination, pIoVec[ index ].iov_base, pIoVec[ index ].iov_len );
+                pDestination = &( pDestination[ pIoVec[ index ].iov_len ] );
+            }
+        }
+
+        pContext->pendingSendLength += bytesToKeep;
+        pContext->packetBytesSent = true;
+
+        LogDebug( ( "Kept %lu bytes until the transport accepts them.",
+                    ( unsigned long ) bytesToKeep ) );
+    }
+
+    return kept;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendBehindPendingBytes( MQTTContext_t * pContext,
+                                            const TransportOutVector_t * pIoVec,
+                                            size_t ioVecCount,
+                                            bool * pPacketKept )
+{
+    MQTTStatus_t status;
+
+    *pPacketKept = false;
+
+    status = sendPendingBytes( pContext, 0U );
+
+    if( status == MQTTSendWouldBlock )
+    {
+        *pPacketKept = keepPendingBytes( pContext, pIoVec, ioVecCount );
+
+        if( *pPacketKept == true )
+        {
+            status = MQTTSuccess;
+        }
+        else
+        {
+            status = sendPendingBytes( pContext, MQTT_SEND_TIMEOUT_MS );
+
+            if( status == MQTTSendWouldBlock )
+            {
+                LogError( ( "sendBehindPendingBytes: Unable to send kept bytes: Timed out." ) );
+                status = MQTTSendFailed;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 static uint32_t calculateElapsedTime( uint32_t later,
                                       uint32_t start )
 {
@@ -1176,6 +2375,7 @@ static MQTTPubAckType_t getAckFromPacketType( uint8_t packetType )
 /*-----------------------------------------------------------*/
 
 static int32_t recvExact( MQTTContext_t * pContext,
+                          size_t offset,
                           size_t bytesToRecv )
 {
     uint8_t * pIndex = NULL;
@@ -1187,12 +2387,13 @@ static int32_t recvExact( MQTTContext_t * pContext,
     bool receiveError = false;
 
     assert( pContext != NULL );
-    assert( bytesToRecv <= pContext->networkBuffer.size );
+    assert( offset <= pContext->networkBuffer.size );
+    assert( bytesToRecv <= ( pContext->networkBuffer.size - offset ) );
     assert( pContext->getTime != NULL );
     assert( pContext->transportInterface.recv != NULL );
     assert( pContext->networkBuffer.pBuffer != NULL );
 
-    pIndex = pContext->networkBuffer.pBuffer;
+    pIndex = &( pContext->networkBuffer.pBuffer[ offset ] );
     recvFunc = pContext->transportInterface.recv;
     getTimeStampMs = pContext->getTime;
 
@@ -1253,6 +2454,15 @@ static int32_t recvExact( MQTTContext_t * pContext,
                 LogError( ( "Unable to receive packet: Timed out in transport recv." ) );
                 receiveError = true;
             }
+            /* Block for the rest of the packet instead of polling, when possible. */
+            else if( waitForReadable( pContext, MQTT_RECV_POLLING_TIMEOUT_MS - timeSinceLastRecvMs ) != MQTTSuccess )
+            {
+                receiveError = true;
+            }
+            else
+            {
+                /* Try to receive again. */
+            }
         }
     }
 
@@ -1262,13 +2472,16 @@ static int32_t recvExact( MQTTContext_t * pContext,
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t receiveConnackPacket( MQTTContext_t * pContext,
-                                          MQTTPacketInfo_t incomingPacket )
+                                          MQTTPacketInfo_t incomingPacket,
+                                          const uint8_t * pStagedData,
+                                          size_t stagedLength )
 {
     MQTTStatus_t status = MQTTSuccess;
     int32_t bytesReceived = 0;
     size_t bytesToReceive = 0U;
 
     assert( pContext != NULL );
+    assert( ( pStagedData != NULL ) || ( stagedLength == 0U ) );
     assert( pContext->networkBuffer.pBuffer != NULL );
     assert( incomingPacket.type == MQTT_PACKET_TYPE_CONNACK );
     assert( incomingPacket.remainingLength < MQTT_REMAINING_LENGTH_INVALID );
@@ -1281,10 +2494,25 @@ static MQTTStatus_t receiveConnackPacket( MQTTContext_t * pContext,
                     "must provide a bigger buffer to handle such packets." ) );
         status = MQTTRecvFailed;
     }
+    else if( stagedLength > incomingPacket.remainingLength )
+    {
+        LogError( ( "CONNACK is shorter than the bytes read ahead with its header. "
+                    "RemainingLength=%lu, ReadAhead=%lu.",
+                    ( unsigned long ) incomingPacket.remainingLength,
+                    ( unsigned long ) stagedLength ) );
+        status = MQTTBadResponse;
+    }
     else
     {
-        bytesToReceive = incomingPacket.remainingLength;
-        bytesReceived = recvExact( pContext, bytesToReceive );
+        /* The start of the packet may already have been read along with the
+         * fixed header. */
+        if( stagedLength > 0U )
+        {
+            ( void ) memcpy( pContext->networkBuffer.pBuffer, pStagedData, stagedLength );
+        }
+
+        bytesToReceive = incomingPacket.remainingLength - stagedLength;
+        bytesReceived = recvExact( pContext, stagedLength, bytesToReceive );
 
         if( bytesReceived == ( int32_t ) bytesToReceive )
         {
@@ -1487,48 +2715,160 @@ static MQTTStatus_t handleKeepAlive( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
-                                                    uint16_t packetId,
-                                                    MQTTPublishState_t publishState )
+static uint32_t getKeepAliveWaitTimeMs( MQTTContext_t * pContext )
 {
-    MQTTStatus_t status = MQTTSuccess;
-    MQTTPublishState_t newState = MQTTStateNull;
-    int32_t sendResult = 0;
-    uint8_t packetTypeByte = 0U;
-    MQTTPubAckType_t packetType;
-    MQTTFixedBuffer_t localBuffer;
-    MQTTConnectionStatus_t connectStatus;
-    uint8_t pubAckPacket[ MQTT_PUBLISH_ACK_PACKET_SIZE ];
-
-    localBuffer.pBuffer = pubAckPacket;
-    localBuffer.size = MQTT_PUBLISH_ACK_PACKET_SIZE;
+    uint32_t now = 0U;
+    uint32_t elapsedMs = 0U;
+    uint32_t waitTimeMs = 0U;
+    uint32_t packetTxTimeoutMs = 0U;
+    uint32_t lastPacketTxTime = 0U;
 
     assert( pContext != NULL );
+    assert( pContext->getTime != NULL );
 
-    packetTypeByte = getAckTypeToSend( publishState );
-
-    LogDebug( ( "Got ACK packet type 0x%02x [pkt ID: %hu] for the publish state 0x%02x",
-                packetTypeByte,
-                packetId,
-                publishState ) );
+    now = pContext->getTime();
 
-    if( packetTypeByte != 0U )
+    /* Mirror the deadlines checked by handleKeepAlive. */
+    if( pContext->waitingForPingResp == true )
     {
-        packetType = getAckFromPacketType( packetTypeByte );
+        elapsedMs = calculateElapsedTime( now, pContext->pingReqSendTimeMs );
 
-        status = MQTT_SerializeAck( &localBuffer,
-                                    packetTypeByte,
-                                    packetId,
-                                    NULL,
-                                    NULL );
+        if( elapsedMs <= MQTT_PINGRESP_TIMEOUT_MS )
+        {
+            /* The timeout is reported once it has been exceeded. */
+            waitTimeMs = MQTT_PINGRESP_TIMEOUT_MS - elapsedMs + 1U;
+        }
+    }
+    else
+    {
+        elapsedMs = calculateElapsedTime( now, pContext->lastPacketRxTime );
 
-        if( MQTT_PUBLISH_ACK_PACKET_SIZE > pContext->connectionProperties.serverMaxPacketSize )
+        if( elapsedMs < PACKET_RX_TIMEOUT_MS )
         {
-            LogError( ( "Packet size is greater than the allowed maximum packet size." ) );
-            status = MQTTBadParameter;
+            waitTimeMs = PACKET_RX_TIMEOUT_MS - elapsedMs;
         }
 
-        if( status == MQTTSuccess )
+        packetTxTimeoutMs = 1000U * ( uint32_t ) pContext->keepAliveIntervalSec;
+
+        if( PACKET_TX_TIMEOUT_MS < packetTxTimeoutMs )
+        {
+            packetTxTimeoutMs = PACKET_TX_TIMEOUT_MS;
+        }
+
+        if( packetTxTimeoutMs != 0U )
+        {
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            lastPacketTxTime = pContext->lastPacketTxTime;
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+            elapsedMs = calculateElapsedTime( now, lastPacketTxTime );
+
+            if( elapsedMs >= packetTxTimeoutMs )
+            {
+                waitTimeMs = 0U;
+            }
+            else if( ( packetTxTimeoutMs - elapsedMs ) < waitTimeMs )
+            {
+                waitTimeMs = packetTxTimeoutMs - elapsedMs;
+            }
+            else
+            {
+                /* The receive deadline comes first. */
+            }
+        }
+    }
+
+    return waitTimeMs;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t waitForReadable( MQTTContext_t * pContext,
+                                     uint32_t timeoutMs )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    int32_t waitResult = 0;
+
+    assert( pContext != NULL );
+
+    if( pContext->waitReadable != NULL )
+    {
+        waitResult = pContext->waitReadable( pContext->transportInterface.pNetworkContext,
+                                             timeoutMs );
+
+        if( waitResult < 0 )
+        {
+            LogError( ( "Network error while waiting for data: ReturnCode=%ld.",
+                        ( long int ) waitResult ) );
+            status = MQTTRecvFailed;
+
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+            if( pContext->connectStatus == MQTTConnected )
+            {
+                pContext->connectStatus = MQTTDisconnectPending;
+            }
+
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
+                                                    uint16_t packetId,
+                                                    MQTTPublishState_t publishState )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishState_t newState = MQTTStateNull;
+    int32_t sendResult = 0;
+    uint8_t packetTypeByte = 0U;
+    MQTTPubAckType_t packetType;
+    MQTTFixedBuffer_t localBuffer;
+    MQTTConnectionStatus_t connectStatus;
+    uint8_t pubAckPacket[ MQTT_PUBLISH_ACK_PACKET_SIZE ];
+    bool ackStaged = false;
+
+    localBuffer.pBuffer = pubAckPacket;
+    localBuffer.size = MQTT_PUBLISH_ACK_PACKET_SIZE;
+
+    assert( pContext != NULL );
+
+    packetTypeByte = getAckTypeToSend( publishState );
+
+    LogDebug( ( "Got ACK packet type 0x%02x [pkt ID: %hu] for the publish state 0x%02x",
+                packetTypeByte,
+                packetId,
+                publishState ) );
+
+    if( packetTypeByte != 0U )
+    {
+        packetType = getAckFromPacketType( packetTypeByte );
+
+        status = MQTT_SerializeAck( &localBuffer,
+                                    packetTypeByte,
+                                    packetId,
+                                    NULL,
+                                    NULL );
+
+        if( MQTT_PUBLISH_ACK_PACKET_SIZE > pContext->connectionProperties.serverMaxPacketSize )
+        {
+            LogError( ( "Packet size is greater than the allowed maximum packet size." ) );
+            status = MQTTBadParameter;
+        }
+
+        if( ( status == MQTTSuccess ) &&
+            ( pContext->pAckStagingBuffer != NULL ) &&
+            ( pContext->ackStagedCount == pContext->ackStagingCapacity ) )
+        {
+            /* Make room for this ack. */
+            status = flushStagedAcks( pContext );
+        }
+
+        if( status == MQTTSuccess )
         {
             MQTT_PRE_STATE_UPDATE_HOOK( pContext );
             {
@@ -1555,7 +2895,22 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
                     status = MQTTPublishStoreFailed;
                 }
 
-                if( status == MQTTSuccess )
+                if( ( status == MQTTSuccess ) && ( pContext->pAckStagingBuffer != NULL ) )
+                {
+                    /* The ack is sent, and the state updated, with the
+                     * other acks gathered in this iteration. */
+                    LogDebug( ( "Staging ACK packet: PacketType=%02x, PacketID=%hu.",
+                                ( unsigned int ) packetTypeByte, ( unsigned short ) packetId ) );
+
+                    ackStaged = true;
+
+                    if( stageAck( pContext, localBuffer.pBuffer ) == false )
+                    {
+                        LogDebug( ( "ACK packet already staged: PacketID=%hu.",
+                                    ( unsigned short ) packetId ) );
+                    }
+                }
+                else if( status == MQTTSuccess )
                 {
                     LogDebug( ( "Sending ACK packet: PacketType=%02x, PacketID=%hu.",
                                 ( unsigned int ) packetTypeByte, ( unsigned short ) packetId ) );
@@ -1571,11 +2926,19 @@ static MQTTStatus_t sendPublishAcksWithoutProperty( MQTTContext_t * pContext,
                         status = MQTTSendFailed;
                     }
                 }
+                else
+                {
+                    /* Not connected or the store failed. */
+                }
             }
             MQTT_POST_STATE_UPDATE_HOOK( pContext );
         }
 
-        if( status == MQTTSuccess )
+        if( ackStaged == true )
+        {
+            /* Sent later by flushStagedAcks. */
+        }
+        else if( status == MQTTSuccess )
         {
             pContext->controlPacketSent = true;
 
@@ -1664,6 +3027,7 @@ static MQTTStatus_t buildAndSendAckWithProps( MQTTContext_t * pContext,
 
         pContext->ackPropsBuffer.currentIndex = 0;
         pContext->ackPropsBuffer.fieldSet = 0;
+        pContext->ackPropsBuffer.seal.packetType = 0U;
     }
 
     if( totalMessageLength > MQTT_MAX_PACKET_SIZE )
@@ -1736,7 +3100,8 @@ static MQTTStatus_t sendPublishAcksWithProperty( MQTTContext_t * pContext,
 
     if( packetTypeByte != 0U )
     {
-        if( pContext->ackPropsBuffer.currentIndex > 0U )
+        if( ( pContext->ackPropsBuffer.currentIndex > 0U ) &&
+            ( isPropertyBuilderSealed( &pContext->ackPropsBuffer, packetTypeByte ) == false ) )
         {
             status = MQTT_ValidatePublishAckProperties( &pContext->ackPropsBuffer );
         }
@@ -1763,8 +3128,17 @@ static MQTTStatus_t sendPublishAcksWithProperty( MQTTContext_t * pContext,
     {
         packetType = getAckFromPacketType( packetTypeByte );
 
-        status = buildAndSendAckWithProps( pContext, packetTypeByte, packetId,
-                                           reasonCode, remainingLength, ackPropertyLength );
+        /* Acks must be sent in the order the packets were received. */
+        if( pContext->ackStagedCount > 0U )
+        {
+            status = flushStagedAcks( pContext );
+        }
+
+        if( status == MQTTSuccess )
+        {
+            status = buildAndSendAckWithProps( pContext, packetTypeByte, packetId,
+                                               reasonCode, remainingLength, ackPropertyLength );
+        }
 
         if( status == MQTTSuccess )
         {
@@ -1790,6 +3164,162 @@ static MQTTStatus_t sendPublishAcksWithProperty( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static bool stageAck( MQTTContext_t * pContext,
+                      const uint8_t * pAck )
+{
+    bool added = true;
+    size_t i;
+    const uint8_t * pStaged = NULL;
+
+    assert( pContext != NULL );
+    assert( pContext->pAckStagingBuffer != NULL );
+    assert( pContext->ackStagedCount < pContext->ackStagingCapacity );
+    assert( pAck != NULL );
+
+    /* A duplicate publish may be received before its ack is sent. Acks only
+     * differ by their type and packet identifier, and a duplicate usually
+     * follows the original publish, so the last gathered ack is checked
+     * first. */
+    i = pContext->ackStagedCount;
+
+    while( ( i > 0U ) && ( added == true ) )
+    {
+        i--;
+        pStaged = &( pContext->pAckStagingBuffer[ i * MQTT_PUBLISH_ACK_PACKET_SIZE ] );
+
+        if( ( pStaged[ 3 ] == pAck[ 3 ] ) &&
+            ( pStaged[ 2 ] == pAck[ 2 ] ) &&
+            ( pStaged[ 0 ] == pAck[ 0 ] ) )
+        {
+            added = false;
+        }
+    }
+
+    if( added == true )
+    {
+        ( void ) memcpy( &( pContext->pAckStagingBuffer[ pContext->ackStagedCount * MQTT_PUBLISH_ACK_PACKET_SIZE ] ),
+                         pAck,
+                         MQTT_PUBLISH_ACK_PACKET_SIZE );
+        pContext->ackStagedCount++;
+    }
+
+    return added;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t flushStagedAcks( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishState_t newState = MQTTStateNull;
+    MQTTConnectionStatus_t connectStatus;
+    size_t stagedCount;
+    size_t stagedLength;
+    size_t i;
+    int32_t sendResult = 0;
+    const uint8_t * pAck = NULL;
+    const uint8_t * pPacketId = NULL;
+    uint16_t packetId;
+
+    assert( pContext != NULL );
+
+    stagedCount = pContext->ackStagedCount;
+    stagedLength = stagedCount * MQTT_PUBLISH_ACK_PACKET_SIZE;
+
+    if( stagedCount > 0U )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+        else
+        {
+            LogDebug( ( "Sending %lu staged ACK packets.",
+                        ( unsigned long ) stagedCount ) );
+
+            sendResult = sendBuffer( pContext,
+                                     pContext->pAckStagingBuffer,
+                                     stagedLength );
+
+            if( sendResult < ( int32_t ) stagedLength )
+            {
+                LogError( ( "Failed to send staged ACK packets: SentBytes=%ld, "
+                            "PacketSize=%lu.",
+                            ( long int ) sendResult,
+                            ( unsigned long ) stagedLength ) );
+                status = MQTTSendFailed;
+            }
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        pContext->ackStagedCount = 0U;
+    }
+
+    if( ( stagedCount > 0U ) && ( status == MQTTSuccess ) )
+    {
+        pContext->controlPacketSent = true;
+
+        for( i = 0U; ( i < stagedCount ) && ( status == MQTTSuccess ); i++ )
+        {
+            pAck = &( pContext->pAckStagingBuffer[ i * MQTT_PUBLISH_ACK_PACKET_SIZE ] );
+            pPacketId = &( pAck[ 2 ] );
+            packetId = UINT16_DECODE( pPacketId );
+
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            {
+                status = MQTT_UpdateStateAck( pContext,
+                                              packetId,
+                                              getAckFromPacketType( pAck[ 0 ] ),
+                                              MQTT_SEND,
+                                              &newState );
+            }
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+            if( status != MQTTSuccess )
+            {
+                LogError( ( "Failed to update state of publish %hu.",
+                            ( unsigned short ) packetId ) );
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t flushStagedAcksAfterReceive( MQTTContext_t * pContext,
+                                                 MQTTStatus_t receiveStatus )
+{
+    MQTTStatus_t status = receiveStatus;
+    MQTTStatus_t flushStatus = MQTTSuccess;
+
+    assert( pContext != NULL );
+
+    if( pContext->ackStagedCount > 0U )
+    {
+        flushStatus = flushStagedAcks( pContext );
+
+        /* Report a failure to send the acks unless an earlier error occurred. */
+        if( ( flushStatus != MQTTSuccess ) &&
+            ( ( status == MQTTSuccess ) ||
+              ( status == MQTTNoDataAvailable ) ||
+              ( status == MQTTNeedMoreBytes ) ) )
+        {
+            status = flushStatus;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t validatePublishAckReasonCode( MQTTSuccessFailReasonCode_t reasonCode,
                                                   uint8_t packetType )
 {
@@ -1847,6 +3377,70 @@ static MQTTStatus_t validatePublishAckReasonCode( MQTTSuccessFailReasonCode_t re
 
 /*-----------------------------------------------------------*/
 
+static MQTTStatus_t deserializeIncomingPublish( MQTTContext_t * pContext,
+                                                const MQTTPacketInfo_t * pIncomingPacket,
+                                                uint16_t * pPacketIdentifier,
+                                                MQTTPublishInfo_t * pPublishInfo,
+                                                MQTTPropBuilder_t * pPropBuffer )
+{
+    MQTTStatus_t status;
+    MQTTSuccessFailReasonCode_t reason;
+
+    assert( pContext != NULL );
+    assert( pIncomingPacket != NULL );
+
+    if( ( pContext->pIncomingPropIndex != NULL ) ||
+        ( pContext->pIncomingPublishProperties != NULL ) )
+    {
+        status = MQTT_DeserializePublishWithProperties( pIncomingPacket,
+                                                        pPacketIdentifier,
+                                                        pPublishInfo,
+                                                        pPropBuffer,
+                                                        pContext->pIncomingPropIndex,
+                                                        pContext->pIncomingPublishProperties,
+                                                        pContext->connectionProperties.maxPacketSize,
+                                                        pContext->connectionProperties.topicAliasMax );
+    }
+    else
+    {
+        status = MQTT_DeserializePublish( pIncomingPacket,
+                                          pPacketIdentifier,
+                                          pPublishInfo,
+                                          pPropBuffer,
+                                          pContext->connectionProperties.maxPacketSize,
+                                          pContext->connectionProperties.topicAliasMax );
+    }
+
+    LogInfo( ( "De-serialized incoming PUBLISH packet: DeserializerResult=%s.",
+               MQTT_Status_strerror( status ) ) );
+
+    if( ( status == MQTTSuccess ) &&
+        ( pContext->pIncomingTopicAliases != NULL ) &&
+        ( pPublishInfo->topicAlias != 0U ) )
+    {
+        status = resolveIncomingTopicAlias( pContext, pPublishInfo );
+
+        if( status != MQTTSuccess )
+        {
+            reason = MQTT_REASON_DISCONNECT_TOPIC_ALIAS_INVALID;
+
+            if( MQTT_Disconnect( pContext, NULL, &reason ) != MQTTSuccess )
+            {
+                LogError( ( "Failed to send disconnect following an invalid topic alias "
+                            "from the server. coreMQTT will forcefully disconnect now." ) );
+            }
+
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            pContext->connectStatus = MQTTNotConnected;
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
                                            MQTTPacketInfo_t * pIncomingPacket )
 {
@@ -1854,7 +3448,7 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
     MQTTPublishState_t publishRecordState = MQTTStateNull;
     uint16_t packetIdentifier = 0U;
     MQTTPublishInfo_t publishInfo = { 0 };
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
     bool duplicatePublish = false;
     MQTTPropBuilder_t propBuffer = { 0 };
     MQTTSuccessFailReasonCode_t reasonCode = MQTT_INVALID_REASON_CODE;
@@ -1864,15 +3458,25 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
     assert( pIncomingPacket != NULL );
     assert( pContext->appCallback != NULL );
 
-    status = MQTT_DeserializePublish( pIncomingPacket,
-                                      &packetIdentifier,
-                                      &publishInfo,
-                                      &propBuffer,
-                                      pContext->connectionProperties.maxPacketSize,
-                                      pContext->connectionProperties.topicAliasMax );
-
-    LogInfo( ( "De-serialized incoming PUBLISH packet: DeserializerResult=%s.",
-               MQTT_Status_strerror( status ) ) );
+    if( ( pContext->pPublishStream != NULL ) &&
+        ( pContext->pPublishStream->headLength != 0U ) )
+    {
+        /* The headers were deserialized by receiveStreamedPublish, and the
+         * payload has already been delivered to the chunk callback. */
+        packetIdentifier = pContext->pPublishStream->packetIdentifier;
+        publishInfo = pContext->pPublishStream->publishInfo;
+        propBuffer = pContext->pPublishStream->propBuffer;
+        publishInfo.pPayload = NULL;
+        status = MQTTSuccess;
+    }
+    else
+    {
+        status = deserializeIncomingPublish( pContext,
+                                             pIncomingPacket,
+                                             &packetIdentifier,
+                                             &publishInfo,
+                                             &propBuffer );
+    }
 
     if( ( status == MQTTSuccess ) &&
         ( pContext->incomingPublishRecords == NULL ) &&
@@ -1961,6 +3565,7 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
         deserializedInfo.packetIdentifier = packetIdentifier;
         deserializedInfo.pPublishInfo = &publishInfo;
         deserializedInfo.deserializationResult = status;
+        deserializedInfo.pPublishProperties = pContext->pIncomingPublishProperties;
 
         /* Invoke application callback to hand the buffer over to application
          * before sending acks. */
@@ -1978,6 +3583,12 @@ static MQTTStatus_t handleIncomingPublish( MQTTContext_t * pContext,
                 pTempReasonCode = &reasonCode;
             }
 
+            if( ( pContext->pSubscriptionHandlers != NULL ) &&
+                ( publishInfo.subscriptionIdCount > 0U ) )
+            {
+                dispatchToSubscriptionHandlers( pContext, &deserializedInfo, &propBuffer );
+            }
+
             if( pContext->appCallback( pContext, pIncomingPacket, &deserializedInfo,
                                        pTempReasonCode, pTempPropBuffer, &propBuffer ) == false )
             {
@@ -2040,7 +3651,7 @@ static MQTTStatus_t handlePublishAcks( MQTTContext_t * pContext,
     uint16_t packetIdentifier;
     MQTTPubAckType_t ackType;
     MQTTEventCallback_t appCallback;
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
     MQTTPropBuilder_t propBuffer = { 0 };
     MQTTPropBuilder_t * pSendProps;
     MQTTSuccessFailReasonCode_t * pSendReasonCode;
@@ -2211,7 +3822,7 @@ static MQTTStatus_t handleIncomingAck( MQTTContext_t * pContext,
 {
     MQTTStatus_t status = MQTTBadResponse;
     uint16_t packetIdentifier = MQTT_PACKET_ID_INVALID;
-    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
 
     MQTTEventCallback_t appCallback;
 
@@ -2319,6 +3930,326 @@ static MQTTStatus_t handleIncomingDisconnect( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+static MQTTStatus_t getPublishVariableHeaderLength( const MQTTPacketInfo_t * pIncomingPacket,
+                                                    size_t availableLength,
+                                                    size_t * pVariableHeaderLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    const uint8_t * pIndex = pIncomingPacket->pRemainingData;
+    size_t length = sizeof( uint16_t );
+    uint32_t propertyLength = 0U;
+
+    assert( pIncomingPacket->pRemainingData != NULL );
+    assert( pVariableHeaderLength != NULL );
+
+    if( availableLength < length )
+    {
+        status = MQTTNeedMoreBytes;
+    }
+    else
+    {
+        /* Topic name length and topic name. */
+        length += ( size_t ) UINT16_DECODE( pIndex );
+
+        /* QoS 1 and QoS 2 publishes carry a packet identifier. */
+        if( ( pIncomingPacket->type & 0x06U ) != 0U )
+        {
+            length += sizeof( uint16_t );
+        }
+
+        if( availableLength <= length )
+        {
+            status = MQTTNeedMoreBytes;
+        }
+        else
+        {
+            status = decodeVariableLength( &pIndex[ length ],
+                                           availableLength - length,
+                                           &propertyLength );
+
+            if( status == MQTTSuccess )
+            {
+                length += ( size_t ) variableLengthEncodedSize( propertyLength ) + ( size_t ) propertyLength;
+
+                if( availableLength < length )
+                {
+                    status = MQTTNeedMoreBytes;
+                }
+            }
+            /* The property length is at most 4 bytes long, it may not have
+             * been fully received yet. */
+            else if( ( availableLength - length ) < 4U )
+            {
+                status = MQTTNeedMoreBytes;
+            }
+            else
+            {
+                LogError( ( "Malformed property length in incoming PUBLISH." ) );
+            }
+        }
+    }
+
+    *pVariableHeaderLength = length;
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t receiveStreamedPublish( MQTTContext_t * pContext,
+                                            MQTTPacketInfo_t * pIncomingPacket,
+                                            uint32_t * pConsumedLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t headLength = 0U;
+    size_t chunkLength = 0U;
+    bool lastChunk = false;
+    uint8_t * pBuffer = pContext->networkBuffer.pBuffer;
+    MQTTPublishStream_t * pStream = pContext->pPublishStream;
+
+    assert( pContext != NULL );
+    assert( pContext->publishChunkCallback != NULL );
+    assert( pStream != NULL );
+    assert( pIncomingPacket != NULL );
+    assert( pConsumedLength != NULL );
+
+    /* The headers are always kept at the start of the buffer. */
+    assert( pContext->headIndex == 0U );
+
+    /* The headers are deserialized only once, and kept for the following
+     * pieces of the payload. */
+    if( pStream->headLength == 0U )
+    {
+        status = getPublishVariableHeaderLength( pIncomingPacket,
+                                                 pContext->index - pIncomingPacket->headerLength,
+                                                 &headLength );
+
+        if( status == MQTTSuccess )
+        {
+            headLength += pIncomingPacket->headerLength;
+
+            if( headLength >= pContext->networkBuffer.size )
+            {
+                LogError( ( "Headers of the incoming PUBLISH leave no space for its payload in the network buffer. Header length %lu",
+                            ( unsigned long ) headLength ) );
+                status = MQTTRecvFailed;
+            }
+        }
+        else if( ( status == MQTTNeedMoreBytes ) &&
+                 ( pContext->index == pContext->networkBuffer.size ) )
+        {
+            LogError( ( "Headers of the incoming PUBLISH do not fit in the network buffer." ) );
+            status = MQTTRecvFailed;
+        }
+        else
+        {
+            /* Either more bytes are needed or the header is malformed. */
+        }
+
+        if( status == MQTTSuccess )
+        {
+            ( void ) memset( pStream, 0x00, sizeof( MQTTPublishStream_t ) );
+
+            status = deserializeIncomingPublish( pContext,
+                                                 pIncomingPacket,
+                                                 &pStream->packetIdentifier,
+                                                 &pStream->publishInfo,
+                                                 &pStream->propBuffer );
+        }
+
+        if( status == MQTTSuccess )
+        {
+            /* A QoS 2 PUBLISH still held by the state engine was already
+             * delivered, and is only acknowledged again. */
+            if( pStream->publishInfo.qos == MQTTQoS2 )
+            {
+                pStream->duplicate = ( MQTT_IncomingPublishState( pContext, pStream->packetIdentifier ) != MQTTStateNull );
+            }
+
+            if( pStream->duplicate == true )
+            {
+                LogDebug( ( "Dropping the payload of duplicate incoming publish with packet id %hu.",
+                            ( unsigned short ) pStream->packetIdentifier ) );
+            }
+
+            pStream->headLength = headLength;
+        }
+    }
+    else
+    {
+        headLength = pStream->headLength;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        chunkLength = pContext->index - headLength;
+
+        if( chunkLength >= ( pStream->publishInfo.payloadLength - pStream->payloadOffset ) )
+        {
+            /* Bytes following the payload belong to the next packet. */
+            chunkLength = pStream->publishInfo.payloadLength - pStream->payloadOffset;
+            lastChunk = true;
+        }
+        else if( pContext->index < pContext->networkBuffer.size )
+        {
+            /* Deliver the payload in pieces that fill the buffer. */
+            status = MQTTNeedMoreBytes;
+        }
+        else
+        {
+            /* MISRA else. */
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* The piece is empty when retrying a PUBLISH whose event callback
+         * failed after the whole payload had been delivered. */
+        if( ( chunkLength > 0U ) &&
+            ( pStream->duplicate == false ) &&
+            ( pContext->publishChunkCallback( pContext, &pStream->publishInfo, pStream->packetIdentifier,
+                                              pStream->payloadOffset,
+                                              &pBuffer[ headLength ], chunkLength ) == false ) )
+        {
+            status = MQTTEventCallbackFailed;
+        }
+        else
+        {
+            pStream->payloadOffset += chunkLength;
+            pContext->lastPacketRxTime = pContext->getTime();
+
+            /* Drop the received piece, keeping the headers in place. */
+            pContext->index -= chunkLength;
+            ( void ) memmove( &pBuffer[ headLength ],
+                              &pBuffer[ headLength + chunkLength ],
+                              pContext->index - headLength );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        if( lastChunk == true )
+        {
+            status = handleIncomingPublish( pContext, pIncomingPacket );
+
+            if( status == MQTTSuccess )
+            {
+                ( void ) memset( pStream, 0x00, sizeof( MQTTPublishStream_t ) );
+                *pConsumedLength = ( uint32_t ) headLength;
+            }
+        }
+        else
+        {
+            status = MQTTNeedMoreBytes;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void resetPublishStream( MQTTContext_t * pContext )
+{
+    assert( pContext != NULL );
+
+    if( pContext->pPublishStream != NULL )
+    {
+        if( pContext->pPublishStream->headLength != 0U )
+        {
+            pContext->index = 0;
+            pContext->headIndex = 0;
+        }
+
+        ( void ) memset( pContext->pPublishStream, 0x00, sizeof( MQTTPublishStream_t ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t handleIncomingPacket( MQTTContext_t * pContext,
+                                          MQTTPacketInfo_t * pIncomingPacket,
+                                          bool manageKeepAlive )
+{
+    MQTTStatus_t status;
+
+    assert( pContext != NULL );
+    assert( pIncomingPacket != NULL );
+
+    /* PUBLISH packets allow flags in the lower four bits. For other
+     * packet types, they are reserved. */
+    if( ( pIncomingPacket->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+    {
+        status = handleIncomingPublish( pContext, pIncomingPacket );
+    }
+    else if( pIncomingPacket->type == MQTT_PACKET_TYPE_DISCONNECT )
+    {
+        status = handleIncomingDisconnect( pContext, pIncomingPacket );
+
+        if( status == MQTTSuccess )
+        {
+            LogInfo( ( "Disconnected from the broker." ) );
+        }
+        else if( status != MQTTEventCallbackFailed )
+        {
+            /* Incoming packet is malformed at this stage. */
+            MQTTSuccessFailReasonCode_t reason = MQTT_REASON_DISCONNECT_MALFORMED_PACKET;
+            status = MQTT_Disconnect( pContext, NULL, &reason );
+
+            if( status != MQTTSuccess )
+            {
+                LogError( ( "Failed to send disconnect following a malformed disconnect "
+                            "from the server. coreMQTT will forcefully disconnect now." ) );
+            }
+            else
+            {
+                status = MQTTStatusNotConnected;
+            }
+        }
+        else /* At this point the callback has failed. */
+        {
+            /* TODO: If handling fails, the packet should be
+             * resent to the application or not? */
+        }
+
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        pContext->connectStatus = MQTTNotConnected;
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+    else
+    {
+        status = handleIncomingAck( pContext, pIncomingPacket, manageKeepAlive );
+
+        /* TODO: decide what to do when the app callback has failed.
+         * Should the packet be re-sent to the app? */
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void linearizeNetworkBuffer( MQTTContext_t * pContext,
+                                    size_t requiredLength )
+{
+    assert( pContext != NULL );
+
+    if( ( pContext->headIndex > 0U ) &&
+        ( ( pContext->networkBuffer.size - pContext->headIndex ) < requiredLength ) )
+    {
+        LogTrace( ( "Moving %lu unprocessed bytes to the start of the network buffer.",
+                    ( unsigned long ) pContext->index ) );
+
+        ( void ) memmove( pContext->networkBuffer.pBuffer,
+                          &( pContext->networkBuffer.pBuffer[ pContext->headIndex ] ),
+                          pContext->index );
+
+        pContext->headIndex = 0U;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
                                             bool manageKeepAlive )
 {
@@ -2326,6 +4257,7 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
     MQTTPacketInfo_t incomingPacket = { 0 };
     int32_t recvBytes;
     uint32_t totalMQTTPacketLength = 0;
+    bool streamPublish = false;
 
     assert( pContext != NULL );
     assert( pContext->networkBuffer.pBuffer != NULL );
@@ -2335,20 +4267,23 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
      * be enough. */
     assert( pContext->networkBuffer.size < 0x7FFFFFFF );
 
-    /* Read as many bytes as possible into the network buffer. */
+    /* Read as many bytes as possible into the network buffer. The head index
+     * is always 0 unless ring receive mode is enabled. */
     recvBytes = pContext->transportInterface.recv( pContext->transportInterface.pNetworkContext,
-                                                   &( pContext->networkBuffer.pBuffer[ pContext->index ] ),
-                                                   pContext->networkBuffer.size - pContext->index );
+                                                   &( pContext->networkBuffer.pBuffer[ pContext->headIndex + pContext->index ] ),
+                                                   pContext->networkBuffer.size - pContext->headIndex - pContext->index );
 
     LogTrace( ( "Received %ld bytes from network.",
                 ( long int ) recvBytes ) );
     LogTrace( ( "Index is at location: %ld",
-                ( long int ) pContext->index ) );
+                ( long int ) ( pContext->headIndex + pContext->index ) ) );
     LogTrace( ( "Remaining buffer capacity: %ld",
-                ( long int ) ( pContext->networkBuffer.size - pContext->index ) ) );
+                ( long int ) ( pContext->networkBuffer.size - pContext->headIndex - pContext->index ) ) );
 
     do
     {
+        streamPublish = false;
+
         if( recvBytes < 0 )
         {
             /* The receive function has failed. Bubble up the error up to the user. */
@@ -2385,7 +4320,7 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
              * requested. */
             pContext->index += ( size_t ) recvBytes;
 
-            status = MQTT_ProcessIncomingPacketTypeAndLength( pContext->networkBuffer.pBuffer,
+            status = MQTT_ProcessIncomingPacketTypeAndLength( &( pContext->networkBuffer.pBuffer[ pContext->headIndex ] ),
                                                               &( pContext->index ),
                                                               &incomingPacket );
 
@@ -2430,8 +4365,14 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         /* Check whether there is data available before processing the packet further. */
         if( ( status == MQTTNeedMoreBytes ) || ( status == MQTTNoDataAvailable ) )
         {
-            /* Do nothing as there is nothing to be processed right now. The proper
-             * error code will be bubbled up to the user. */
+            /* Nothing can be processed right now. The proper error code will be
+             * bubbled up to the user. An incomplete fixed header needs at least
+             * one more byte, so make room for it if the head is at the end of
+             * the buffer. */
+            if( status == MQTTNeedMoreBytes )
+            {
+                linearizeNetworkBuffer( pContext, pContext->index + 1U );
+            }
         }
         /* Any other error code. */
         else if( status != MQTTSuccess )
@@ -2442,14 +4383,27 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         /* If the MQTT Packet size is bigger than the buffer itself. */
         else if( totalMQTTPacketLength > pContext->networkBuffer.size )
         {
-            LogError( ( "Incoming packet size is bigger than MQTT buffer size. Total packet length %" PRIu32,
-                        totalMQTTPacketLength ) );
-            status = MQTTRecvFailed;
+            if( ( ( incomingPacket.type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH ) &&
+                ( pContext->publishChunkCallback != NULL ) )
+            {
+                /* Stream the payload, with the headers at the start of the buffer. */
+                streamPublish = true;
+                linearizeNetworkBuffer( pContext, pContext->networkBuffer.size );
+            }
+            else
+            {
+                LogError( ( "Incoming packet size is bigger than MQTT buffer size. Total packet length %" PRIu32,
+                            totalMQTTPacketLength ) );
+                status = MQTTRecvFailed;
+            }
         }
         /* If the total packet is of more length than the bytes we have available. */
         else if( totalMQTTPacketLength > pContext->index )
         {
             status = MQTTNeedMoreBytes;
+
+            /* Only a packet straddling the end of the buffer is moved. */
+            linearizeNetworkBuffer( pContext, totalMQTTPacketLength );
         }
         else
         {
@@ -2459,71 +4413,51 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         /* Handle received packet. If incomplete data was read then this will not execute. */
         if( status == MQTTSuccess )
         {
-            incomingPacket.pRemainingData = &pContext->networkBuffer.pBuffer[ incomingPacket.headerLength ];
+            incomingPacket.pRemainingData = &pContext->networkBuffer.pBuffer[ pContext->headIndex + incomingPacket.headerLength ];
 
-            /* PUBLISH packets allow flags in the lower four bits. For other
-             * packet types, they are reserved. */
-            if( ( incomingPacket.type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+            if( streamPublish == true )
             {
-                status = handleIncomingPublish( pContext, &incomingPacket );
+                status = receiveStreamedPublish( pContext, &incomingPacket, &totalMQTTPacketLength );
             }
-            else if( incomingPacket.type == MQTT_PACKET_TYPE_DISCONNECT )
+            else
             {
-                status = handleIncomingDisconnect( pContext, &incomingPacket );
+                status = handleIncomingPacket( pContext, &incomingPacket, manageKeepAlive );
+            }
 
-                if( status == MQTTSuccess )
-                {
-                    LogInfo( ( "Disconnected from the broker." ) );
-                }
-                else if( status != MQTTEventCallbackFailed )
-                {
-                    /* Incoming packet is malformed at this stage. */
-                    MQTTSuccessFailReasonCode_t reason = MQTT_REASON_DISCONNECT_MALFORMED_PACKET;
-                    status = MQTT_Disconnect( pContext, NULL, &reason );
+            if( status == MQTTSuccess )
+            {
+                /* Update the index to reflect the remaining bytes in the buffer.  */
+                pContext->index -= totalMQTTPacketLength;
 
-                    if( status != MQTTSuccess )
+                if( pContext->ringReceiveEnabled == true )
+                {
+                    /* Consume the packet in place. Rewind to the start of the
+                     * buffer once everything received has been processed. */
+                    if( pContext->index == 0U )
                     {
-                        LogError( ( "Failed to send disconnect following a malformed disconnect "
-                                    "from the server. coreMQTT will forcefully disconnect now." ) );
+                        pContext->headIndex = 0U;
                     }
                     else
                     {
-                        status = MQTTStatusNotConnected;
+                        pContext->headIndex += totalMQTTPacketLength;
                     }
                 }
-                else /* At this point the callback has failed. */
+                else
                 {
-                    /* TODO: If handling fails, the packet should be
-                     * resent to the application or not? */
+                    /* Move the remaining bytes to the front of the buffer. */
+                    ( void ) memmove( pContext->networkBuffer.pBuffer,
+                                      &( pContext->networkBuffer.pBuffer[ totalMQTTPacketLength ] ),
+                                      pContext->index );
                 }
 
-                MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-                pContext->connectStatus = MQTTNotConnected;
-                MQTT_POST_STATE_UPDATE_HOOK( pContext );
-            }
-            else
-            {
-                status = handleIncomingAck( pContext, &incomingPacket, manageKeepAlive );
-
-                /* TODO: decide what to do when the app callback has failed.
-                 * Should the packet be re-sent to the app? */
-            }
-
-            if( status == MQTTSuccess )
-            {
-                /* Update the index to reflect the remaining bytes in the buffer.  */
-                pContext->index -= totalMQTTPacketLength;
-
-                /* Move the remaining bytes to the front of the buffer. */
-                ( void ) memmove( pContext->networkBuffer.pBuffer,
-                                  &( pContext->networkBuffer.pBuffer[ totalMQTTPacketLength ] ),
-                                  pContext->index );
-
                 pContext->lastPacketRxTime = pContext->getTime();
             }
         }
     } while( ( pContext->index > 0U ) && ( status == MQTTSuccess ) );
 
+    /* Send the acks for the packets handled in this iteration together. */
+    status = flushStagedAcksAfterReceive( pContext, status );
+
     if( status == MQTTNoDataAvailable )
     {
         /* No data available is not an error. Reset to MQTTSuccess so the
@@ -2536,39 +4470,264 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t validateSubscribeUnsubscribeParams( const MQTTContext_t * pContext,
-                                                        const MQTTSubscribeInfo_t * pSubscriptionList,
-                                                        size_t subscriptionCount,
-                                                        uint16_t packetId,
-                                                        MQTTSubscriptionType_t subscriptionType )
+static MQTTStatus_t completeBufferedPackets( MQTTContext_t * pContext,
+                                             const uint8_t * pLease,
+                                             size_t leasedBytes,
+                                             size_t * pOffset,
+                                             bool manageKeepAlive )
 {
     MQTTStatus_t status = MQTTSuccess;
-    size_t iterator;
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    uint8_t * pBuffer = pContext->networkBuffer.pBuffer;
+    size_t packetLength = 0U;
+    size_t copyLength = 0U;
 
-    /* Validate all the parameters. */
-    if( ( pContext == NULL ) || ( pSubscriptionList == NULL ) )
-    {
-        LogError( ( "Argument cannot be NULL: pContext=%p, "
-                    "pSubscriptionList=%p.",
-                    ( const void * ) pContext,
-                    ( const void * ) pSubscriptionList ) );
-        status = MQTTBadParameter;
-    }
-    else if( subscriptionCount == 0UL )
-    {
-        LogError( ( "Subscription count is 0." ) );
-        status = MQTTBadParameter;
-    }
-    else if( packetId == 0U )
-    {
-        LogError( ( "Packet Id for subscription packet is 0." ) );
-        status = MQTTBadParameter;
-    }
-    else
+    assert( pLease != NULL );
+    assert( pOffset != NULL );
+
+    while( ( status == MQTTSuccess ) && ( pContext->index > 0U ) )
     {
-        if( pContext->incomingPublishRecords == NULL )
+        status = MQTT_ProcessIncomingPacketTypeAndLength( pBuffer,
+                                                          &( pContext->index ),
+                                                          &incomingPacket );
+
+        /* The length of the fixed header is only known once it has been
+         * decoded, so it is copied a byte at a time. */
+        if( ( status == MQTTNeedMoreBytes ) &&
+            ( *pOffset < leasedBytes ) &&
+            ( pContext->index < pContext->networkBuffer.size ) )
         {
-            for( iterator = 0U; iterator < subscriptionCount; iterator++ )
+            pBuffer[ pContext->index ] = pLease[ *pOffset ];
+            pContext->index++;
+            ( *pOffset )++;
+            status = MQTTSuccess;
+        }
+        else if( status == MQTTSuccess )
+        {
+            packetLength = ( size_t ) incomingPacket.remainingLength + incomingPacket.headerLength;
+
+            if( packetLength > pContext->networkBuffer.size )
+            {
+                LogError( ( "Incoming packet spanning two leased buffers is bigger than MQTT buffer size. Total packet length %lu",
+                            ( unsigned long ) packetLength ) );
+                status = MQTTRecvFailed;
+            }
+            else
+            {
+                if( packetLength > pContext->index )
+                {
+                    copyLength = packetLength - pContext->index;
+
+                    if( copyLength > ( leasedBytes - *pOffset ) )
+                    {
+                        copyLength = leasedBytes - *pOffset;
+                    }
+
+                    ( void ) memcpy( &pBuffer[ pContext->index ], &pLease[ *pOffset ], copyLength );
+                    pContext->index += copyLength;
+                    *pOffset += copyLength;
+                }
+
+                if( packetLength > pContext->index )
+                {
+                    status = MQTTNeedMoreBytes;
+                }
+                else
+                {
+                    incomingPacket.pRemainingData = &pBuffer[ incomingPacket.headerLength ];
+                    status = handleIncomingPacket( pContext, &incomingPacket, manageKeepAlive );
+
+                    if( status == MQTTSuccess )
+                    {
+                        pContext->index -= packetLength;
+                        ( void ) memmove( pBuffer, &pBuffer[ packetLength ], pContext->index );
+                        pContext->lastPacketRxTime = pContext->getTime();
+                    }
+                }
+            }
+        }
+        else
+        {
+            /* Either the lease is exhausted or the packet is invalid. */
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t receiveLeasedIteration( MQTTContext_t * pContext,
+                                            bool manageKeepAlive )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTStatus_t keepAliveStatus;
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    void * pLeasedBuffer = NULL;
+    uint8_t * pLease = NULL;
+    int32_t leasedBytes;
+    size_t offset = 0U;
+    size_t remainingBytes = 0U;
+    size_t packetLength = 0U;
+
+    assert( pContext != NULL );
+    assert( pContext->recvLease != NULL );
+    assert( pContext->release != NULL );
+
+    leasedBytes = pContext->recvLease( pContext->transportInterface.pNetworkContext,
+                                       &pLeasedBuffer );
+
+    LogTrace( ( "Leased %ld bytes from network.",
+                ( long int ) leasedBytes ) );
+
+    if( leasedBytes < 0 )
+    {
+        /* The receive function has failed. Bubble up the error up to the user. */
+        status = MQTTRecvFailed;
+
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        if( pContext->connectStatus == MQTTConnected )
+        {
+            pContext->connectStatus = MQTTDisconnectPending;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+    else if( leasedBytes == 0 )
+    {
+        status = ( pContext->index == 0U ) ? MQTTNoDataAvailable : MQTTNeedMoreBytes;
+
+        /* No data was received, check for keep alive timeout. */
+        if( manageKeepAlive == true )
+        {
+            keepAliveStatus = handleKeepAlive( pContext );
+
+            if( keepAliveStatus != MQTTSuccess )
+            {
+                LogError( ( "Handling of keep alive failed. Status=%s",
+                            MQTT_Status_strerror( keepAliveStatus ) ) );
+                status = keepAliveStatus;
+            }
+        }
+    }
+    else
+    {
+        pLease = ( uint8_t * ) pLeasedBuffer;
+
+        if( pContext->index > 0U )
+        {
+            status = completeBufferedPackets( pContext, pLease, ( size_t ) leasedBytes,
+                                              &offset, manageKeepAlive );
+        }
+
+        /* Handle the packets contained in the lease in place. */
+        while( ( status == MQTTSuccess ) && ( offset < ( size_t ) leasedBytes ) )
+        {
+            remainingBytes = ( size_t ) leasedBytes - offset;
+
+            status = MQTT_ProcessIncomingPacketTypeAndLength( &pLease[ offset ],
+                                                              &remainingBytes,
+                                                              &incomingPacket );
+
+            if( status == MQTTSuccess )
+            {
+                packetLength = ( size_t ) incomingPacket.remainingLength + incomingPacket.headerLength;
+
+                if( packetLength > remainingBytes )
+                {
+                    status = MQTTNeedMoreBytes;
+                }
+            }
+
+            if( status == MQTTSuccess )
+            {
+                incomingPacket.pRemainingData = &pLease[ offset + incomingPacket.headerLength ];
+                status = handleIncomingPacket( pContext, &incomingPacket, manageKeepAlive );
+
+                if( status == MQTTSuccess )
+                {
+                    offset += packetLength;
+                    pContext->lastPacketRxTime = pContext->getTime();
+                }
+            }
+        }
+
+        /* Keep the bytes which could not be handled in place, a packet
+         * spanning into the next lease or one whose handling failed, as the
+         * lease is handed back to the transport. Bytes following a
+         * disconnection are dropped. */
+        remainingBytes = ( size_t ) leasedBytes - offset;
+
+        if( ( remainingBytes > 0U ) && ( status != MQTTStatusNotConnected ) )
+        {
+            if( remainingBytes > ( pContext->networkBuffer.size - pContext->index ) )
+            {
+                LogError( ( "Unprocessed leased bytes do not fit in the MQTT buffer. Unprocessed length %lu",
+                            ( unsigned long ) remainingBytes ) );
+                status = MQTTRecvFailed;
+            }
+            else
+            {
+                ( void ) memcpy( &( pContext->networkBuffer.pBuffer[ pContext->index ] ),
+                                 &pLease[ offset ],
+                                 remainingBytes );
+                pContext->index += remainingBytes;
+            }
+        }
+
+        pContext->release( pContext->transportInterface.pNetworkContext,
+                           pLeasedBuffer );
+    }
+
+    /* Send the acks for the packets handled in this iteration together. */
+    status = flushStagedAcksAfterReceive( pContext, status );
+
+    if( status == MQTTNoDataAvailable )
+    {
+        /* No data available is not an error. Reset to MQTTSuccess so the
+         * return code will indicate success. */
+        status = MQTTSuccess;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t validateSubscribeUnsubscribeParams( const MQTTContext_t * pContext,
+                                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                                        size_t subscriptionCount,
+                                                        uint16_t packetId,
+                                                        MQTTSubscriptionType_t subscriptionType )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t iterator;
+
+    /* Validate all the parameters. */
+    if( ( pContext == NULL ) || ( pSubscriptionList == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pSubscriptionList=%p.",
+                    ( const void * ) pContext,
+                    ( const void * ) pSubscriptionList ) );
+        status = MQTTBadParameter;
+    }
+    else if( subscriptionCount == 0UL )
+    {
+        LogError( ( "Subscription count is 0." ) );
+        status = MQTTBadParameter;
+    }
+    else if( packetId == 0U )
+    {
+        LogError( ( "Packet Id for subscription packet is 0." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        if( pContext->incomingPublishRecords == NULL )
+        {
+            for( iterator = 0U; iterator < subscriptionCount; iterator++ )
             {
                 if( pSubscriptionList[ iterator ].qos > MQTTQoS0 )
                 {
@@ -2985,73 +5144,103 @@ static MQTTStatus_t sendUnsubscribeWithoutCopy( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
-                                            const MQTTPublishInfo_t * pPublishInfo,
-                                            uint8_t * pMqttHeader,
-                                            size_t headerSize,
+static MQTTStatus_t sendSerializedSubUnsub( MQTTContext_t * pContext,
+                                            const MQTTSubscribeInfo_t * pSubscriptionList,
+                                            size_t subscriptionCount,
                                             uint16_t packetId,
-                                            const MQTTPropBuilder_t * pPropertyBuilder )
+                                            uint32_t remainingLength,
+                                            uint32_t packetSize,
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint8_t packetType )
 {
-    MQTTStatus_t status = MQTTSuccess;
-    size_t ioVectorLength;
-    uint32_t totalMessageLength;
-    uint32_t publishPropLength = 0U;
-    bool dupFlagChanged = false;
+    MQTTStatus_t status;
 
-    /* Bytes required to encode the packet ID in an MQTT header according to
-     * the MQTT specification. */
-    uint8_t serializedPacketID[ 2U ];
+    assert( pContext != NULL );
+    assert( pContext->subscribeBuffer.pBuffer != NULL );
+    assert( packetSize <= pContext->subscribeBuffer.size );
 
-    /**
-     * Maximum number of bytes to send the Property Length.
-     * Property Length  0 + 4 = 4
-     */
-    uint8_t propertyLength[ 4U ];
+    if( packetType == MQTT_PACKET_TYPE_SUBSCRIBE )
+    {
+        status = MQTT_SerializeSubscribe( pSubscriptionList,
+                                          subscriptionCount,
+                                          pPropertyBuilder,
+                                          packetId,
+                                          remainingLength,
+                                          &( pContext->subscribeBuffer ) );
+    }
+    else
+    {
+        status = MQTT_SerializeUnsubscribe( pSubscriptionList,
+                                            subscriptionCount,
+                                            pPropertyBuilder,
+                                            packetId,
+                                            remainingLength,
+                                            &( pContext->subscribeBuffer ) );
+    }
 
-    /* Maximum number of vectors required to encode and send a publish
-     * packet. The breakdown is shown below.
-     * Fixed header (including topic string length)      0 + 1 = 1
-     * Topic string                                        + 1 = 2
-     * Packet ID (only when QoS > QoS0)                    + 1 = 3
-     * Property Length                                     + 1 = 4
-     * Optional Properties                                 + 1 = 5
-     * Payload                                             + 1 = 6  */
-
-    TransportOutVector_t pIoVector[ 6U ];
+    if( status == MQTTSuccess )
+    {
+        if( sendBuffer( pContext, pContext->subscribeBuffer.pBuffer, packetSize ) != ( int32_t ) packetSize )
+        {
+            LogError( ( "Error in sending %s packet",
+                        ( packetType == MQTT_PACKET_TYPE_SUBSCRIBE ) ? "SUBSCRIBE" : "UNSUBSCRIBE" ) );
+            status = MQTTSendFailed;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t appendPublishVectors( const MQTTPublishInfo_t * pPublishInfo,
+                                          uint8_t * pMqttHeader,
+                                          size_t headerSize,
+                                          uint16_t packetId,
+                                          const MQTTPropBuilder_t * pPropertyBuilder,
+                                          uint16_t topicAlias,
+                                          uint8_t * pSerializedPacketId,
+                                          uint8_t * pPropertyLength,
+                                          IoVecState_t * pVecState )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint32_t builderPropLength = 0U;
+    uint32_t publishPropLength = 0U;
     uint8_t * pIndex;
-    TransportOutVector_t * iterator;
+    TransportOutVector_t * iterator = pVecState->pIterator;
 
-    assert( pContext != NULL );
     assert( pPublishInfo != NULL );
     assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pPublishInfo->topicNameLength ) );
     assert( !CHECK_SIZE_T_OVERFLOWS_32BIT( pPublishInfo->payloadLength ) );
     assert( headerSize <= 7U );
 
     /* The header is sent first. */
-    pIoVector[ 0U ].iov_base = pMqttHeader;
-    pIoVector[ 0U ].iov_len = headerSize;
-    totalMessageLength = ( uint32_t ) headerSize;
+    iterator->iov_base = pMqttHeader;
+    iterator->iov_len = headerSize;
+    pVecState->totalMessageLength += ( uint32_t ) headerSize;
+    iterator++;
 
     /* Then the topic name has to be sent. */
-    pIoVector[ 1U ].iov_base = pPublishInfo->pTopicName;
-    pIoVector[ 1U ].iov_len = pPublishInfo->topicNameLength;
-    totalMessageLength += ( uint32_t ) pPublishInfo->topicNameLength;
+    iterator->iov_base = pPublishInfo->pTopicName;
+    iterator->iov_len = pPublishInfo->topicNameLength;
+    pVecState->totalMessageLength += ( uint32_t ) pPublishInfo->topicNameLength;
+    iterator++;
 
-    /* The next field's index should be 2 as the first two fields
-     * have been filled in. */
-    ioVectorLength = 2U;
+    /* The first two fields have been filled in. */
+    pVecState->ioVectorLength += 2U;
 
     if( pPublishInfo->qos > MQTTQoS0 )
     {
         /* Encode the packet ID. */
-        serializedPacketID[ 0 ] = ( ( uint8_t ) ( ( packetId ) >> 8 ) );
-        serializedPacketID[ 1 ] = ( ( uint8_t ) ( ( packetId ) & 0x00ffU ) );
+        pSerializedPacketId[ 0 ] = ( ( uint8_t ) ( ( packetId ) >> 8 ) );
+        pSerializedPacketId[ 1 ] = ( ( uint8_t ) ( ( packetId ) & 0x00ffU ) );
 
-        pIoVector[ ioVectorLength ].iov_base = serializedPacketID;
-        pIoVector[ ioVectorLength ].iov_len = sizeof( serializedPacketID );
+        iterator->iov_base = pSerializedPacketId;
+        iterator->iov_len = 2U;
+        iterator++;
 
-        ioVectorLength++;
-        totalMessageLength += 2U;
+        pVecState->ioVectorLength++;
+        pVecState->totalMessageLength += 2U;
     }
 
     if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
@@ -3059,102 +5248,154 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
         assert( !CHECK_SIZE_T_OVERFLOWS_32BIT( pPropertyBuilder->currentIndex ) );
         assert( pPropertyBuilder->currentIndex < MQTT_REMAINING_LENGTH_INVALID );
 
-        publishPropLength = ( uint32_t ) pPropertyBuilder->currentIndex;
+        builderPropLength = ( uint32_t ) pPropertyBuilder->currentIndex;
+    }
+
+    publishPropLength = builderPropLength;
+
+    if( topicAlias != 0U )
+    {
+        publishPropLength += CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE;
     }
 
-    iterator = &pIoVector[ ioVectorLength ];
-    pIndex = propertyLength;
+    pIndex = pPropertyLength;
     pIndex = encodeVariableLength( pIndex, publishPropLength );
-    iterator->iov_base = propertyLength;
+
+    /* The Topic Alias property goes right after the property length, in the
+     * same vector, ahead of the properties of the builder. */
+    if( topicAlias != 0U )
+    {
+        pIndex[ 0 ] = MQTT_TOPIC_ALIAS_ID;
+        pIndex[ 1 ] = UINT16_HIGH_BYTE( topicAlias );
+        pIndex[ 2 ] = UINT16_LOW_BYTE( topicAlias );
+        pIndex = &pIndex[ CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE ];
+    }
+
+    iterator->iov_base = pPropertyLength;
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
     /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
     /* coverity[misra_c_2012_rule_18_2_violation] */
     /* coverity[misra_c_2012_rule_10_8_violation] */
-    iterator->iov_len = ( size_t ) ( pIndex - propertyLength );
-    totalMessageLength += ( uint32_t ) iterator->iov_len;
+    iterator->iov_len = ( size_t ) ( pIndex - pPropertyLength );
+    pVecState->totalMessageLength += ( uint32_t ) iterator->iov_len;
     iterator++;
-    ioVectorLength++;
+    pVecState->ioVectorLength++;
 
     /* Serialize the publish properties, if provided. */
-    if( publishPropLength > 0U )
+    if( builderPropLength > 0U )
     {
         iterator->iov_base = pPropertyBuilder->pBuffer;
         iterator->iov_len = pPropertyBuilder->currentIndex;
 
         if( CHECK_SIZE_T_OVERFLOWS_32BIT( pPropertyBuilder->currentIndex ) ||
-            ADDITION_WILL_OVERFLOW_U32( totalMessageLength, pPropertyBuilder->currentIndex ) ||
-            ( ( totalMessageLength + pPropertyBuilder->currentIndex ) > MQTT_MAX_PACKET_SIZE ) )
+            ADDITION_WILL_OVERFLOW_U32( pVecState->totalMessageLength, pPropertyBuilder->currentIndex ) ||
+            ( ( pVecState->totalMessageLength + pPropertyBuilder->currentIndex ) > MQTT_MAX_PACKET_SIZE ) )
         {
             LogError( ( "Total MQTT packet size must be less than 268435461." ) );
             status = MQTTBadParameter;
         }
         else
         {
-            totalMessageLength += ( uint32_t ) iterator->iov_len;
+            pVecState->totalMessageLength += ( uint32_t ) iterator->iov_len;
             iterator++;
-            ioVectorLength++;
+            pVecState->ioVectorLength++;
         }
     }
 
     /* Publish packets are allowed to contain no payload. */
     if( ( status == MQTTSuccess ) && ( pPublishInfo->payloadLength > 0U ) )
     {
-        pIoVector[ ioVectorLength ].iov_base = pPublishInfo->pPayload;
-        pIoVector[ ioVectorLength ].iov_len = pPublishInfo->payloadLength;
+        iterator->iov_base = pPublishInfo->pPayload;
+        iterator->iov_len = pPublishInfo->payloadLength;
 
-        if( ADDITION_WILL_OVERFLOW_U32( totalMessageLength, pPublishInfo->payloadLength ) ||
-            ( ( totalMessageLength + pPublishInfo->payloadLength ) > MQTT_MAX_PACKET_SIZE ) )
+        if( ADDITION_WILL_OVERFLOW_U32( pVecState->totalMessageLength, pPublishInfo->payloadLength ) ||
+            ( ( pVecState->totalMessageLength + pPublishInfo->payloadLength ) > MQTT_MAX_PACKET_SIZE ) )
         {
             LogError( ( "Total MQTT packet size must be less than 268435461." ) );
             status = MQTTBadParameter;
         }
         else
         {
-            ioVectorLength++;
-            totalMessageLength += ( uint32_t ) pPublishInfo->payloadLength;
+            iterator++;
+            pVecState->ioVectorLength++;
+            pVecState->totalMessageLength += ( uint32_t ) pPublishInfo->payloadLength;
         }
     }
 
-    /* Store a copy of the publish for retransmission purposes. */
-    if( ( status == MQTTSuccess ) &&
-        ( pPublishInfo->qos > MQTTQoS0 ) &&
-        ( pContext->storeFunction != NULL ) )
-    {
-        /* If not already set, set the dup flag before storing a copy of the publish
-         * this is because on retrieving back this copy we will get it in the form of an
-         * array of TransportOutVector_t that holds the data in a const pointer which cannot be
-         * changed after retrieving. */
-        if( pPublishInfo->dup != true )
-        {
-            status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, true );
+    pVecState->pIterator = iterator;
 
-            dupFlagChanged = ( status == MQTTSuccess );
-        }
+    return status;
+}
 
-        if( status == MQTTSuccess )
-        {
-            MQTTVec_t mqttVec;
+/*-----------------------------------------------------------*/
 
-            mqttVec.pVector = pIoVector;
-            mqttVec.vectorLen = ioVectorLength;
+static MQTTStatus_t storeOutgoingPublish( MQTTContext_t * pContext,
+                                          const MQTTPublishInfo_t * pPublishInfo,
+                                          uint16_t packetId,
+                                          uint8_t * pMqttHeader,
+                                          TransportOutVector_t * pIoVector,
+                                          size_t ioVectorLength,
+                                          const MQTTPayloadReference_t * pPayloadReference )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    bool dupFlagChanged = false;
+    MQTTVec_t mqttVec;
 
-            if( pContext->storeFunction( pContext, ( uint32_t ) packetId, &mqttVec ) != true )
-            {
-                status = MQTTPublishStoreFailed;
-            }
+    assert( pContext != NULL );
+    assert( pContext->storeFunction != NULL );
+
+    /* If not already set, set the dup flag before storing a copy of the publish
+     * this is because on retrieving back this copy we will get it in the form of an
+     * array of TransportOutVector_t that holds the data in a const pointer which cannot be
+     * changed after retrieving. */
+    if( pPublishInfo->dup != true )
+    {
+        status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, true );
+
+        dupFlagChanged = ( status == MQTTSuccess );
+    }
+
+    /* The payload is kept by reference when it is the last vector of the
+     * packet, so that only the bytes before it are copied. */
+    if( ( status == MQTTSuccess ) &&
+        ( pContext->storeReferenceFunction != NULL ) &&
+        ( pPayloadReference != NULL ) &&
+        ( pPublishInfo->payloadLength > 0U ) &&
+        ( ioVectorLength > 1U ) &&
+        ( pIoVector[ ioVectorLength - 1U ].iov_base == pPublishInfo->pPayload ) &&
+        ( pIoVector[ ioVectorLength - 1U ].iov_len == pPublishInfo->payloadLength ) )
+    {
+        mqttVec.pVector = pIoVector;
+        mqttVec.vectorLen = ioVectorLength - 1U;
+
+        if( pContext->storeReferenceFunction( pContext,
+                                              ( uint32_t ) packetId,
+                                              &mqttVec,
+                                              pPublishInfo,
+                                              pPayloadReference ) != true )
+        {
+            status = MQTTPublishStoreFailed;
         }
+    }
+    else if( status == MQTTSuccess )
+    {
+        mqttVec.pVector = pIoVector;
+        mqttVec.vectorLen = ioVectorLength;
 
-        /* change the value of the dup flag to its original, if it was changed */
-        if( ( status == MQTTSuccess ) && ( dupFlagChanged == true ) )
+        if( pContext->storeFunction( pContext, ( uint32_t ) packetId, &mqttVec ) != true )
         {
-            status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, false );
+            status = MQTTPublishStoreFailed;
         }
     }
+    else
+    {
+        /* MISRA Empty body */
+    }
 
-    if( ( status == MQTTSuccess ) &&
-        ( sendMessageVector( pContext, pIoVector, ioVectorLength ) != ( int32_t ) totalMessageLength ) )
+    /* change the value of the dup flag to its original, if it was changed */
+    if( ( status == MQTTSuccess ) && ( dupFlagChanged == true ) )
     {
-        status = MQTTSendFailed;
+        status = MQTT_UpdateDuplicatePublishFlag( pMqttHeader, false );
     }
 
     return status;
@@ -3162,18 +5403,446 @@ static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Tracks the state of building a scatter-gather IO vector list.
- *
- * Groups the iterator, vector count, and accumulated message length
- * that are always passed together when appending to an IO vector.
- */
-typedef struct IoVecState
+static MQTTStatus_t appendPayloadSegments( const TransportOutVector_t * pPayloadSegments,
+                                           size_t payloadSegmentCount,
+                                           IoVecState_t * pVecState )
 {
-    TransportOutVector_t * pIterator; /**< Current position in the IO vector array. */
-    size_t ioVectorLength;            /**< Number of vectors added so far. */
-    uint32_t totalMessageLength;      /**< Accumulated byte count across all vectors. */
-} IoVecState_t;
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index = 0U;
+
+    assert( pPayloadSegments != NULL );
+    assert( payloadSegmentCount <= MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS );
+
+    while( ( status == MQTTSuccess ) && ( index < payloadSegmentCount ) )
+    {
+        if( ADDITION_WILL_OVERFLOW_U32( pVecState->totalMessageLength, pPayloadSegments[ index ].iov_len ) ||
+            ( ( pVecState->totalMessageLength + pPayloadSegments[ index ].iov_len ) > MQTT_MAX_PACKET_SIZE ) )
+        {
+            LogError( ( "Total MQTT packet size must be less than 268435461." ) );
+            status = MQTTBadParameter;
+        }
+        else if( pPayloadSegments[ index ].iov_len > 0U )
+        {
+            /* Only the vector is copied, as the transport may update it while
+             * sending. */
+            *( pVecState->pIterator ) = pPayloadSegments[ index ];
+            pVecState->pIterator++;
+            pVecState->ioVectorLength++;
+            pVecState->totalMessageLength += ( uint32_t ) pPayloadSegments[ index ].iov_len;
+        }
+        else
+        {
+            /* Empty segments are not sent. */
+        }
+
+        index++;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendPublishWithoutCopy( MQTTContext_t * pContext,
+                                            const MQTTPublishInfo_t * pPublishInfo,
+                                            uint8_t * pMqttHeader,
+                                            size_t headerSize,
+                                            uint16_t packetId,
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint16_t topicAlias,
+                                            const TransportOutVector_t * pPayloadSegments,
+                                            size_t payloadSegmentCount,
+                                            const MQTTPayloadReference_t * pPayloadReference )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t segmentedPublishInfo;
+    const MQTTPublishInfo_t * pVectorPublishInfo = pPublishInfo;
+
+    /* Bytes required to encode the packet ID in an MQTT header according to
+     * the MQTT specification. */
+    uint8_t serializedPacketID[ 2U ];
+
+    /**
+     * Maximum number of bytes to send the Property Length, and the Topic Alias
+     * property which follows it.
+     * Property Length  0 + 4 = 4
+     * Topic Alias        + 3 = 7
+     */
+    uint8_t propertyLength[ 4U + CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE ];
+
+    /* Maximum number of vectors required to encode and send a publish
+     * packet. */
+    TransportOutVector_t pIoVector[ CORE_MQTT_PUBLISH_MAX_SEGMENTED_VECTOR_LENGTH ];
+    IoVecState_t vecState;
+
+    assert( pContext != NULL );
+
+    vecState.pIterator = pIoVector;
+    vecState.ioVectorLength = 0U;
+    vecState.totalMessageLength = 0U;
+
+    /* A segmented payload is added after the rest of the packet. */
+    if( pPayloadSegments != NULL )
+    {
+        segmentedPublishInfo = *pPublishInfo;
+        segmentedPublishInfo.payloadLength = 0U;
+        pVectorPublishInfo = &segmentedPublishInfo;
+    }
+
+    status = appendPublishVectors( pVectorPublishInfo,
+                                   pMqttHeader,
+                                   headerSize,
+                                   packetId,
+                                   pPropertyBuilder,
+                                   topicAlias,
+                                   serializedPacketID,
+                                   propertyLength,
+                                   &vecState );
+
+    if( ( status == MQTTSuccess ) && ( pPayloadSegments != NULL ) )
+    {
+        status = appendPayloadSegments( pPayloadSegments, payloadSegmentCount, &vecState );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        status = storeAndSendPublish( pContext,
+                                      pPublishInfo,
+                                      packetId,
+                                      pMqttHeader,
+                                      pIoVector,
+                                      &vecState,
+                                      pPayloadReference );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t storeAndSendPublish( MQTTContext_t * pContext,
+                                         const MQTTPublishInfo_t * pPublishInfo,
+                                         uint16_t packetId,
+                                         uint8_t * pMqttHeader,
+                                         TransportOutVector_t * pIoVector,
+                                         const IoVecState_t * pVecState,
+                                         const MQTTPayloadReference_t * pPayloadReference )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    /* Store a copy of the publish for retransmission purposes. */
+    if( ( pPublishInfo->qos > MQTTQoS0 ) &&
+        ( pContext->storeFunction != NULL ) )
+    {
+        status = storeOutgoingPublish( pContext,
+                                       pPublishInfo,
+                                       packetId,
+                                       pMqttHeader,
+                                       pIoVector,
+                                       pVecState->ioVectorLength,
+                                       pPayloadReference );
+    }
+
+    if( ( status == MQTTSuccess ) &&
+        ( sendMessageVector( pContext, pIoVector, pVecState->ioVectorLength ) != ( int32_t ) pVecState->totalMessageLength ) )
+    {
+        status = MQTTSendFailed;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendPreparedPublish( MQTTContext_t * pContext,
+                                         const MQTTPublishTemplate_t * pTemplate,
+                                         uint8_t * pMqttHeader,
+                                         size_t headerSize,
+                                         const void * pPayload,
+                                         size_t payloadLength,
+                                         uint16_t packetId )
+{
+    const MQTTPublishInfo_t * pPublishInfo = &pTemplate->publishInfo;
+    uint8_t serializedPacketID[ 2U ];
+    TransportOutVector_t pIoVector[ CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH ];
+    IoVecState_t vecState;
+
+    assert( headerSize <= 7U );
+
+    vecState.pIterator = pIoVector;
+    vecState.ioVectorLength = 0U;
+    vecState.totalMessageLength = 0U;
+
+    /* The length of the packet was checked by the caller, so the vectors are
+     * added without checks. */
+    appendPreparedVector( pMqttHeader, headerSize, &vecState );
+    appendPreparedVector( pPublishInfo->pTopicName, pPublishInfo->topicNameLength, &vecState );
+
+    if( pPublishInfo->qos > MQTTQoS0 )
+    {
+        serializedPacketID[ 0 ] = UINT16_HIGH_BYTE( packetId );
+        serializedPacketID[ 1 ] = UINT16_LOW_BYTE( packetId );
+        appendPreparedVector( serializedPacketID, 2U, &vecState );
+    }
+
+    appendPreparedVector( pTemplate->propertyLength, pTemplate->propertyLengthSize, &vecState );
+
+    if( pTemplate->propertiesLength > 0U )
+    {
+        appendPreparedVector( pTemplate->pProperties, pTemplate->propertiesLength, &vecState );
+    }
+
+    if( payloadLength > 0U )
+    {
+        appendPreparedVector( pPayload, payloadLength, &vecState );
+    }
+
+    return storeAndSendPublish( pContext,
+                                pPublishInfo,
+                                packetId,
+                                pMqttHeader,
+                                pIoVector,
+                                &vecState,
+                                NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static void appendPreparedVector( const void * pData,
+                                  size_t length,
+                                  IoVecState_t * pVecState )
+{
+    pVecState->pIterator->iov_base = pData;
+    pVecState->pIterator->iov_len = length;
+    pVecState->pIterator++;
+    pVecState->ioVectorLength++;
+    pVecState->totalMessageLength += ( uint32_t ) length;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t flushPublishBatch( MQTTContext_t * pContext,
+                                       const MQTTPublishInfo_t * pPublishInfo,
+                                       const uint16_t * pPacketIds,
+                                       size_t firstIndex,
+                                       size_t endIndex,
+                                       TransportOutVector_t * pIoVector,
+                                       const IoVecState_t * pVecState,
+                                       MQTTStatus_t * pPublishStatus )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishState_t publishStatus = MQTTStateNull;
+    size_t index;
+
+    assert( pVecState->ioVectorLength > 0U );
+
+    if( sendMessageVector( pContext, pIoVector, pVecState->ioVectorLength ) != ( int32_t ) pVecState->totalMessageLength )
+    {
+        LogError( ( "Error in sending a batch of PUBLISH packets." ) );
+        status = MQTTSendFailed;
+    }
+
+    for( index = firstIndex; index < endIndex; index++ )
+    {
+        if( pPublishStatus[ index ] != MQTTSuccess )
+        {
+            /* This packet was not gathered. */
+        }
+        else if( status != MQTTSuccess )
+        {
+            pPublishStatus[ index ] = status;
+        }
+        else if( pPublishInfo[ index ].qos > MQTTQoS0 )
+        {
+            /* Update state machine after PUBLISH is sent.
+             * Only to be done for QoS1 or QoS2. */
+            pPublishStatus[ index ] = MQTT_UpdateStatePublish( pContext,
+                                                               pPacketIds[ index ],
+                                                               MQTT_SEND,
+                                                               pPublishInfo[ index ].qos,
+                                                               &publishStatus );
+
+            if( pPublishStatus[ index ] != MQTTSuccess )
+            {
+                LogError( ( "Update state for publish failed with status %s."
+                            " However PUBLISH packet was sent to the broker."
+                            " Any further handling of ACKs for the packet Id"
+                            " will fail.",
+                            MQTT_Status_strerror( pPublishStatus[ index ] ) ) );
+            }
+        }
+        else
+        {
+            /* Nothing to update for QoS 0. */
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void sendPublishBatch( MQTTContext_t * pContext,
+                              const MQTTPublishInfo_t * pPublishInfo,
+                              const uint16_t * pPacketIds,
+                              const MQTTPropBuilder_t * const * pPropertyBuilders,
+                              size_t publishCount,
+                              MQTTStatus_t * pPublishStatus )
+{
+    MQTTStatus_t status;
+    MQTTStatus_t sendStatus = MQTTSuccess;
+    TransportOutVector_t pIoVector[ MQTT_PUBLISH_BATCH_MAX_VECTORS ];
+    PublishBatchEntry_t entries[ MQTT_PUBLISH_BATCH_MAX_VECTORS / CORE_MQTT_PUBLISH_MIN_VECTOR_LENGTH ];
+    const size_t maxEntryCount = sizeof( entries ) / sizeof( entries[ 0 ] );
+    IoVecState_t vecState;
+    IoVecState_t savedVecState;
+    size_t entryCount = 0U;
+    size_t firstIndex = 0U;
+    size_t index;
+    size_t headerSize = 0U;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    uint16_t packetId;
+    bool stateReserved;
+    const MQTTPropBuilder_t * pPropertyBuilder;
+    MQTTConnectionStatus_t connectStatus;
+
+    vecState.pIterator = pIoVector;
+    vecState.ioVectorLength = 0U;
+    vecState.totalMessageLength = 0U;
+
+    for( index = 0U; index < publishCount; index++ )
+    {
+        status = pPublishStatus[ index ];
+        packetId = ( pPacketIds != NULL ) ? pPacketIds[ index ] : 0U;
+        pPropertyBuilder = ( pPropertyBuilders != NULL ) ? pPropertyBuilders[ index ] : NULL;
+        connectStatus = pContext->connectStatus;
+        stateReserved = false;
+
+        if( status != MQTTSuccess )
+        {
+            /* The packet failed validation. */
+        }
+        else if( sendStatus != MQTTSuccess )
+        {
+            /* Nothing more is written once a write failed part way. */
+            status = sendStatus;
+        }
+        else if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+        else
+        {
+            status = MQTT_GetPublishPacketSize( &pPublishInfo[ index ],
+                                                pPropertyBuilder,
+                                                &remainingLength,
+                                                &packetSize,
+                                                pContext->connectionProperties.serverMaxPacketSize );
+        }
+
+        /* Send the packets gathered so far if this one does not fit. */
+        if( ( status == MQTTSuccess ) &&
+            ( entryCount > 0U ) &&
+            ( ( entryCount == maxEntryCount ) ||
+              ( vecState.ioVectorLength > ( MQTT_PUBLISH_BATCH_MAX_VECTORS - CORE_MQTT_PUBLISH_MAX_VECTOR_LENGTH ) ) ||
+              ( packetSize > ( MQTT_MAX_PACKET_SIZE - vecState.totalMessageLength ) ) ) )
+        {
+            sendStatus = flushPublishBatch( pContext, pPublishInfo, pPacketIds,
+                                            firstIndex, index, pIoVector, &vecState, pPublishStatus );
+            status = sendStatus;
+
+            vecState.pIterator = pIoVector;
+            vecState.ioVectorLength = 0U;
+            vecState.totalMessageLength = 0U;
+            entryCount = 0U;
+            firstIndex = index;
+        }
+
+        if( status == MQTTSuccess )
+        {
+            status = MQTT_SerializePublishHeaderWithoutTopic( &pPublishInfo[ index ],
+                                                              remainingLength,
+                                                              entries[ entryCount ].header,
+                                                              &headerSize );
+        }
+
+        if( ( status == MQTTSuccess ) && ( pPublishInfo[ index ].qos > MQTTQoS0 ) )
+        {
+            status = MQTT_ReserveState( pContext,
+                                        packetId,
+                                        pPublishInfo[ index ].qos );
+
+            if( status == MQTTSuccess )
+            {
+                stateReserved = true;
+            }
+            /* State already exists for a duplicate packet. */
+            else if( ( status == MQTTStateCollision ) && ( pPublishInfo[ index ].dup == true ) )
+            {
+                status = MQTTSuccess;
+            }
+            else
+            {
+                /* MISRA Empty body */
+            }
+        }
+
+        if( status == MQTTSuccess )
+        {
+            savedVecState = vecState;
+
+            status = appendPublishVectors( &pPublishInfo[ index ],
+                                           entries[ entryCount ].header,
+                                           headerSize,
+                                           packetId,
+                                           pPropertyBuilder,
+                                           0U,
+                                           entries[ entryCount ].packetId,
+                                           entries[ entryCount ].propertyLength,
+                                           &vecState );
+
+            if( ( status == MQTTSuccess ) &&
+                ( pPublishInfo[ index ].qos > MQTTQoS0 ) &&
+                ( pContext->storeFunction != NULL ) )
+            {
+                status = storeOutgoingPublish( pContext,
+                                               &pPublishInfo[ index ],
+                                               packetId,
+                                               entries[ entryCount ].header,
+                                               savedVecState.pIterator,
+                                               vecState.ioVectorLength - savedVecState.ioVectorLength,
+                                               NULL );
+            }
+
+            if( status == MQTTSuccess )
+            {
+                entryCount++;
+            }
+            else
+            {
+                /* Drop the vectors of this packet, and free the state
+                 * reserved for it as it is never sent. */
+                vecState = savedVecState;
+
+                if( stateReserved )
+                {
+                    ( void ) MQTT_RemoveStateRecord( pContext, packetId );
+                }
+            }
+        }
+
+        pPublishStatus[ index ] = status;
+    }
+
+    if( entryCount > 0U )
+    {
+        ( void ) flushPublishBatch( pContext, pPublishInfo, pPacketIds,
+                                    firstIndex, publishCount, pIoVector, &vecState, pPublishStatus );
+    }
+}
+
+/*-----------------------------------------------------------*/
 
 /**
  * @brief Add an encoded string to the IO vector if it fits within maxPacketSize.
@@ -3462,10 +6131,15 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
     MQTTStatus_t status = MQTTSuccess;
     MQTTGetCurrentTimeFunc_t getTimeStamp = NULL;
     uint32_t entryTimeMs = 0U;
+    uint32_t elapsedTimeMs = 0U;
     bool breakFromLoop = false;
     uint16_t loopCount = 0U;
     MQTTDeserializedInfo_t deserializedInfo = { 0 };
     MQTTPropBuilder_t propBuffer = { 0 };
+    uint8_t stagingBuffer[ CORE_MQTT_CONNACK_STAGING_BUFFER_SIZE ] = { 0 };
+    size_t stagedBytes = 0U;
+    size_t stagedDataLength = 0U;
+    const uint8_t * pStagedData = NULL;
 
     assert( pContext != NULL );
     assert( pIncomingPacket != NULL );
@@ -3479,12 +6153,16 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
     do
     {
         /* Transport read for incoming CONNACK packet type and length.
-         * MQTT_GetIncomingPacketTypeAndLength is a blocking call and it is
-         * returned after a transport receive timeout, an error, or a successful
-         * receive of packet type and length. */
-        status = MQTT_GetIncomingPacketTypeAndLength( pContext->transportInterface.recv,
-                                                      pContext->transportInterface.pNetworkContext,
-                                                      pIncomingPacket );
+         * The fixed header is read ahead into a staging buffer so that it
+         * usually takes a single transport read instead of one per byte.
+         * The call returns after a transport receive timeout, an error, or a
+         * successful receive of packet type and length. */
+        status = MQTT_GetIncomingPacketTypeAndLengthBuffered( pContext->transportInterface.recv,
+                                                              pContext->transportInterface.pNetworkContext,
+                                                              stagingBuffer,
+                                                              sizeof( stagingBuffer ),
+                                                              &stagedBytes,
+                                                              pIncomingPacket );
 
         /* The loop times out based on 2 conditions.
          * 1. If timeoutMs is greater than 0:
@@ -3497,7 +6175,8 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
          *    A value of 0 for the config will try once to read CONNACK. */
         if( timeoutMs > 0U )
         {
-            breakFromLoop = calculateElapsedTime( getTimeStamp(), entryTimeMs ) >= timeoutMs;
+            elapsedTimeMs = calculateElapsedTime( getTimeStamp(), entryTimeMs );
+            breakFromLoop = elapsedTimeMs >= timeoutMs;
         }
         else
         {
@@ -3505,8 +6184,26 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
             loopCount++;
         }
 
-        /* Loop until there is data to read or if we have exceeded the timeout/retries. */
-    } while( ( status == MQTTNoDataAvailable ) && ( breakFromLoop == false ) );
+        /* Block for the remaining time instead of polling, when possible. */
+        if( ( ( status == MQTTNoDataAvailable ) || ( status == MQTTNeedMoreBytes ) ) &&
+            ( breakFromLoop == false ) &&
+            ( timeoutMs > 0U ) )
+        {
+            if( waitForReadable( pContext, timeoutMs - elapsedTimeMs ) != MQTTSuccess )
+            {
+                status = MQTTRecvFailed;
+            }
+        }
+
+        /* Loop until the fixed header is read or if we have exceeded the timeout/retries. */
+    } while( ( ( status == MQTTNoDataAvailable ) || ( status == MQTTNeedMoreBytes ) ) &&
+             ( breakFromLoop == false ) );
+
+    if( status == MQTTNeedMoreBytes )
+    {
+        LogError( ( "Timed out after receiving a partial CONNACK header." ) );
+        status = MQTTRecvFailed;
+    }
 
     if( status == MQTTSuccess )
     {
@@ -3516,8 +6213,17 @@ static MQTTStatus_t receiveConnack( MQTTContext_t * pContext,
          * recv from network once. */
         if( pIncomingPacket->type == MQTT_PACKET_TYPE_CONNACK )
         {
+            /* Bytes read past the fixed header belong to the CONNACK. */
+            if( stagedBytes > pIncomingPacket->headerLength )
+            {
+                pStagedData = &( stagingBuffer[ pIncomingPacket->headerLength ] );
+                stagedDataLength = stagedBytes - pIncomingPacket->headerLength;
+            }
+
             status = receiveConnackPacket( pContext,
-                                           *pIncomingPacket );
+                                           *pIncomingPacket,
+                                           pStagedData,
+                                           stagedDataLength );
         }
         /* TODO: Handle AUTH packets here as well. */
         else
@@ -3647,7 +6353,12 @@ static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext )
         {
             packetId = MQTT_PublishToResend( pContext, &cursor );
 
-            if( packetId != MQTT_PACKET_ID_INVALID )
+            if( ( packetId != MQTT_PACKET_ID_INVALID ) &&
+                ( pContext->retrieveReferenceFunction != NULL ) )
+            {
+                status = resendPublishByReference( pContext, packetId );
+            }
+            else if( packetId != MQTT_PACKET_ID_INVALID )
             {
                 if( pContext->retrieveFunction( pContext, ( uint32_t ) packetId, &pMqttPacket, &totalMessageLength ) != true )
                 {
@@ -3672,6 +6383,10 @@ static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext )
                     MQTT_POST_STATE_UPDATE_HOOK( pContext );
                 }
             }
+            else
+            {
+                /* MISRA Empty body */
+            }
         } while( ( packetId != MQTT_PACKET_ID_INVALID ) &&
                  ( status == MQTTSuccess ) );
     }
@@ -3681,16 +6396,219 @@ static MQTTStatus_t handleUncleanSessionResumption( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
+static MQTTStatus_t resendPublishByReference( MQTTContext_t * pContext,
+                                              uint16_t packetId )
 {
     MQTTStatus_t status = MQTTSuccess;
-    MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
-    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    TransportOutVector_t packetVectors[ MQTT_RETRIEVED_PUBLISH_MAX_VECTORS ];
+    size_t vectorCount = 0U;
+    size_t totalMessageLength = 0U;
+    size_t index;
+
+    assert( pContext != NULL );
+    assert( pContext->retrieveReferenceFunction != NULL );
+
+    if( pContext->retrieveReferenceFunction( pContext, ( uint32_t ) packetId, packetVectors, &vectorCount ) != true )
+    {
+        LogError( ( "Failed to retrieve publish with packet ID %u", packetId ) );
+        status = MQTTPublishRetrieveFailed;
+    }
+    else if( ( vectorCount == 0U ) || ( vectorCount > MQTT_RETRIEVED_PUBLISH_MAX_VECTORS ) )
+    {
+        LogError( ( "Retrieve function returned %lu vectors for the publish with packet ID %u.",
+                    ( unsigned long ) vectorCount,
+                    packetId ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        for( index = 0U; ( index < vectorCount ) && ( status == MQTTSuccess ); index++ )
+        {
+            if( ( packetVectors[ index ].iov_base == NULL ) ||
+                ( packetVectors[ index ].iov_len > ( MQTT_MAX_PACKET_SIZE - totalMessageLength ) ) )
+            {
+                LogError( ( "Total packet size returned by the retrieve function exceeds the MQTT Max packet size." ) );
+                status = MQTTBadParameter;
+            }
+            else
+            {
+                totalMessageLength += packetVectors[ index ].iov_len;
+            }
+        }
+    }
+
+    if( ( status == MQTTSuccess ) && ( totalMessageLength == 0U ) )
+    {
+        LogError( ( "Retrieve function returned an empty publish with packet ID %u.", packetId ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        if( sendMessageVector( pContext, packetVectors, vectorCount ) != ( int32_t ) totalMessageLength )
+        {
+            status = MQTTSendFailed;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t resendStoredPacketBatches( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTStateCursor_t pubrelCursor = MQTT_STATE_CURSOR_INITIALIZER;
+    MQTTStateCursor_t publishCursor = MQTT_STATE_CURSOR_INITIALIZER;
+    MQTTPublishState_t state = MQTTStateNull;
+    uint16_t packetId;
+    uint32_t handles[ MQTT_PUBLISH_BATCH_MAX_VECTORS ];
+    size_t handleCount = 0U;
+    bool pubrelsDone = false;
+    bool publishesDone = false;
+
+    assert( pContext != NULL );
+    assert( pContext->retrieveBatchFunction != NULL );
+
+    /* Gather the PUBREL packets first and then the PUBLISH packets, in the
+     * order they are resent one by one. */
+    while( ( status == MQTTSuccess ) && ( publishesDone == false ) )
+    {
+        if( pubrelsDone == false )
+        {
+            packetId = MQTT_PubrelToResend( pContext, &pubrelCursor, &state );
+
+            if( packetId == MQTT_PACKET_ID_INVALID )
+            {
+                pubrelsDone = true;
+            }
+            else
+            {
+                handles[ handleCount ] = SET_INCOMING_PUB_FLAG( packetId );
+                handleCount++;
+            }
+        }
+        else
+        {
+            packetId = MQTT_PublishToResend( pContext, &publishCursor );
+
+            if( packetId == MQTT_PACKET_ID_INVALID )
+            {
+                publishesDone = true;
+            }
+            else
+            {
+                handles[ handleCount ] = ( uint32_t ) packetId;
+                handleCount++;
+            }
+        }
+
+        if( ( handleCount == MQTT_PUBLISH_BATCH_MAX_VECTORS ) ||
+            ( ( publishesDone == true ) && ( handleCount > 0U ) ) )
+        {
+            status = resendPacketBatch( pContext, handles, handleCount );
+            handleCount = 0U;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t resendPacketBatch( MQTTContext_t * pContext,
+                                       const uint32_t * pHandles,
+                                       size_t handleCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    TransportOutVector_t pIoVector[ MQTT_PUBLISH_BATCH_MAX_VECTORS ];
+    size_t index = 0U;
+    size_t firstIndex = 0U;
+    size_t packetLength;
+    uint32_t totalMessageLength = 0U;
+
+    assert( pContext != NULL );
+    assert( pHandles != NULL );
+    assert( ( handleCount > 0U ) && ( handleCount <= MQTT_PUBLISH_BATCH_MAX_VECTORS ) );
+
+    ( void ) memset( pIoVector, 0, sizeof( pIoVector ) );
+
+    if( pContext->retrieveBatchFunction( pContext, pHandles, handleCount, pIoVector ) != true )
+    {
+        LogError( ( "Failed to retrieve %lu packets to resend.",
+                    ( unsigned long ) handleCount ) );
+        status = MQTTPublishRetrieveFailed;
+    }
+
+    while( ( status == MQTTSuccess ) && ( index <= handleCount ) )
+    {
+        packetLength = ( index < handleCount ) ? pIoVector[ index ].iov_len : 0U;
+
+        if( ( index < handleCount ) &&
+            ( ( pIoVector[ index ].iov_base == NULL ) ||
+              ( packetLength == 0U ) ||
+              CHECK_SIZE_T_OVERFLOWS_32BIT( packetLength ) ||
+              ( packetLength > MQTT_MAX_PACKET_SIZE ) ) )
+        {
+            LogError( ( "Packet returned by the retrieve function for handle %lu is invalid.",
+                        ( unsigned long ) pHandles[ index ] ) );
+            status = MQTTBadParameter;
+        }
+        else if( ( index < handleCount ) &&
+                 ( ( uint32_t ) packetLength <= ( MQTT_MAX_PACKET_SIZE - totalMessageLength ) ) )
+        {
+            /* The packet is sent with the ones before it. */
+            totalMessageLength += ( uint32_t ) packetLength;
+            index++;
+        }
+        else
+        {
+            /* Send the packets gathered so far, then start again from this
+             * one. */
+            MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+            if( sendMessageVector( pContext, &( pIoVector[ firstIndex ] ), index - firstIndex ) != ( int32_t ) totalMessageLength )
+            {
+                LogError( ( "Failed to resend %lu packets.",
+                            ( unsigned long ) ( index - firstIndex ) ) );
+                status = MQTTSendFailed;
+            }
+
+            MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+            firstIndex = index;
+            totalMessageLength = 0U;
+
+            if( index == handleCount )
+            {
+                /* All the packets are sent. */
+                index++;
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTStateCursor_t cursor = MQTT_STATE_CURSOR_INITIALIZER;
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
 
     assert( pContext != NULL );
 
     /* Reset the index and clear the buffer when a new session is established. */
     pContext->index = 0;
+    pContext->headIndex = 0;
+    pContext->ackStagedCount = 0;
     ( void ) memset( pContext->networkBuffer.pBuffer, 0, pContext->networkBuffer.size );
 
     if( pContext->outgoingPublishRecordMaxCount > 0U )
@@ -3715,6 +6633,13 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
         ( void ) memset( pContext->outgoingPublishRecords,
                          0x00,
                          pContext->outgoingPublishRecordMaxCount * sizeof( *pContext->outgoingPublishRecords ) );
+
+        if( pContext->pOutgoingPublishIndex != NULL )
+        {
+            MQTT_ResetStateIndex( pContext->pOutgoingPublishIndex,
+                                  pContext->outgoingPublishRecords,
+                                  pContext->outgoingPublishRecordMaxCount );
+        }
     }
 
     if( pContext->incomingPublishRecordMaxCount > 0U )
@@ -3740,6 +6665,13 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
         ( void ) memset( pContext->incomingPublishRecords,
                          0x00,
                          pContext->incomingPublishRecordMaxCount * sizeof( *pContext->incomingPublishRecords ) );
+
+        if( pContext->pIncomingPublishIndex != NULL )
+        {
+            MQTT_ResetStateIndex( pContext->pIncomingPublishIndex,
+                                  pContext->incomingPublishRecords,
+                                  pContext->incomingPublishRecordMaxCount );
+        }
     }
 
     return status;
@@ -3747,479 +6679,568 @@ static MQTTStatus_t handleCleanSession( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
-                                           const MQTTPublishInfo_t * pPublishInfo,
-                                           uint16_t packetId )
+static bool isPropertyBuilderSealed( const MQTTPropBuilder_t * pPropertyBuilder,
+                                     uint8_t packetType )
 {
-    MQTTStatus_t status = MQTTSuccess;
-
-    /* Validate arguments. */
-    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) )
-    {
-        LogError( ( "Argument cannot be NULL: pContext=%p, "
-                    "pPublishInfo=%p.",
-                    ( const void * ) pContext,
-                    ( const void * ) pPublishInfo ) );
-        status = MQTTBadParameter;
-    }
-    else if( ( pPublishInfo->qos != MQTTQoS0 ) && ( packetId == 0U ) )
-    {
-        LogError( ( "Packet Id is 0 for PUBLISH with QoS=%u.",
-                    ( unsigned int ) pPublishInfo->qos ) );
-        status = MQTTBadParameter;
-    }
-    else if( ( pPublishInfo->payloadLength > 0U ) && ( pPublishInfo->pPayload == NULL ) )
-    {
-        LogError( ( "A nonzero payload length requires a non-NULL payload: "
-                    "payloadLength=%lu, pPayload=%p.",
-                    ( unsigned long ) pPublishInfo->payloadLength,
-                    pPublishInfo->pPayload ) );
-        status = MQTTBadParameter;
-    }
-    else if( CHECK_SIZE_T_OVERFLOWS_16BIT( pPublishInfo->topicNameLength ) )
-    {
-        LogError( ( "Topic name length must be less than 65536." ) );
-        status = MQTTBadParameter;
-    }
-    else if( CHECK_SIZE_T_OVERFLOWS_32BIT( pPublishInfo->payloadLength ) ||
-             ( pPublishInfo->payloadLength >= MQTT_REMAINING_LENGTH_INVALID ) )
-    {
-        LogError( ( "pPublishInfo->payloadLength must be less than %" PRIu32, MQTT_REMAINING_LENGTH_INVALID ) );
-        status = MQTTBadParameter;
-    }
-    else if( ( pContext->outgoingPublishRecords == NULL ) && ( pPublishInfo->qos > MQTTQoS0 ) )
-    {
-        LogError( ( "Trying to publish a QoS > MQTTQoS0 packet when outgoing publishes "
-                    "for QoS1/QoS2 have not been enabled. Please, call MQTT_InitStatefulQoS "
-                    "to initialize and enable the use of QoS1/QoS2 publishes." ) );
-        status = MQTTBadParameter;
-    }
-    else
-    {
-        /* MISRA else */
-    }
+    assert( pPropertyBuilder != NULL );
 
-    return status;
+    /* Adding a property changes the length of the properties, and the fields
+     * set for most properties. */
+    return ( pPropertyBuilder->seal.packetType == packetType ) &&
+           ( pPropertyBuilder->seal.length == pPropertyBuilder->currentIndex ) &&
+           ( pPropertyBuilder->seal.fieldSet == pPropertyBuilder->fieldSet );
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t validateTopicFilter( const MQTTContext_t * pContext,
-                                         const MQTTSubscribeInfo_t * pSubscriptionList,
-                                         size_t iterator,
-                                         MQTTSubscriptionType_t subscriptionType )
+static MQTTStatus_t validatePublish( const MQTTContext_t * pContext,
+                                     const MQTTPublishInfo_t * pPublishInfo,
+                                     uint16_t packetId,
+                                     const MQTTPropBuilder_t * pPropertyBuilder,
+                                     bool payloadInSegments,
+                                     uint16_t * pTopicAlias )
 {
-    MQTTStatus_t status = MQTTSuccess;
+    MQTTStatus_t status;
 
-    if( ( pSubscriptionList[ iterator ].pTopicFilter == NULL ) ||
-        ( pSubscriptionList[ iterator ].topicFilterLength == 0U ) )
-    {
-        LogError( ( "Invalid subscription at index %lu: Topic filter is NULL or has zero length.",
-                    ( unsigned long ) iterator ) );
-        status = MQTTBadParameter;
-    }
+    *pTopicAlias = 0U;
 
-    if( ( status == MQTTSuccess ) &&
-        CHECK_SIZE_T_OVERFLOWS_16BIT( pSubscriptionList[ iterator ].topicFilterLength ) )
-    {
-        LogError( ( "Topic filter length must be less than 65536 for topic number %" PRIu32, ( uint32_t ) iterator ) );
-        status = MQTTBadParameter;
-    }
+    status = validatePublishParams( pContext, pPublishInfo, packetId, payloadInSegments );
 
-    if( ( status == MQTTSuccess ) && ( subscriptionType == MQTT_TYPE_SUBSCRIBE ) )
+    /* Validate Publish Properties and extract Topic Alias from the properties. */
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
     {
-        if( pSubscriptionList[ iterator ].qos > MQTTQoS2 )
-        {
-            LogError( ( "Protocol Error : QoS cannot be greater than 2" ) );
-            status = MQTTBadParameter;
-        }
-        else if( checkWildcardSubscriptions( pContext->connectionProperties.isWildcardAvailable,
-                                             pSubscriptionList,
-                                             iterator ) )
-        {
-            LogError( ( "Protocol Error : Wildcard Subscriptions not allowed. " ) );
-            status = MQTTBadParameter;
-        }
-        else if( pSubscriptionList[ iterator ].retainHandlingOption > retainDoNotSendonSub )
+        if( isPropertyBuilderSealed( pPropertyBuilder, MQTT_PACKET_TYPE_PUBLISH ) )
         {
-            LogError( ( "Protocol Error : retainHandlingOption cannot be greater than 2" ) );
-            status = MQTTBadParameter;
+            /* Only the Topic Alias depends on the connection. */
+            *pTopicAlias = pPropertyBuilder->seal.topicAlias;
+
+            if( pContext->connectionProperties.serverTopicAliasMax < *pTopicAlias )
+            {
+                LogError( ( "Protocol Error: Topic Alias greater than Topic Alias Max" ) );
+                status = MQTTBadParameter;
+            }
         }
         else
         {
-            status = validateSharedSubscriptions( pContext,
-                                                  pSubscriptionList,
-                                                  iterator );
+            status = MQTT_ValidatePublishProperties( pContext->connectionProperties.serverTopicAliasMax,
+                                                     pPropertyBuilder, pTopicAlias );
         }
     }
 
+    if( status == MQTTSuccess )
+    {
+        /* Validate Publish Properties with the persistent Connection Properties. */
+        status = MQTT_ValidatePublishParams( pPublishInfo,
+                                             pContext->connectionProperties.retainAvailable,
+                                             pContext->connectionProperties.serverMaxQos,
+                                             *pTopicAlias,
+                                             pContext->connectionProperties.serverMaxPacketSize );
+    }
+
     return status;
 }
 
 /*-----------------------------------------------------------*/
 
-static bool checkWildcardSubscriptions( uint8_t isWildcardAvailable,
-                                        const MQTTSubscribeInfo_t * pSubscriptionList,
-                                        size_t iterator )
+static MQTTStatus_t serializePublishHeader( const MQTTContext_t * pContext,
+                                            const MQTTPublishInfo_t * pPublishInfo,
+                                            const MQTTPropBuilder_t * pPropertyBuilder,
+                                            uint16_t topicAlias,
+                                            uint8_t * pMqttHeader,
+                                            size_t * pHeaderSize )
 {
-    bool ret = false;
+    MQTTStatus_t status;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    MQTTPropBuilder_t sizingProperties = { 0 };
+    const MQTTPropBuilder_t * pSizingProperties = pPropertyBuilder;
 
-    if( isWildcardAvailable == 0U )
+    if( topicAlias != 0U )
     {
-        if( ( ( strchr( pSubscriptionList[ iterator ].pTopicFilter, ( int32_t ) '#' ) != NULL ) ||
-              ( strchr( pSubscriptionList[ iterator ].pTopicFilter, ( int32_t ) '+' ) != NULL ) ) )
+        /* The size of the packet only depends on the length of its properties,
+         * so it is calculated as if the builder held the Topic Alias too. */
+        if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
         {
-            ret = true;
+            sizingProperties = *pPropertyBuilder;
+        }
+        else
+        {
+            /* Any buffer marks the properties as present; it is not read. */
+            sizingProperties.pBuffer = pMqttHeader;
         }
+
+        sizingProperties.currentIndex += CORE_MQTT_TOPIC_ALIAS_PROPERTY_SIZE;
+        pSizingProperties = &sizingProperties;
     }
 
-    return ret;
+    /* Get the remaining length and packet size. */
+    status = MQTT_GetPublishPacketSize( pPublishInfo,
+                                        pSizingProperties,
+                                        &remainingLength,
+                                        &packetSize,
+                                        pContext->connectionProperties.serverMaxPacketSize );
+
+    if( status == MQTTSuccess )
+    {
+        status = MQTT_SerializePublishHeaderWithoutTopic( pPublishInfo,
+                                                          remainingLength,
+                                                          pMqttHeader,
+                                                          pHeaderSize );
+    }
+
+    return status;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t validateSharedSubscriptions( const MQTTContext_t * pContext,
-                                                 const MQTTSubscribeInfo_t * pSubscriptionList,
-                                                 const size_t iterator )
+static void resetOutgoingTopicAliases( MQTTContext_t * pContext )
 {
-    MQTTStatus_t status = MQTTSuccess;
-    uint16_t topicFilterLength;
-    bool isSharedSub;
-    const char * shareNameEnd;
-    const char * shareNameStart;
+    size_t index;
 
-    assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pSubscriptionList[ iterator ].topicFilterLength ) );
+    assert( pContext->pOutgoingTopicAliases != NULL );
 
-    topicFilterLength = ( uint16_t ) pSubscriptionList[ iterator ].topicFilterLength;
-    isSharedSub = ( topicFilterLength > 7U );
+    for( index = 0U; index < pContext->outgoingTopicAliasCapacity; index++ )
+    {
+        pContext->pOutgoingTopicAliases[ index ].topicNameLength = 0U;
+        pContext->pOutgoingTopicAliases[ index ].lastUsed = 0U;
+    }
 
-    /* Need to check this only if the length is proper. */
-    if( pSubscriptionList[ iterator ].topicFilterLength > 7U )
+    /* Before the CONNACK, the Topic Alias Maximum of the broker is 0. */
+    if( ( size_t ) pContext->connectionProperties.serverTopicAliasMax < pContext->outgoingTopicAliasCapacity )
     {
-        isSharedSub = ( isSharedSub ) && ( ( strncmp( pSubscriptionList[ iterator ].pTopicFilter, "$share/", 7U ) ) == 0 );
+        pContext->outgoingTopicAliasCount = ( size_t ) pContext->connectionProperties.serverTopicAliasMax;
+    }
+    else
+    {
+        pContext->outgoingTopicAliasCount = pContext->outgoingTopicAliasCapacity;
     }
 
-    if( isSharedSub )
+    pContext->outgoingTopicAliasClock = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t hashTopicName( const char * pTopicName,
+                               size_t topicNameLength )
+{
+    uint32_t hash = 2166136261U;
+    size_t index;
+
+    for( index = 0U; index < topicNameLength; index++ )
     {
-        shareNameStart = &( pSubscriptionList[ iterator ].pTopicFilter[ 7U ] );
-        shareNameEnd = memchr( shareNameStart, ( int32_t ) '/', ( size_t ) topicFilterLength - 7U );
+        hash ^= ( uint32_t ) ( ( uint8_t ) pTopicName[ index ] );
+        hash *= 16777619U;
+    }
 
-        if( ( shareNameEnd == NULL ) ||
-            ( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ 7 ] ) ) )
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t findOutgoingTopicAlias( const MQTTContext_t * pContext,
+                                        const MQTTPublishInfo_t * pPublishInfo,
+                                        bool * pIsSet )
+{
+    const MQTTTopicAlias_t * pAliases = pContext->pOutgoingTopicAliases;
+    const size_t aliasCount = pContext->outgoingTopicAliasCount;
+    uint32_t topicHash;
+    size_t index;
+    size_t foundIndex = aliasCount;
+    size_t freeIndex = aliasCount;
+    size_t leastRecentIndex = 0U;
+
+    assert( aliasCount > 0U );
+    assert( pPublishInfo->topicNameLength <= pContext->outgoingTopicAliasNameLength );
+
+    topicHash = hashTopicName( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+
+    for( index = 0U; ( index < aliasCount ) && ( foundIndex == aliasCount ); index++ )
+    {
+        if( pAliases[ index ].topicNameLength == 0U )
         {
-            LogError( ( "Protocol Error : ShareName is not present , missing or empty" ) );
-            status = MQTTBadParameter;
+            if( freeIndex == aliasCount )
+            {
+                freeIndex = index;
+            }
         }
-        else if( pSubscriptionList[ iterator ].noLocalOption )
+        else if( ( pAliases[ index ].topicHash == topicHash ) &&
+                 ( ( size_t ) pAliases[ index ].topicNameLength == pPublishInfo->topicNameLength ) &&
+                 ( memcmp( &pContext->pOutgoingTopicAliasNames[ index * pContext->outgoingTopicAliasNameLength ],
+                           pPublishInfo->pTopicName,
+                           pPublishInfo->topicNameLength ) == 0 ) )
         {
-            LogError( ( "Protocol Error : noLocalOption cannot be 1 for shared subscriptions" ) );
-            status = MQTTBadParameter;
+            foundIndex = index;
         }
-        else if( pContext->connectionProperties.isSharedAvailable == 0U )
+        else if( pAliases[ index ].lastUsed < pAliases[ leastRecentIndex ].lastUsed )
         {
-            LogError( ( "Protocol Error : Shared Subscriptions not allowed" ) );
-            status = MQTTBadParameter;
+            leastRecentIndex = index;
         }
-        else if( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ topicFilterLength - 1U ] ) )
+        else
         {
-            LogError( ( "Protocol Error : Topic filter after share name is missing" ) );
-            status = MQTTBadParameter;
+            /* This alias was used more recently. */
+        }
+    }
+
+    *pIsSet = ( foundIndex != aliasCount );
+
+    if( *pIsSet == false )
+    {
+        /* Prefer an alias which is not set to reassigning one. */
+        foundIndex = ( freeIndex != aliasCount ) ? freeIndex : leastRecentIndex;
+    }
+
+    return ( uint16_t ) ( foundIndex + 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void recordOutgoingTopicAlias( MQTTContext_t * pContext,
+                                      const MQTTPublishInfo_t * pPublishInfo,
+                                      uint16_t topicAlias )
+{
+    MQTTTopicAlias_t * pAlias;
+    size_t index;
+
+    if( ( topicAlias != 0U ) && ( ( size_t ) topicAlias <= pContext->outgoingTopicAliasCount ) )
+    {
+        pAlias = &pContext->pOutgoingTopicAliases[ topicAlias - 1U ];
+
+        if( pPublishInfo->topicNameLength > pContext->outgoingTopicAliasNameLength )
+        {
+            /* The broker maps the alias to a topic which does not fit. */
+            pAlias->topicNameLength = 0U;
         }
         else
         {
-            const char * ptr;
+            if( pPublishInfo->topicNameLength > 0U )
+            {
+                ( void ) memcpy( &pContext->pOutgoingTopicAliasNames[ ( topicAlias - 1U ) * pContext->outgoingTopicAliasNameLength ],
+                                 pPublishInfo->pTopicName,
+                                 pPublishInfo->topicNameLength );
+                pAlias->topicNameLength = ( uint16_t ) pPublishInfo->topicNameLength;
+                pAlias->topicHash = hashTopicName( pPublishInfo->pTopicName, pPublishInfo->topicNameLength );
+            }
 
-            for( ptr = shareNameStart; ptr < shareNameEnd; ptr++ )
+            pContext->outgoingTopicAliasClock++;
+
+            /* When the counter wraps around, the order of use is forgotten
+             * rather than kept wrong. */
+            if( pContext->outgoingTopicAliasClock == 0U )
             {
-                if( ( *ptr == '#' ) || ( *ptr == '+' ) )
+                for( index = 0U; index < pContext->outgoingTopicAliasCount; index++ )
                 {
-                    status = MQTTBadParameter;
-                    break; /* Invalid share name */
+                    pContext->pOutgoingTopicAliases[ index ].lastUsed = 0U;
                 }
+
+                pContext->outgoingTopicAliasClock = 1U;
             }
+
+            pAlias->lastUsed = pContext->outgoingTopicAliasClock;
         }
     }
-
-    return status;
 }
 
 /*-----------------------------------------------------------*/
 
-static void addSubscriptionOptions( const MQTTSubscribeInfo_t subscriptionInfo,
-                                    uint8_t * pSubscriptionOptionsArray,
-                                    size_t currentOptionIndex )
+static void resetIncomingTopicAliases( MQTTContext_t * pContext )
 {
-    uint8_t subscriptionOptions = 0U;
+    size_t index;
 
-    if( subscriptionInfo.qos == MQTTQoS1 )
+    assert( pContext->pIncomingTopicAliases != NULL );
+
+    for( index = 0U; index < pContext->incomingTopicAliasCapacity; index++ )
     {
-        LogInfo( ( "Adding QoS as QoS 1 in SUBSCRIBE payload" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_QOS1 );
+        pContext->pIncomingTopicAliases[ index ].topicNameLength = 0U;
+        pContext->pIncomingTopicAliases[ index ].lastUsed = 0U;
     }
-    else if( subscriptionInfo.qos == MQTTQoS2 )
+
+    if( ( size_t ) pContext->connectionProperties.topicAliasMax < pContext->incomingTopicAliasCapacity )
     {
-        LogInfo( ( "Adding QoS as QoS 2 in SUBSCRIBE payload" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_QOS2 );
+        pContext->incomingTopicAliasCount = ( size_t ) pContext->connectionProperties.topicAliasMax;
     }
     else
     {
-        LogInfo( ( "Adding QoS as QoS 0 in SUBSCRIBE payload" ) );
+        pContext->incomingTopicAliasCount = pContext->incomingTopicAliasCapacity;
     }
+}
 
-    if( subscriptionInfo.noLocalOption )
-    {
-        LogInfo( ( "Adding noLocalOption in SUBSCRIBE payload" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_NO_LOCAL );
-    }
-    else
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t limitIncomingTopicAliasMax( const MQTTContext_t * pContext,
+                                                MQTTPropBuilder_t * pPropertyBuilder )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index = 0U;
+    uint8_t propertyType = 0U;
+    uint16_t topicAliasMax = 0U;
+
+    while( ( status == MQTTSuccess ) && ( index < pPropertyBuilder->currentIndex ) )
     {
-        LogDebug( ( "Adding noLocalOption as 0 in SUBSCRIBE payload" ) );
+        status = MQTT_GetNextPropertyType( pPropertyBuilder, &index, &propertyType );
+
+        if( status != MQTTSuccess )
+        {
+            /* The property is invalid. */
+        }
+        else if( propertyType == MQTT_TOPIC_ALIAS_MAX_ID )
+        {
+            status = MQTTPropGet_TopicAliasMax( pPropertyBuilder, &index, &topicAliasMax );
+
+            /* The value is in the two bytes before the index. */
+            if( ( status == MQTTSuccess ) &&
+                ( ( size_t ) topicAliasMax > pContext->incomingTopicAliasCapacity ) )
+            {
+                LogWarn( ( "Topic Alias Maximum %hu lowered to the %lu incoming topic aliases kept.",
+                           ( unsigned short ) topicAliasMax,
+                           ( unsigned long ) pContext->incomingTopicAliasCapacity ) );
+                pPropertyBuilder->pBuffer[ index - 2U ] = UINT16_HIGH_BYTE( ( uint16_t ) pContext->incomingTopicAliasCapacity );
+                pPropertyBuilder->pBuffer[ index - 1U ] = UINT16_LOW_BYTE( ( uint16_t ) pContext->incomingTopicAliasCapacity );
+            }
+        }
+        else
+        {
+            status = MQTT_SkipNextProperty( pPropertyBuilder, &index );
+        }
     }
 
-    if( subscriptionInfo.retainAsPublishedOption )
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t resolveIncomingTopicAlias( MQTTContext_t * pContext,
+                                               MQTTPublishInfo_t * pPublishInfo )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTTopicAlias_t * pAlias;
+    char * pTopicName;
+    uint16_t topicAlias = pPublishInfo->topicAlias;
+
+    if( ( size_t ) topicAlias > pContext->incomingTopicAliasCount )
     {
-        LogInfo( ( " retainAsPublishedOption in SUBSCRIBE payload" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_AS_PUBLISHED );
+        LogError( ( "Topic alias %hu exceeds the %lu topic aliases kept.",
+                    ( unsigned short ) topicAlias,
+                    ( unsigned long ) pContext->incomingTopicAliasCount ) );
+        status = MQTTBadResponse;
     }
     else
     {
-        LogDebug( ( "retainAsPublishedOption as 0 in SUBSCRIBE payload" ) );
-    }
+        pAlias = &pContext->pIncomingTopicAliases[ topicAlias - 1U ];
+        pTopicName = &pContext->pIncomingTopicAliasNames[ ( topicAlias - 1U ) * pContext->incomingTopicAliasNameLength ];
 
-    if( subscriptionInfo.retainHandlingOption == retainSendOnSub )
-    {
-        LogInfo( ( "Send Retain messages at the time of subscribe" ) );
+        if( pPublishInfo->topicNameLength > pContext->incomingTopicAliasNameLength )
+        {
+            LogWarn( ( "Topic name of topic alias %hu is too long to be kept: topicNameLength=%lu.",
+                       ( unsigned short ) topicAlias,
+                       ( unsigned long ) pPublishInfo->topicNameLength ) );
+            pAlias->topicNameLength = 0U;
+            pAlias->lastUsed = 1U;
+        }
+        else if( pPublishInfo->topicNameLength > 0U )
+        {
+            ( void ) memcpy( pTopicName,
+                             pPublishInfo->pTopicName,
+                             pPublishInfo->topicNameLength );
+            pAlias->topicNameLength = ( uint16_t ) pPublishInfo->topicNameLength;
+            pAlias->lastUsed = 1U;
+        }
+        else if( pAlias->topicNameLength > 0U )
+        {
+            pPublishInfo->pTopicName = pTopicName;
+            pPublishInfo->topicNameLength = pAlias->topicNameLength;
+        }
+        else if( pAlias->lastUsed != 0U )
+        {
+            LogWarn( ( "Topic name of topic alias %hu of incoming PUBLISH was not kept.",
+                       ( unsigned short ) topicAlias ) );
+        }
+        else
+        {
+            LogError( ( "Topic alias %hu of incoming PUBLISH was never set.",
+                        ( unsigned short ) topicAlias ) );
+            status = MQTTBadResponse;
+        }
     }
-    else if( subscriptionInfo.retainHandlingOption == retainSendOnSubIfNotPresent )
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void callSubscriptionHandler( MQTTContext_t * pContext,
+                                     MQTTDeserializedInfo_t * pDeserializedInfo,
+                                     uint32_t subscriptionId )
+{
+    const MQTTSubscriptionHandler_t * pHandler;
+
+    if( ( subscriptionId == 0U ) || ( ( size_t ) subscriptionId > pContext->subscriptionHandlerCount ) )
     {
-        LogInfo( ( "Send retained messages at subscribe only if the subscription does not currently exist" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_HANDLING1 );
+        LogWarn( ( "Subscription identifier %lu of incoming PUBLISH exceeds the %lu handlers.",
+                   ( unsigned long ) subscriptionId,
+                   ( unsigned long ) pContext->subscriptionHandlerCount ) );
     }
     else
     {
-        LogInfo( ( "Do not send retained messages at subscribe" ) );
-        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_HANDLING2 );
-    }
+        pHandler = &pContext->pSubscriptionHandlers[ subscriptionId - 1U ];
 
-    pSubscriptionOptionsArray[ currentOptionIndex ] = subscriptionOptions;
+        if( pHandler->callback != NULL )
+        {
+            pHandler->callback( pContext, pDeserializedInfo, pHandler->pUserData );
+        }
+        else
+        {
+            LogDebug( ( "No handler registered for subscription identifier %lu.",
+                        ( unsigned long ) subscriptionId ) );
+        }
+    }
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
-                                       MQTTPacketInfo_t * pIncomingPacket )
+static void dispatchToSubscriptionHandlers( MQTTContext_t * pContext,
+                                            MQTTDeserializedInfo_t * pDeserializedInfo,
+                                            const MQTTPropBuilder_t * pPropBuffer )
 {
     MQTTStatus_t status = MQTTSuccess;
-    uint16_t packetIdentifier;
-    MQTTEventCallback_t appCallback;
-    MQTTDeserializedInfo_t deserializedInfo;
-    MQTTPropBuilder_t propBuffer = { 0 };
+    size_t index = 0U;
+    uint8_t propertyType = 0U;
+    uint32_t subscriptionId = 0U;
 
-    MQTTReasonCodeInfo_t ackInfo = { 0 };
+    if( pDeserializedInfo->pPublishInfo->subscriptionIdCount == 1U )
+    {
+        callSubscriptionHandler( pContext,
+                                 pDeserializedInfo,
+                                 pDeserializedInfo->pPublishInfo->subscriptionId );
+    }
+    else
+    {
+        /* A PUBLISH matching several subscriptions carries the identifier of
+         * each of them, which are only kept in its properties. */
+        while( ( status == MQTTSuccess ) && ( index < pPropBuffer->currentIndex ) )
+        {
+            status = MQTT_GetNextPropertyType( pPropBuffer, &index, &propertyType );
 
-    assert( pContext != NULL );
-    assert( pIncomingPacket != NULL );
-    assert( pContext->appCallback != NULL );
+            if( status != MQTTSuccess )
+            {
+                /* The property is invalid. */
+            }
+            else if( propertyType == MQTT_SUBSCRIPTION_ID_ID )
+            {
+                status = MQTTPropGet_SubscriptionId( pPropBuffer, &index, &subscriptionId );
 
-    appCallback = pContext->appCallback;
+                if( status == MQTTSuccess )
+                {
+                    callSubscriptionHandler( pContext, pDeserializedInfo, subscriptionId );
+                }
+            }
+            else
+            {
+                status = MQTT_SkipNextProperty( pPropBuffer, &index );
+            }
+        }
 
-    status = MQTT_DeserializeAck( pIncomingPacket,
-                                  &packetIdentifier,
-                                  &ackInfo,
-                                  &propBuffer,
-                                  &pContext->connectionProperties );
+        if( status != MQTTSuccess )
+        {
+            LogError( ( "Failed to read the subscription identifiers of incoming PUBLISH: %s.",
+                        MQTT_Status_strerror( status ) ) );
+        }
+    }
+}
 
-    LogInfo( ( "Ack packet deserialized with result: %s.",
-               MQTT_Status_strerror( status ) ) );
+/*-----------------------------------------------------------*/
 
-    if( status == MQTTSuccess )
+static void releaseFailedSubscriptionHandlers( MQTTContext_t * pContext,
+                                               uint16_t packetId )
+{
+    size_t index;
+    MQTTSubscriptionHandler_t * pHandler;
+
+    for( index = 0U; index < pContext->subscriptionHandlerCount; index++ )
     {
-        deserializedInfo.packetIdentifier = packetIdentifier;
-        deserializedInfo.deserializationResult = status;
-        deserializedInfo.pPublishInfo = NULL;
-        deserializedInfo.pReasonCode = &ackInfo;
+        pHandler = &pContext->pSubscriptionHandlers[ index ];
 
-        /* Invoke application callback to hand the buffer over to application */
-        if( appCallback( pContext, pIncomingPacket, &deserializedInfo, NULL,
-                         NULL, &propBuffer ) == false )
+        if( ( pHandler->failedPacketId != MQTT_PACKET_ID_INVALID ) &&
+            ( ( packetId == MQTT_PACKET_ID_INVALID ) || ( pHandler->failedPacketId == packetId ) ) )
         {
-            status = MQTTEventCallbackFailed;
+            LogDebug( ( "Unregistering the handler of subscription identifier %lu.",
+                        ( unsigned long ) ( index + 1U ) ) );
+            pHandler->callback = NULL;
+            pHandler->pUserData = NULL;
+            pHandler->failedPacketId = MQTT_PACKET_ID_INVALID;
         }
     }
-
-    return status;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
-                                               const MQTTSuccessFailReasonCode_t * pReasonCode,
-                                               uint32_t remainingLength,
-                                               const MQTTPropBuilder_t * pPropertyBuilder )
+static bool validateStateIndex( size_t recordCount,
+                                const uint16_t * pBuckets,
+                                size_t bucketCount )
 {
-    int32_t bytesSentOrError;
-    size_t ioVectorLength = 0U;
-    uint32_t totalMessageLength = 0U;
-    uint32_t disconnectPropLen = 0U;
-    MQTTStatus_t status = MQTTSuccess;
+    /* Records are at positions up to 65534, stored plus one in a bucket. A
+     * power of 2 bucket count lets the hash wrap with a mask, and a bucket
+     * count above the record count leaves a free bucket to end each search. */
+    return ( recordCount > 0U ) &&
+           ( recordCount <= ( size_t ) UINT16_MAX ) &&
+           ( pBuckets != NULL ) &&
+           ( bucketCount > recordCount ) &&
+           ( ( bucketCount & ( bucketCount - 1U ) ) == 0U );
+}
 
-    /* Maximum number of bytes required by the fixed size part of the CONNECT
-     * packet header according to the MQTT specification.
-     * MQTT Control Byte      0 + 1 = 1
-     * Remaining length (max)   + 4 = 5
-     * Reason Code              + 1 = 6
-     *
-     * Note that the reason code is not actually 'fixed'. But it avoids much
-     * calculation and potential TCP/TLS overhead in some implementations later
-     * at the cost of one byte on the stack.
-     */
-    uint8_t fixedHeader[ 6U ];
+/*-----------------------------------------------------------*/
 
-    /**
-     * Maximum number of bytes to send the Property Length.
-     * Property Length  0 + 4 = 4
-     */
-    uint8_t propertyLength[ 4U ];
-
-    /* The maximum vectors required to encode and send a disconnect packet. The
-     * breakdown is shown below.
-     * disconnect Header    0 + 1 = 1
-     * Property Length        + 1 = 2
-     * Optional Properties    + 1 = 3
-     * */
-    TransportOutVector_t pIoVector[ 3U ];
-
-    uint8_t * pIndex = fixedHeader;
-    TransportOutVector_t * iterator = pIoVector;
-
-    assert( pContext != NULL );
-    assert( remainingLength < MQTT_REMAINING_LENGTH_INVALID );
-
-    if( pPropertyBuilder != NULL )
-    {
-        assert( pReasonCode != NULL );
-    }
-
-    /* Only for fixed size fields. */
-    pIndex = serializeDisconnectFixed( pIndex, pReasonCode, remainingLength );
-    iterator->iov_base = fixedHeader;
-    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
-    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
-    /* coverity[misra_c_2012_rule_18_2_violation] */
-    /* coverity[misra_c_2012_rule_10_8_violation] */
-    iterator->iov_len = ( size_t ) ( pIndex - fixedHeader );
-    assert( iterator->iov_len <= 6U );
-    totalMessageLength += ( uint32_t ) iterator->iov_len;
-    iterator++;
-    ioVectorLength++;
-
-    if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
-    {
-        disconnectPropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
-    }
-
-    pIndex = encodeVariableLength( propertyLength, disconnectPropLen );
-    iterator->iov_base = propertyLength;
-    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
-    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
-    /* coverity[misra_c_2012_rule_18_2_violation] */
-    /* coverity[misra_c_2012_rule_10_8_violation] */
-    iterator->iov_len = ( size_t ) ( pIndex - propertyLength );
-    totalMessageLength += ( uint32_t ) iterator->iov_len;
-    iterator++;
-    ioVectorLength++;
-
-    if( disconnectPropLen > 0U )
-    {
-        iterator->iov_base = pPropertyBuilder->pBuffer;
-        iterator->iov_len = pPropertyBuilder->currentIndex;
-
-        if( ADDITION_WILL_OVERFLOW_U32( totalMessageLength, pPropertyBuilder->currentIndex ) ||
-            ( ( totalMessageLength + pPropertyBuilder->currentIndex ) > MQTT_MAX_PACKET_SIZE ) )
-        {
-            LogError( ( "Total MQTT packet size must be less than 268435461" ) );
-            status = MQTTBadParameter;
-        }
-        else
-        {
-            totalMessageLength += ( uint32_t ) iterator->iov_len;
-            iterator++;
-            ioVectorLength++;
-        }
-    }
-
-    if( status == MQTTSuccess )
-    {
-        bytesSentOrError = sendMessageVector( pContext, pIoVector, ioVectorLength );
-
-        if( bytesSentOrError != ( int32_t ) totalMessageLength )
-        {
-            status = MQTTSendFailed;
-            LogError( ( "Failed to send disconnect packet." ) );
-        }
-    }
-
-    return status;
-}
-
-/*-----------------------------------------------------------*/
-
-MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
-                        const TransportInterface_t * pTransportInterface,
-                        MQTTGetCurrentTimeFunc_t getTimeFunction,
-                        MQTTEventCallback_t userCallback,
-                        const MQTTFixedBuffer_t * pNetworkBuffer )
-{
-    MQTTStatus_t status = MQTTSuccess;
+static MQTTStatus_t validatePublishParams( const MQTTContext_t * pContext,
+                                           const MQTTPublishInfo_t * pPublishInfo,
+                                           uint16_t packetId,
+                                           bool payloadInSegments )
+{
+    MQTTStatus_t status = MQTTSuccess;
 
     /* Validate arguments. */
-    if( ( pContext == NULL ) || ( pTransportInterface == NULL ) ||
-        ( pNetworkBuffer == NULL ) )
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) )
     {
         LogError( ( "Argument cannot be NULL: pContext=%p, "
-                    "pTransportInterface=%p, "
-                    "pNetworkBuffer=%p",
-                    ( void * ) pContext,
-                    ( const void * ) pTransportInterface,
-                    ( const void * ) pNetworkBuffer ) );
+                    "pPublishInfo=%p.",
+                    ( const void * ) pContext,
+                    ( const void * ) pPublishInfo ) );
         status = MQTTBadParameter;
     }
-    else if( getTimeFunction == NULL )
+    else if( ( pPublishInfo->qos != MQTTQoS0 ) && ( packetId == 0U ) )
     {
-        LogError( ( "Invalid parameter: getTimeFunction is NULL" ) );
+        LogError( ( "Packet Id is 0 for PUBLISH with QoS=%u.",
+                    ( unsigned int ) pPublishInfo->qos ) );
         status = MQTTBadParameter;
     }
-    else if( userCallback == NULL )
+    else if( ( pPublishInfo->payloadLength > 0U ) && ( pPublishInfo->pPayload == NULL ) &&
+             ( payloadInSegments == false ) )
     {
-        LogError( ( "Invalid parameter: userCallback is NULL" ) );
+        LogError( ( "A nonzero payload length requires a non-NULL payload: "
+                    "payloadLength=%lu, pPayload=%p.",
+                    ( unsigned long ) pPublishInfo->payloadLength,
+                    pPublishInfo->pPayload ) );
         status = MQTTBadParameter;
     }
-    else if( pTransportInterface->recv == NULL )
+    else if( CHECK_SIZE_T_OVERFLOWS_16BIT( pPublishInfo->topicNameLength ) )
     {
-        LogError( ( "Invalid parameter: pTransportInterface->recv is NULL" ) );
+        LogError( ( "Topic name length must be less than 65536." ) );
         status = MQTTBadParameter;
     }
-    else if( pTransportInterface->send == NULL )
+    else if( CHECK_SIZE_T_OVERFLOWS_32BIT( pPublishInfo->payloadLength ) ||
+             ( pPublishInfo->payloadLength >= MQTT_REMAINING_LENGTH_INVALID ) )
     {
-        LogError( ( "Invalid parameter: pTransportInterface->send is NULL" ) );
+        LogError( ( "pPublishInfo->payloadLength must be less than %" PRIu32, MQTT_REMAINING_LENGTH_INVALID ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pContext->outgoingPublishRecords == NULL ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+    {
+        LogError( ( "Trying to publish a QoS > MQTTQoS0 packet when outgoing publishes "
+                    "for QoS1/QoS2 have not been enabled. Please, call MQTT_InitStatefulQoS "
+                    "to initialize and enable the use of QoS1/QoS2 publishes." ) );
         status = MQTTBadParameter;
     }
     else
     {
-        ( void ) memset( pContext, 0x00, sizeof( MQTTContext_t ) );
-
-        pContext->connectStatus = MQTTNotConnected;
-        pContext->transportInterface = *pTransportInterface;
-        pContext->getTime = getTimeFunction;
-        pContext->appCallback = userCallback;
-        pContext->networkBuffer = *pNetworkBuffer;
-        pContext->ackPropsBuffer.pBuffer = NULL;
-
-        /* Zero is not a valid packet ID per MQTT spec. Start from 1. */
-        pContext->nextPacketId = 1;
-
-        /* Setting default connect properties in our application */
-        status = MQTT_InitConnect( &( pContext->connectionProperties ) );
+        /* MISRA else */
     }
 
     return status;
@@ -4227,67 +7248,52 @@ MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
-                                   MQTTPubAckInfo_t * pOutgoingPublishRecords,
-                                   size_t outgoingPublishCount,
-                                   MQTTPubAckInfo_t * pIncomingPublishRecords,
-                                   size_t incomingPublishCount,
-                                   uint8_t * pAckPropsBuf,
-                                   size_t ackPropsBufLength )
+static MQTTStatus_t validateTopicFilter( const MQTTContext_t * pContext,
+                                         const MQTTSubscribeInfo_t * pSubscriptionList,
+                                         size_t iterator,
+                                         MQTTSubscriptionType_t subscriptionType )
 {
     MQTTStatus_t status = MQTTSuccess;
 
-    if( pContext == NULL )
+    if( ( pSubscriptionList[ iterator ].pTopicFilter == NULL ) ||
+        ( pSubscriptionList[ iterator ].topicFilterLength == 0U ) )
     {
-        LogError( ( "Argument cannot be NULL: pContext=%p\n",
-                    ( void * ) pContext ) );
+        LogError( ( "Invalid subscription at index %lu: Topic filter is NULL or has zero length.",
+                    ( unsigned long ) iterator ) );
         status = MQTTBadParameter;
     }
 
-    /* Check whether the arguments make sense. Not equal here behaves
-     * like an exclusive-or operator for boolean values. */
-    else if( ( outgoingPublishCount == 0U ) !=
-             ( pOutgoingPublishRecords == NULL ) )
+    if( ( status == MQTTSuccess ) &&
+        CHECK_SIZE_T_OVERFLOWS_16BIT( pSubscriptionList[ iterator ].topicFilterLength ) )
     {
-        LogError( ( "Arguments do not match: pOutgoingPublishRecords=%p, "
-                    "outgoingPublishCount=%lu",
-                    ( void * ) pOutgoingPublishRecords,
-                    ( unsigned long ) outgoingPublishCount ) );
+        LogError( ( "Topic filter length must be less than 65536 for topic number %" PRIu32, ( uint32_t ) iterator ) );
         status = MQTTBadParameter;
     }
 
-    /* Check whether the arguments make sense. Not equal here behaves
-     * like an exclusive-or operator for boolean values. */
-    else if( ( incomingPublishCount == 0U ) !=
-             ( pIncomingPublishRecords == NULL ) )
-    {
-        LogError( ( "Arguments do not match: pIncomingPublishRecords=%p, "
-                    "incomingPublishCount=%lu",
-                    ( void * ) pIncomingPublishRecords,
-                    ( unsigned long ) incomingPublishCount ) );
-        status = MQTTBadParameter;
-    }
-    else if( pContext->appCallback == NULL )
-    {
-        LogError( ( "MQTT_InitStatefulQoS must be called only after MQTT_Init has"
-                    " been called successfully.\n" ) );
-        status = MQTTBadParameter;
-    }
-    else
+    if( ( status == MQTTSuccess ) && ( subscriptionType == MQTT_TYPE_SUBSCRIBE ) )
     {
-        pContext->incomingPublishRecordMaxCount = incomingPublishCount;
-        pContext->incomingPublishRecords = pIncomingPublishRecords;
-        pContext->outgoingPublishRecordMaxCount = outgoingPublishCount;
-        pContext->outgoingPublishRecords = pOutgoingPublishRecords;
-
-        if( ( pAckPropsBuf != NULL ) && ( ackPropsBufLength != 0U ) )
+        if( pSubscriptionList[ iterator ].qos > MQTTQoS2 )
         {
-            status = MQTTPropertyBuilder_Init( &pContext->ackPropsBuffer, pAckPropsBuf, ackPropsBufLength );
+            LogError( ( "Protocol Error : QoS cannot be greater than 2" ) );
+            status = MQTTBadParameter;
+        }
+        else if( checkWildcardSubscriptions( pContext->connectionProperties.isWildcardAvailable,
+                                             pSubscriptionList,
+                                             iterator ) )
+        {
+            LogError( ( "Protocol Error : Wildcard Subscriptions not allowed. " ) );
+            status = MQTTBadParameter;
+        }
+        else if( pSubscriptionList[ iterator ].retainHandlingOption > retainDoNotSendonSub )
+        {
+            LogError( ( "Protocol Error : retainHandlingOption cannot be greater than 2" ) );
+            status = MQTTBadParameter;
         }
         else
         {
-            pContext->ackPropsBuffer.pBuffer = NULL;
-            pContext->ackPropsBuffer.bufferLength = 0;
+            status = validateSharedSubscriptions( pContext,
+                                                  pSubscriptionList,
+                                                  iterator );
         }
     }
 
@@ -4296,39 +7302,1534 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
-                                   MQTTStorePacketForRetransmit storeFunction,
-                                   MQTTRetrievePacketForRetransmit retrieveFunction,
-                                   MQTTClearPacketForRetransmit clearFunction )
+static bool checkWildcardSubscriptions( uint8_t isWildcardAvailable,
+                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                        size_t iterator )
 {
-    MQTTStatus_t status = MQTTSuccess;
+    bool ret = false;
 
-    if( pContext == NULL )
+    if( isWildcardAvailable == 0U )
     {
-        LogError( ( "Argument cannot be NULL: pContext=%p\n",
-                    ( void * ) pContext ) );
-        status = MQTTBadParameter;
+        if( ( ( strchr( pSubscriptionList[ iterator ].pTopicFilter, ( int32_t ) '#' ) != NULL ) ||
+              ( strchr( pSubscriptionList[ iterator ].pTopicFilter, ( int32_t ) '+' ) != NULL ) ) )
+        {
+            ret = true;
+        }
     }
-    else if( storeFunction == NULL )
+
+    return ret;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t validateSharedSubscriptions( const MQTTContext_t * pContext,
+                                                 const MQTTSubscribeInfo_t * pSubscriptionList,
+                                                 const size_t iterator )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint16_t topicFilterLength;
+    bool isSharedSub;
+    const char * shareNameEnd;
+    const char * shareNameStart;
+
+    assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pSubscriptionList[ iterator ].topicFilterLength ) );
+
+    topicFilterLength = ( uint16_t ) pSubscriptionList[ iterator ].topicFilterLength;
+    isSharedSub = ( topicFilterLength > 7U );
+
+    /* Need to check this only if the length is proper. */
+    if( pSubscriptionList[ iterator ].topicFilterLength > 7U )
+    {
+        isSharedSub = ( isSharedSub ) && ( ( strncmp( pSubscriptionList[ iterator ].pTopicFilter, "$share/", 7U ) ) == 0 );
+    }
+
+    if( isSharedSub )
+    {
+        shareNameStart = &( pSubscriptionList[ iterator ].pTopicFilter[ 7U ] );
+        shareNameEnd = memchr( shareNameStart, ( int32_t ) '/', ( size_t ) topicFilterLength - 7U );
+
+        if( ( shareNameEnd == NULL ) ||
+            ( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ 7 ] ) ) )
+        {
+            LogError( ( "Protocol Error : ShareName is not present , missing or empty" ) );
+            status = MQTTBadParameter;
+        }
+        else if( pSubscriptionList[ iterator ].noLocalOption )
+        {
+            LogError( ( "Protocol Error : noLocalOption cannot be 1 for shared subscriptions" ) );
+            status = MQTTBadParameter;
+        }
+        else if( pContext->connectionProperties.isSharedAvailable == 0U )
+        {
+            LogError( ( "Protocol Error : Shared Subscriptions not allowed" ) );
+            status = MQTTBadParameter;
+        }
+        else if( shareNameEnd == &( pSubscriptionList[ iterator ].pTopicFilter[ topicFilterLength - 1U ] ) )
+        {
+            LogError( ( "Protocol Error : Topic filter after share name is missing" ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            const char * ptr;
+
+            for( ptr = shareNameStart; ptr < shareNameEnd; ptr++ )
+            {
+                if( ( *ptr == '#' ) || ( *ptr == '+' ) )
+                {
+                    status = MQTTBadParameter;
+                    break; /* Invalid share name */
+                }
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void addSubscriptionOptions( const MQTTSubscribeInfo_t subscriptionInfo,
+                                    uint8_t * pSubscriptionOptionsArray,
+                                    size_t currentOptionIndex )
+{
+    uint8_t subscriptionOptions = 0U;
+
+    if( subscriptionInfo.qos == MQTTQoS1 )
+    {
+        LogInfo( ( "Adding QoS as QoS 1 in SUBSCRIBE payload" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_QOS1 );
+    }
+    else if( subscriptionInfo.qos == MQTTQoS2 )
+    {
+        LogInfo( ( "Adding QoS as QoS 2 in SUBSCRIBE payload" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_QOS2 );
+    }
+    else
+    {
+        LogInfo( ( "Adding QoS as QoS 0 in SUBSCRIBE payload" ) );
+    }
+
+    if( subscriptionInfo.noLocalOption )
+    {
+        LogInfo( ( "Adding noLocalOption in SUBSCRIBE payload" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_NO_LOCAL );
+    }
+    else
+    {
+        LogDebug( ( "Adding noLocalOption as 0 in SUBSCRIBE payload" ) );
+    }
+
+    if( subscriptionInfo.retainAsPublishedOption )
+    {
+        LogInfo( ( " retainAsPublishedOption in SUBSCRIBE payload" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_AS_PUBLISHED );
+    }
+    else
+    {
+        LogDebug( ( "retainAsPublishedOption as 0 in SUBSCRIBE payload" ) );
+    }
+
+    if( subscriptionInfo.retainHandlingOption == retainSendOnSub )
+    {
+        LogInfo( ( "Send Retain messages at the time of subscribe" ) );
+    }
+    else if( subscriptionInfo.retainHandlingOption == retainSendOnSubIfNotPresent )
+    {
+        LogInfo( ( "Send retained messages at subscribe only if the subscription does not currently exist" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_HANDLING1 );
+    }
+    else
+    {
+        LogInfo( ( "Do not send retained messages at subscribe" ) );
+        UINT8_SET_BIT( subscriptionOptions, MQTT_SUBSCRIBE_RETAIN_HANDLING2 );
+    }
+
+    pSubscriptionOptionsArray[ currentOptionIndex ] = subscriptionOptions;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t handleSubUnsubAck( MQTTContext_t * pContext,
+                                       MQTTPacketInfo_t * pIncomingPacket )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint16_t packetIdentifier;
+    MQTTEventCallback_t appCallback;
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+
+    MQTTReasonCodeInfo_t ackInfo = { 0 };
+
+    assert( pContext != NULL );
+    assert( pIncomingPacket != NULL );
+    assert( pContext->appCallback != NULL );
+
+    appCallback = pContext->appCallback;
+
+    status = MQTT_DeserializeAck( pIncomingPacket,
+                                  &packetIdentifier,
+                                  &ackInfo,
+                                  &propBuffer,
+                                  &pContext->connectionProperties );
+
+    LogInfo( ( "Ack packet deserialized with result: %s.",
+               MQTT_Status_strerror( status ) ) );
+
+    if( status == MQTTSuccess )
+    {
+        /* The packet ID is free again once the SUBACK or UNSUBACK arrives, so
+         * the application callback may use it. */
+        if( pContext->pPacketIdBitmap != NULL )
+        {
+            MQTT_FreePacketId( pContext, packetIdentifier );
+        }
+
+        if( ( pIncomingPacket->type == MQTT_PACKET_TYPE_SUBACK ) &&
+            ( pContext->pSubscriptionHandlers != NULL ) )
+        {
+            releaseFailedSubscriptionHandlers( pContext, packetIdentifier );
+        }
+
+        deserializedInfo.packetIdentifier = packetIdentifier;
+        deserializedInfo.deserializationResult = status;
+        deserializedInfo.pPublishInfo = NULL;
+        deserializedInfo.pReasonCode = &ackInfo;
+
+        /* Invoke application callback to hand the buffer over to application */
+        if( appCallback( pContext, pIncomingPacket, &deserializedInfo, NULL,
+                         NULL, &propBuffer ) == false )
+        {
+            status = MQTTEventCallbackFailed;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t sendDisconnectWithoutCopy( MQTTContext_t * pContext,
+                                               const MQTTSuccessFailReasonCode_t * pReasonCode,
+                                               uint32_t remainingLength,
+                                               const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    int32_t bytesSentOrError;
+    size_t ioVectorLength = 0U;
+    uint32_t totalMessageLength = 0U;
+    uint32_t disconnectPropLen = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+
+    /* Maximum number of bytes required by the fixed size part of the CONNECT
+     * packet header according to the MQTT specification.
+     * MQTT Control Byte      0 + 1 = 1
+     * Remaining length (max)   + 4 = 5
+     * Reason Code              + 1 = 6
+     *
+     * Note that the reason code is not actually 'fixed'. But it avoids much
+     * calculation and potential TCP/TLS overhead in some implementations later
+     * at the cost of one byte on the stack.
+     */
+    uint8_t fixedHeader[ 6U ];
+
+    /**
+     * Maximum number of bytes to send the Property Length.
+     * Property Length  0 + 4 = 4
+     */
+    uint8_t propertyLength[ 4U ];
+
+    /* The maximum vectors required to encode and send a disconnect packet. The
+     * breakdown is shown below.
+     * disconnect Header    0 + 1 = 1
+     * Property Length        + 1 = 2
+     * Optional Properties    + 1 = 3
+     * */
+    TransportOutVector_t pIoVector[ 3U ];
+
+    uint8_t * pIndex = fixedHeader;
+    TransportOutVector_t * iterator = pIoVector;
+
+    assert( pContext != NULL );
+    assert( remainingLength < MQTT_REMAINING_LENGTH_INVALID );
+
+    if( pPropertyBuilder != NULL )
+    {
+        assert( pReasonCode != NULL );
+    }
+
+    /* Only for fixed size fields. */
+    pIndex = serializeDisconnectFixed( pIndex, pReasonCode, remainingLength );
+    iterator->iov_base = fixedHeader;
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+    /* coverity[misra_c_2012_rule_18_2_violation] */
+    /* coverity[misra_c_2012_rule_10_8_violation] */
+    iterator->iov_len = ( size_t ) ( pIndex - fixedHeader );
+    assert( iterator->iov_len <= 6U );
+    totalMessageLength += ( uint32_t ) iterator->iov_len;
+    iterator++;
+    ioVectorLength++;
+
+    if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    {
+        disconnectPropLen = ( uint32_t ) pPropertyBuilder->currentIndex;
+    }
+
+    pIndex = encodeVariableLength( propertyLength, disconnectPropLen );
+    iterator->iov_base = propertyLength;
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+    /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
+    /* coverity[misra_c_2012_rule_18_2_violation] */
+    /* coverity[misra_c_2012_rule_10_8_violation] */
+    iterator->iov_len = ( size_t ) ( pIndex - propertyLength );
+    totalMessageLength += ( uint32_t ) iterator->iov_len;
+    iterator++;
+    ioVectorLength++;
+
+    if( disconnectPropLen > 0U )
+    {
+        iterator->iov_base = pPropertyBuilder->pBuffer;
+        iterator->iov_len = pPropertyBuilder->currentIndex;
+
+        if( ADDITION_WILL_OVERFLOW_U32( totalMessageLength, pPropertyBuilder->currentIndex ) ||
+            ( ( totalMessageLength + pPropertyBuilder->currentIndex ) > MQTT_MAX_PACKET_SIZE ) )
+        {
+            LogError( ( "Total MQTT packet size must be less than 268435461" ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            totalMessageLength += ( uint32_t ) iterator->iov_len;
+            iterator++;
+            ioVectorLength++;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        bytesSentOrError = sendMessageVector( pContext, pIoVector, ioVectorLength );
+
+        if( bytesSentOrError != ( int32_t ) totalMessageLength )
+        {
+            status = MQTTSendFailed;
+            LogError( ( "Failed to send disconnect packet." ) );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Init( MQTTContext_t * pContext,
+                        const TransportInterface_t * pTransportInterface,
+                        MQTTGetCurrentTimeFunc_t getTimeFunction,
+                        MQTTEventCallback_t userCallback,
+                        const MQTTFixedBuffer_t * pNetworkBuffer )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    /* Validate arguments. */
+    if( ( pContext == NULL ) || ( pTransportInterface == NULL ) ||
+        ( pNetworkBuffer == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pTransportInterface=%p, "
+                    "pNetworkBuffer=%p",
+                    ( void * ) pContext,
+                    ( const void * ) pTransportInterface,
+                    ( const void * ) pNetworkBuffer ) );
+        status = MQTTBadParameter;
+    }
+    else if( getTimeFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: getTimeFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( userCallback == NULL )
+    {
+        LogError( ( "Invalid parameter: userCallback is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( pTransportInterface->recv == NULL )
+    {
+        LogError( ( "Invalid parameter: pTransportInterface->recv is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( pTransportInterface->send == NULL )
+    {
+        LogError( ( "Invalid parameter: pTransportInterface->send is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pContext, 0x00, sizeof( MQTTContext_t ) );
+
+        pContext->connectStatus = MQTTNotConnected;
+        pContext->transportInterface = *pTransportInterface;
+        pContext->getTime = getTimeFunction;
+        pContext->appCallback = userCallback;
+        pContext->networkBuffer = *pNetworkBuffer;
+        pContext->ackPropsBuffer.pBuffer = NULL;
+
+        /* Zero is not a valid packet ID per MQTT spec. Start from 1. */
+        pContext->nextPacketId = 1;
+
+        /* Setting default connect properties in our application */
+        status = MQTT_InitConnect( &( pContext->connectionProperties ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
+                                   MQTTPubAckInfo_t * pOutgoingPublishRecords,
+                                   size_t outgoingPublishCount,
+                                   MQTTPubAckInfo_t * pIncomingPublishRecords,
+                                   size_t incomingPublishCount,
+                                   uint8_t * pAckPropsBuf,
+                                   size_t ackPropsBufLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+
+    /* Check whether the arguments make sense. Not equal here behaves
+     * like an exclusive-or operator for boolean values. */
+    else if( ( outgoingPublishCount == 0U ) !=
+             ( pOutgoingPublishRecords == NULL ) )
+    {
+        LogError( ( "Arguments do not match: pOutgoingPublishRecords=%p, "
+                    "outgoingPublishCount=%lu",
+                    ( void * ) pOutgoingPublishRecords,
+                    ( unsigned long ) outgoingPublishCount ) );
+        status = MQTTBadParameter;
+    }
+
+    /* Check whether the arguments make sense. Not equal here behaves
+     * like an exclusive-or operator for boolean values. */
+    else if( ( incomingPublishCount == 0U ) !=
+             ( pIncomingPublishRecords == NULL ) )
+    {
+        LogError( ( "Arguments do not match: pIncomingPublishRecords=%p, "
+                    "incomingPublishCount=%lu",
+                    ( void * ) pIncomingPublishRecords,
+                    ( unsigned long ) incomingPublishCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->appCallback == NULL )
+    {
+        LogError( ( "MQTT_InitStatefulQoS must be called only after MQTT_Init has"
+                    " been called successfully.\n" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->incomingPublishRecordMaxCount = incomingPublishCount;
+        pContext->incomingPublishRecords = pIncomingPublishRecords;
+        pContext->outgoingPublishRecordMaxCount = outgoingPublishCount;
+        pContext->outgoingPublishRecords = pOutgoingPublishRecords;
+        pContext->pIncomingPublishIndex = NULL;
+        pContext->pOutgoingPublishIndex = NULL;
+        pContext->pPacketIdBitmap = NULL;
+
+        if( ( pAckPropsBuf != NULL ) && ( ackPropsBufLength != 0U ) )
+        {
+            status = MQTTPropertyBuilder_Init( &pContext->ackPropsBuffer, pAckPropsBuf, ackPropsBufLength );
+        }
+        else
+        {
+            pContext->ackPropsBuffer.pBuffer = NULL;
+            pContext->ackPropsBuffer.bufferLength = 0;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitStatefulQoSIndex( MQTTContext_t * pContext,
+                                        MQTTPubAckIndex_t * pOutgoingPublishIndex,
+                                        uint16_t * pOutgoingBuckets,
+                                        size_t outgoingBucketCount,
+                                        MQTTPubAckIndex_t * pIncomingPublishIndex,
+                                        uint16_t * pIncomingBuckets,
+                                        size_t incomingBucketCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pOutgoingPublishIndex != NULL ) &&
+             ( validateStateIndex( pContext->outgoingPublishRecordMaxCount,
+                                   pOutgoingBuckets,
+                                   outgoingBucketCount ) == false ) )
+    {
+        LogError( ( "Invalid index of outgoing publish records: pOutgoingBuckets=%p, "
+                    "outgoingBucketCount=%lu",
+                    ( void * ) pOutgoingBuckets,
+                    ( unsigned long ) outgoingBucketCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pIncomingPublishIndex != NULL ) &&
+             ( validateStateIndex( pContext->incomingPublishRecordMaxCount,
+                                   pIncomingBuckets,
+                                   incomingBucketCount ) == false ) )
+    {
+        LogError( ( "Invalid index of incoming publish records: pIncomingBuckets=%p, "
+                    "incomingBucketCount=%lu",
+                    ( void * ) pIncomingBuckets,
+                    ( unsigned long ) incomingBucketCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        if( pOutgoingPublishIndex != NULL )
+        {
+            pOutgoingPublishIndex->pBuckets = pOutgoingBuckets;
+            pOutgoingPublishIndex->bucketCount = outgoingBucketCount;
+            MQTT_ResetStateIndex( pOutgoingPublishIndex,
+                                  pContext->outgoingPublishRecords,
+                                  pContext->outgoingPublishRecordMaxCount );
+        }
+
+        if( pIncomingPublishIndex != NULL )
+        {
+            pIncomingPublishIndex->pBuckets = pIncomingBuckets;
+            pIncomingPublishIndex->bucketCount = incomingBucketCount;
+            MQTT_ResetStateIndex( pIncomingPublishIndex,
+                                  pContext->incomingPublishRecords,
+                                  pContext->incomingPublishRecordMaxCount );
+        }
+
+        pContext->pOutgoingPublishIndex = pOutgoingPublishIndex;
+        pContext->pIncomingPublishIndex = pIncomingPublishIndex;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitPacketIdAllocator( MQTTContext_t * pContext,
+                                         uint32_t * pBitmap,
+                                         size_t bitmapWordCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pBitmap == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pBitmap=%p",
+                    ( void * ) pContext,
+                    ( void * ) pBitmap ) );
+        status = MQTTBadParameter;
+    }
+    else if( bitmapWordCount < MQTT_PACKET_ID_BITMAP_WORDS )
+    {
+        LogError( ( "Packet ID bitmap must have at least %u words: bitmapWordCount=%lu",
+                    ( unsigned int ) MQTT_PACKET_ID_BITMAP_WORDS,
+                    ( unsigned long ) bitmapWordCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pPacketIdBitmap = pBitmap;
+        MQTT_ResetPacketIds( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitOutgoingTopicAliases( MQTTContext_t * pContext,
+                                            MQTTTopicAlias_t * pAliases,
+                                            size_t aliasCount,
+                                            char * pTopicNames,
+                                            size_t topicNameLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pAliases == NULL ) || ( pTopicNames == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pAliases=%p, pTopicNames=%p",
+                    ( void * ) pContext,
+                    ( void * ) pAliases,
+                    ( void * ) pTopicNames ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( aliasCount == 0U ) || ( aliasCount > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Number of topic aliases must be between 1 and 65535: aliasCount=%lu",
+                    ( unsigned long ) aliasCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( topicNameLength == 0U ) || ( topicNameLength > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Topic name length must be between 1 and 65535: topicNameLength=%lu",
+                    ( unsigned long ) topicNameLength ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pOutgoingTopicAliases = pAliases;
+        pContext->outgoingTopicAliasCapacity = aliasCount;
+        pContext->pOutgoingTopicAliasNames = pTopicNames;
+        pContext->outgoingTopicAliasNameLength = topicNameLength;
+        resetOutgoingTopicAliases( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitIncomingTopicAliases( MQTTContext_t * pContext,
+                                            MQTTTopicAlias_t * pAliases,
+                                            size_t aliasCount,
+                                            char * pTopicNames,
+                                            size_t topicNameLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pAliases == NULL ) || ( pTopicNames == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pAliases=%p, pTopicNames=%p",
+                    ( void * ) pContext,
+                    ( void * ) pAliases,
+                    ( void * ) pTopicNames ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( aliasCount == 0U ) || ( aliasCount > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Number of topic aliases must be between 1 and 65535: aliasCount=%lu",
+                    ( unsigned long ) aliasCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( topicNameLength == 0U ) || ( topicNameLength > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Topic name length must be between 1 and 65535: topicNameLength=%lu",
+                    ( unsigned long ) topicNameLength ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pIncomingTopicAliases = pAliases;
+        pContext->incomingTopicAliasCapacity = aliasCount;
+        pContext->pIncomingTopicAliasNames = pTopicNames;
+        pContext->incomingTopicAliasNameLength = topicNameLength;
+        resetIncomingTopicAliases( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitSubscriptionHandlers( MQTTContext_t * pContext,
+                                            MQTTSubscriptionHandler_t * pHandlers,
+                                            size_t handlerCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t i;
+
+    if( ( pContext == NULL ) || ( pHandlers == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pHandlers=%p",
+                    ( void * ) pContext,
+                    ( void * ) pHandlers ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( handlerCount == 0U ) || ( handlerCount > ( size_t ) MAX_VARIABLE_LENGTH_INT_VALUE ) )
+    {
+        LogError( ( "Number of handlers must be between 1 and %lu: handlerCount=%lu",
+                    ( unsigned long ) MAX_VARIABLE_LENGTH_INT_VALUE,
+                    ( unsigned long ) handlerCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        for( i = 0U; i < handlerCount; i++ )
+        {
+            pHandlers[ i ].callback = NULL;
+            pHandlers[ i ].pUserData = NULL;
+            pHandlers[ i ].failedPacketId = MQTT_PACKET_ID_INVALID;
+        }
+
+        pContext->pSubscriptionHandlers = pHandlers;
+        pContext->subscriptionHandlerCount = handlerCount;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitIncomingPropertyIndex( MQTTContext_t * pContext,
+                                             MQTTPropIndex_t * pIndex )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pIndex == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pIndex=%p",
+                    ( void * ) pContext,
+                    ( void * ) pIndex ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* The index describes no properties until a PUBLISH is received. */
+        pIndex->pBuffer = NULL;
+        pIndex->length = 0U;
+        pContext->pIncomingPropIndex = pIndex;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitIncomingPublishProperties( MQTTContext_t * pContext,
+                                                 MQTTPublishProperties_t * pProperties )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pProperties == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pProperties=%p",
+                    ( void * ) pContext,
+                    ( void * ) pProperties ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pProperties, 0, sizeof( MQTTPublishProperties_t ) );
+        pContext->pIncomingPublishProperties = pProperties;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
+                                   MQTTStorePacketForRetransmit storeFunction,
+                                   MQTTRetrievePacketForRetransmit retrieveFunction,
+                                   MQTTClearPacketForRetransmit clearFunction )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( storeFunction == NULL )
     {
         LogError( ( "Invalid parameter: storeFunction is NULL" ) );
         status = MQTTBadParameter;
     }
-    else if( retrieveFunction == NULL )
+    else if( retrieveFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: retrieveFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( clearFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: clearFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->storeFunction = storeFunction;
+        pContext->retrieveFunction = retrieveFunction;
+        pContext->clearFunction = clearFunction;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRetransmitBatch( MQTTContext_t * pContext,
+                                       MQTTRetrievePacketsForRetransmit retrieveBatchFunction )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( retrieveBatchFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: retrieveBatchFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->retrieveFunction == NULL )
+    {
+        LogError( ( "Retransmits have not been initialized. Please call "
+                    "MQTT_InitRetransmits first." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->retrieveBatchFunction = retrieveBatchFunction;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRetransmitReferences( MQTTContext_t * pContext,
+                                            MQTTStorePublishByReference storeReferenceFunction,
+                                            MQTTRetrievePublishByReference retrieveReferenceFunction )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( storeReferenceFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: storeReferenceFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( retrieveReferenceFunction == NULL )
+    {
+        LogError( ( "Invalid parameter: retrieveReferenceFunction is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pContext->retrieveFunction == NULL ) ||
+             ( pContext->clearFunction == NULL ) )
+    {
+        LogError( ( "Retransmits have not been initialized. Please call "
+                    "MQTT_InitRetransmits first." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->storeReferenceFunction = storeReferenceFunction;
+        pContext->retrieveReferenceFunction = retrieveReferenceFunction;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRecvLease( MQTTContext_t * pContext,
+                                 TransportRecvLease_t recvLease,
+                                 TransportRelease_t release )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( recvLease == NULL ) || ( release == NULL ) )
+    {
+        LogError( ( "Invalid parameter: recvLease and release must both be set" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->recvLease = recvLease;
+        pContext->release = release;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitWaitReadable( MQTTContext_t * pContext,
+                                    TransportWaitReadable_t waitReadable,
+                                    uint32_t timeoutMs )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( waitReadable == NULL )
+    {
+        LogError( ( "Invalid parameter: waitReadable is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->waitReadable = waitReadable;
+        pContext->waitReadableTimeoutMs = timeoutMs;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitRingReceive( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p\n",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->ringReceiveEnabled = true;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitPublishStreaming( MQTTContext_t * pContext,
+                                        MQTTPublishStream_t * pPublishStream,
+                                        MQTTPublishChunkCallback_t chunkCallback )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pPublishStream == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pPublishStream=%p\n",
+                    ( void * ) pContext,
+                    ( void * ) pPublishStream ) );
+        status = MQTTBadParameter;
+    }
+    else if( chunkCallback == NULL )
+    {
+        LogError( ( "Invalid parameter: chunkCallback is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pPublishStream, 0x00, sizeof( MQTTPublishStream_t ) );
+        pContext->pPublishStream = pPublishStream;
+        pContext->publishChunkCallback = chunkCallback;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitAckCoalescing( MQTTContext_t * pContext,
+                                     uint8_t * pAckBuffer,
+                                     size_t ackBufferSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pAckBuffer == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pAckBuffer=%p\n",
+                    ( void * ) pContext,
+                    ( void * ) pAckBuffer ) );
+        status = MQTTBadParameter;
+    }
+    else if( ackBufferSize < MQTT_PUBLISH_ACK_PACKET_SIZE )
+    {
+        LogError( ( "Ack buffer must hold at least one ack: ackBufferSize=%lu",
+                    ( unsigned long ) ackBufferSize ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pAckStagingBuffer = pAckBuffer;
+        pContext->ackStagingCapacity = ackBufferSize / MQTT_PUBLISH_ACK_PACKET_SIZE;
+        pContext->ackStagedCount = 0U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitNonBlockingSend( MQTTContext_t * pContext,
+                                       uint8_t * pBuffer,
+                                       size_t bufferSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pBuffer == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pBuffer=%p\n",
+                    ( void * ) pContext,
+                    ( void * ) pBuffer ) );
+        status = MQTTBadParameter;
+    }
+    else if( bufferSize == 0U )
+    {
+        LogError( ( "Pending send buffer cannot be empty." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->pendingSendBuffer.pBuffer = pBuffer;
+        pContext->pendingSendBuffer.size = bufferSize;
+        pContext->pendingSendOffset = 0U;
+        pContext->pendingSendLength = 0U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t flushPendingBytes( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    assert( pContext != NULL );
+
+    if( pContext->pendingSendLength > 0U )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        {
+            status = sendPendingBytes( pContext, 0U );
+        }
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_FlushPending( MQTTContext_t * pContext )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p.",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->getTime == NULL )
+    {
+        LogError( ( "MQTT Context must have a valid getTime function." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        status = flushPendingBytes( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_InitSubscribeBuffer( MQTTContext_t * pContext,
+                                       uint8_t * pBuffer,
+                                       size_t bufferSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pBuffer == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pBuffer=%p\n",
+                    ( void * ) pContext,
+                    ( void * ) pBuffer ) );
+        status = MQTTBadParameter;
+    }
+    else if( bufferSize == 0U )
+    {
+        LogError( ( "Subscribe buffer cannot be empty." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pContext->subscribeBuffer.pBuffer = pBuffer;
+        pContext->subscribeBuffer.size = bufferSize;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
+                                  uint16_t packetId )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogWarn( ( "pContext is NULL\n" ) );
+        status = MQTTBadParameter;
+    }
+    else if( pContext->outgoingPublishRecords == NULL )
+    {
+        LogError( ( "QoS1/QoS2 is not initialized for use. Please "
+                    "call MQTT_InitStatefulQoS to enable QoS1 and QoS2 "
+                    "publishes.\n" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        status = MQTT_RemoveStateRecord( pContext,
+                                         packetId );
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext )
+{
+    MQTTConnectionStatus_t connectStatus;
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( pContext == NULL )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p",
+                    ( const void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        switch( connectStatus )
+        {
+            case MQTTConnected:
+                status = MQTTStatusConnected;
+                break;
+
+            case MQTTDisconnectPending:
+                status = MQTTStatusDisconnectPending;
+                break;
+
+            default:
+                status = MQTTStatusNotConnected;
+                break;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
+                           const MQTTConnectInfo_t * pConnectInfo,
+                           const MQTTPublishInfo_t * pWillInfo,
+                           uint32_t timeoutMs,
+                           bool * pSessionPresent,
+                           MQTTPropBuilder_t * pPropertyBuilder,
+                           const MQTTPropBuilder_t * pWillPropertyBuilder )
+{
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPacketInfo_t incomingPacket = { 0 };
+    MQTTConnectionStatus_t connectStatus;
+    uint8_t backupPropBuffer[ 5 ];
+    MQTTPropBuilder_t backupPropBuilder = { 0 };
+    MQTTPropBuilder_t * pBackupPropBuilder = pPropertyBuilder;
+
+    if( ( pContext == NULL ) || ( pConnectInfo == NULL ) || ( pSessionPresent == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pConnectInfo=%p, pSessionPresent=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pConnectInfo,
+                    ( void * ) pSessionPresent ) );
+        status = MQTTBadParameter;
+    }
+
+    if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) && ( pWillPropertyBuilder != NULL ) )
+    {
+        status = MQTT_ValidateWillProperties( pWillPropertyBuilder );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        if( pBackupPropBuilder != NULL )
+        {
+            bool isRequestProblemInfoSet = false;
+            uint32_t packetMaxSize = UINT32_MAX;
+            status = MQTT_ValidateConnectProperties( pBackupPropBuilder,
+                                                     &isRequestProblemInfoSet,
+                                                     &packetMaxSize );
+
+            /* Update the field in the context so that it can be gated on. Note that we
+             * did not intentionally check the result of the above API call as it will be
+             * checked later. Even if the call fails, we will set the variable in the
+             * context incorrectly which is fine. */
+            pContext->connectionProperties.requestProblemInfo = isRequestProblemInfoSet;
+
+            if( packetMaxSize > pContext->networkBuffer.size )
+            {
+                LogError( ( "Properties have packet maximum set to %" PRIu32
+                            " whereas the buffer length is %" PRIu32
+                            ". Please make sure that buffer is at least as big as %" PRIu32
+                            " otherwise the server can send a bigger packet which cannot be processed by the coreMQTT library.",
+                            packetMaxSize,
+                            ( uint32_t ) pContext->networkBuffer.size,
+                            packetMaxSize ) );
+                status = MQTTBadParameter;
+            }
+
+            if( ( status == MQTTSuccess ) && ( pContext->pIncomingTopicAliases != NULL ) )
+            {
+                status = limitIncomingTopicAliasMax( pContext, pBackupPropBuilder );
+            }
+        }
+        else
+        {
+            uint32_t maxPacketSize;
+            backupPropBuilder.pBuffer = backupPropBuffer;
+            backupPropBuilder.bufferLength = sizeof( backupPropBuffer );
+
+            pBackupPropBuilder = &backupPropBuilder;
+
+            if( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->networkBuffer.size ) )
+            {
+                maxPacketSize = 0xFFFFFFFFU;
+            }
+            else
+            {
+                maxPacketSize = ( uint32_t ) pContext->networkBuffer.size;
+            }
+
+            LogInfo( ( "Application has not set any properties. Adding a property to set the maximum "
+                       "packet size received from the server for the client to be %" PRIu32 ".",
+                       maxPacketSize ) );
+            status = MQTTPropAdd_MaxPacketSize( pBackupPropBuilder,
+                                                maxPacketSize,
+                                                NULL );
+        }
+    }
+
+    if( status == MQTTSuccess )
     {
-        LogError( ( "Invalid parameter: retrieveFunction is NULL" ) );
-        status = MQTTBadParameter;
+        /* Get MQTT connect packet size and remaining length. */
+        status = MQTT_GetConnectPacketSize( pConnectInfo,
+                                            pWillInfo,
+                                            pBackupPropBuilder,
+                                            pWillPropertyBuilder,
+                                            &remainingLength,
+                                            &packetSize );
+        /* coverity[sensitive_data_leak] */
+        LogDebug( ( "CONNECT packet size is %lu and remaining length is %lu.",
+                    ( unsigned long ) packetSize,
+                    ( unsigned long ) remainingLength ) );
     }
-    else if( clearFunction == NULL )
+
+    if( status == MQTTSuccess )
     {
-        LogError( ( "Invalid parameter: clearFunction is NULL" ) );
-        status = MQTTBadParameter;
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        if( connectStatus != MQTTNotConnected )
+        {
+            status = ( connectStatus == MQTTConnected ) ? MQTTStatusConnected : MQTTStatusDisconnectPending;
+        }
+
+        if( status == MQTTSuccess )
+        {
+            /* Bytes kept for an earlier connection are never sent on this one. */
+            pContext->pendingSendOffset = 0U;
+            pContext->pendingSendLength = 0U;
+
+            status = sendConnectWithoutCopy( pContext,
+                                             pConnectInfo,
+                                             pWillInfo,
+                                             remainingLength,
+                                             pBackupPropBuilder,
+                                             pWillPropertyBuilder );
+        }
+
+        /* TODO: As part of CONNECT/CONNACK setup, there can be AUTH packets sent.
+         * It is not dealt with currently. */
+
+        /* Read CONNACK from transport layer. */
+        if( status == MQTTSuccess )
+        {
+            status = receiveConnack( pContext,
+                                     timeoutMs,
+                                     pConnectInfo->cleanSession,
+                                     &incomingPacket,
+                                     pSessionPresent );
+        }
+
+        /**
+         * Update the maximum number of concurrent incoming and outgoing PUBLISH records
+         * based on MQTT 5.0 Receive Maximum property :
+         *
+         * - For incoming publishes: Use the minimum between the client's configured receive maximum
+         *   (In the MQTT_Init function) and the receive maximum value sent in CONNECT properties
+         *
+         * - For outgoing publishes: Use the minimum between the client's configured maximum
+         *   (In the MQTT_Init function) and the server's receive maximum value received in CONNACK properties
+         **/
+        if( status == MQTTSuccess )
+        {
+            if( pContext->connectionProperties.receiveMax < pContext->incomingPublishRecordMaxCount )
+            {
+                pContext->incomingPublishRecordMaxCount = pContext->connectionProperties.receiveMax;
+
+                /* Records past the new count are no longer in use. */
+                if( pContext->pIncomingPublishIndex != NULL )
+                {
+                    MQTT_ResetStateIndex( pContext->pIncomingPublishIndex,
+                                          pContext->incomingPublishRecords,
+                                          pContext->incomingPublishRecordMaxCount );
+                }
+            }
+
+            if( pContext->connectionProperties.serverReceiveMax < pContext->outgoingPublishRecordMaxCount )
+            {
+                pContext->outgoingPublishRecordMaxCount = pContext->connectionProperties.serverReceiveMax;
+
+                if( pContext->pOutgoingPublishIndex != NULL )
+                {
+                    MQTT_ResetStateIndex( pContext->pOutgoingPublishIndex,
+                                          pContext->outgoingPublishRecords,
+                                          pContext->outgoingPublishRecordMaxCount );
+                }
+            }
+        }
+
+        if( ( status == MQTTSuccess ) && ( *pSessionPresent != true ) )
+        {
+            status = handleCleanSession( pContext );
+        }
+
+        if( status == MQTTSuccess )
+        {
+            pContext->connectStatus = MQTTConnected;
+
+            /* Packets of the previous connection which were not acknowledged
+             * never will be, except the publishes of a resumed session. */
+            if( pContext->pPacketIdBitmap != NULL )
+            {
+                MQTT_ResetPacketIds( pContext );
+            }
+
+            /* Topic aliases only last as long as a connection. */
+            if( pContext->pOutgoingTopicAliases != NULL )
+            {
+                resetOutgoingTopicAliases( pContext );
+            }
+
+            if( pContext->pIncomingTopicAliases != NULL )
+            {
+                resetIncomingTopicAliases( pContext );
+            }
+
+            /* The SUBACK of a SUBSCRIBE which failed to send never arrives
+             * on a new connection. */
+            if( pContext->pSubscriptionHandlers != NULL )
+            {
+                releaseFailedSubscriptionHandlers( pContext, MQTT_PACKET_ID_INVALID );
+            }
+
+            /* A PUBLISH partly streamed over the previous connection is sent
+             * again in full, whether or not the session is resumed. */
+            resetPublishStream( pContext );
+
+            /**
+             * Initialize the client's keep-alive timer using the Server Keep Alive value
+             * received in the CONNACK.
+             * This value overrides the client's original keep-alive setting,
+             * as per MQTT v5 specification.
+             */
+            pContext->keepAliveIntervalSec = pContext->connectionProperties.serverKeepAlive;
+            pContext->waitingForPingResp = false;
+            pContext->pingReqSendTimeMs = 0U;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    if( ( status == MQTTSuccess ) && ( *pSessionPresent == true ) )
+    {
+        /* Resend PUBRELs and PUBLISHES when reestablishing a session */
+        if( ( pContext->retrieveFunction != NULL ) &&
+            ( pContext->retrieveBatchFunction != NULL ) &&
+            ( pContext->retrieveReferenceFunction == NULL ) )
+        {
+            status = resendStoredPacketBatches( pContext );
+        }
+        else
+        {
+            status = handleUncleanSessionResumption( pContext );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        LogInfo( ( "MQTT connection established with the broker." ) );
+    }
+    else if( ( status == MQTTStatusConnected ) || ( status == MQTTStatusDisconnectPending ) )
+    {
+        LogInfo( ( "MQTT Connection is either already established or a disconnect is pending, return status = %s.",
+                   MQTT_Status_strerror( status ) ) );
+    }
+    else if( pContext == NULL )
+    {
+        LogError( ( "MQTT connection failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
     }
     else
     {
-        pContext->storeFunction = storeFunction;
-        pContext->retrieveFunction = retrieveFunction;
-        pContext->clearFunction = clearFunction;
+        LogError( ( "MQTT connection failed with status = %s.",
+                    MQTT_Status_strerror( status ) ) );
+
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        if( pContext->connectStatus == MQTTConnected )
+        {
+            /* This will only be executed if after the connack is received
+             * the retransmits fail for some reason on an unclean session
+             * connection. In this case we need to retry the re-transmits
+             * which can only be done using the connect API and that can only
+             * be done once we are disconnected, hence we ask the user to
+             * call disconnect here */
+            pContext->connectStatus = MQTTDisconnectPending;
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
+                             const MQTTSubscribeInfo_t * pSubscriptionList,
+                             size_t subscriptionCount,
+                             uint16_t packetId,
+                             const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    MQTTConnectionStatus_t connectStatus;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    MQTTStatus_t status = MQTTSuccess;
+
+    status = validateSubscribeUnsubscribeParams( pContext,
+                                                 pSubscriptionList,
+                                                 subscriptionCount,
+                                                 packetId,
+                                                 MQTT_TYPE_SUBSCRIBE );
+
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    {
+        bool isSubscriptionIdAvailable;
+        assert( ( pContext->connectionProperties.isSubscriptionIdAvailable == 0U ) ||
+                ( pContext->connectionProperties.isSubscriptionIdAvailable == 1U ) );
+
+        isSubscriptionIdAvailable = ( pContext->connectionProperties.isSubscriptionIdAvailable != 0U );
+
+        /* Sealed properties were validated assuming Subscription Identifiers
+         * are available. */
+        if( ( isSubscriptionIdAvailable == false ) ||
+            ( isPropertyBuilderSealed( pPropertyBuilder, MQTT_PACKET_TYPE_SUBSCRIBE ) == false ) )
+        {
+            status = MQTT_ValidateSubscribeProperties( isSubscriptionIdAvailable,
+                                                       pPropertyBuilder );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        /* Get the remaining length and packet size. */
+        status = MQTT_GetSubscribePacketSize( pSubscriptionList,
+                                              subscriptionCount,
+                                              pPropertyBuilder,
+                                              &remainingLength,
+                                              &packetSize,
+                                              pContext->connectionProperties.serverMaxPacketSize );
+        LogDebug( ( "SUBSCRIBE packet size is %lu and remaining length is %lu.",
+                    ( unsigned long ) packetSize,
+                    ( unsigned long ) remainingLength ) );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        connectStatus = pContext->connectStatus;
+
+        if( connectStatus != MQTTConnected )
+        {
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+        }
+
+        if( status != MQTTSuccess )
+        {
+            /* Not connected. */
+        }
+        else if( ( pContext->subscribeBuffer.pBuffer != NULL ) &&
+                 ( packetSize <= pContext->subscribeBuffer.size ) )
+        {
+            /* Send the whole SUBSCRIBE packet with one transport write. */
+            status = sendSerializedSubUnsub( pContext,
+                                             pSubscriptionList,
+                                             subscriptionCount,
+                                             packetId,
+                                             remainingLength,
+                                             packetSize,
+                                             pPropertyBuilder,
+                                             MQTT_PACKET_TYPE_SUBSCRIBE );
+        }
+        else
+        {
+            /* Send MQTT SUBSCRIBE packet. */
+            status = sendSubscribeWithoutCopy( pContext,
+                                               pSubscriptionList,
+                                               subscriptionCount,
+                                               packetId,
+                                               remainingLength,
+                                               pPropertyBuilder );
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
     return status;
@@ -4336,71 +8837,122 @@ MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_CancelCallback( const MQTTContext_t * pContext,
-                                  uint16_t packetId )
+MQTTStatus_t MQTT_SubscribeWithHandler( MQTTContext_t * pContext,
+                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                        size_t subscriptionCount,
+                                        uint16_t packetId,
+                                        MQTTPropBuilder_t * pPropertyBuilder,
+                                        MQTTSubscriptionCallback_t callback,
+                                        void * pUserData,
+                                        uint32_t * pSubscriptionId )
 {
     MQTTStatus_t status = MQTTSuccess;
-
-    if( pContext == NULL )
-    {
-        LogWarn( ( "pContext is NULL\n" ) );
+    MQTTPropBuilder_t idPropertyBuilder = { 0 };
+    uint8_t idPropertyBuffer[ CORE_MQTT_SUBSCRIPTION_ID_PROPERTY_MAX_SIZE ];
+    MQTTPropBuilder_t * pBuilder = pPropertyBuilder;
+    size_t builderIndex = 0U;
+    uint32_t builderFieldSet = 0U;
+    MQTTPropBuilderSeal_t builderSeal = { 0 };
+    uint8_t packetType = MQTT_PACKET_TYPE_SUBSCRIBE;
+    MQTTSubscriptionHandler_t * pHandler = NULL;
+    size_t handlerIndex = 0U;
+
+    if( ( pContext == NULL ) || ( callback == NULL ) || ( pSubscriptionId == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pContext=%p, pSubscriptionId=%p",
+                    ( void * ) pContext,
+                    ( void * ) pSubscriptionId ) );
         status = MQTTBadParameter;
     }
-    else if( pContext->outgoingPublishRecords == NULL )
+    else if( pContext->pSubscriptionHandlers == NULL )
     {
-        LogError( ( "QoS1/QoS2 is not initialized for use. Please "
-                    "call MQTT_InitStatefulQoS to enable QoS1 and QoS2 "
-                    "publishes.\n" ) );
+        LogError( ( "Subscription handlers have not been initialized. Please "
+                    "call MQTT_InitSubscriptionHandlers first." ) );
         status = MQTTBadParameter;
     }
     else
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-
-        status = MQTT_RemoveStateRecord( pContext,
-                                         packetId );
+        while( ( pHandler == NULL ) && ( handlerIndex < pContext->subscriptionHandlerCount ) )
+        {
+            if( pContext->pSubscriptionHandlers[ handlerIndex ].callback == NULL )
+            {
+                pHandler = &pContext->pSubscriptionHandlers[ handlerIndex ];
+            }
+            else
+            {
+                handlerIndex++;
+            }
+        }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        if( pHandler == NULL )
+        {
+            LogError( ( "All %lu subscription identifiers are in use.",
+                        ( unsigned long ) pContext->subscriptionHandlerCount ) );
+            status = MQTTNoMemory;
+        }
     }
 
-    return status;
-}
-
-/*-----------------------------------------------------------*/
-
-MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext )
-{
-    MQTTConnectionStatus_t connectStatus;
-    MQTTStatus_t status = MQTTSuccess;
-
-    if( pContext == NULL )
+    if( status == MQTTSuccess )
     {
-        LogError( ( "Argument cannot be NULL: pContext=%p",
-                    ( const void * ) pContext ) );
-        status = MQTTBadParameter;
+        if( pBuilder == NULL )
+        {
+            idPropertyBuilder.pBuffer = idPropertyBuffer;
+            idPropertyBuilder.bufferLength = sizeof( idPropertyBuffer );
+            pBuilder = &idPropertyBuilder;
+        }
+        else
+        {
+            builderIndex = pBuilder->currentIndex;
+            builderFieldSet = pBuilder->fieldSet;
+            builderSeal = pBuilder->seal;
+        }
+
+        status = MQTTPropAdd_SubscriptionId( pBuilder,
+                                             ( uint32_t ) ( handlerIndex + 1U ),
+                                             &packetType );
     }
 
     if( status == MQTTSuccess )
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
-
-        connectStatus = pContext->connectStatus;
+        /* Register the handler before sending, as a matching PUBLISH may be
+         * received as soon as the SUBSCRIBE is sent. */
+        pHandler->callback = callback;
+        pHandler->pUserData = pUserData;
+        pContext->packetBytesSent = false;
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        status = MQTT_Subscribe( pContext,
+                                 pSubscriptionList,
+                                 subscriptionCount,
+                                 packetId,
+                                 pBuilder );
 
-        switch( connectStatus )
+        /* Give the properties of the application back as they were, sealed
+         * if they were, as adding the identifier unsealed them. */
+        if( pPropertyBuilder != NULL )
         {
-            case MQTTConnected:
-                status = MQTTStatusConnected;
-                break;
-
-            case MQTTDisconnectPending:
-                status = MQTTStatusDisconnectPending;
-                break;
+            pPropertyBuilder->currentIndex = builderIndex;
+            pPropertyBuilder->fieldSet = builderFieldSet;
+            pPropertyBuilder->seal = builderSeal;
+        }
 
-            default:
-                status = MQTTStatusNotConnected;
-                break;
+        if( status == MQTTSuccess )
+        {
+            *pSubscriptionId = ( uint32_t ) ( handlerIndex + 1U );
+        }
+        else if( pContext->packetBytesSent == true )
+        {
+            /* The broker may still get the SUBSCRIBE and send matching
+             * PUBLISH packets, until its SUBACK or a new connection. */
+            LogWarn( ( "Keeping the handler of subscription identifier %lu until "
+                       "the SUBACK of the partly sent SUBSCRIBE.",
+                       ( unsigned long ) ( handlerIndex + 1U ) ) );
+            pHandler->failedPacketId = packetId;
+            *pSubscriptionId = ( uint32_t ) ( handlerIndex + 1U );
+        }
+        else
+        {
+            pHandler->callback = NULL;
+            pHandler->pUserData = NULL;
         }
     }
 
@@ -4409,226 +8961,293 @@ MQTTStatus_t MQTT_CheckConnectStatus( const MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
-                           const MQTTConnectInfo_t * pConnectInfo,
-                           const MQTTPublishInfo_t * pWillInfo,
-                           uint32_t timeoutMs,
-                           bool * pSessionPresent,
-                           MQTTPropBuilder_t * pPropertyBuilder,
-                           const MQTTPropBuilder_t * pWillPropertyBuilder )
+MQTTStatus_t MQTT_RemoveSubscriptionHandler( MQTTContext_t * pContext,
+                                             uint32_t subscriptionId )
 {
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
     MQTTStatus_t status = MQTTSuccess;
-    MQTTPacketInfo_t incomingPacket = { 0 };
-    MQTTConnectionStatus_t connectStatus;
-    uint8_t backupPropBuffer[ 5 ];
-    MQTTPropBuilder_t backupPropBuilder = { 0 };
-    MQTTPropBuilder_t * pBackupPropBuilder = pPropertyBuilder;
 
-    if( ( pContext == NULL ) || ( pConnectInfo == NULL ) || ( pSessionPresent == NULL ) )
+    if( ( pContext == NULL ) || ( pContext->pSubscriptionHandlers == NULL ) )
     {
-        LogError( ( "Argument cannot be NULL: pContext=%p, "
-                    "pConnectInfo=%p, pSessionPresent=%p.",
-                    ( void * ) pContext,
-                    ( const void * ) pConnectInfo,
-                    ( void * ) pSessionPresent ) );
+        LogError( ( "Argument cannot be NULL and subscription handlers must be "
+                    "initialized: pContext=%p",
+                    ( void * ) pContext ) );
         status = MQTTBadParameter;
     }
-
-    if( ( status == MQTTSuccess ) && ( pWillInfo != NULL ) && ( pWillPropertyBuilder != NULL ) )
+    else if( ( subscriptionId == 0U ) ||
+             ( ( size_t ) subscriptionId > pContext->subscriptionHandlerCount ) ||
+             ( pContext->pSubscriptionHandlers[ subscriptionId - 1U ].callback == NULL ) )
     {
-        status = MQTT_ValidateWillProperties( pWillPropertyBuilder );
+        LogError( ( "No handler registered for subscription identifier %lu.",
+                    ( unsigned long ) subscriptionId ) );
+        status = MQTTBadParameter;
     }
-
-    if( status == MQTTSuccess )
+    else
     {
-        if( pBackupPropBuilder != NULL )
-        {
-            bool isRequestProblemInfoSet = false;
-            uint32_t packetMaxSize = UINT32_MAX;
-            status = MQTT_ValidateConnectProperties( pBackupPropBuilder,
-                                                     &isRequestProblemInfoSet,
-                                                     &packetMaxSize );
+        pContext->pSubscriptionHandlers[ subscriptionId - 1U ].callback = NULL;
+        pContext->pSubscriptionHandlers[ subscriptionId - 1U ].pUserData = NULL;
+        pContext->pSubscriptionHandlers[ subscriptionId - 1U ].failedPacketId = MQTT_PACKET_ID_INVALID;
+    }
 
-            /* Update the field in the context so that it can be gated on. Note that we
-             * did not intentionally check the result of the above API call as it will be
-             * checked later. Even if the call fails, we will set the variable in the
-             * context incorrectly which is fine. */
-            pContext->connectionProperties.requestProblemInfo = isRequestProblemInfoSet;
+    return status;
+}
 
-            if( packetMaxSize > pContext->networkBuffer.size )
-            {
-                LogError( ( "Properties have packet maximum set to %" PRIu32
-                            " whereas the buffer length is %" PRIu32
-                            ". Please make sure that buffer is at least as big as %" PRIu32
-                            " otherwise the server can send a bigger packet which cannot be processed by the coreMQTT library.",
-                            packetMaxSize,
-                            ( uint32_t ) pContext->networkBuffer.size,
-                            packetMaxSize ) );
-                status = MQTTBadParameter;
-            }
-        }
-        else
-        {
-            uint32_t maxPacketSize;
-            backupPropBuilder.pBuffer = backupPropBuffer;
-            backupPropBuilder.bufferLength = sizeof( backupPropBuffer );
+/*-----------------------------------------------------------*/
 
-            pBackupPropBuilder = &backupPropBuilder;
+static MQTTStatus_t publishPacket( MQTTContext_t * pContext,
+                                   const MQTTPublishInfo_t * pPublishInfo,
+                                   uint16_t packetId,
+                                   const MQTTPropBuilder_t * pPropertyBuilder,
+                                   const TransportOutVector_t * pPayloadSegments,
+                                   size_t payloadSegmentCount,
+                                   const MQTTPayloadReference_t * pPayloadReference )
+{
+    size_t headerSize = 0U;
+    MQTTPublishState_t publishStatus = MQTTStateNull;
+    MQTTConnectionStatus_t connectStatus;
+    uint16_t topicAlias = 0U;
+    uint16_t assignedTopicAlias = 0U;
+    bool assignTopicAlias = false;
+    bool topicAliasSet = false;
+    MQTTPublishInfo_t aliasedPublishInfo;
+    const MQTTPublishInfo_t * pSentPublishInfo = pPublishInfo;
 
-            if( CHECK_SIZE_T_OVERFLOWS_32BIT( pContext->networkBuffer.size ) )
-            {
-                maxPacketSize = 0xFFFFFFFFU;
-            }
-            else
-            {
-                maxPacketSize = ( uint32_t ) pContext->networkBuffer.size;
-            }
+    /* Maximum number of bytes required by the 'fixed' part of the PUBLISH
+     * packet header according to the MQTT specifications.
+     * Header byte           0 + 1 = 1
+     * Length (max)            + 4 = 5
+     * Topic string length     + 2 = 7
+     *
+     * Note that since publish is one of the most common operations in MQTT
+     * connection, we have moved the topic string length to the 'fixed' part of
+     * the header so efficiency. Otherwise, we would need an extra vector and
+     * an extra call to 'send' (in case writev is not defined) to send the
+     * topic length.    */
+    uint8_t mqttHeader[ 7U ];
+    MQTTStatus_t status = MQTTSuccess;
 
-            LogInfo( ( "Application has not set any properties. Adding a property to set the maximum "
-                       "packet size received from the server for the client to be %" PRIu32 ".",
-                       maxPacketSize ) );
-            status = MQTTPropAdd_MaxPacketSize( pBackupPropBuilder,
-                                                maxPacketSize,
-                                                NULL );
-        }
-    }
+    /* Validate arguments and properties. */
+    status = validatePublish( pContext, pPublishInfo, packetId, pPropertyBuilder,
+                              ( pPayloadSegments != NULL ), &topicAlias );
 
-    if( status == MQTTSuccess )
+    /* Topics are aliased automatically unless the application set an alias. */
+    assignTopicAlias = ( status == MQTTSuccess ) &&
+                       ( topicAlias == 0U ) &&
+                       ( pContext->pOutgoingTopicAliases != NULL ) &&
+                       ( pPublishInfo->topicNameLength > 0U ) &&
+                       ( pPublishInfo->topicNameLength <= pContext->outgoingTopicAliasNameLength );
+
+    if( ( status == MQTTSuccess ) && ( assignTopicAlias == false ) )
     {
-        /* Get MQTT connect packet size and remaining length. */
-        status = MQTT_GetConnectPacketSize( pConnectInfo,
-                                            pWillInfo,
-                                            pBackupPropBuilder,
-                                            pWillPropertyBuilder,
-                                            &remainingLength,
-                                            &packetSize );
-        /* coverity[sensitive_data_leak] */
-        LogDebug( ( "CONNECT packet size is %lu and remaining length is %lu.",
-                    ( unsigned long ) packetSize,
-                    ( unsigned long ) remainingLength ) );
+        status = serializePublishHeader( pContext,
+                                         pPublishInfo,
+                                         pPropertyBuilder,
+                                         0U,
+                                         mqttHeader,
+                                         &headerSize );
     }
 
     if( status == MQTTSuccess )
     {
+        /* Take the mutex as multiple send calls are required for sending this
+         * packet. */
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
         connectStatus = pContext->connectStatus;
 
-        if( connectStatus != MQTTNotConnected )
+        if( connectStatus != MQTTConnected )
         {
-            status = ( connectStatus == MQTTConnected ) ? MQTTStatusConnected : MQTTStatusDisconnectPending;
+            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
         }
 
-        if( status == MQTTSuccess )
+        /* The alias table is shared with other publishes, so the alias is
+         * looked up, and the header serialized, with the mutex taken. */
+        if( ( status == MQTTSuccess ) && ( assignTopicAlias == true ) )
         {
-            status = sendConnectWithoutCopy( pContext,
-                                             pConnectInfo,
-                                             pWillInfo,
-                                             remainingLength,
-                                             pBackupPropBuilder,
-                                             pWillPropertyBuilder );
-        }
+            if( pContext->outgoingTopicAliasCount > 0U )
+            {
+                assignedTopicAlias = findOutgoingTopicAlias( pContext, pPublishInfo, &topicAliasSet );
+                aliasedPublishInfo = *pPublishInfo;
 
-        /* TODO: As part of CONNECT/CONNACK setup, there can be AUTH packets sent.
-         * It is not dealt with currently. */
+                /* A publish stored for retransmission keeps its topic name,
+                 * as the alias is not set on the next connection. */
+                if( ( topicAliasSet == true ) &&
+                    ( ( pPublishInfo->qos == MQTTQoS0 ) || ( pContext->storeFunction == NULL ) ) )
+                {
+                    aliasedPublishInfo.topicNameLength = 0U;
+                }
 
-        /* Read CONNACK from transport layer. */
-        if( status == MQTTSuccess )
-        {
-            status = receiveConnack( pContext,
-                                     timeoutMs,
-                                     pConnectInfo->cleanSession,
-                                     &incomingPacket,
-                                     pSessionPresent );
+                pSentPublishInfo = &aliasedPublishInfo;
+            }
+
+            status = serializePublishHeader( pContext,
+                                             pSentPublishInfo,
+                                             pPropertyBuilder,
+                                             assignedTopicAlias,
+                                             mqttHeader,
+                                             &headerSize );
+        }
+
+        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        {
+            /* Set the flag so that the corresponding hook can be called later. */
+
+            status = MQTT_ReserveState( pContext,
+                                        packetId,
+                                        pPublishInfo->qos );
+
+            /* State already exists for a duplicate packet.
+             * If a state doesn't exist, it will be handled as a new publish in
+             * state engine. */
+            if( ( status == MQTTStateCollision ) && ( pPublishInfo->dup == true ) )
+            {
+                status = MQTTSuccess;
+            }
         }
 
-        /**
-         * Update the maximum number of concurrent incoming and outgoing PUBLISH records
-         * based on MQTT 5.0 Receive Maximum property :
-         *
-         * - For incoming publishes: Use the minimum between the client's configured receive maximum
-         *   (In the MQTT_Init function) and the receive maximum value sent in CONNECT properties
-         *
-         * - For outgoing publishes: Use the minimum between the client's configured maximum
-         *   (In the MQTT_Init function) and the server's receive maximum value received in CONNACK properties
-         **/
         if( status == MQTTSuccess )
         {
-            if( pContext->connectionProperties.receiveMax < pContext->incomingPublishRecordMaxCount )
-            {
-                pContext->incomingPublishRecordMaxCount = pContext->connectionProperties.receiveMax;
-            }
+            assert( headerSize <= 7U );
 
-            if( pContext->connectionProperties.serverReceiveMax < pContext->outgoingPublishRecordMaxCount )
-            {
-                pContext->outgoingPublishRecordMaxCount = pContext->connectionProperties.serverReceiveMax;
-            }
+            status = sendPublishWithoutCopy( pContext,
+                                             pSentPublishInfo,
+                                             mqttHeader,
+                                             headerSize,
+                                             packetId,
+                                             pPropertyBuilder,
+                                             assignedTopicAlias,
+                                             pPayloadSegments,
+                                             payloadSegmentCount,
+                                             pPayloadReference );
         }
 
-        if( ( status == MQTTSuccess ) && ( *pSessionPresent != true ) )
+        /* The broker knows the alias only once the packet is sent. */
+        if( ( status == MQTTSuccess ) && ( pContext->pOutgoingTopicAliases != NULL ) )
         {
-            status = handleCleanSession( pContext );
+            recordOutgoingTopicAlias( pContext,
+                                      pSentPublishInfo,
+                                      ( assignedTopicAlias != 0U ) ? assignedTopicAlias : topicAlias );
         }
 
-        if( status == MQTTSuccess )
+        if( ( status == MQTTSuccess ) &&
+            ( pPublishInfo->qos > MQTTQoS0 ) )
         {
-            pContext->connectStatus = MQTTConnected;
+            /* Update state machine after PUBLISH is sent.
+             * Only to be done for QoS1 or QoS2. */
+            status = MQTT_UpdateStatePublish( pContext,
+                                              packetId,
+                                              MQTT_SEND,
+                                              pPublishInfo->qos,
+                                              &publishStatus );
 
-            /**
-             * Initialize the client's keep-alive timer using the Server Keep Alive value
-             * received in the CONNACK.
-             * This value overrides the client's original keep-alive setting,
-             * as per MQTT v5 specification.
-             */
-            pContext->keepAliveIntervalSec = pContext->connectionProperties.serverKeepAlive;
-            pContext->waitingForPingResp = false;
-            pContext->pingReqSendTimeMs = 0U;
+            if( status != MQTTSuccess )
+            {
+                LogError( ( "Update state for publish failed with status %s."
+                            " However PUBLISH packet was sent to the broker."
+                            " Any further handling of ACKs for the packet Id"
+                            " will fail.",
+                            MQTT_Status_strerror( status ) ) );
+            }
         }
 
+        /* mutex should be released and not before updating the state
+         * because we need to make sure that the state is updated
+         * after sending the publish packet, before the receive
+         * loop receives ack for this and would want to update its state
+         */
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
-    if( ( status == MQTTSuccess ) && ( *pSessionPresent == true ) )
+    if( status != MQTTSuccess )
     {
-        /* Resend PUBRELs and PUBLISHES when reestablishing a session */
-        status = handleUncleanSessionResumption( pContext );
+        LogError( ( "MQTT PUBLISH failed with status %s.",
+                    MQTT_Status_strerror( status ) ) );
     }
 
-    if( status == MQTTSuccess )
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
+                           const MQTTPublishInfo_t * pPublishInfo,
+                           uint16_t packetId,
+                           const MQTTPropBuilder_t * pPropertyBuilder )
+{
+    return publishPacket( pContext, pPublishInfo, packetId, pPropertyBuilder, NULL, 0U, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PublishSegmented( MQTTContext_t * pContext,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    uint16_t packetId,
+                                    const MQTTPropBuilder_t * pPropertyBuilder,
+                                    const TransportOutVector_t * pPayloadSegments,
+                                    size_t payloadSegmentCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t segmentsLength = 0U;
+    size_t index = 0U;
+
+    if( pPublishInfo == NULL )
     {
-        LogInfo( ( "MQTT connection established with the broker." ) );
+        LogError( ( "Argument cannot be NULL: pPublishInfo=%p.",
+                    ( const void * ) pPublishInfo ) );
+        status = MQTTBadParameter;
     }
-    else if( ( status == MQTTStatusConnected ) || ( status == MQTTStatusDisconnectPending ) )
+    else if( ( pPayloadSegments == NULL ) || ( payloadSegmentCount == 0U ) )
     {
-        LogInfo( ( "MQTT Connection is either already established or a disconnect is pending, return status = %s.",
-                   MQTT_Status_strerror( status ) ) );
+        LogError( ( "Payload segments should be non-NULL and their count should be > 0: "
+                    "pPayloadSegments=%p, payloadSegmentCount=%lu.",
+                    ( const void * ) pPayloadSegments,
+                    ( unsigned long ) payloadSegmentCount ) );
+        status = MQTTBadParameter;
     }
-    else if( pContext == NULL )
+    else if( payloadSegmentCount > MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS )
     {
-        LogError( ( "MQTT connection failed with status = %s.",
-                    MQTT_Status_strerror( status ) ) );
+        LogError( ( "The payload cannot have more than %lu segments: payloadSegmentCount=%lu.",
+                    ( unsigned long ) MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS,
+                    ( unsigned long ) payloadSegmentCount ) );
+        status = MQTTBadParameter;
     }
     else
     {
-        LogError( ( "MQTT connection failed with status = %s.",
-                    MQTT_Status_strerror( status ) ) );
+        while( ( status == MQTTSuccess ) && ( index < payloadSegmentCount ) )
+        {
+            if( ( pPayloadSegments[ index ].iov_base == NULL ) && ( pPayloadSegments[ index ].iov_len > 0U ) )
+            {
+                LogError( ( "Payload segment %lu has a nonzero length and a NULL base.",
+                            ( unsigned long ) index ) );
+                status = MQTTBadParameter;
+            }
+            else if( ADDITION_WILL_OVERFLOW_SIZE_T( segmentsLength, pPayloadSegments[ index ].iov_len ) )
+            {
+                LogError( ( "The length of the payload segments overflows." ) );
+                status = MQTTBadParameter;
+            }
+            else
+            {
+                segmentsLength += pPayloadSegments[ index ].iov_len;
+            }
 
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+            index++;
+        }
 
-        if( pContext->connectStatus == MQTTConnected )
+        /* The payload length was used to size the packet. */
+        if( ( status == MQTTSuccess ) && ( segmentsLength != pPublishInfo->payloadLength ) )
         {
-            /* This will only be executed if after the connack is received
-             * the retransmits fail for some reason on an unclean session
-             * connection. In this case we need to retry the re-transmits
-             * which can only be done using the connect API and that can only
-             * be done once we are disconnected, hence we ask the user to
-             * call disconnect here */
-            pContext->connectStatus = MQTTDisconnectPending;
+            LogError( ( "The payload length must be the length of the payload segments: "
+                        "payloadLength=%lu, length of segments=%lu.",
+                        ( unsigned long ) pPublishInfo->payloadLength,
+                        ( unsigned long ) segmentsLength ) );
+            status = MQTTBadParameter;
         }
+    }
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    if( status == MQTTSuccess )
+    {
+        status = publishPacket( pContext, pPublishInfo, packetId, pPropertyBuilder,
+                                pPayloadSegments, payloadSegmentCount, NULL );
     }
 
     return status;
@@ -4636,71 +9255,104 @@ MQTTStatus_t MQTT_Connect( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
-                             const MQTTSubscribeInfo_t * pSubscriptionList,
-                             size_t subscriptionCount,
-                             uint16_t packetId,
-                             const MQTTPropBuilder_t * pPropertyBuilder )
+MQTTStatus_t MQTT_PublishByReference( MQTTContext_t * pContext,
+                                      const MQTTPublishInfo_t * pPublishInfo,
+                                      uint16_t packetId,
+                                      const MQTTPropBuilder_t * pPropertyBuilder,
+                                      const MQTTPayloadReference_t * pPayloadReference )
 {
-    MQTTConnectionStatus_t connectStatus;
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
     MQTTStatus_t status = MQTTSuccess;
 
-    status = validateSubscribeUnsubscribeParams( pContext,
-                                                 pSubscriptionList,
-                                                 subscriptionCount,
-                                                 packetId,
-                                                 MQTT_TYPE_SUBSCRIBE );
+    if( ( pPayloadReference == NULL ) || ( pPayloadReference->payloadReference == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pPayloadReference=%p.",
+                    ( const void * ) pPayloadReference ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        status = publishPacket( pContext, pPublishInfo, packetId, pPropertyBuilder,
+                                NULL, 0U, pPayloadReference );
+    }
 
-    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PreparePublish( const MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  const MQTTPropBuilder_t * pPropertyBuilder,
+                                  MQTTPublishTemplate_t * pTemplate )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo;
+    uint16_t topicAlias = 0U;
+    uint32_t remainingLength = 0U;
+    uint32_t packetSize = 0U;
+    uint8_t mqttHeader[ 7U ];
+    size_t headerSize = 0U;
+    const uint8_t * pIndex;
+
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) || ( pTemplate == NULL ) )
     {
-        bool isSubscriptionIdAvailable;
-        assert( ( pContext->connectionProperties.isSubscriptionIdAvailable == 0U ) ||
-                ( pContext->connectionProperties.isSubscriptionIdAvailable == 1U ) );
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pPublishInfo=%p, pTemplate=%p.",
+                    ( const void * ) pContext,
+                    ( const void * ) pPublishInfo,
+                    ( void * ) pTemplate ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* The template does not include the payload. */
+        publishInfo = *pPublishInfo;
+        publishInfo.pPayload = NULL;
+        publishInfo.payloadLength = 0U;
 
-        isSubscriptionIdAvailable = ( pContext->connectionProperties.isSubscriptionIdAvailable != 0U );
-        status = MQTT_ValidateSubscribeProperties( isSubscriptionIdAvailable,
-                                                   pPropertyBuilder );
+        /* The packet ID is only given to MQTT_PublishPrepared, so any valid
+         * one is validated here. */
+        status = validatePublish( pContext, &publishInfo, 1U, pPropertyBuilder, false, &topicAlias );
     }
 
     if( status == MQTTSuccess )
     {
-        /* Get the remaining length and packet size. */
-        status = MQTT_GetSubscribePacketSize( pSubscriptionList,
-                                              subscriptionCount,
-                                              pPropertyBuilder,
-                                              &remainingLength,
-                                              &packetSize,
-                                              pContext->connectionProperties.serverMaxPacketSize );
-        LogDebug( ( "SUBSCRIBE packet size is %lu and remaining length is %lu.",
-                    ( unsigned long ) packetSize,
-                    ( unsigned long ) remainingLength ) );
+        status = MQTT_GetPublishPacketSize( &publishInfo,
+                                            pPropertyBuilder,
+                                            &remainingLength,
+                                            &packetSize,
+                                            pContext->connectionProperties.serverMaxPacketSize );
     }
 
     if( status == MQTTSuccess )
     {
-        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+        status = MQTT_SerializePublishHeaderWithoutTopic( &publishInfo,
+                                                          remainingLength,
+                                                          mqttHeader,
+                                                          &headerSize );
+    }
 
-        connectStatus = pContext->connectStatus;
+    if( status == MQTTSuccess )
+    {
+        pTemplate->publishInfo = publishInfo;
+        pTemplate->pProperties = NULL;
+        pTemplate->propertiesLength = 0U;
 
-        if( connectStatus != MQTTConnected )
+        if( ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
         {
-            status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
+            pTemplate->pProperties = pPropertyBuilder->pBuffer;
+            pTemplate->propertiesLength = pPropertyBuilder->currentIndex;
         }
 
-        if( status == MQTTSuccess )
-        {
-            /* Send MQTT SUBSCRIBE packet. */
-            status = sendSubscribeWithoutCopy( pContext,
-                                               pSubscriptionList,
-                                               subscriptionCount,
-                                               packetId,
-                                               remainingLength,
-                                               pPropertyBuilder );
-        }
+        pTemplate->remainingLength = remainingLength;
+        pTemplate->topicAlias = topicAlias;
+        pTemplate->headerByte = mqttHeader[ 0 ];
 
-        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+        pIndex = encodeVariableLength( pTemplate->propertyLength,
+                                       ( uint32_t ) pTemplate->propertiesLength );
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+        /* coverity[misra_c_2012_rule_18_2_violation] */
+        pTemplate->propertyLengthSize = ( uint8_t ) ( pIndex - pTemplate->propertyLength );
     }
 
     return status;
@@ -4708,76 +9360,113 @@ MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
-                           const MQTTPublishInfo_t * pPublishInfo,
-                           uint16_t packetId,
-                           const MQTTPropBuilder_t * pPropertyBuilder )
+static MQTTStatus_t validatePreparedPublish( const MQTTContext_t * pContext,
+                                             const MQTTPublishTemplate_t * pTemplate,
+                                             const void * pPayload,
+                                             size_t payloadLength,
+                                             uint16_t packetId,
+                                             uint32_t * pRemainingLength )
 {
-    size_t headerSize = 0U;
-    uint32_t remainingLength = 0U;
-    uint32_t packetSize = 0U;
-    MQTTPublishState_t publishStatus = MQTTStateNull;
-    MQTTConnectionStatus_t connectStatus;
-    uint16_t topicAlias = 0U;
-
-    /* Maximum number of bytes required by the 'fixed' part of the PUBLISH
-     * packet header according to the MQTT specifications.
-     * Header byte           0 + 1 = 1
-     * Length (max)            + 4 = 5
-     * Topic string length     + 2 = 7
-     *
-     * Note that since publish is one of the most common operations in MQTT
-     * connection, we have moved the topic string length to the 'fixed' part of
-     * the header so efficiency. Otherwise, we would need an extra vector and
-     * an extra call to 'send' (in case writev is not defined) to send the
-     * topic length.    */
-    uint8_t mqttHeader[ 7U ];
     MQTTStatus_t status = MQTTSuccess;
+    const MQTTPublishInfo_t * pPublishInfo;
+    uint32_t remainingLength = 0U;
 
-    /* Validate arguments. */
-    status = validatePublishParams( pContext, pPublishInfo, packetId );
-
-    /* Validate Publish Properties and extract Topic Alias from the properties. */
-    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    if( ( pContext == NULL ) || ( pTemplate == NULL ) )
     {
-        status = MQTT_ValidatePublishProperties( pContext->connectionProperties.serverTopicAliasMax,
-                                                 pPropertyBuilder, &topicAlias );
+        LogError( ( "Argument cannot be NULL: pContext=%p, pTemplate=%p.",
+                    ( const void * ) pContext,
+                    ( const void * ) pTemplate ) );
+        status = MQTTBadParameter;
     }
-
-    if( status == MQTTSuccess )
+    else if( ( payloadLength > 0U ) && ( pPayload == NULL ) )
     {
-        /* Validate Publish Properties with the persistent Connection Properties. */
-        status = MQTT_ValidatePublishParams( pPublishInfo,
-                                             pContext->connectionProperties.retainAvailable,
-                                             pContext->connectionProperties.serverMaxQos,
-                                             topicAlias,
-                                             pContext->connectionProperties.serverMaxPacketSize );
+        LogError( ( "A nonzero payload length requires a non-NULL payload: "
+                    "payloadLength=%lu.",
+                    ( unsigned long ) payloadLength ) );
+        status = MQTTBadParameter;
     }
-
-    if( status == MQTTSuccess )
+    else if( CHECK_SIZE_T_OVERFLOWS_32BIT( payloadLength ) ||
+             ( ( uint32_t ) payloadLength >= ( MQTT_REMAINING_LENGTH_INVALID - pTemplate->remainingLength ) ) )
     {
-        /* Get the remaining length and packet size. */
-        status = MQTT_GetPublishPacketSize( pPublishInfo,
-                                            pPropertyBuilder,
-                                            &remainingLength,
-                                            &packetSize,
-                                            pContext->connectionProperties.serverMaxPacketSize );
+        LogError( ( "The remaining length of the packet must be less than %" PRIu32,
+                    MQTT_REMAINING_LENGTH_INVALID ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pPublishInfo = &pTemplate->publishInfo;
+        remainingLength = pTemplate->remainingLength + ( uint32_t ) payloadLength;
+
+        /* Only the checks which depend on the payload, the packet ID or the
+         * connection are repeated. */
+        if( ( pPublishInfo->qos != MQTTQoS0 ) && ( packetId == 0U ) )
+        {
+            LogError( ( "Packet Id is 0 for PUBLISH with QoS=%u.",
+                        ( unsigned int ) pPublishInfo->qos ) );
+            status = MQTTBadParameter;
+        }
+        else if( ( pContext->outgoingPublishRecords == NULL ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        {
+            LogError( ( "Trying to publish a QoS > MQTTQoS0 packet when outgoing publishes "
+                        "for QoS1/QoS2 have not been enabled." ) );
+            status = MQTTBadParameter;
+        }
+        else if( ( ( uint8_t ) pPublishInfo->qos > pContext->connectionProperties.serverMaxQos ) ||
+                 ( ( pPublishInfo->retain == true ) && ( pContext->connectionProperties.retainAvailable == 0U ) ) )
+        {
+            LogError( ( "The QoS or retain flag of the template is not supported by the server." ) );
+            status = MQTTBadParameter;
+        }
+        else if( pTemplate->topicAlias > pContext->connectionProperties.serverTopicAliasMax )
+        {
+            LogError( ( "Protocol Error: Topic Alias greater than Topic Alias Max" ) );
+            status = MQTTBadParameter;
+        }
+        else if( ( 1U + variableLengthEncodedSize( remainingLength ) + remainingLength ) >
+                 pContext->connectionProperties.serverMaxPacketSize )
+        {
+            LogError( ( "Packet size is greater than the allowed maximum packet size." ) );
+            status = MQTTBadParameter;
+        }
+        else
+        {
+            *pRemainingLength = remainingLength;
+        }
     }
 
-    if( status == MQTTSuccess )
-    {
-        status = MQTT_SerializePublishHeaderWithoutTopic( pPublishInfo,
-                                                          remainingLength,
-                                                          mqttHeader,
-                                                          &headerSize );
-    }
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_PublishPrepared( MQTTContext_t * pContext,
+                                   const MQTTPublishTemplate_t * pTemplate,
+                                   const void * pPayload,
+                                   size_t payloadLength,
+                                   uint16_t packetId )
+{
+    MQTTStatus_t status;
+    MQTTPublishState_t publishStatus = MQTTStateNull;
+    MQTTConnectionStatus_t connectStatus;
+    uint32_t remainingLength = 0U;
+    uint8_t mqttHeader[ 7U ];
+    uint8_t * pIndex;
+    size_t headerSize;
+
+    status = validatePreparedPublish( pContext, pTemplate, pPayload, payloadLength,
+                                      packetId, &remainingLength );
 
     if( status == MQTTSuccess )
     {
-        assert( headerSize <= 7U );
+        /* Only the remaining length of the header depends on the payload. */
+        mqttHeader[ 0 ] = pTemplate->headerByte;
+        pIndex = encodeVariableLength( &mqttHeader[ 1 ], remainingLength );
+        pIndex[ 0 ] = UINT16_HIGH_BYTE( pTemplate->publishInfo.topicNameLength );
+        pIndex[ 1 ] = UINT16_LOW_BYTE( pTemplate->publishInfo.topicNameLength );
+        /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+        /* coverity[misra_c_2012_rule_18_2_violation] */
+        headerSize = ( size_t ) ( &pIndex[ 2 ] - mqttHeader );
 
-        /* Take the mutex as multiple send calls are required for sending this
-         * packet. */
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
         connectStatus = pContext->connectStatus;
@@ -4787,18 +9476,13 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
             status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
         }
 
-        if( ( status == MQTTSuccess ) && ( pPublishInfo->qos > MQTTQoS0 ) )
+        if( ( status == MQTTSuccess ) && ( pTemplate->publishInfo.qos > MQTTQoS0 ) )
         {
-            /* Set the flag so that the corresponding hook can be called later. */
-
             status = MQTT_ReserveState( pContext,
                                         packetId,
-                                        pPublishInfo->qos );
+                                        pTemplate->publishInfo.qos );
 
-            /* State already exists for a duplicate packet.
-             * If a state doesn't exist, it will be handled as a new publish in
-             * state engine. */
-            if( ( status == MQTTStateCollision ) && ( pPublishInfo->dup == true ) )
+            if( ( status == MQTTStateCollision ) && ( pTemplate->publishInfo.dup == true ) )
             {
                 status = MQTTSuccess;
             }
@@ -4806,23 +9490,26 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
 
         if( status == MQTTSuccess )
         {
-            status = sendPublishWithoutCopy( pContext,
-                                             pPublishInfo,
-                                             mqttHeader,
-                                             headerSize,
-                                             packetId,
-                                             pPropertyBuilder );
+            status = sendPreparedPublish( pContext,
+                                          pTemplate,
+                                          mqttHeader,
+                                          headerSize,
+                                          pPayload,
+                                          payloadLength,
+                                          packetId );
         }
 
-        if( ( status == MQTTSuccess ) &&
-            ( pPublishInfo->qos > MQTTQoS0 ) )
+        if( ( status == MQTTSuccess ) && ( pContext->pOutgoingTopicAliases != NULL ) )
+        {
+            recordOutgoingTopicAlias( pContext, &pTemplate->publishInfo, pTemplate->topicAlias );
+        }
+
+        if( ( status == MQTTSuccess ) && ( pTemplate->publishInfo.qos > MQTTQoS0 ) )
         {
-            /* Update state machine after PUBLISH is sent.
-             * Only to be done for QoS1 or QoS2. */
             status = MQTT_UpdateStatePublish( pContext,
                                               packetId,
                                               MQTT_SEND,
-                                              pPublishInfo->qos,
+                                              pTemplate->publishInfo.qos,
                                               &publishStatus );
 
             if( status != MQTTSuccess )
@@ -4835,11 +9522,6 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
             }
         }
 
-        /* mutex should be released and not before updating the state
-         * because we need to make sure that the state is updated
-         * after sending the publish packet, before the receive
-         * loop receives ack for this and would want to update its state
-         */
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
     }
 
@@ -4854,6 +9536,94 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_PublishBatch( MQTTContext_t * pContext,
+                                const MQTTPublishInfo_t * pPublishInfo,
+                                const uint16_t * pPacketIds,
+                                const MQTTPropBuilder_t * const * pPropertyBuilders,
+                                size_t publishCount,
+                                MQTTStatus_t * pPublishStatus )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index;
+    uint16_t topicAlias;
+
+    if( ( pContext == NULL ) || ( pPublishInfo == NULL ) || ( pPublishStatus == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pContext=%p, "
+                    "pPublishInfo=%p, pPublishStatus=%p.",
+                    ( void * ) pContext,
+                    ( const void * ) pPublishInfo,
+                    ( void * ) pPublishStatus ) );
+        status = MQTTBadParameter;
+    }
+    else if( publishCount == 0U )
+    {
+        LogError( ( "The batch must have at least one PUBLISH packet." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        for( index = 0U; index < publishCount; index++ )
+        {
+            pPublishStatus[ index ] = validatePublish( pContext,
+                                                       &pPublishInfo[ index ],
+                                                       ( pPacketIds != NULL ) ? pPacketIds[ index ] : 0U,
+                                                       ( pPropertyBuilders != NULL ) ? pPropertyBuilders[ index ] : NULL,
+                                                       false,
+                                                       &topicAlias );
+        }
+
+        /* Take the mutex once; the state of all packets is reserved, and
+         * updated, without the receive loop running in between. */
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        sendPublishBatch( pContext,
+                          pPublishInfo,
+                          pPacketIds,
+                          pPropertyBuilders,
+                          publishCount,
+                          pPublishStatus );
+
+        /* The broker knows an alias only once the packet is sent. The Topic
+         * Alias of each packet is read again as it was not kept. */
+        if( ( pContext->pOutgoingTopicAliases != NULL ) && ( pPropertyBuilders != NULL ) )
+        {
+            for( index = 0U; index < publishCount; index++ )
+            {
+                if( ( pPublishStatus[ index ] == MQTTSuccess ) &&
+                    ( pPropertyBuilders[ index ] != NULL ) &&
+                    ( validatePublish( pContext,
+                                       &pPublishInfo[ index ],
+                                       ( pPacketIds != NULL ) ? pPacketIds[ index ] : 0U,
+                                       pPropertyBuilders[ index ],
+                                       false,
+                                       &topicAlias ) == MQTTSuccess ) )
+                {
+                    recordOutgoingTopicAlias( pContext, &pPublishInfo[ index ], topicAlias );
+                }
+            }
+        }
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+
+        /* Report the first failure. */
+        for( index = 0U; ( index < publishCount ) && ( status == MQTTSuccess ); index++ )
+        {
+            status = pPublishStatus[ index ];
+        }
+    }
+
+    if( status != MQTTSuccess )
+    {
+        LogError( ( "MQTT PUBLISH batch failed with status %s.",
+                    MQTT_Status_strerror( status ) ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_Ping( MQTTContext_t * pContext )
 {
     int32_t sendResult = 0;
@@ -4961,7 +9731,8 @@ MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
                                                  packetId,
                                                  MQTT_TYPE_UNSUBSCRIBE );
 
-    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) )
+    if( ( status == MQTTSuccess ) && ( pPropertyBuilder != NULL ) && ( pPropertyBuilder->pBuffer != NULL ) &&
+        ( isPropertyBuilderSealed( pPropertyBuilder, MQTT_PACKET_TYPE_UNSUBSCRIBE ) == false ) )
     {
         status = MQTT_ValidateUnsubscribeProperties( pPropertyBuilder );
     }
@@ -4992,7 +9763,24 @@ MQTTStatus_t MQTT_Unsubscribe( MQTTContext_t * pContext,
             status = ( connectStatus == MQTTNotConnected ) ? MQTTStatusNotConnected : MQTTStatusDisconnectPending;
         }
 
-        if( status == MQTTSuccess )
+        if( status != MQTTSuccess )
+        {
+            /* Not connected. */
+        }
+        else if( ( pContext->subscribeBuffer.pBuffer != NULL ) &&
+                 ( packetSize <= pContext->subscribeBuffer.size ) )
+        {
+            /* Send the whole UNSUBSCRIBE packet with one transport write. */
+            status = sendSerializedSubUnsub( pContext,
+                                             pSubscriptionList,
+                                             subscriptionCount,
+                                             packetId,
+                                             remainingLength,
+                                             packetSize,
+                                             pPropertyBuilder,
+                                             MQTT_PACKET_TYPE_UNSUBSCRIBE );
+        }
+        else
         {
             status = sendUnsubscribeWithoutCopy( pContext,
                                                  pSubscriptionList,
@@ -5072,6 +9860,9 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
 
             /* Reset the index and clean the buffer on a successful disconnect. */
             pContext->index = 0;
+            pContext->headIndex = 0;
+            resetPublishStream( pContext );
+            pContext->ackStagedCount = 0;
             ( void ) memset( pContext->networkBuffer.pBuffer, 0, pContext->networkBuffer.size );
 
             LogInfo( ( "MQTT Connection Disconnected Successfully" ) );
@@ -5093,6 +9884,7 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
 MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext )
 {
     MQTTStatus_t status = MQTTBadParameter;
+    uint32_t waitTimeMs = 0U;
 
     if( pContext == NULL )
     {
@@ -5109,7 +9901,66 @@ MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext )
     else
     {
         pContext->controlPacketSent = false;
-        status = receiveSingleIteration( pContext, true );
+
+        /* Send the bytes kept by non-blocking sends, as far as the transport
+         * accepts them. */
+        status = flushPendingBytes( pContext );
+
+        if( status == MQTTSendWouldBlock )
+        {
+            status = MQTTSuccess;
+        }
+
+        /* With nothing buffered, block until data arrives, the timeout of
+         * the application expires or the next keep alive action is due
+         * instead of polling the transport. Bytes still kept must not wait
+         * for data to arrive. */
+        if( status != MQTTSuccess )
+        {
+            /* The kept bytes could not be sent. */
+        }
+        else if( ( pContext->waitReadable != NULL ) &&
+                 ( pContext->index == 0U ) &&
+                 ( pContext->pendingSendLength == 0U ) )
+        {
+            waitTimeMs = getKeepAliveWaitTimeMs( pContext );
+
+            if( waitTimeMs > pContext->waitReadableTimeoutMs )
+            {
+                waitTimeMs = pContext->waitReadableTimeoutMs;
+            }
+
+            status = waitForReadable( pContext, waitTimeMs );
+
+            /* Send the bytes kept by non-blocking sends made during the
+             * wait. */
+            if( status == MQTTSuccess )
+            {
+                status = flushPendingBytes( pContext );
+            }
+
+            if( status == MQTTSendWouldBlock )
+            {
+                status = MQTTSuccess;
+            }
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+
+        if( status != MQTTSuccess )
+        {
+            /* The wait failed. */
+        }
+        else if( pContext->recvLease != NULL )
+        {
+            status = receiveLeasedIteration( pContext, true );
+        }
+        else
+        {
+            status = receiveSingleIteration( pContext, true );
+        }
     }
 
     return status;
@@ -5133,6 +9984,10 @@ MQTTStatus_t MQTT_ReceiveLoop( MQTTContext_t * pContext )
     {
         LogError( ( "Invalid input parameter: MQTT context's networkBuffer must not be NULL." ) );
     }
+    else if( pContext->recvLease != NULL )
+    {
+        status = receiveLeasedIteration( pContext, false );
+    }
     else
     {
         status = receiveSingleIteration( pContext, false );
@@ -5151,17 +10006,34 @@ uint16_t MQTT_GetPacketId( MQTTContext_t * pContext )
     {
         MQTT_PRE_STATE_UPDATE_HOOK( pContext );
 
-        packetId = pContext->nextPacketId;
+        if( pContext->pPacketIdBitmap != NULL )
+        {
+            /* Skip the IDs which are still held. */
+            packetId = MQTT_AllocatePacketId( pContext, pContext->nextPacketId );
+
+            if( packetId == MQTT_PACKET_ID_INVALID )
+            {
+                LogError( ( "All packet IDs are held by outgoing packets." ) );
+            }
+        }
+        else
+        {
+            packetId = pContext->nextPacketId;
+        }
 
         /* A packet ID of zero is not a valid packet ID. When the max ID
          * is reached the next one should start at 1. */
-        if( pContext->nextPacketId == ( uint16_t ) UINT16_MAX )
+        if( packetId == ( uint16_t ) UINT16_MAX )
         {
             pContext->nextPacketId = 1;
         }
+        else if( packetId != MQTT_PACKET_ID_INVALID )
+        {
+            pContext->nextPacketId = packetId + 1U;
+        }
         else
         {
-            pContext->nextPacketId++;
+            /* No ID was handed out. */
         }
 
         MQTT_POST_STATE_UPDATE_HOOK( pContext );
@@ -5172,6 +10044,36 @@ uint16_t MQTT_GetPacketId( MQTTContext_t * pContext )
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_ReleasePacketId( MQTTContext_t * pContext,
+                                   uint16_t packetId )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( ( pContext == NULL ) || ( pContext->pPacketIdBitmap == NULL ) )
+    {
+        LogError( ( "A packet ID allocator is required: pContext=%p",
+                    ( void * ) pContext ) );
+        status = MQTTBadParameter;
+    }
+    else if( packetId == MQTT_PACKET_ID_INVALID )
+    {
+        LogError( ( "Packet ID must be nonzero." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        MQTT_PRE_STATE_UPDATE_HOOK( pContext );
+
+        MQTT_FreePacketId( pContext, packetId );
+
+        MQTT_POST_STATE_UPDATE_HOOK( pContext );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
                               const size_t topicNameLength,
                               const char * pTopicFilter,
@@ -5251,6 +10153,143 @@ MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_CompileTopicFilter( const char * pTopicFilter,
+                                      size_t topicFilterLength,
+                                      MQTTTopicFilterLevel_t * pLevels,
+                                      size_t levelCount,
+                                      MQTTCompiledTopicFilter_t * pCompiledFilter )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t compiledCount = 0U;
+    uint16_t levelStart = 0U, filterIndex = 0U;
+
+    if( ( pTopicFilter == NULL ) || ( topicFilterLength == 0U ) )
+    {
+        LogError( ( "Invalid parameter: Topic filter should be non-NULL and "
+                    "its length should be > 0: TopicFilter=%p, TopicFilterLength=%hu",
+                    ( const void * ) pTopicFilter,
+                    ( unsigned short ) topicFilterLength ) );
+        status = MQTTBadParameter;
+    }
+    else if( CHECK_SIZE_T_OVERFLOWS_16BIT( topicFilterLength ) )
+    {
+        LogError( ( "topicFilterLength must be fit in a 16-bit value (<65535)" ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pLevels == NULL ) || ( levelCount == 0U ) )
+    {
+        LogError( ( "Invalid parameter: Levels should be non-NULL and their "
+                    "count should be > 0: Levels=%p, LevelCount=%lu",
+                    ( void * ) pLevels,
+                    ( unsigned long ) levelCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( pCompiledFilter == NULL )
+    {
+        LogError( ( "Invalid parameter: Output parameter, pCompiledFilter, is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Split the topic filter at each '/'. A topic filter ending with '/'
+         * ends with an empty level. */
+        while( ( status == MQTTSuccess ) && ( levelStart <= topicFilterLength ) )
+        {
+            filterIndex = levelStart;
+
+            while( ( filterIndex < topicFilterLength ) && ( pTopicFilter[ filterIndex ] != '/' ) )
+            {
+                filterIndex++;
+            }
+
+            if( ( compiledCount > 0U ) &&
+                ( pLevels[ compiledCount - 1U ].type == MQTTTopicLevelMultiWild ) )
+            {
+                LogError( ( "Invalid topic filter: Wildcard # must be the last level." ) );
+                status = MQTTBadParameter;
+            }
+            else if( compiledCount == levelCount )
+            {
+                LogError( ( "Topic filter has more than %lu levels.",
+                            ( unsigned long ) levelCount ) );
+                status = MQTTNoMemory;
+            }
+            else
+            {
+                status = compileTopicLevel( &( pTopicFilter[ levelStart ] ),
+                                            filterIndex - levelStart,
+                                            &( pLevels[ compiledCount ] ) );
+                compiledCount++;
+            }
+
+            levelStart = filterIndex + 1U;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        pCompiledFilter->pLevels = pLevels;
+        pCompiledFilter->levelCount = compiledCount;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_MatchCompiledTopic( const char * pTopicName,
+                                      size_t topicNameLength,
+                                      const MQTTCompiledTopicFilter_t * pCompiledFilter,
+                                      bool * pIsMatch )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    bool matchStatus = false;
+
+    if( ( pTopicName == NULL ) || ( topicNameLength == 0U ) )
+    {
+        LogError( ( "Invalid parameter: Topic name should be non-NULL and its "
+                    "length should be > 0: TopicName=%p, TopicNameLength=%hu",
+                    ( const void * ) pTopicName,
+                    ( unsigned short ) topicNameLength ) );
+        status = MQTTBadParameter;
+    }
+    else if( CHECK_SIZE_T_OVERFLOWS_16BIT( topicNameLength ) )
+    {
+        LogError( ( "topicNameLength must be fit in a 16-bit value (<65535)" ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pCompiledFilter == NULL ) || ( pCompiledFilter->pLevels == NULL ) ||
+             ( pCompiledFilter->levelCount == 0U ) )
+    {
+        LogError( ( "Invalid parameter: Compiled topic filter should be non-NULL "
+                    "and have at least one level." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pIsMatch == NULL )
+    {
+        LogError( ( "Invalid parameter: Output parameter, pIsMatch, is NULL" ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Topic names starting with '$' are not matched by topic filters
+         * starting with a wildcard, as in MQTT_MatchTopic. */
+        if( !( ( pTopicName[ 0 ] == '$' ) &&
+               ( pCompiledFilter->pLevels[ 0 ].type != MQTTTopicLevelLiteral ) ) )
+        {
+            matchStatus = matchCompiledLevels( pTopicName,
+                                               ( uint16_t ) topicNameLength,
+                                               pCompiledFilter );
+        }
+
+        *pIsMatch = matchStatus;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_GetSubAckStatusCodes( const MQTTPacketInfo_t * pSubackPacket,
                                         uint8_t ** pPayloadStart,
                                         size_t * pPayloadSize )
@@ -5471,6 +10510,10 @@ const char * MQTT_Status_strerror( MQTTStatus_t status )
             str = "MQTTPublishRetrieveFailed";
             break;
 
+        case MQTTSendWouldBlock:
+            str = "MQTTSendWouldBlock";
+            break;
+
         default:
             str = "Invalid MQTT Status code";
             break;
@@ -132,6 +132,24 @@ static MQTTStatus_t getPropUtf8( const MQTTPropBuilder_t * pPropertyBuilder,
                                  const char ** property,
                                  size_t * propertyLength );
 
+/**
+ * @brief Decode a property of a PUBLISH into the matching field of the
+ * properties struct.
+ *
+ * @param[in] pPropertyBuilder Pointer to the property builder containing the properties.
+ * @param[in,out] currentIndex Pointer to the current index in the property buffer.
+ *                             Updated to point past the property on success.
+ * @param[in] propertyId ID of the property at @p currentIndex.
+ * @param[out] pProperties The decoded properties.
+ *
+ * @return #MQTTSuccess if the property is successfully decoded;
+ * #MQTTBadParameter if the property is invalid.
+ */
+static MQTTStatus_t decodePublishProperty( const MQTTPropBuilder_t * pPropertyBuilder,
+                                           size_t * currentIndex,
+                                           uint8_t propertyId,
+                                           MQTTPublishProperties_t * pProperties );
+
 /*-----------------------------------------------------------*/
 
 static inline MQTTStatus_t checkPropBuilderParams( const MQTTPropBuilder_t * mqttPropBuilder,
@@ -563,6 +581,181 @@ MQTTStatus_t MQTT_SkipNextProperty( const MQTTPropBuilder_t * pPropertyBuilder,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_FindProperty( const MQTTPropBuilder_t * pPropertyBuilder,
+                                const MQTTPropIndex_t * pPropIndex,
+                                uint8_t propertyId,
+                                size_t * currentIndex )
+{
+    MQTTStatus_t status = checkPropBuilderParams( pPropertyBuilder, currentIndex );
+    size_t index = 0U;
+    uint8_t property = 0U;
+    bool found = false;
+
+    if( status != MQTTSuccess )
+    {
+        /* Do nothing. checkPropBuilderParams will log the warning/error. */
+    }
+    else
+    {
+        index = *currentIndex;
+
+        /* The index only holds for the properties it was filled from. */
+        if( ( pPropIndex != NULL ) &&
+            ( pPropIndex->pBuffer == pPropertyBuilder->pBuffer ) &&
+            ( pPropIndex->length == pPropertyBuilder->currentIndex ) &&
+            ( propertyId < MQTT_PROPERTY_INDEX_LENGTH ) )
+        {
+            if( pPropIndex->offsets[ propertyId ] == 0U )
+            {
+                status = MQTTEndOfProperties;
+            }
+            else if( ( ( size_t ) pPropIndex->offsets[ propertyId ] - 1U ) >= index )
+            {
+                index = ( size_t ) pPropIndex->offsets[ propertyId ] - 1U;
+                found = true;
+            }
+            else if( ( propertyId != MQTT_USER_PROPERTY_ID ) &&
+                     ( propertyId != MQTT_SUBSCRIPTION_ID_ID ) )
+            {
+                /* Other properties appear at most once. */
+                status = MQTTEndOfProperties;
+            }
+            else
+            {
+                /* A later instance of a repeated property is looked for
+                 * below. */
+            }
+        }
+
+        while( ( status == MQTTSuccess ) && ( found == false ) )
+        {
+            status = MQTT_GetNextPropertyType( pPropertyBuilder, &index, &property );
+
+            if( status != MQTTSuccess )
+            {
+                /* No such property, or an invalid one. */
+            }
+            else if( property == propertyId )
+            {
+                found = true;
+            }
+            else
+            {
+                status = MQTT_SkipNextProperty( pPropertyBuilder, &index );
+            }
+        }
+
+        if( found == true )
+        {
+            *currentIndex = index;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t decodePublishProperty( const MQTTPropBuilder_t * pPropertyBuilder,
+                                           size_t * currentIndex,
+                                           uint8_t propertyId,
+                                           MQTTPublishProperties_t * pProperties )
+{
+    MQTTStatus_t status;
+
+    switch( propertyId )
+    {
+        case MQTT_PAYLOAD_FORMAT_ID:
+            status = MQTTPropGet_PayloadFormatIndicator( pPropertyBuilder,
+                                                         currentIndex,
+                                                         &pProperties->payloadFormat );
+            pProperties->payloadFormatPresent = ( status == MQTTSuccess );
+            break;
+
+        case MQTT_MSG_EXPIRY_ID:
+            status = MQTTPropGet_MessageExpiryInterval( pPropertyBuilder,
+                                                        currentIndex,
+                                                        &pProperties->messageExpiryInterval );
+            pProperties->messageExpiryPresent = ( status == MQTTSuccess );
+            break;
+
+        case MQTT_CONTENT_TYPE_ID:
+            status = MQTTPropGet_ContentType( pPropertyBuilder,
+                                              currentIndex,
+                                              &pProperties->pContentType,
+                                              &pProperties->contentTypeLength );
+            break;
+
+        case MQTT_RESPONSE_TOPIC_ID:
+            status = MQTTPropGet_ResponseTopic( pPropertyBuilder,
+                                                currentIndex,
+                                                &pProperties->pResponseTopic,
+                                                &pProperties->responseTopicLength );
+            break;
+
+        case MQTT_CORRELATION_DATA_ID:
+            status = MQTTPropGet_CorrelationData( pPropertyBuilder,
+                                                  currentIndex,
+                                                  &pProperties->pCorrelationData,
+                                                  &pProperties->correlationDataLength );
+            break;
+
+        case MQTT_USER_PROPERTY_ID:
+            status = MQTT_SkipNextProperty( pPropertyBuilder, currentIndex );
+
+            if( status == MQTTSuccess )
+            {
+                pProperties->userPropertyCount++;
+            }
+
+            break;
+
+        default:
+            /* The Topic Alias and Subscription Identifiers are decoded into
+             * the publish info. */
+            status = MQTT_SkipNextProperty( pPropertyBuilder, currentIndex );
+            break;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_DeserializePublishPropertiesInto( const MQTTPropBuilder_t * pPropertyBuilder,
+                                                    MQTTPublishProperties_t * pProperties )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index = 0U;
+    uint8_t propertyId = 0U;
+
+    if( ( pPropertyBuilder == NULL ) || ( pProperties == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pPropertyBuilder=%p, pProperties=%p.",
+                    ( const void * ) pPropertyBuilder,
+                    ( void * ) pProperties ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pProperties, 0, sizeof( MQTTPublishProperties_t ) );
+
+        while( ( status == MQTTSuccess ) && ( index < pPropertyBuilder->currentIndex ) )
+        {
+            status = MQTT_GetNextPropertyType( pPropertyBuilder, &index, &propertyId );
+
+            if( status == MQTTSuccess )
+            {
+                status = decodePublishProperty( pPropertyBuilder, &index, propertyId, pProperties );
+            }
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTTPropGet_UserProp( const MQTTPropBuilder_t * pPropertyBuilder,
                                    size_t * currentIndex,
                                    MQTTUserProperty_t * pUserProperty )
@@ -143,6 +143,31 @@ static MQTTStatus_t addPropUtf8( MQTTPropBuilder_t * pPropertyBuilder,
                                  uint8_t fieldPosition,
                                  const uint8_t * pOptionalMqttPacketType );
 
+/**
+ * @brief Add a property holding text to the property builder.
+ *
+ * Same as #addPropUtf8, but when #MQTT_VALIDATE_UTF8 is enabled the text is
+ * also checked to be well-formed UTF-8.
+ *
+ * @param[in,out] pPropertyBuilder Pointer to the property builder to add the property to.
+ * @param[in] property The UTF-8 string property value to add.
+ * @param[in] propertyLength The length of the UTF-8 string property.
+ * @param[in] propId The property ID for this property.
+ * @param[in] fieldPosition The bit position in the fieldSet for duplicate checking.
+ * @param[in] pOptionalMqttPacketType Optional MQTT packet type for validation.
+ *                                    Can be NULL to skip packet type validation.
+ *
+ * @return #MQTTSuccess if the property is successfully added;
+ * #MQTTBadParameter if parameters are invalid or the text is not well-formed;
+ * #MQTTNoMemory if insufficient buffer space.
+ */
+static MQTTStatus_t addPropUtf8String( MQTTPropBuilder_t * pPropertyBuilder,
+                                       const char * property,
+                                       size_t propertyLength,
+                                       uint8_t propId,
+                                       uint8_t fieldPosition,
+                                       const uint8_t * pOptionalMqttPacketType );
+
 /*-----------------------------------------------------------*/
 
 static bool isValidPropertyInPacketType( const uint8_t * mqttPacketType,
@@ -402,6 +427,7 @@ static MQTTStatus_t addPropUint8( MQTTPropBuilder_t * pPropertyBuilder,
         *pIndex = ( ( property != 0U ) ? 1U : 0U );
         UINT32_SET_BIT( pPropertyBuilder->fieldSet, fieldPosition );
         pPropertyBuilder->currentIndex += 2U;
+        pPropertyBuilder->seal.packetType = 0U;
     }
 
     return status;
@@ -463,6 +489,7 @@ static MQTTStatus_t addPropUint16( MQTTPropBuilder_t * pPropertyBuilder,
 
         UINT32_SET_BIT( pPropertyBuilder->fieldSet, fieldPosition );
         pPropertyBuilder->currentIndex += 3U;
+        pPropertyBuilder->seal.packetType = 0U;
     }
 
     return status;
@@ -524,6 +551,7 @@ static MQTTStatus_t addPropUint32( MQTTPropBuilder_t * pPropertyBuilder,
         /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
         /* coverity[misra_c_2012_rule_10_8_violation] */
         pPropertyBuilder->currentIndex += 5U;
+        pPropertyBuilder->seal.packetType = 0U;
         UINT32_SET_BIT( pPropertyBuilder->fieldSet, fieldPosition );
     }
 
@@ -603,6 +631,39 @@ static MQTTStatus_t addPropUtf8( MQTTPropBuilder_t * pPropertyBuilder,
         /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
         /* coverity[misra_c_2012_rule_10_8_violation] */
         pPropertyBuilder->currentIndex += ( size_t ) ( pIndex - ( &pPropertyBuilder->pBuffer[ pPropertyBuilder->currentIndex ] ) );
+        pPropertyBuilder->seal.packetType = 0U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t addPropUtf8String( MQTTPropBuilder_t * pPropertyBuilder,
+                                       const char * property,
+                                       size_t propertyLength,
+                                       uint8_t propId,
+                                       uint8_t fieldPosition,
+                                       const uint8_t * pOptionalMqttPacketType )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    #if ( MQTT_VALIDATE_UTF8 != 0 )
+        if( ( property != NULL ) && ( isValidUtf8String( property, propertyLength ) == false ) )
+        {
+            LogError( ( "Property is not a well-formed UTF-8 string." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
+
+    if( status == MQTTSuccess )
+    {
+        status = addPropUtf8( pPropertyBuilder,
+                              property,
+                              propertyLength,
+                              propId,
+                              fieldPosition,
+                              pOptionalMqttPacketType );
     }
 
     return status;
@@ -681,6 +742,7 @@ MQTTStatus_t MQTTPropAdd_SubscriptionId( MQTTPropBuilder_t * pPropertyBuilder,
         /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
         /* coverity[misra_c_2012_rule_10_8_violation] */
         pPropertyBuilder->currentIndex += ( size_t ) ( pIndex - &pPropertyBuilder->pBuffer[ pPropertyBuilder->currentIndex ] );
+        pPropertyBuilder->seal.packetType = 0U;
         UINT32_SET_BIT( pPropertyBuilder->fieldSet, MQTT_SUBSCRIPTION_ID_POS );
     }
 
@@ -756,6 +818,15 @@ MQTTStatus_t MQTTPropAdd_UserProp( MQTTPropBuilder_t * pPropertyBuilder,
         status = MQTTBadParameter;
     }
 
+    #if ( MQTT_VALIDATE_UTF8 != 0 )
+        else if( ( isValidUtf8String( userProperty->pKey, userProperty->keyLength ) == false ) ||
+                 ( isValidUtf8String( userProperty->pValue, userProperty->valueLength ) == false ) )
+        {
+            LogError( ( "User property key and value must be well-formed UTF-8 strings." ) );
+            status = MQTTBadParameter;
+        }
+    #endif
+
     /*
      * User property is encoded as a key-value pair of UTF-8 strings.
      * 2-bytes for string length of key + key length +
@@ -793,6 +864,7 @@ MQTTStatus_t MQTTPropAdd_UserProp( MQTTPropBuilder_t * pPropertyBuilder,
         /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-108 */
         /* coverity[misra_c_2012_rule_10_8_violation] */
         pPropertyBuilder->currentIndex += ( size_t ) ( pIndex - start );
+        pPropertyBuilder->seal.packetType = 0U;
     }
 
     return status;
@@ -923,12 +995,12 @@ MQTTStatus_t MQTTPropAdd_AuthMethod( MQTTPropBuilder_t * pPropertyBuilder,
     else
     {
         /* Auth method has no restrictions and hence no additional checks required. */
-        status = addPropUtf8( pPropertyBuilder,
-                              authMethod,
-                              authMethodLength,
-                              MQTT_AUTH_METHOD_ID,
-                              MQTT_AUTHENTICATION_METHOD_POS,
-                              pOptionalMqttPacketType );
+        status = addPropUtf8String( pPropertyBuilder,
+                                    authMethod,
+                                    authMethodLength,
+                                    MQTT_AUTH_METHOD_ID,
+                                    MQTT_AUTHENTICATION_METHOD_POS,
+                                    pOptionalMqttPacketType );
     }
 
     return status;
@@ -1080,12 +1152,12 @@ MQTTStatus_t MQTTPropAdd_ResponseTopic( MQTTPropBuilder_t * pPropertyBuilder,
     }
     else
     {
-        status = addPropUtf8( pPropertyBuilder,
-                              responseTopic,
-                              responseTopicLength,
-                              MQTT_RESPONSE_TOPIC_ID,
-                              MQTT_RESPONSE_TOPIC_POS,
-                              pOptionalMqttPacketType );
+        status = addPropUtf8String( pPropertyBuilder,
+                                    responseTopic,
+                                    responseTopicLength,
+                                    MQTT_RESPONSE_TOPIC_ID,
+                                    MQTT_RESPONSE_TOPIC_POS,
+                                    pOptionalMqttPacketType );
     }
 
     return status;
@@ -1136,12 +1208,12 @@ MQTTStatus_t MQTTPropAdd_ContentType( MQTTPropBuilder_t * pPropertyBuilder,
     else
     {
         /* No restriction and hence no additional checks on the content type. */
-        status = addPropUtf8( pPropertyBuilder,
-                              contentType,
-                              contentTypeLength,
-                              MQTT_CONTENT_TYPE_ID,
-                              MQTT_CONTENT_TYPE_POS,
-                              pOptionalMqttPacketType );
+        status = addPropUtf8String( pPropertyBuilder,
+                                    contentType,
+                                    contentTypeLength,
+                                    MQTT_CONTENT_TYPE_ID,
+                                    MQTT_CONTENT_TYPE_POS,
+                                    pOptionalMqttPacketType );
     }
 
     return status;
@@ -1164,12 +1236,12 @@ MQTTStatus_t MQTTPropAdd_ReasonString( MQTTPropBuilder_t * pPropertyBuilder,
     else
     {
         /* No restriction and hence no additional checks on the reason string. */
-        status = addPropUtf8( pPropertyBuilder,
-                              pReasonString,
-                              reasonStringLength,
-                              MQTT_REASON_STRING_ID,
-                              MQTT_REASON_STRING_POS,
-                              pOptionalMqttPacketType );
+        status = addPropUtf8String( pPropertyBuilder,
+                                    pReasonString,
+                                    reasonStringLength,
+                                    MQTT_REASON_STRING_ID,
+                                    MQTT_REASON_STRING_POS,
+                                    pOptionalMqttPacketType );
     }
 
     return status;
@@ -0,0 +1,1443 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_retransmit_store.c
+ * @brief Implements the functions in core_mqtt_retransmit_store.h.
+ */
+#include <assert.h>
+#include <string.h>
+#include "core_mqtt_retransmit_store.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief First byte of the header of a record.
+ */
+#define RECORD_MAGIC_0            ( ( uint8_t ) 0x4DU )
+
+/**
+ * @brief Second byte of the header of a record.
+ */
+#define RECORD_MAGIC_1            ( ( uint8_t ) 0x52U )
+
+/**
+ * @brief State byte of a record whose packet is stored.
+ */
+#define RECORD_STATE_LIVE         ( ( uint8_t ) 0xA5U )
+
+/**
+ * @brief State byte of a record whose packet was cleared.
+ */
+#define RECORD_STATE_CLEARED      ( ( uint8_t ) 0x00U )
+
+/**
+ * @brief Position of the state byte in the header of a record.
+ *
+ * The two magic bytes come first, so that zeroing them marks the end of the
+ * records of a segment. The state byte is not covered by the checksum, so
+ * that a record is cleared by writing a single byte.
+ */
+#define RECORD_STATE_POS          ( 2U )
+#define RECORD_HANDLE_POS         ( 4U )  /**< @brief Position of the handle. */
+#define RECORD_SEQUENCE_POS       ( 8U )  /**< @brief Position of the sequence number. */
+#define RECORD_LENGTH_POS         ( 12U ) /**< @brief Position of the packet length. */
+#define RECORD_CHECKSUM_POS       ( 16U ) /**< @brief Position of the checksum. */
+
+/**
+ * @brief Size of the end marker written after the last record of a segment.
+ */
+#define RECORD_END_MARKER_SIZE    ( 2U )
+
+/**
+ * @brief Bit set in the handles of the PUBREL and PUBREC packets stored by
+ * the library, as opposed to PUBLISH packets.
+ */
+#define RECORD_ACK_HANDLE_FLAG    ( ( uint32_t ) 0x10000U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Write a 32-bit value in little endian order.
+ *
+ * @param[out] pBytes Where to write the value.
+ * @param[in] value The value.
+ */
+static void writeUint32( uint8_t * pBytes,
+                         uint32_t value );
+
+/**
+ * @brief Read a 32-bit value written by #writeUint32.
+ *
+ * @param[in] pBytes Where to read the value.
+ *
+ * @return The value.
+ */
+static uint32_t readUint32( const uint8_t * pBytes );
+
+/**
+ * @brief Compute the 32-bit FNV-1a checksum of a record, over the fields of
+ * its header after the state byte and its packet.
+ *
+ * @param[in] pRecord The record.
+ * @param[in] packetLength Length of the packet of the record.
+ *
+ * @return The checksum.
+ */
+static uint32_t recordChecksum( const uint8_t * pRecord,
+                                size_t packetLength );
+
+/**
+ * @brief Check the record at a position of a segment, as found when
+ * recovering a store.
+ *
+ * @param[in] pStore The store.
+ * @param[in] segment The segment.
+ * @param[in] position Position of the record in the segment.
+ * @param[out] pRecordSize Size of the record, header included, if it is
+ * valid.
+ *
+ * @return true if a complete record is found at the position, else false.
+ */
+static bool isValidRecord( const MQTTRetransmitStore_t * pStore,
+                           size_t segment,
+                           size_t position,
+                           size_t * pRecordSize );
+
+/**
+ * @brief Get the entry at which the search for a handle starts.
+ *
+ * @param[in] pStore The store.
+ * @param[in] handle The handle.
+ *
+ * @return The home entry of the handle.
+ */
+static size_t entryHome( const MQTTRetransmitStore_t * pStore,
+                         uint32_t handle );
+
+/**
+ * @brief Find a handle in the index of a store.
+ *
+ * @param[in] pStore The store.
+ * @param[in] handle The handle.
+ * @param[out] pEntry The entry holding the handle if it is found, else the
+ * free entry which ended the search.
+ *
+ * @return true if the handle is found, else false.
+ */
+static bool entryFind( const MQTTRetransmitStore_t * pStore,
+                       uint32_t handle,
+                       size_t * pEntry );
+
+/**
+ * @brief Remove the handle in an entry from the index of a store.
+ *
+ * Entries after it are shifted back so that no search ends early.
+ *
+ * @param[in] pStore The store.
+ * @param[in] entry The entry to free.
+ */
+static void entryRemove( MQTTRetransmitStore_t * pStore,
+                         size_t entry );
+
+/**
+ * @brief Check the parameters of a store and set up its fields, with an
+ * empty index and empty segments.
+ *
+ * @param[out] pStore The store.
+ * @param[in] pMemory Memory for the log.
+ * @param[in] memorySize Size of @p pMemory.
+ * @param[in] pSegments Memory for the bookkeeping of the segments.
+ * @param[in] segmentCount Number of segments.
+ * @param[in] pEntries Memory for the index.
+ * @param[in] entryCount Number of entries of the index.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed, else
+ * #MQTTSuccess.
+ */
+static MQTTStatus_t initStore( MQTTRetransmitStore_t * pStore,
+                               uint8_t * pMemory,
+                               size_t memorySize,
+                               MQTTRetransmitStoreSegment_t * pSegments,
+                               size_t segmentCount,
+                               MQTTRetransmitStoreEntry_t * pEntries,
+                               size_t entryCount );
+
+/**
+ * @brief Empty a segment.
+ *
+ * @param[in] pStore The store.
+ * @param[in] segment The segment.
+ */
+static void resetSegment( MQTTRetransmitStore_t * pStore,
+                          size_t segment );
+
+/**
+ * @brief Mark a record as cleared and take its bytes off the live bytes of
+ * its segment.
+ *
+ * @param[in] pStore The store.
+ * @param[in] offset Position of the record in the memory of the store.
+ *
+ * @return The segment of the record.
+ */
+static size_t clearRecord( MQTTRetransmitStore_t * pStore,
+                           size_t offset );
+
+/**
+ * @brief Take room for a record at the end of the current segment.
+ *
+ * The position after the record is marked as the end of the segment before
+ * the record is written, so that a record left incomplete is the last one
+ * read by #MQTT_RetransmitStoreRecover.
+ *
+ * @param[in] pStore The store.
+ * @param[in] recordSize Size of the record. The current segment must have
+ * room for it.
+ *
+ * @return Position of the record in the memory of the store.
+ */
+static size_t takeRoom( MQTTRetransmitStore_t * pStore,
+                        size_t recordSize );
+
+/**
+ * @brief Copy the live records of a segment into an empty segment, and
+ * empty the former.
+ *
+ * The copies keep the sequence numbers of the records, so that the order in
+ * which the packets were first stored is not lost.
+ *
+ * @param[in] pStore The store.
+ * @param[in] victim The segment to empty.
+ * @param[in] reserve The empty segment.
+ */
+static void compactSegment( MQTTRetransmitStore_t * pStore,
+                            size_t victim,
+                            size_t reserve );
+
+/**
+ * @brief Find the free segments of a store, which are the empty segments
+ * other than the current one.
+ *
+ * @param[in] pStore The store.
+ * @param[out] pFreeSegment The first free segment, if any.
+ *
+ * @return The number of free segments.
+ */
+static size_t findFreeSegment( const MQTTRetransmitStore_t * pStore,
+                               size_t * pFreeSegment );
+
+/**
+ * @brief Make room in the current segment for a record, moving to a free
+ * segment or compacting one if needed.
+ *
+ * A free segment is always kept for compaction.
+ *
+ * @param[in] pStore The store.
+ * @param[in] recordSize Size of the record.
+ *
+ * @return #MQTTNoMemory if no room can be made, else #MQTTSuccess.
+ */
+static MQTTStatus_t makeRoom( MQTTRetransmitStore_t * pStore,
+                              size_t recordSize );
+
+/**
+ * @brief Check whether the records of a segment are the copies of records of
+ * another segment, as left by a compaction which did not complete.
+ *
+ * Compaction copies records in order, keeping their handle and sequence
+ * number, and the originals stay readable until the segment they are in is
+ * emptied.
+ *
+ * @param[in] pStore The store.
+ * @param[in] reserve The segment which may hold the copies.
+ * @param[in] victim The segment which may hold the originals.
+ *
+ * @return true if @p reserve holds records, each of which is found in
+ * @p victim, else false.
+ */
+static bool isCompactionCopy( const MQTTRetransmitStore_t * pStore,
+                              size_t reserve,
+                              size_t victim );
+
+/**
+ * @brief Undo a compaction which did not complete, so that a free segment is
+ * kept for the next one: the originals of the copies are made live again,
+ * and the segment holding the copies is emptied.
+ *
+ * @param[in] pStore The store.
+ * @param[in] reserve The segment holding the copies.
+ * @param[in] victim The segment holding the originals.
+ */
+static void rollBackCompaction( MQTTRetransmitStore_t * pStore,
+                                size_t reserve,
+                                size_t victim );
+
+/**
+ * @brief Read the records of a segment found when recovering a store, and
+ * index their packets.
+ *
+ * @param[in] pStore The store.
+ * @param[in] segment The segment.
+ * @param[in,out] pLatestSequence The most recent sequence number read.
+ * @param[in,out] pFoundRecord Whether a record was read in a previous
+ * segment, and is set when one is read.
+ *
+ * @return #MQTTNoMemory if the index is full, else #MQTTSuccess.
+ */
+static MQTTStatus_t recoverSegment( MQTTRetransmitStore_t * pStore,
+                                    size_t segment,
+                                    uint32_t * pLatestSequence,
+                                    bool * pFoundRecord );
+
+/**
+ * @brief Get the age of the packet stored for a handle, in the order the
+ * packets were first stored.
+ *
+ * @param[in] pStore The store.
+ * @param[in] handle A stored handle.
+ *
+ * @return The distance from the sequence number of the packet to
+ * #MQTTRetransmitStore_t.nextSequence, smaller for older packets.
+ */
+static uint32_t packetOrder( const MQTTRetransmitStore_t * pStore,
+                             uint32_t handle );
+
+/**
+ * @brief Insert a state record among records sorted by the order of their
+ * packets.
+ *
+ * @param[in] pStore The store.
+ * @param[in,out] pRecords The records.
+ * @param[in] recordsUsed Number of records already inserted.
+ * @param[in] pRecord The record to insert.
+ * @param[in] order Order of the packet of the record.
+ * @param[in] isOutgoing Whether the records are outgoing records.
+ */
+static void insertRecord( const MQTTRetransmitStore_t * pStore,
+                          MQTTPubAckInfo_t * pRecords,
+                          size_t recordsUsed,
+                          const MQTTPubAckInfo_t * pRecord,
+                          uint32_t order,
+                          bool isOutgoing );
+
+/*-----------------------------------------------------------*/
+
+static void writeUint32( uint8_t * pBytes,
+                         uint32_t value )
+{
+    pBytes[ 0 ] = ( uint8_t ) ( value & 0xFFU );
+    pBytes[ 1 ] = ( uint8_t ) ( ( value >> 8U ) & 0xFFU );
+    pBytes[ 2 ] = ( uint8_t ) ( ( value >> 16U ) & 0xFFU );
+    pBytes[ 3 ] = ( uint8_t ) ( ( value >> 24U ) & 0xFFU );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t readUint32( const uint8_t * pBytes )
+{
+    return ( uint32_t ) pBytes[ 0 ] |
+           ( ( uint32_t ) pBytes[ 1 ] << 8U ) |
+           ( ( uint32_t ) pBytes[ 2 ] << 16U ) |
+           ( ( uint32_t ) pBytes[ 3 ] << 24U );
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t recordChecksum( const uint8_t * pRecord,
+                                size_t packetLength )
+{
+    uint32_t hash = 2166136261U;
+    size_t index;
+    size_t end = MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE + packetLength;
+
+    for( index = RECORD_HANDLE_POS; index < end; index++ )
+    {
+        /* The checksum field itself is skipped. */
+        if( ( index < RECORD_CHECKSUM_POS ) || ( index >= MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) )
+        {
+            hash ^= ( uint32_t ) pRecord[ index ];
+            hash *= 16777619U;
+        }
+    }
+
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool isValidRecord( const MQTTRetransmitStore_t * pStore,
+                           size_t segment,
+                           size_t position,
+                           size_t * pRecordSize )
+{
+    bool isValid = false;
+    const uint8_t * pRecord = &pStore->pMemory[ ( segment * pStore->segmentSize ) + position ];
+    size_t packetLength;
+
+    if( ( pStore->segmentSize - position ) <= MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE )
+    {
+        /* No room left for a record. */
+    }
+    else if( ( pRecord[ 0 ] != RECORD_MAGIC_0 ) || ( pRecord[ 1 ] != RECORD_MAGIC_1 ) )
+    {
+        /* End of the records of the segment. */
+    }
+    else if( ( pRecord[ RECORD_STATE_POS ] != RECORD_STATE_LIVE ) &&
+             ( pRecord[ RECORD_STATE_POS ] != RECORD_STATE_CLEARED ) )
+    {
+        LogWarn( ( "Invalid record state in segment %lu at %lu.",
+                   ( unsigned long ) segment,
+                   ( unsigned long ) position ) );
+    }
+    else
+    {
+        packetLength = ( size_t ) readUint32( &pRecord[ RECORD_LENGTH_POS ] );
+
+        if( ( readUint32( &pRecord[ RECORD_HANDLE_POS ] ) == 0U ) ||
+            ( packetLength == 0U ) ||
+            ( packetLength > ( pStore->segmentSize - position - MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) ) )
+        {
+            LogWarn( ( "Invalid record header in segment %lu at %lu.",
+                       ( unsigned long ) segment,
+                       ( unsigned long ) position ) );
+        }
+        else if( readUint32( &pRecord[ RECORD_CHECKSUM_POS ] ) != recordChecksum( pRecord, packetLength ) )
+        {
+            LogWarn( ( "Incomplete record in segment %lu at %lu.",
+                       ( unsigned long ) segment,
+                       ( unsigned long ) position ) );
+        }
+        else
+        {
+            *pRecordSize = MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE + packetLength;
+            isValid = true;
+        }
+    }
+
+    return isValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t entryHome( const MQTTRetransmitStore_t * pStore,
+                         uint32_t handle )
+{
+    /* Handles are packet IDs, handed out mostly in sequence, with a flag
+     * above them for acknowledgments. Folding the flag in keeps a packet ID
+     * and its acknowledgment apart. */
+    return ( size_t ) ( handle ^ ( handle >> 16U ) ) & ( pStore->entryCount - 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool entryFind( const MQTTRetransmitStore_t * pStore,
+                       uint32_t handle,
+                       size_t * pEntry )
+{
+    bool isFound = false;
+    size_t entry = entryHome( pStore, handle );
+
+    /* There is always a free entry, as an entry is kept free when storing. */
+    while( ( pStore->pEntries[ entry ].handle != 0U ) && ( isFound == false ) )
+    {
+        if( pStore->pEntries[ entry ].handle == handle )
+        {
+            isFound = true;
+        }
+        else
+        {
+            entry = ( entry + 1U ) & ( pStore->entryCount - 1U );
+        }
+    }
+
+    *pEntry = entry;
+
+    return isFound;
+}
+
+/*-----------------------------------------------------------*/
+
+static void entryRemove( MQTTRetransmitStore_t * pStore,
+                         size_t entry )
+{
+    const size_t mask = pStore->entryCount - 1U;
+    size_t hole = entry;
+    size_t next = ( entry + 1U ) & mask;
+    size_t home;
+
+    pStore->pEntries[ hole ].handle = 0U;
+
+    while( pStore->pEntries[ next ].handle != 0U )
+    {
+        home = entryHome( pStore, pStore->pEntries[ next ].handle );
+
+        /* The entry can fill the hole only if the hole lies between its home
+         * entry and its current entry. */
+        if( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            pStore->pEntries[ hole ] = pStore->pEntries[ next ];
+            pStore->pEntries[ next ].handle = 0U;
+            hole = next;
+        }
+
+        next = ( next + 1U ) & mask;
+    }
+
+    pStore->entriesUsed--;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t initStore( MQTTRetransmitStore_t * pStore,
+                               uint8_t * pMemory,
+                               size_t memorySize,
+                               MQTTRetransmitStoreSegment_t * pSegments,
+                               size_t segmentCount,
+                               MQTTRetransmitStoreEntry_t * pEntries,
+                               size_t entryCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t segmentSize = 0U;
+
+    if( ( pStore == NULL ) || ( pMemory == NULL ) || ( pSegments == NULL ) || ( pEntries == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pStore=%p, pMemory=%p, pSegments=%p, pEntries=%p",
+                    ( void * ) pStore,
+                    ( void * ) pMemory,
+                    ( void * ) pSegments,
+                    ( void * ) pEntries ) );
+        status = MQTTBadParameter;
+    }
+    else if( segmentCount < 2U )
+    {
+        LogError( ( "A store needs at least 2 segments: segmentCount=%lu",
+                    ( unsigned long ) segmentCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( entryCount < 2U ) || ( ( entryCount & ( entryCount - 1U ) ) != 0U ) )
+    {
+        LogError( ( "Number of entries must be a power of 2: entryCount=%lu",
+                    ( unsigned long ) entryCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        segmentSize = memorySize / segmentCount;
+
+        if( ( segmentSize <= MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) ||
+            ( ( uint64_t ) segmentSize > ( uint64_t ) UINT32_MAX ) )
+        {
+            LogError( ( "Segment size must be larger than a record header and at most 4 GB: "
+                        "memorySize=%lu, segmentCount=%lu",
+                        ( unsigned long ) memorySize,
+                        ( unsigned long ) segmentCount ) );
+            status = MQTTBadParameter;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        ( void ) memset( pEntries, 0, entryCount * sizeof( MQTTRetransmitStoreEntry_t ) );
+        ( void ) memset( pSegments, 0, segmentCount * sizeof( MQTTRetransmitStoreSegment_t ) );
+
+        pStore->pMemory = pMemory;
+        pStore->segmentSize = segmentSize;
+        pStore->pSegments = pSegments;
+        pStore->segmentCount = segmentCount;
+        pStore->currentSegment = 0U;
+        pStore->pEntries = pEntries;
+        pStore->entryCount = entryCount;
+        pStore->entriesUsed = 0U;
+        pStore->nextSequence = 0U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static void resetSegment( MQTTRetransmitStore_t * pStore,
+                          size_t segment )
+{
+    uint8_t * pSegment = &pStore->pMemory[ segment * pStore->segmentSize ];
+
+    /* The records left in the segment are no longer read. */
+    pSegment[ 0 ] = 0U;
+    pSegment[ 1 ] = 0U;
+
+    pStore->pSegments[ segment ].used = 0U;
+    pStore->pSegments[ segment ].live = 0U;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t clearRecord( MQTTRetransmitStore_t * pStore,
+                           size_t offset )
+{
+    uint8_t * pRecord = &pStore->pMemory[ offset ];
+    size_t segment = offset / pStore->segmentSize;
+
+    pRecord[ RECORD_STATE_POS ] = RECORD_STATE_CLEARED;
+    pStore->pSegments[ segment ].live -= MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE +
+                                         ( size_t ) readUint32( &pRecord[ RECORD_LENGTH_POS ] );
+
+    return segment;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t takeRoom( MQTTRetransmitStore_t * pStore,
+                        size_t recordSize )
+{
+    MQTTRetransmitStoreSegment_t * pSegment = &pStore->pSegments[ pStore->currentSegment ];
+    size_t offset = ( pStore->currentSegment * pStore->segmentSize ) + pSegment->used;
+
+    assert( ( pStore->segmentSize - pSegment->used ) >= recordSize );
+
+    if( ( pStore->segmentSize - pSegment->used - recordSize ) >= RECORD_END_MARKER_SIZE )
+    {
+        pStore->pMemory[ offset + recordSize ] = 0U;
+        pStore->pMemory[ offset + recordSize + 1U ] = 0U;
+    }
+
+    pSegment->used += recordSize;
+    pSegment->live += recordSize;
+
+    return offset;
+}
+
+/*-----------------------------------------------------------*/
+
+static void compactSegment( MQTTRetransmitStore_t * pStore,
+                            size_t victim,
+                            size_t reserve )
+{
+    size_t position = 0U;
+    size_t offset;
+    size_t newOffset;
+    size_t recordSize;
+    size_t entry;
+    bool isFound;
+    uint8_t * pRecord;
+    size_t current = pStore->currentSegment;
+
+    assert( pStore->pSegments[ reserve ].used == 0U );
+
+    /* Records are appended to the reserve while copying. */
+    pStore->currentSegment = reserve;
+
+    while( position < pStore->pSegments[ victim ].used )
+    {
+        offset = ( victim * pStore->segmentSize ) + position;
+        pRecord = &pStore->pMemory[ offset ];
+        recordSize = MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE +
+                     ( size_t ) readUint32( &pRecord[ RECORD_LENGTH_POS ] );
+
+        if( pRecord[ RECORD_STATE_POS ] == RECORD_STATE_LIVE )
+        {
+            newOffset = takeRoom( pStore, recordSize );
+            ( void ) memcpy( &pStore->pMemory[ newOffset ], pRecord, recordSize );
+
+            isFound = entryFind( pStore, readUint32( &pRecord[ RECORD_HANDLE_POS ] ), &entry );
+            assert( isFound == true );
+            ( void ) isFound;
+            pStore->pEntries[ entry ].offset = newOffset;
+
+            /* The copy is complete, so the original may go. Both are read
+             * by recovery until then, and hold the same packet. */
+            pRecord[ RECORD_STATE_POS ] = RECORD_STATE_CLEARED;
+        }
+
+        position += recordSize;
+    }
+
+    resetSegment( pStore, victim );
+
+    if( victim != current )
+    {
+        pStore->currentSegment = current;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t findFreeSegment( const MQTTRetransmitStore_t * pStore,
+                               size_t * pFreeSegment )
+{
+    size_t freeCount = 0U;
+    size_t segment;
+
+    for( segment = pStore->segmentCount; segment > 0U; segment-- )
+    {
+        if( ( ( segment - 1U ) != pStore->currentSegment ) &&
+            ( pStore->pSegments[ segment - 1U ].used == 0U ) )
+        {
+            *pFreeSegment = segment - 1U;
+            freeCount++;
+        }
+    }
+
+    return freeCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t makeRoom( MQTTRetransmitStore_t * pStore,
+                              size_t recordSize )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t freeSegment = 0U;
+    size_t freeCount;
+    size_t victim = pStore->currentSegment;
+    size_t segment;
+
+    if( ( pStore->segmentSize - pStore->pSegments[ pStore->currentSegment ].used ) >= recordSize )
+    {
+        /* The current segment has room. */
+    }
+    else
+    {
+        freeCount = findFreeSegment( pStore, &freeSegment );
+
+        if( freeCount > 1U )
+        {
+            pStore->currentSegment = freeSegment;
+        }
+        else if( freeCount == 1U )
+        {
+            /* Compact the segment with the fewest live bytes into the last
+             * free segment. */
+            for( segment = 0U; segment < pStore->segmentCount; segment++ )
+            {
+                if( ( segment != freeSegment ) &&
+                    ( pStore->pSegments[ segment ].live < pStore->pSegments[ victim ].live ) )
+                {
+                    victim = segment;
+                }
+            }
+
+            if( ( pStore->segmentSize - pStore->pSegments[ victim ].live ) >= recordSize )
+            {
+                LogDebug( ( "Compacting segment %lu of the retransmit store.",
+                            ( unsigned long ) victim ) );
+                compactSegment( pStore, victim, freeSegment );
+                pStore->currentSegment = freeSegment;
+            }
+            else
+            {
+                status = MQTTNoMemory;
+            }
+        }
+        else
+        {
+            status = MQTTNoMemory;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool isCompactionCopy( const MQTTRetransmitStore_t * pStore,
+                              size_t reserve,
+                              size_t victim )
+{
+    bool isCopy = true;
+    size_t position = 0U;
+    size_t victimPosition = 0U;
+    size_t recordSize = 0U;
+    size_t victimRecordSize = 0U;
+    const uint8_t * pRecord;
+    const uint8_t * pOriginal;
+    bool isFound;
+
+    if( isValidRecord( pStore, reserve, 0U, &recordSize ) == false )
+    {
+        isCopy = false;
+    }
+
+    while( ( isCopy == true ) && ( isValidRecord( pStore, reserve, position, &recordSize ) == true ) )
+    {
+        pRecord = &pStore->pMemory[ ( reserve * pStore->segmentSize ) + position ];
+        isFound = false;
+
+        /* The copies are in the order of their originals, and keep their
+         * handle and sequence number, which follow each other. */
+        while( ( isFound == false ) &&
+               ( isValidRecord( pStore, victim, victimPosition, &victimRecordSize ) == true ) )
+        {
+            pOriginal = &pStore->pMemory[ ( victim * pStore->segmentSize ) + victimPosition ];
+            isFound = ( memcmp( &pOriginal[ RECORD_HANDLE_POS ],
+                                &pRecord[ RECORD_HANDLE_POS ],
+                                RECORD_LENGTH_POS - RECORD_HANDLE_POS ) == 0 );
+            victimPosition += victimRecordSize;
+        }
+
+        isCopy = isFound;
+        position += recordSize;
+    }
+
+    return isCopy;
+}
+
+/*-----------------------------------------------------------*/
+
+static void rollBackCompaction( MQTTRetransmitStore_t * pStore,
+                                size_t reserve,
+                                size_t victim )
+{
+    size_t position = 0U;
+    size_t victimPosition = 0U;
+    size_t recordSize = 0U;
+    size_t victimRecordSize = 0U;
+    const uint8_t * pRecord;
+    uint8_t * pOriginal;
+    bool isFound;
+
+    while( isValidRecord( pStore, reserve, position, &recordSize ) == true )
+    {
+        pRecord = &pStore->pMemory[ ( reserve * pStore->segmentSize ) + position ];
+        isFound = false;
+
+        while( ( isFound == false ) &&
+               ( isValidRecord( pStore, victim, victimPosition, &victimRecordSize ) == true ) )
+        {
+            pOriginal = &pStore->pMemory[ ( victim * pStore->segmentSize ) + victimPosition ];
+            isFound = ( memcmp( &pOriginal[ RECORD_HANDLE_POS ],
+                                &pRecord[ RECORD_HANDLE_POS ],
+                                RECORD_LENGTH_POS - RECORD_HANDLE_POS ) == 0 );
+
+            /* Only live records are copied, so the original was live. */
+            if( isFound == true )
+            {
+                pOriginal[ RECORD_STATE_POS ] = RECORD_STATE_LIVE;
+            }
+
+            victimPosition += victimRecordSize;
+        }
+
+        position += recordSize;
+    }
+
+    resetSegment( pStore, reserve );
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t recoverSegment( MQTTRetransmitStore_t * pStore,
+                                    size_t segment,
+                                    uint32_t * pLatestSequence,
+                                    bool * pFoundRecord )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTRetransmitStoreSegment_t * pSegment = &pStore->pSegments[ segment ];
+    size_t recordSize = 0U;
+    size_t offset;
+    size_t entry;
+    uint8_t * pRecord;
+    const uint8_t * pOther;
+    uint32_t handle;
+    uint32_t sequence;
+
+    while( ( status == MQTTSuccess ) &&
+           ( isValidRecord( pStore, segment, pSegment->used, &recordSize ) == true ) )
+    {
+        offset = ( segment * pStore->segmentSize ) + pSegment->used;
+        pRecord = &pStore->pMemory[ offset ];
+        handle = readUint32( &pRecord[ RECORD_HANDLE_POS ] );
+        sequence = readUint32( &pRecord[ RECORD_SEQUENCE_POS ] );
+
+        pSegment->used += recordSize;
+
+        if( ( *pFoundRecord == false ) || ( ( uint32_t ) ( sequence - *pLatestSequence ) < 0x80000000U ) )
+        {
+            *pLatestSequence = sequence;
+            pStore->currentSegment = segment;
+            *pFoundRecord = true;
+        }
+
+        if( pRecord[ RECORD_STATE_POS ] == RECORD_STATE_CLEARED )
+        {
+            /* MISRA Empty body */
+        }
+        else if( entryFind( pStore, handle, &entry ) == true )
+        {
+            pSegment->live += recordSize;
+            pOther = &pStore->pMemory[ pStore->pEntries[ entry ].offset ];
+
+            /* Keep the most recent packet of the handle. A copy made by
+             * compaction has the sequence number of its original. */
+            if( ( uint32_t ) ( sequence - readUint32( &pOther[ RECORD_SEQUENCE_POS ] ) - 1U ) < 0x7FFFFFFFU )
+            {
+                ( void ) clearRecord( pStore, pStore->pEntries[ entry ].offset );
+                pStore->pEntries[ entry ].offset = offset;
+            }
+            else
+            {
+                ( void ) clearRecord( pStore, offset );
+            }
+        }
+        else if( ( pStore->entriesUsed + 1U ) >= pStore->entryCount )
+        {
+            LogError( ( "The retransmit store holds more packets than its index: entryCount=%lu",
+                        ( unsigned long ) pStore->entryCount ) );
+            status = MQTTNoMemory;
+        }
+        else
+        {
+            pSegment->live += recordSize;
+            pStore->pEntries[ entry ].handle = handle;
+            pStore->pEntries[ entry ].offset = offset;
+            pStore->entriesUsed++;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t packetOrder( const MQTTRetransmitStore_t * pStore,
+                             uint32_t handle )
+{
+    size_t entry = 0U;
+    bool isFound;
+
+    isFound = entryFind( pStore, handle, &entry );
+    assert( isFound == true );
+    ( void ) isFound;
+
+    /* Sequence numbers wrap around, so they are compared from the next one,
+     * which is later than all of them. */
+    return readUint32( &pStore->pMemory[ pStore->pEntries[ entry ].offset + RECORD_SEQUENCE_POS ] ) -
+           pStore->nextSequence;
+}
+
+/*-----------------------------------------------------------*/
+
+static void insertRecord( const MQTTRetransmitStore_t * pStore,
+                          MQTTPubAckInfo_t * pRecords,
+                          size_t recordsUsed,
+                          const MQTTPubAckInfo_t * pRecord,
+                          uint32_t order,
+                          bool isOutgoing )
+{
+    size_t low = 0U;
+    size_t high = recordsUsed;
+    size_t middle;
+    uint32_t handle;
+
+    /* Find the first record of a more recent packet. */
+    while( low < high )
+    {
+        middle = low + ( ( high - low ) / 2U );
+        handle = ( uint32_t ) pRecords[ middle ].packetId;
+
+        /* Outgoing PUBRELs and incoming PUBRECs are stored under a flagged
+         * handle. */
+        if( ( isOutgoing == false ) || ( pRecords[ middle ].publishState == MQTTPubCompPending ) )
+        {
+            handle |= RECORD_ACK_HANDLE_FLAG;
+        }
+
+        if( packetOrder( pStore, handle ) < order )
+        {
+            low = middle + 1U;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    ( void ) memmove( &pRecords[ low + 1U ], &pRecords[ low ], ( recordsUsed - low ) * sizeof( MQTTPubAckInfo_t ) );
+    pRecords[ low ] = *pRecord;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreInit( MQTTRetransmitStore_t * pStore,
+                                       uint8_t * pMemory,
+                                       size_t memorySize,
+                                       MQTTRetransmitStoreSegment_t * pSegments,
+                                       size_t segmentCount,
+                                       MQTTRetransmitStoreEntry_t * pEntries,
+                                       size_t entryCount )
+{
+    MQTTStatus_t status;
+    size_t segment;
+
+    status = initStore( pStore, pMemory, memorySize, pSegments, segmentCount, pEntries, entryCount );
+
+    if( status == MQTTSuccess )
+    {
+        for( segment = 0U; segment < segmentCount; segment++ )
+        {
+            resetSegment( pStore, segment );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreRecover( MQTTRetransmitStore_t * pStore,
+                                          uint8_t * pMemory,
+                                          size_t memorySize,
+                                          MQTTRetransmitStoreSegment_t * pSegments,
+                                          size_t segmentCount,
+                                          MQTTRetransmitStoreEntry_t * pEntries,
+                                          size_t entryCount )
+{
+    MQTTStatus_t status;
+    size_t segment;
+    size_t victim;
+    uint32_t latestSequence = 0U;
+    bool foundRecord = false;
+    bool rolledBack = false;
+
+    status = initStore( pStore, pMemory, memorySize, pSegments, segmentCount, pEntries, entryCount );
+
+    /* A compaction stopped before emptying its victim leaves no free segment
+     * to compact into, so it is undone first. */
+    for( segment = 0U; ( status == MQTTSuccess ) && ( rolledBack == false ) && ( segment < segmentCount ); segment++ )
+    {
+        for( victim = 0U; ( rolledBack == false ) && ( victim < segmentCount ); victim++ )
+        {
+            if( ( victim != segment ) && ( isCompactionCopy( pStore, segment, victim ) == true ) )
+            {
+                LogWarn( ( "Rolling back the compaction of segment %lu into segment %lu.",
+                           ( unsigned long ) victim,
+                           ( unsigned long ) segment ) );
+                rollBackCompaction( pStore, segment, victim );
+                rolledBack = true;
+            }
+        }
+    }
+
+    for( segment = 0U; ( status == MQTTSuccess ) && ( segment < segmentCount ); segment++ )
+    {
+        status = recoverSegment( pStore, segment, &latestSequence, &foundRecord );
+    }
+
+    if( status == MQTTSuccess )
+    {
+        if( foundRecord == true )
+        {
+            pStore->nextSequence = latestSequence + 1U;
+        }
+
+        /* Segments left with no live record are free again. */
+        for( segment = 0U; segment < segmentCount; segment++ )
+        {
+            if( pSegments[ segment ].live == 0U )
+            {
+                resetSegment( pStore, segment );
+            }
+        }
+
+        LogDebug( ( "Recovered %lu packets from the retransmit store.",
+                    ( unsigned long ) pStore->entriesUsed ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreAppend( MQTTRetransmitStore_t * pStore,
+                                         uint32_t handle,
+                                         const MQTTVec_t * pMqttVec )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t packetLength = 0U;
+    size_t recordSize = 0U;
+    size_t entry = 0U;
+    size_t offset;
+    size_t segment;
+    bool isFound = false;
+    uint8_t * pRecord;
+
+    if( ( pStore == NULL ) || ( pStore->pMemory == NULL ) || ( pMqttVec == NULL ) || ( handle == 0U ) )
+    {
+        LogError( ( "Invalid parameter: pStore=%p, pMqttVec=%p, handle=%lu",
+                    ( const void * ) pStore,
+                    ( const void * ) pMqttVec,
+                    ( unsigned long ) handle ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        status = MQTT_GetBytesInMQTTVec( pMqttVec, &packetLength );
+    }
+
+    if( status != MQTTSuccess )
+    {
+        /* MISRA Empty body */
+    }
+    else if( ( packetLength == 0U ) ||
+             ( packetLength > ( pStore->segmentSize - MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) ) )
+    {
+        LogError( ( "Packet does not fit in a segment of the retransmit store: packetLength=%lu, segmentSize=%lu",
+                    ( unsigned long ) packetLength,
+                    ( unsigned long ) pStore->segmentSize ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        recordSize = MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE + packetLength;
+        isFound = entryFind( pStore, handle, &entry );
+
+        /* An entry is always kept free to end the searches. */
+        if( ( isFound == false ) && ( ( pStore->entriesUsed + 1U ) >= pStore->entryCount ) )
+        {
+            LogError( ( "No free entry left in the retransmit store: entryCount=%lu",
+                        ( unsigned long ) pStore->entryCount ) );
+            status = MQTTNoMemory;
+        }
+        else
+        {
+            status = makeRoom( pStore, recordSize );
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        offset = takeRoom( pStore, recordSize );
+        pRecord = &pStore->pMemory[ offset ];
+
+        MQTT_SerializeMQTTVec( &pRecord[ MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ], pMqttVec );
+        pRecord[ RECORD_STATE_POS ] = RECORD_STATE_LIVE;
+        pRecord[ RECORD_STATE_POS + 1U ] = 0U;
+        writeUint32( &pRecord[ RECORD_HANDLE_POS ], handle );
+        writeUint32( &pRecord[ RECORD_SEQUENCE_POS ], pStore->nextSequence );
+        writeUint32( &pRecord[ RECORD_LENGTH_POS ], ( uint32_t ) packetLength );
+        writeUint32( &pRecord[ RECORD_CHECKSUM_POS ], recordChecksum( pRecord, packetLength ) );
+
+        /* The magic bytes are written last, so that the record is read only
+         * once complete. */
+        pRecord[ 1 ] = RECORD_MAGIC_1;
+        pRecord[ 0 ] = RECORD_MAGIC_0;
+
+        pStore->nextSequence++;
+
+        if( isFound == true )
+        {
+            /* Compaction may have moved the previous packet of the handle,
+             * but not its entry. */
+            segment = clearRecord( pStore, pStore->pEntries[ entry ].offset );
+
+            if( pStore->pSegments[ segment ].live == 0U )
+            {
+                resetSegment( pStore, segment );
+            }
+        }
+        else
+        {
+            pStore->pEntries[ entry ].handle = handle;
+            pStore->entriesUsed++;
+        }
+
+        pStore->pEntries[ entry ].offset = offset;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreRetrieve( const MQTTRetransmitStore_t * pStore,
+                                           uint32_t handle,
+                                           uint8_t ** ppPacket,
+                                           size_t * pPacketLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t entry = 0U;
+    uint8_t * pRecord;
+
+    if( ( pStore == NULL ) || ( pStore->pEntries == NULL ) || ( ppPacket == NULL ) || ( pPacketLength == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pStore=%p, ppPacket=%p, pPacketLength=%p",
+                    ( const void * ) pStore,
+                    ( void * ) ppPacket,
+                    ( void * ) pPacketLength ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( handle == 0U ) || ( entryFind( pStore, handle, &entry ) == false ) )
+    {
+        LogError( ( "No packet stored for handle %lu.",
+                    ( unsigned long ) handle ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pRecord = &pStore->pMemory[ pStore->pEntries[ entry ].offset ];
+        *ppPacket = &pRecord[ MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ];
+        *pPacketLength = ( size_t ) readUint32( &pRecord[ RECORD_LENGTH_POS ] );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreRetrieveBatch( const MQTTRetransmitStore_t * pStore,
+                                                const uint32_t * pHandles,
+                                                size_t handleCount,
+                                                TransportOutVector_t * pPackets )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint8_t * pPacket = NULL;
+    size_t packetLength = 0U;
+    size_t index;
+
+    if( ( pStore == NULL ) || ( pHandles == NULL ) || ( pPackets == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pStore=%p, pHandles=%p, pPackets=%p",
+                    ( const void * ) pStore,
+                    ( const void * ) pHandles,
+                    ( void * ) pPackets ) );
+        status = MQTTBadParameter;
+    }
+
+    for( index = 0U; ( status == MQTTSuccess ) && ( index < handleCount ); index++ )
+    {
+        status = MQTT_RetransmitStoreRetrieve( pStore, pHandles[ index ], &pPacket, &packetLength );
+
+        if( status == MQTTSuccess )
+        {
+            pPackets[ index ].iov_base = pPacket;
+            pPackets[ index ].iov_len = packetLength;
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreClear( MQTTRetransmitStore_t * pStore,
+                                        uint32_t handle )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t entry = 0U;
+    size_t segment;
+
+    if( ( pStore == NULL ) || ( pStore->pEntries == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pStore=%p",
+                    ( void * ) pStore ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( handle == 0U ) || ( entryFind( pStore, handle, &entry ) == false ) )
+    {
+        LogWarn( ( "No packet stored for handle %lu.",
+                   ( unsigned long ) handle ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        segment = clearRecord( pStore, pStore->pEntries[ entry ].offset );
+        entryRemove( pStore, entry );
+
+        /* A segment with no live record is free without compaction. */
+        if( pStore->pSegments[ segment ].live == 0U )
+        {
+            resetSegment( pStore, segment );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreCompact( MQTTRetransmitStore_t * pStore,
+                                          bool * pCompacted )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t reserve = 0U;
+    size_t victim = 0U;
+    size_t segment;
+    size_t cleared;
+    size_t mostCleared = 0U;
+    bool compacted = false;
+
+    if( ( pStore == NULL ) || ( pStore->pSegments == NULL ) )
+    {
+        LogError( ( "Argument cannot be NULL: pStore=%p",
+                    ( void * ) pStore ) );
+        status = MQTTBadParameter;
+    }
+    else if( findFreeSegment( pStore, &reserve ) == 0U )
+    {
+        LogDebug( ( "No free segment to compact into." ) );
+    }
+    else
+    {
+        for( segment = 0U; segment < pStore->segmentCount; segment++ )
+        {
+            cleared = pStore->pSegments[ segment ].used - pStore->pSegments[ segment ].live;
+
+            if( cleared > mostCleared )
+            {
+                mostCleared = cleared;
+                victim = segment;
+            }
+        }
+
+        if( mostCleared > 0U )
+        {
+            compactSegment( pStore, victim, reserve );
+            compacted = true;
+        }
+    }
+
+    if( pCompacted != NULL )
+    {
+        *pCompacted = compacted;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RetransmitStoreRestoreRecords( const MQTTRetransmitStore_t * pStore,
+                                                 MQTTPubAckInfo_t * pOutgoingPublishRecords,
+                                                 size_t outgoingPublishCount,
+                                                 MQTTPubAckInfo_t * pIncomingPublishRecords,
+                                                 size_t incomingPublishCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t outgoingUsed = 0U;
+    size_t incomingUsed = 0U;
+    size_t entry;
+    uint32_t handle;
+    uint8_t packetType;
+    MQTTPubAckInfo_t record;
+
+    if( ( pStore == NULL ) || ( pStore->pEntries == NULL ) ||
+        ( pOutgoingPublishRecords == NULL ) ||
+        ( ( pIncomingPublishRecords == NULL ) && ( incomingPublishCount > 0U ) ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pStore=%p, pOutgoingPublishRecords=%p, pIncomingPublishRecords=%p",
+                    ( const void * ) pStore,
+                    ( void * ) pOutgoingPublishRecords,
+                    ( void * ) pIncomingPublishRecords ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pOutgoingPublishRecords, 0, outgoingPublishCount * sizeof( MQTTPubAckInfo_t ) );
+
+        if( incomingPublishCount > 0U )
+        {
+            ( void ) memset( pIncomingPublishRecords, 0, incomingPublishCount * sizeof( MQTTPubAckInfo_t ) );
+        }
+    }
+
+    for( entry = 0U; ( status == MQTTSuccess ) && ( entry < pStore->entryCount ); entry++ )
+    {
+        handle = pStore->pEntries[ entry ].handle;
+        packetType = ( handle == 0U ) ? 0U :
+                     pStore->pMemory[ pStore->pEntries[ entry ].offset + MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ];
+        record.packetId = ( uint16_t ) ( handle & 0xFFFFU );
+        record.qos = MQTTQoS2;
+        record.publishState = MQTTStateNull;
+
+        if( handle == 0U )
+        {
+            /* MISRA Empty body */
+        }
+        else if( ( handle & RECORD_ACK_HANDLE_FLAG ) == 0U )
+        {
+            if( ( packetType & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+            {
+                record.qos = ( MQTTQoS_t ) ( ( packetType >> 1U ) & 0x03U );
+                record.publishState = ( record.qos == MQTTQoS1 ) ? MQTTPubAckPending : MQTTPubRecPending;
+            }
+        }
+        else if( packetType == MQTT_PACKET_TYPE_PUBREL )
+        {
+            record.publishState = MQTTPubCompPending;
+        }
+        else if( packetType == MQTT_PACKET_TYPE_PUBREC )
+        {
+            record.publishState = MQTTPubRelPending;
+        }
+        else
+        {
+            /* MISRA Empty body */
+        }
+
+        if( record.publishState == MQTTStateNull )
+        {
+            if( handle != 0U )
+            {
+                LogWarn( ( "Packet stored for handle %lu is not a PUBLISH, PUBREL or PUBREC.",
+                           ( unsigned long ) handle ) );
+            }
+        }
+        else if( ( record.packetId == 0U ) || ( record.qos == MQTTQoS0 ) )
+        {
+            LogWarn( ( "Packet stored for handle %lu has no packet ID.",
+                       ( unsigned long ) handle ) );
+        }
+        else if( record.publishState == MQTTPubRelPending )
+        {
+            if( incomingUsed < incomingPublishCount )
+            {
+                insertRecord( pStore, pIncomingPublishRecords, incomingUsed, &record, packetOrder( pStore, handle ), false );
+                incomingUsed++;
+            }
+            else
+            {
+                status = MQTTNoMemory;
+            }
+        }
+        else if( outgoingUsed < outgoingPublishCount )
+        {
+            insertRecord( pStore, pOutgoingPublishRecords, outgoingUsed, &record, packetOrder( pStore, handle ), true );
+            outgoingUsed++;
+        }
+        else
+        {
+            status = MQTTNoMemory;
+        }
+    }
+
+    if( status == MQTTNoMemory )
+    {
+        LogError( ( "The retransmit store holds more packets than there are state records." ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
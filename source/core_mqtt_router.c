@@ -0,0 +1,967 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_router.c
+ * @brief Implements the functions in core_mqtt_router.h.
+ */
+#include <assert.h>
+#include <string.h>
+#include "core_mqtt_router.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Length of the "$share/" prefix of a shared subscription.
+ */
+#define MQTT_ROUTER_SHARE_PREFIX_LENGTH    ( 7U )
+
+/**
+ * @brief A part of the trie left to walk by #MQTT_RouterDispatch.
+ */
+typedef struct MQTTRouterBranch
+{
+    uint16_t node; /**< @brief The node matching the levels before @p start. */
+    size_t start;  /**< @brief Start of the next level of the topic name, or past its end. */
+} MQTTRouterBranch_t;
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Find the end of a topic level.
+ *
+ * @param[in] pTopic The topic name or filter.
+ * @param[in] start Start of the level.
+ * @param[in] topicLength Length of the topic name or filter.
+ *
+ * @return The position of the '/' ending the level, or @p topicLength.
+ */
+static size_t levelEnd( const char * pTopic,
+                        size_t start,
+                        size_t topicLength );
+
+/**
+ * @brief Hash a topic level with 32-bit FNV-1a, together with its parent.
+ *
+ * @param[in] parent Index of the parent node.
+ * @param[in] pLevel The level.
+ * @param[in] levelLength Length of the level.
+ *
+ * @return The hash.
+ */
+static uint32_t hashLevel( uint16_t parent,
+                           const char * pLevel,
+                           size_t levelLength );
+
+/**
+ * @brief Get the level of a node.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] node Index of the node.
+ *
+ * @return The level, kept in the level buffer of the router.
+ */
+static char * nodeLevel( const MQTTRouter_t * pRouter,
+                         uint16_t node );
+
+/**
+ * @brief Find the literal child of a node.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] parent Index of the node.
+ * @param[in] pLevel The level of the child.
+ * @param[in] levelLength Length of the level.
+ *
+ * @return Index of the child, or 0 if there is none.
+ */
+static uint16_t findChild( const MQTTRouter_t * pRouter,
+                           uint16_t parent,
+                           const char * pLevel,
+                           size_t levelLength );
+
+/**
+ * @brief Add a child to a node.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] parent Index of the node.
+ * @param[in] pLevel The level of the child, which may be "+" or "#", of at
+ * most #MQTTRouter_t.levelLength bytes.
+ * @param[in] levelLength Length of the level.
+ *
+ * @return Index of the child, or 0 if there is no free node.
+ */
+static uint16_t addChild( MQTTRouter_t * pRouter,
+                          uint16_t parent,
+                          const char * pLevel,
+                          size_t levelLength );
+
+/**
+ * @brief Remove a literal child from the hash table of the levels.
+ *
+ * Entries after its bucket are shifted back so that no search ends early.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] child Index of the child.
+ */
+static void removeBucket( MQTTRouter_t * pRouter,
+                          uint16_t child );
+
+/**
+ * @brief Free a node which has no routes and no children, and then each of
+ * its parents left without routes and children.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] node Index of the node. Nothing is freed if it is the root or
+ * is still used.
+ */
+static void freeUnusedNodes( MQTTRouter_t * pRouter,
+                             uint16_t node );
+
+/**
+ * @brief Skip the "$share/<share name>/" prefix of a shared subscription.
+ *
+ * @param[in,out] ppTopicFilter The topic filter.
+ * @param[in,out] pTopicFilterLength Length of the topic filter.
+ *
+ * @return #MQTTBadParameter if the share name or the topic filter after it
+ * is missing or invalid; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t skipSharePrefix( const char ** ppTopicFilter,
+                                     size_t * pTopicFilterLength );
+
+/**
+ * @brief Check that the wildcards of a topic filter are whole levels, that
+ * '#' is only in the last level, and that no level is too long to be kept.
+ *
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] levelLength Longest level kept.
+ *
+ * @return `true` if the topic filter is valid, else `false`.
+ */
+static bool validateTopicFilter( const char * pTopicFilter,
+                                 size_t topicFilterLength,
+                                 size_t levelLength );
+
+/**
+ * @brief Find the node of the last level of a topic filter.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] pTopicFilter Valid topic filter.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] addMissing Whether to add the levels not in the trie.
+ *
+ * @return Index of the node, or 0 if a level is missing and could not be
+ * added, in which case the levels added are freed again.
+ */
+static uint16_t findFilterNode( MQTTRouter_t * pRouter,
+                                const char * pTopicFilter,
+                                size_t topicFilterLength,
+                                bool addMissing );
+
+/**
+ * @brief Call the handlers of the topic filters ending at a node.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] node Index of the node.
+ * @param[in] pContext The MQTT context passed to the handlers.
+ * @param[in] pDeserializedInfo The incoming PUBLISH.
+ *
+ * @return Number of handlers called.
+ */
+static size_t callRoutes( const MQTTRouter_t * pRouter,
+                          uint16_t node,
+                          MQTTContext_t * pContext,
+                          MQTTDeserializedInfo_t * pDeserializedInfo );
+
+/**
+ * @brief Add a branch for #MQTT_RouterDispatch to walk.
+ *
+ * @param[in,out] pBranches The pending branches.
+ * @param[in,out] pBranchCount Number of pending branches.
+ * @param[in] node The node matching the levels before @p start.
+ * @param[in] start Start of the next level of the topic name.
+ *
+ * @return #MQTTNoMemory if #MQTT_ROUTER_MAX_TOPIC_LEVELS branches are
+ * already pending; #MQTTSuccess otherwise.
+ */
+static MQTTStatus_t pushBranch( MQTTRouterBranch_t * pBranches,
+                                size_t * pBranchCount,
+                                uint16_t node,
+                                size_t start );
+
+/*-----------------------------------------------------------*/
+
+static size_t levelEnd( const char * pTopic,
+                        size_t start,
+                        size_t topicLength )
+{
+    size_t index = start;
+
+    while( ( index < topicLength ) && ( pTopic[ index ] != '/' ) )
+    {
+        index++;
+    }
+
+    return index;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t hashLevel( uint16_t parent,
+                           const char * pLevel,
+                           size_t levelLength )
+{
+    uint32_t hash = 2166136261U;
+    size_t index;
+
+    hash = ( hash ^ ( ( uint32_t ) parent & 0xFFU ) ) * 16777619U;
+    hash = ( hash ^ ( ( uint32_t ) parent >> 8U ) ) * 16777619U;
+
+    for( index = 0U; index < levelLength; index++ )
+    {
+        hash = ( hash ^ ( uint32_t ) ( uint8_t ) pLevel[ index ] ) * 16777619U;
+    }
+
+    return hash;
+}
+
+/*-----------------------------------------------------------*/
+
+static char * nodeLevel( const MQTTRouter_t * pRouter,
+                         uint16_t node )
+{
+    return &pRouter->pLevels[ ( size_t ) node * pRouter->levelLength ];
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t findChild( const MQTTRouter_t * pRouter,
+                           uint16_t parent,
+                           const char * pLevel,
+                           size_t levelLength )
+{
+    size_t mask = pRouter->bucketCount - 1U;
+    size_t bucket = ( size_t ) hashLevel( parent, pLevel, levelLength ) & mask;
+    uint16_t child = 0U;
+    const MQTTRouterNode_t * pNode;
+
+    /* There is always a free bucket, since there are more buckets than
+     * nodes. */
+    while( ( child == 0U ) && ( pRouter->pBuckets[ bucket ] != 0U ) )
+    {
+        pNode = &pRouter->pNodes[ pRouter->pBuckets[ bucket ] ];
+
+        if( ( pNode->parent == parent ) &&
+            ( ( size_t ) pNode->levelLength == levelLength ) &&
+            ( memcmp( nodeLevel( pRouter, pRouter->pBuckets[ bucket ] ), pLevel, levelLength ) == 0 ) )
+        {
+            child = pRouter->pBuckets[ bucket ];
+        }
+        else
+        {
+            bucket = ( bucket + 1U ) & mask;
+        }
+    }
+
+    return child;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t addChild( MQTTRouter_t * pRouter,
+                          uint16_t parent,
+                          const char * pLevel,
+                          size_t levelLength )
+{
+    size_t mask = pRouter->bucketCount - 1U;
+    size_t bucket;
+    uint16_t child = 0U;
+    MQTTRouterNode_t * pNode;
+
+    assert( levelLength <= pRouter->levelLength );
+
+    /* Nodes freed before are taken first. */
+    if( pRouter->freeNode != 0U )
+    {
+        child = pRouter->freeNode;
+        pRouter->freeNode = pRouter->pNodes[ child ].parent;
+    }
+    else if( pRouter->nodesUsed < pRouter->nodeCount )
+    {
+        child = ( uint16_t ) pRouter->nodesUsed;
+        pRouter->nodesUsed++;
+    }
+    else
+    {
+        /* No free node. */
+    }
+
+    if( child != 0U )
+    {
+        pNode = &pRouter->pNodes[ child ];
+        ( void ) memcpy( nodeLevel( pRouter, child ), pLevel, levelLength );
+        pNode->levelLength = ( uint16_t ) levelLength;
+        pNode->parent = parent;
+        pNode->plusChild = 0U;
+        pNode->hashChild = 0U;
+        pNode->childCount = 0U;
+        pNode->firstRoute = 0U;
+        pRouter->pNodes[ parent ].childCount++;
+
+        if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '+' ) )
+        {
+            pRouter->pNodes[ parent ].plusChild = child;
+        }
+        else if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '#' ) )
+        {
+            pRouter->pNodes[ parent ].hashChild = child;
+        }
+        else
+        {
+            bucket = ( size_t ) hashLevel( parent, pLevel, levelLength ) & mask;
+
+            while( pRouter->pBuckets[ bucket ] != 0U )
+            {
+                bucket = ( bucket + 1U ) & mask;
+            }
+
+            pRouter->pBuckets[ bucket ] = child;
+        }
+    }
+
+    return child;
+}
+
+/*-----------------------------------------------------------*/
+
+static void removeBucket( MQTTRouter_t * pRouter,
+                          uint16_t child )
+{
+    const size_t mask = pRouter->bucketCount - 1U;
+    const MQTTRouterNode_t * pNode = &pRouter->pNodes[ child ];
+    size_t hole = ( size_t ) hashLevel( pNode->parent, nodeLevel( pRouter, child ), pNode->levelLength ) & mask;
+    size_t next;
+    size_t home;
+    uint16_t entry;
+
+    while( pRouter->pBuckets[ hole ] != child )
+    {
+        hole = ( hole + 1U ) & mask;
+    }
+
+    pRouter->pBuckets[ hole ] = 0U;
+    next = ( hole + 1U ) & mask;
+
+    while( pRouter->pBuckets[ next ] != 0U )
+    {
+        entry = pRouter->pBuckets[ next ];
+        pNode = &pRouter->pNodes[ entry ];
+        home = ( size_t ) hashLevel( pNode->parent, nodeLevel( pRouter, entry ), pNode->levelLength ) & mask;
+
+        /* The entry can fill the hole only if the hole lies between its home
+         * bucket and its current bucket. */
+        if( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            pRouter->pBuckets[ hole ] = entry;
+            pRouter->pBuckets[ next ] = 0U;
+            hole = next;
+        }
+
+        next = ( next + 1U ) & mask;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void freeUnusedNodes( MQTTRouter_t * pRouter,
+                             uint16_t node )
+{
+    uint16_t current = node;
+    uint16_t parent;
+    MQTTRouterNode_t * pNode;
+
+    while( ( current != 0U ) &&
+           ( pRouter->pNodes[ current ].firstRoute == 0U ) &&
+           ( pRouter->pNodes[ current ].childCount == 0U ) )
+    {
+        pNode = &pRouter->pNodes[ current ];
+        parent = pNode->parent;
+
+        if( pRouter->pNodes[ parent ].plusChild == current )
+        {
+            pRouter->pNodes[ parent ].plusChild = 0U;
+        }
+        else if( pRouter->pNodes[ parent ].hashChild == current )
+        {
+            pRouter->pNodes[ parent ].hashChild = 0U;
+        }
+        else
+        {
+            removeBucket( pRouter, current );
+        }
+
+        pRouter->pNodes[ parent ].childCount--;
+
+        pNode->levelLength = 0U;
+        pNode->parent = pRouter->freeNode;
+        pRouter->freeNode = current;
+
+        current = parent;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t skipSharePrefix( const char ** ppTopicFilter,
+                                     size_t * pTopicFilterLength )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    const char * pTopicFilter = *ppTopicFilter;
+    size_t topicFilterLength = *pTopicFilterLength;
+    size_t shareNameEnd;
+    size_t index;
+
+    if( ( topicFilterLength > MQTT_ROUTER_SHARE_PREFIX_LENGTH ) &&
+        ( strncmp( pTopicFilter, "$share/", MQTT_ROUTER_SHARE_PREFIX_LENGTH ) == 0 ) )
+    {
+        shareNameEnd = levelEnd( pTopicFilter, MQTT_ROUTER_SHARE_PREFIX_LENGTH, topicFilterLength );
+
+        for( index = MQTT_ROUTER_SHARE_PREFIX_LENGTH; index < shareNameEnd; index++ )
+        {
+            if( ( pTopicFilter[ index ] == '+' ) || ( pTopicFilter[ index ] == '#' ) )
+            {
+                status = MQTTBadParameter;
+            }
+        }
+
+        if( ( shareNameEnd == MQTT_ROUTER_SHARE_PREFIX_LENGTH ) ||
+            ( shareNameEnd >= ( topicFilterLength - 1U ) ) )
+        {
+            status = MQTTBadParameter;
+        }
+
+        if( status == MQTTSuccess )
+        {
+            *ppTopicFilter = &pTopicFilter[ shareNameEnd + 1U ];
+            *pTopicFilterLength = topicFilterLength - shareNameEnd - 1U;
+        }
+        else
+        {
+            LogError( ( "Invalid shared subscription: %.*s",
+                        ( int ) topicFilterLength,
+                        pTopicFilter ) );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool validateTopicFilter( const char * pTopicFilter,
+                                 size_t topicFilterLength,
+                                 size_t levelLength )
+{
+    bool isValid = true;
+    size_t index;
+    size_t levelStart = 0U;
+
+    for( index = 0U; index < topicFilterLength; index++ )
+    {
+        if( ( index - levelStart ) >= levelLength )
+        {
+            /* The level is too long to be kept. */
+            isValid = isValid && ( pTopicFilter[ index ] == '/' );
+        }
+
+        if( pTopicFilter[ index ] == '/' )
+        {
+            levelStart = index + 1U;
+        }
+        else if( pTopicFilter[ index ] == '+' )
+        {
+            /* '+' must be the whole level. */
+            isValid = isValid &&
+                      ( index == levelStart ) &&
+                      ( ( ( index + 1U ) == topicFilterLength ) || ( pTopicFilter[ index + 1U ] == '/' ) );
+        }
+        else if( pTopicFilter[ index ] == '#' )
+        {
+            /* '#' must be the whole last level. */
+            isValid = isValid &&
+                      ( index == levelStart ) &&
+                      ( ( index + 1U ) == topicFilterLength );
+        }
+        else
+        {
+            /* MISRA else. */
+        }
+    }
+
+    return isValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint16_t findFilterNode( MQTTRouter_t * pRouter,
+                                const char * pTopicFilter,
+                                size_t topicFilterLength,
+                                bool addMissing )
+{
+    uint16_t node = 0U;
+    uint16_t child = 0U;
+    size_t start = 0U;
+    size_t end;
+    const char * pLevel;
+    size_t levelLength;
+
+    do
+    {
+        end = levelEnd( pTopicFilter, start, topicFilterLength );
+        pLevel = &pTopicFilter[ start ];
+        levelLength = end - start;
+
+        if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '+' ) )
+        {
+            child = pRouter->pNodes[ node ].plusChild;
+        }
+        else if( ( levelLength == 1U ) && ( pLevel[ 0 ] == '#' ) )
+        {
+            child = pRouter->pNodes[ node ].hashChild;
+        }
+        else
+        {
+            child = findChild( pRouter, node, pLevel, levelLength );
+        }
+
+        if( ( child == 0U ) && ( addMissing == true ) )
+        {
+            child = addChild( pRouter, node, pLevel, levelLength );
+
+            if( child == 0U )
+            {
+                freeUnusedNodes( pRouter, node );
+            }
+        }
+
+        node = child;
+        start = end + 1U;
+    } while( ( node != 0U ) && ( start <= topicFilterLength ) );
+
+    return node;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t callRoutes( const MQTTRouter_t * pRouter,
+                          uint16_t node,
+                          MQTTContext_t * pContext,
+                          MQTTDeserializedInfo_t * pDeserializedInfo )
+{
+    size_t callCount = 0U;
+    uint16_t route = pRouter->pNodes[ node ].firstRoute;
+    const MQTTRoute_t * pRoute;
+
+    while( route != 0U )
+    {
+        pRoute = &pRouter->pRoutes[ route - 1U ];
+        pRoute->callback( pContext, pDeserializedInfo, pRoute->pUserData );
+        callCount++;
+        route = pRoute->nextRoute;
+    }
+
+    return callCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t pushBranch( MQTTRouterBranch_t * pBranches,
+                                size_t * pBranchCount,
+                                uint16_t node,
+                                size_t start )
+{
+    MQTTStatus_t status = MQTTSuccess;
+
+    if( *pBranchCount > ( size_t ) MQTT_ROUTER_MAX_TOPIC_LEVELS )
+    {
+        LogError( ( "Topic name has too many levels to route: MQTT_ROUTER_MAX_TOPIC_LEVELS=%u.",
+                    ( unsigned int ) MQTT_ROUTER_MAX_TOPIC_LEVELS ) );
+        status = MQTTNoMemory;
+    }
+    else
+    {
+        pBranches[ *pBranchCount ].node = node;
+        pBranches[ *pBranchCount ].start = start;
+        ( *pBranchCount )++;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RouterInit( MQTTRouter_t * pRouter,
+                              MQTTRouterNode_t * pNodes,
+                              size_t nodeCount,
+                              char * pLevels,
+                              size_t levelLength,
+                              uint16_t * pBuckets,
+                              size_t bucketCount,
+                              MQTTRoute_t * pRoutes,
+                              size_t routeCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    size_t index;
+
+    if( ( pRouter == NULL ) || ( pNodes == NULL ) || ( pLevels == NULL ) ||
+        ( pBuckets == NULL ) || ( pRoutes == NULL ) )
+    {
+        LogError( ( "Arguments cannot be NULL: pRouter=%p, pNodes=%p, pLevels=%p, pBuckets=%p, pRoutes=%p",
+                    ( void * ) pRouter,
+                    ( void * ) pNodes,
+                    ( void * ) pLevels,
+                    ( void * ) pBuckets,
+                    ( void * ) pRoutes ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( nodeCount < 2U ) || ( nodeCount > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Number of nodes must be between 2 and 65535: nodeCount=%lu",
+                    ( unsigned long ) nodeCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( levelLength == 0U ) || ( levelLength > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Level length must be between 1 and 65535: levelLength=%lu",
+                    ( unsigned long ) levelLength ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( bucketCount <= nodeCount ) || ( ( bucketCount & ( bucketCount - 1U ) ) != 0U ) )
+    {
+        LogError( ( "Number of buckets must be a power of 2 larger than the number of nodes: "
+                    "bucketCount=%lu, nodeCount=%lu",
+                    ( unsigned long ) bucketCount,
+                    ( unsigned long ) nodeCount ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( routeCount == 0U ) || ( routeCount > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Number of routes must be between 1 and 65535: routeCount=%lu",
+                    ( unsigned long ) routeCount ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        ( void ) memset( pBuckets, 0, bucketCount * sizeof( uint16_t ) );
+        ( void ) memset( &pNodes[ 0 ], 0, sizeof( MQTTRouterNode_t ) );
+
+        /* All routes are free. */
+        for( index = 0U; index < routeCount; index++ )
+        {
+            pRoutes[ index ].callback = NULL;
+            pRoutes[ index ].pUserData = NULL;
+            pRoutes[ index ].nextRoute = ( uint16_t ) ( ( index + 2U ) % ( routeCount + 1U ) );
+        }
+
+        pRouter->pNodes = pNodes;
+        pRouter->nodeCount = nodeCount;
+        pRouter->nodesUsed = 1U;
+        pRouter->freeNode = 0U;
+        pRouter->pLevels = pLevels;
+        pRouter->levelLength = levelLength;
+        pRouter->pBuckets = pBuckets;
+        pRouter->bucketCount = bucketCount;
+        pRouter->pRoutes = pRoutes;
+        pRouter->routeCount = routeCount;
+        pRouter->freeRoute = 1U;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RouterAdd( MQTTRouter_t * pRouter,
+                             const char * pTopicFilter,
+                             size_t topicFilterLength,
+                             MQTTRouteCallback_t callback,
+                             void * pUserData )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    const char * pFilter = pTopicFilter;
+    size_t filterLength = topicFilterLength;
+    uint16_t node = 0U;
+    uint16_t route;
+    MQTTRoute_t * pRoute;
+
+    if( ( pRouter == NULL ) || ( pRouter->pNodes == NULL ) || ( callback == NULL ) )
+    {
+        LogError( ( "Router must be initialized and the handler cannot be NULL: pRouter=%p",
+                    ( void * ) pRouter ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pTopicFilter == NULL ) || ( topicFilterLength == 0U ) ||
+             ( topicFilterLength > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Topic filter must be non-NULL and its length between 1 and 65535: "
+                    "pTopicFilter=%p, topicFilterLength=%lu",
+                    ( const void * ) pTopicFilter,
+                    ( unsigned long ) topicFilterLength ) );
+        status = MQTTBadParameter;
+    }
+    else if( pRouter->freeRoute == 0U )
+    {
+        LogError( ( "No free route to add topic filter %.*s.",
+                    ( int ) topicFilterLength,
+                    pTopicFilter ) );
+        status = MQTTNoMemory;
+    }
+    else
+    {
+        status = skipSharePrefix( &pFilter, &filterLength );
+    }
+
+    if( ( status == MQTTSuccess ) &&
+        ( validateTopicFilter( pFilter, filterLength, pRouter->levelLength ) == false ) )
+    {
+        LogError( ( "Invalid topic filter, or level longer than %lu bytes: %.*s",
+                    ( unsigned long ) pRouter->levelLength,
+                    ( int ) topicFilterLength,
+                    pTopicFilter ) );
+        status = MQTTBadParameter;
+    }
+
+    if( status == MQTTSuccess )
+    {
+        node = findFilterNode( pRouter, pFilter, filterLength, true );
+
+        if( node == 0U )
+        {
+            LogError( ( "No free node to add topic filter %.*s.",
+                        ( int ) topicFilterLength,
+                        pTopicFilter ) );
+            status = MQTTNoMemory;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        route = pRouter->freeRoute;
+        pRoute = &pRouter->pRoutes[ route - 1U ];
+        pRouter->freeRoute = pRoute->nextRoute;
+
+        pRoute->callback = callback;
+        pRoute->pUserData = pUserData;
+        pRoute->nextRoute = pRouter->pNodes[ node ].firstRoute;
+        pRouter->pNodes[ node ].firstRoute = route;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RouterRemove( MQTTRouter_t * pRouter,
+                                const char * pTopicFilter,
+                                size_t topicFilterLength,
+                                MQTTRouteCallback_t callback,
+                                const void * pUserData )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    const char * pFilter = pTopicFilter;
+    size_t filterLength = topicFilterLength;
+    uint16_t node = 0U;
+    uint16_t route;
+    uint16_t * pLink;
+    MQTTRoute_t * pRoute = NULL;
+
+    if( ( pRouter == NULL ) || ( pRouter->pNodes == NULL ) || ( callback == NULL ) )
+    {
+        LogError( ( "Router must be initialized and the handler cannot be NULL: pRouter=%p",
+                    ( void * ) pRouter ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pTopicFilter == NULL ) || ( topicFilterLength == 0U ) ||
+             ( topicFilterLength > ( size_t ) UINT16_MAX ) )
+    {
+        LogError( ( "Topic filter must be non-NULL and its length between 1 and 65535: "
+                    "pTopicFilter=%p, topicFilterLength=%lu",
+                    ( const void * ) pTopicFilter,
+                    ( unsigned long ) topicFilterLength ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        status = skipSharePrefix( &pFilter, &filterLength );
+    }
+
+    if( ( status == MQTTSuccess ) &&
+        ( validateTopicFilter( pFilter, filterLength, pRouter->levelLength ) == true ) )
+    {
+        node = findFilterNode( pRouter, pFilter, filterLength, false );
+    }
+
+    if( ( status == MQTTSuccess ) && ( node != 0U ) )
+    {
+        pLink = &pRouter->pNodes[ node ].firstRoute;
+
+        while( ( pRoute == NULL ) && ( *pLink != 0U ) )
+        {
+            if( ( pRouter->pRoutes[ *pLink - 1U ].callback == callback ) &&
+                ( pRouter->pRoutes[ *pLink - 1U ].pUserData == pUserData ) )
+            {
+                pRoute = &pRouter->pRoutes[ *pLink - 1U ];
+            }
+            else
+            {
+                pLink = &pRouter->pRoutes[ *pLink - 1U ].nextRoute;
+            }
+        }
+    }
+
+    if( ( status == MQTTSuccess ) && ( pRoute != NULL ) )
+    {
+        /* Unlink the route and free it. */
+        route = *pLink;
+        *pLink = pRoute->nextRoute;
+        pRoute->callback = NULL;
+        pRoute->pUserData = NULL;
+        pRoute->nextRoute = pRouter->freeRoute;
+        pRouter->freeRoute = route;
+
+        freeUnusedNodes( pRouter, node );
+    }
+    else if( status == MQTTSuccess )
+    {
+        LogError( ( "Handler is not registered for topic filter %.*s.",
+                    ( int ) topicFilterLength,
+                    pTopicFilter ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Invalid parameters were logged. */
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_RouterDispatch( const MQTTRouter_t * pRouter,
+                                  MQTTContext_t * pContext,
+                                  MQTTDeserializedInfo_t * pDeserializedInfo,
+                                  size_t * pMatchCount )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTRouterBranch_t branches[ MQTT_ROUTER_MAX_TOPIC_LEVELS + 1U ];
+    size_t branchCount = 0U;
+    size_t matchCount = 0U;
+    MQTTRouterBranch_t branch;
+    const MQTTRouterNode_t * pNode;
+    const char * pTopicName = NULL;
+    size_t topicNameLength = 0U;
+    bool matchWildcards;
+    size_t end;
+    uint16_t child;
+
+    if( ( pRouter == NULL ) || ( pRouter->pNodes == NULL ) ||
+        ( pDeserializedInfo == NULL ) || ( pDeserializedInfo->pPublishInfo == NULL ) )
+    {
+        LogError( ( "Router must be initialized and the PUBLISH cannot be NULL: "
+                    "pRouter=%p, pDeserializedInfo=%p",
+                    ( const void * ) pRouter,
+                    ( void * ) pDeserializedInfo ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pDeserializedInfo->pPublishInfo->pTopicName == NULL ) ||
+             ( pDeserializedInfo->pPublishInfo->topicNameLength == 0U ) )
+    {
+        LogError( ( "PUBLISH has no topic name to route." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        pTopicName = pDeserializedInfo->pPublishInfo->pTopicName;
+        topicNameLength = pDeserializedInfo->pPublishInfo->topicNameLength;
+        status = pushBranch( branches, &branchCount, 0U, 0U );
+    }
+
+    /* Walk the trie depth first. At each level, the topic name can continue
+     * along the literal child and the '+' child of a node, and ends at its
+     * '#' child. */
+    while( ( status == MQTTSuccess ) && ( branchCount > 0U ) )
+    {
+        branchCount--;
+        branch = branches[ branchCount ];
+        pNode = &pRouter->pNodes[ branch.node ];
+
+        /* Topic names starting with '$' are not matched by topic filters
+         * starting with a wildcard. */
+        matchWildcards = ( branch.node != 0U ) || ( pTopicName[ 0 ] != '$' );
+
+        if( branch.start > topicNameLength )
+        {
+            /* All levels matched. "sport/#" also matches "sport". */
+            matchCount += callRoutes( pRouter, branch.node, pContext, pDeserializedInfo );
+
+            if( pNode->hashChild != 0U )
+            {
+                matchCount += callRoutes( pRouter, pNode->hashChild, pContext, pDeserializedInfo );
+            }
+        }
+        else
+        {
+            if( ( matchWildcards == true ) && ( pNode->hashChild != 0U ) )
+            {
+                matchCount += callRoutes( pRouter, pNode->hashChild, pContext, pDeserializedInfo );
+            }
+
+            end = levelEnd( pTopicName, branch.start, topicNameLength );
+
+            if( ( matchWildcards == true ) && ( pNode->plusChild != 0U ) )
+            {
+                status = pushBranch( branches, &branchCount, pNode->plusChild, end + 1U );
+            }
+
+            child = findChild( pRouter, branch.node, &pTopicName[ branch.start ], end - branch.start );
+
+            if( ( status == MQTTSuccess ) && ( child != 0U ) )
+            {
+                status = pushBranch( branches, &branchCount, child, end + 1U );
+            }
+        }
+    }
+
+    if( pMatchCount != NULL )
+    {
+        *pMatchCount = matchCount;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
@@ -336,6 +336,8 @@ static MQTTStatus_t deserializeSubUnsubAck( const MQTTPacketInfo_t * incomingPac
  * @param[out] pPublishInfo Pointer to #MQTTPublishInfo_t where output is
  * written.
  * @param[out] pPropBuffer Pointer to the property buffer.
+ * @param[out] pPropIndex Index of the properties, or NULL.
+ * @param[out] pProperties Decoded properties, or NULL.
  * @param[in] topicAliasMax Maximum allowed Topic Alias.
  *
  * @return #MQTTSuccess if PUBLISH is valid;
@@ -345,6 +347,8 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
                                         uint16_t * pPacketId,
                                         MQTTPublishInfo_t * pPublishInfo,
                                         MQTTPropBuilder_t * pPropBuffer,
+                                        MQTTPropIndex_t * pPropIndex,
+                                        MQTTPublishProperties_t * pProperties,
                                         uint16_t topicAliasMax );
 
 /**
@@ -465,6 +469,8 @@ static MQTTStatus_t logAckResponse( MQTTSuccessFailReasonCode_t reasonCode,
  * @param[out] pPublishInfo Pointer to #MQTTPublishInfo_t where output is
  * written.
  * @param[out] pPropBuffer Pointer to the property buffer.
+ * @param[out] pPropIndex Index of the properties, or NULL.
+ * @param[out] pProperties Decoded properties, or NULL.
  * @param[in] pIndex Pointer to the start of the properties.
  * @param[in] topicAliasMax Maximum allowed Topic Alias.
  * @param[in] remainingLength Remaining length of the incoming packet.
@@ -474,6 +480,8 @@ static MQTTStatus_t logAckResponse( MQTTSuccessFailReasonCode_t reasonCode,
  */
 static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishInfo,
                                                   MQTTPropBuilder_t * pPropBuffer,
+                                                  MQTTPropIndex_t * pPropIndex,
+                                                  MQTTPublishProperties_t * pProperties,
                                                   uint8_t * pIndex,
                                                   uint16_t topicAliasMax,
                                                   uint32_t remainingLength );
@@ -2037,6 +2045,8 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
                                         uint16_t * pPacketId,
                                         MQTTPublishInfo_t * pPublishInfo,
                                         MQTTPropBuilder_t * pPropBuffer,
+                                        MQTTPropIndex_t * pPropIndex,
+                                        MQTTPublishProperties_t * pProperties,
                                         uint16_t topicAliasMax )
 {
     MQTTStatus_t status = MQTTSuccess;
@@ -2082,6 +2092,15 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
                                               2U + ( uint32_t ) pPublishInfo->topicNameLength + 1U );
     }
 
+    #if ( MQTT_VALIDATE_UTF8 != 0 )
+        if( ( status == MQTTSuccess ) &&
+            ( isValidUtf8String( ( const char * ) pIndex, pPublishInfo->topicNameLength ) == false ) )
+        {
+            LogError( ( "Protocol Error: Topic name is not well-formed UTF-8." ) );
+            status = MQTTBadResponse;
+        }
+    #endif
+
     if( status == MQTTSuccess )
     {
         /* Parse the topic. */
@@ -2118,6 +2137,8 @@ static MQTTStatus_t deserializePublish( const MQTTPacketInfo_t * pIncomingPacket
     {
         status = deserializePublishProperties( pPublishInfo,
                                                pPropBuffer,
+                                               pPropIndex,
+                                               pProperties,
                                                pIndex,
                                                topicAliasMax,
                                                pIncomingPacket->remainingLength );
@@ -2328,7 +2349,7 @@ static MQTTStatus_t deserializeConnackProperty( uint8_t propertyId,
             break;
 
         case MQTT_ASSIGNED_CLIENT_ID:
-            status = decodeUtf8( &data, &dataLength, pPropertyLength, &pSeen->clientId, ppVariableHeader );
+            status = decodeUtf8String( &data, &dataLength, pPropertyLength, &pSeen->clientId, ppVariableHeader );
 
             if( status == MQTTSuccess )
             {
@@ -2351,7 +2372,7 @@ static MQTTStatus_t deserializeConnackProperty( uint8_t propertyId,
             break;
 
         case MQTT_REASON_STRING_ID:
-            status = decodeUtf8( &data, &dataLength, pPropertyLength, &pSeen->reasonString, ppVariableHeader );
+            status = decodeUtf8String( &data, &dataLength, pPropertyLength, &pSeen->reasonString, ppVariableHeader );
 
             if( status == MQTTSuccess )
             {
@@ -2429,7 +2450,7 @@ static MQTTStatus_t deserializeConnackProperty( uint8_t propertyId,
             break;
 
         case MQTT_RESPONSE_INFO_ID:
-            status = decodeUtf8( &data, &dataLength, pPropertyLength, &pSeen->responseInfo, ppVariableHeader );
+            status = decodeUtf8String( &data, &dataLength, pPropertyLength, &pSeen->responseInfo, ppVariableHeader );
 
             if( ( status == MQTTSuccess ) && ( pConnackProperties->requestResponseInfo == false ) )
             {
@@ -2446,7 +2467,7 @@ static MQTTStatus_t deserializeConnackProperty( uint8_t propertyId,
             break;
 
         case MQTT_SERVER_REF_ID:
-            status = decodeUtf8( &data, &dataLength, pPropertyLength, &pSeen->serverRef, ppVariableHeader );
+            status = decodeUtf8String( &data, &dataLength, pPropertyLength, &pSeen->serverRef, ppVariableHeader );
 
             if( status == MQTTSuccess )
             {
@@ -2457,7 +2478,7 @@ static MQTTStatus_t deserializeConnackProperty( uint8_t propertyId,
             break;
 
         case MQTT_AUTH_METHOD_ID:
-            status = decodeUtf8( &data, &dataLength, pPropertyLength, &pSeen->authMethod, ppVariableHeader );
+            status = decodeUtf8String( &data, &dataLength, pPropertyLength, &pSeen->authMethod, ppVariableHeader );
 
             if( status == MQTTSuccess )
             {
@@ -2505,6 +2526,7 @@ static MQTTStatus_t deserializeConnackProperties( MQTTConnectionProperties_t * p
         pPropBuffer->bufferLength = propertyLength;
         pPropBuffer->currentIndex = propertyLength;
         pPropBuffer->fieldSet = 0U;
+        pPropBuffer->seal.packetType = 0U;
     }
 
     while( ( propertyLength > 0U ) && ( status == MQTTSuccess ) )
@@ -2658,8 +2680,8 @@ static MQTTStatus_t deserializeSubUnsubAckProperties( MQTTPropBuilder_t * pPropB
         switch( propertyId )
         {
             case MQTT_REASON_STRING_ID:
-                status = decodeUtf8( &pReasonString, &reasonStringLength, &propertyLength,
-                                     &reasonString, &pLocalIndex );
+                status = decodeUtf8String( &pReasonString, &reasonStringLength, &propertyLength,
+                                           &reasonString, &pLocalIndex );
 
                 if( status == MQTTSuccess )
                 {
@@ -2795,6 +2817,8 @@ static void serializeConnectPacket( const MQTTConnectInfo_t * pConnectInfo,
 
 static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishInfo,
                                                   MQTTPropBuilder_t * pPropBuffer,
+                                                  MQTTPropIndex_t * pPropIndex,
+                                                  MQTTPublishProperties_t * pProperties,
                                                   uint8_t * pIndex,
                                                   uint16_t topicAliasMax,
                                                   uint32_t remainingLength )
@@ -2815,6 +2839,15 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
     assert( !CHECK_SIZE_T_OVERFLOWS_16BIT( pPublishInfo->topicNameLength ) );
     assert( !CHECK_U32T_OVERFLOWS_SIZE_T( remainingLength ) );
 
+    pPublishInfo->topicAlias = 0U;
+    pPublishInfo->subscriptionId = 0U;
+    pPublishInfo->subscriptionIdCount = 0U;
+
+    if( pProperties != NULL )
+    {
+        ( void ) memset( pProperties, 0, sizeof( MQTTPublishProperties_t ) );
+    }
+
     /* Decode Property Length. */
     remainingLengthForProperties = remainingLength;
 
@@ -2881,11 +2914,30 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
         pPropBuffer->pBuffer = pLocalIndex;
         pPropBuffer->bufferLength = propertyLength;
         pPropBuffer->currentIndex = propertyLength;
+        pPropBuffer->seal.packetType = 0U;
+    }
+
+    if( pPropIndex != NULL )
+    {
+        pPropIndex->pBuffer = pLocalIndex;
+        pPropIndex->length = propertyLength;
+        ( void ) memset( pPropIndex->offsets, 0, sizeof( pPropIndex->offsets ) );
     }
 
     while( ( propertyLength > 0U ) && ( status == MQTTSuccess ) )
     {
         uint8_t propertyId = *pLocalIndex;
+
+        /* Record where the first property of each identifier starts. */
+        if( ( pPropIndex != NULL ) &&
+            ( propertyId < MQTT_PROPERTY_INDEX_LENGTH ) &&
+            ( pPropIndex->offsets[ propertyId ] == 0U ) )
+        {
+            /* More details at: https://github.com/FreeRTOS/coreMQTT/blob/main/MISRA.md#rule-182 */
+            /* coverity[misra_c_2012_rule_18_2_violation] */
+            pPropIndex->offsets[ propertyId ] = ( uint32_t ) ( pLocalIndex - pPropIndex->pBuffer ) + 1U;
+        }
+
         pLocalIndex = &pLocalIndex[ 1 ];
         propertyLength -= 1U;
 
@@ -2904,6 +2956,15 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                            status = MQTTBadResponse;
                            LogError( ( "Payload Format Indicator is not 0x00. " ) );
                        }
+                       else if( pProperties != NULL )
+                       {
+                           pProperties->payloadFormatPresent = true;
+                           pProperties->payloadFormat = property;
+                       }
+                       else
+                       {
+                           /* The property is not kept. */
+                       }
                    }
                }
                break;
@@ -2926,7 +2987,13 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                {
                    const char * pProperty;
                    size_t length;
-                   status = decodeUtf8( &pProperty, &length, &propertyLength, &responseTopic, &pLocalIndex );
+                   status = decodeUtf8String( &pProperty, &length, &propertyLength, &responseTopic, &pLocalIndex );
+
+                   if( ( status == MQTTSuccess ) && ( pProperties != NULL ) )
+                   {
+                       pProperties->pResponseTopic = pProperty;
+                       pProperties->responseTopicLength = length;
+                   }
                }
                break;
 
@@ -2935,6 +3002,12 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                    const char * pProperty;
                    size_t length;
                    status = decodeUtf8( &pProperty, &length, &propertyLength, &correlationData, &pLocalIndex );
+
+                   if( ( status == MQTTSuccess ) && ( pProperties != NULL ) )
+                   {
+                       pProperties->pCorrelationData = pProperty;
+                       pProperties->correlationDataLength = length;
+                   }
                }
                break;
 
@@ -2942,6 +3015,12 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                {
                    uint32_t property;
                    status = decodeUint32t( &property, &propertyLength, &messageExpiryInterval, &pLocalIndex );
+
+                   if( ( status == MQTTSuccess ) && ( pProperties != NULL ) )
+                   {
+                       pProperties->messageExpiryPresent = true;
+                       pProperties->messageExpiryInterval = property;
+                   }
                }
                break;
 
@@ -2949,7 +3028,13 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                {
                    const char * pProperty;
                    size_t length;
-                   status = decodeUtf8( &pProperty, &length, &propertyLength, &contentType, &pLocalIndex );
+                   status = decodeUtf8String( &pProperty, &length, &propertyLength, &contentType, &pLocalIndex );
+
+                   if( ( status == MQTTSuccess ) && ( pProperties != NULL ) )
+                   {
+                       pProperties->pContentType = pProperty;
+                       pProperties->contentTypeLength = length;
+                   }
                }
                break;
 
@@ -2960,6 +3045,13 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                 {
                     pLocalIndex = &pLocalIndex[ variableLengthEncodedSize( subscriptionId ) ];
                     propertyLength -= variableLengthEncodedSize( subscriptionId );
+
+                    if( pPublishInfo->subscriptionIdCount == 0U )
+                    {
+                        pPublishInfo->subscriptionId = subscriptionId;
+                    }
+
+                    pPublishInfo->subscriptionIdCount++;
                 }
 
                 break;
@@ -2976,6 +3068,11 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
                                             &propertyValueLen,
                                             &propertyLength,
                                             &pLocalIndex );
+
+                   if( ( status == MQTTSuccess ) && ( pProperties != NULL ) )
+                   {
+                       pProperties->userPropertyCount++;
+                   }
                }
                break;
 
@@ -2992,6 +3089,10 @@ static MQTTStatus_t deserializePublishProperties( MQTTPublishInfo_t * pPublishIn
             status = MQTTBadResponse;
             LogError( ( "Topic Alias greater than Topic Alias Max. " ) );
         }
+        else
+        {
+            pPublishInfo->topicAlias = topicAliasVal;
+        }
     }
 
     return status;
@@ -3337,7 +3438,7 @@ static MQTTStatus_t decodePubAckProperties( MQTTPropBuilder_t * pPropBuffer,
                {
                    const char * pProperty;
                    size_t length;
-                   status = decodeUtf8( &pProperty, &length, &propertyLength, &reasonString, &pLocalIndex );
+                   status = decodeUtf8String( &pProperty, &length, &propertyLength, &reasonString, &pLocalIndex );
                    break;
                }
 
@@ -4613,6 +4714,27 @@ MQTTStatus_t MQTT_DeserializePublish( const MQTTPacketInfo_t * pIncomingPacket,
                                       MQTTPropBuilder_t * propBuffer,
                                       uint32_t maxPacketSize,
                                       uint16_t topicAliasMax )
+{
+    return MQTT_DeserializePublishWithProperties( pIncomingPacket,
+                                                  pPacketId,
+                                                  pPublishInfo,
+                                                  propBuffer,
+                                                  NULL,
+                                                  NULL,
+                                                  maxPacketSize,
+                                                  topicAliasMax );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTT_DeserializePublishWithProperties( const MQTTPacketInfo_t * pIncomingPacket,
+                                                    uint16_t * pPacketId,
+                                                    MQTTPublishInfo_t * pPublishInfo,
+                                                    MQTTPropBuilder_t * propBuffer,
+                                                    MQTTPropIndex_t * pPropIndex,
+                                                    MQTTPublishProperties_t * pProperties,
+                                                    uint32_t maxPacketSize,
+                                                    uint16_t topicAliasMax )
 {
     MQTTStatus_t status = MQTTSuccess;
 
@@ -4651,7 +4773,7 @@ MQTTStatus_t MQTT_DeserializePublish( const MQTTPacketInfo_t * pIncomingPacket,
     }
     else
     {
-        status = deserializePublish( pIncomingPacket, pPacketId, pPublishInfo, propBuffer, topicAliasMax );
+        status = deserializePublish( pIncomingPacket, pPacketId, pPublishInfo, propBuffer, pPropIndex, pProperties, topicAliasMax );
     }
 
     return status;
@@ -4906,6 +5028,96 @@ MQTTStatus_t MQTT_GetIncomingPacketTypeAndLength( TransportRecv_t readFunc,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t MQTT_GetIncomingPacketTypeAndLengthBuffered( TransportRecv_t readFunc,
+                                                          NetworkContext_t * pNetworkContext,
+                                                          uint8_t * pStagingBuffer,
+                                                          size_t stagingBufferSize,
+                                                          size_t * pStagedBytes,
+                                                          MQTTPacketInfo_t * pIncomingPacket )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    int32_t bytesReceived = 0;
+    bool readMore = true;
+
+    if( readFunc == NULL )
+    {
+        LogError( ( "Invalid parameter: readFunc is NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( pIncomingPacket == NULL )
+    {
+        LogError( ( "Invalid parameter: pIncomingPacket is NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else if( ( pStagingBuffer == NULL ) || ( pStagedBytes == NULL ) )
+    {
+        LogError( ( "Invalid parameter: pStagingBuffer=%p, pStagedBytes=%p.",
+                    ( void * ) pStagingBuffer,
+                    ( void * ) pStagedBytes ) );
+        status = MQTTBadParameter;
+    }
+    else if( stagingBufferSize < MQTT_FIXED_HEADER_MAX_SIZE )
+    {
+        LogError( ( "Staging buffer must hold at least %lu bytes. stagingBufferSize=%lu.",
+                    ( unsigned long ) MQTT_FIXED_HEADER_MAX_SIZE,
+                    ( unsigned long ) stagingBufferSize ) );
+        status = MQTTBadParameter;
+    }
+    else if( *pStagedBytes > stagingBufferSize )
+    {
+        LogError( ( "Staged bytes cannot exceed the staging buffer size. stagedBytes=%lu.",
+                    ( unsigned long ) *pStagedBytes ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* Parse whatever is left over from a previous call first. */
+        status = MQTT_ProcessIncomingPacketTypeAndLength( pStagingBuffer,
+                                                          pStagedBytes,
+                                                          pIncomingPacket );
+    }
+
+    while( ( readMore == true ) &&
+           ( ( status == MQTTNoDataAvailable ) || ( status == MQTTNeedMoreBytes ) ) )
+    {
+        /* The fixed header is incomplete, and since it is never longer than
+         * the staging buffer, there is room to read more. */
+        assert( *pStagedBytes < stagingBufferSize );
+
+        bytesReceived = readFunc( pNetworkContext,
+                                  &( pStagingBuffer[ *pStagedBytes ] ),
+                                  stagingBufferSize - *pStagedBytes );
+
+        if( bytesReceived < 0 )
+        {
+            LogError( ( "Failed to read the packet header from the transport: "
+                        "transportStatus=%ld.",
+                        ( long int ) bytesReceived ) );
+            status = MQTTRecvFailed;
+        }
+        else if( bytesReceived == 0 )
+        {
+            /* Keep any partial header for the next call. */
+            readMore = false;
+        }
+        else
+        {
+            /* It is a bug in the application's transport receive
+             * implementation if more bytes than requested are received. */
+            assert( ( size_t ) bytesReceived <= ( stagingBufferSize - *pStagedBytes ) );
+
+            *pStagedBytes += ( size_t ) bytesReceived;
+            status = MQTT_ProcessIncomingPacketTypeAndLength( pStagingBuffer,
+                                                              pStagedBytes,
+                                                              pIncomingPacket );
+        }
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_UpdateDuplicatePublishFlag( uint8_t * pHeader,
                                               bool set )
 {
@@ -5056,6 +5268,67 @@ MQTTStatus_t MQTTPropertyBuilder_Init( MQTTPropBuilder_t * pPropertyBuilder,
         pPropertyBuilder->currentIndex = 0;
         pPropertyBuilder->bufferLength = length;
         pPropertyBuilder->fieldSet = 0; /* 0 means no field is set. */
+        ( void ) memset( &pPropertyBuilder->seal, 0x00, sizeof( pPropertyBuilder->seal ) );
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MQTTPropertyBuilder_Seal( MQTTPropBuilder_t * pPropertyBuilder,
+                                       uint8_t packetType )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    uint16_t topicAlias = 0U;
+
+    if( ( pPropertyBuilder == NULL ) || ( pPropertyBuilder->pBuffer == NULL ) )
+    {
+        LogError( ( "Invalid arguments passed to MQTTPropertyBuilder_Seal. "
+                    "pPropertyBuilder and its buffer must be non-NULL." ) );
+        status = MQTTBadParameter;
+    }
+    else
+    {
+        /* A builder failing validation is left unsealed. */
+        pPropertyBuilder->seal.packetType = 0U;
+
+        /* The checks depending on the connection are made when sending.
+         * Here, any Topic Alias is allowed and Subscription Identifiers are
+         * assumed to be available. */
+        if( packetType == MQTT_PACKET_TYPE_PUBLISH )
+        {
+            status = MQTT_ValidatePublishProperties( UINT16_MAX, pPropertyBuilder, &topicAlias );
+        }
+        else if( packetType == MQTT_PACKET_TYPE_SUBSCRIBE )
+        {
+            status = MQTT_ValidateSubscribeProperties( true, pPropertyBuilder );
+        }
+        else if( packetType == MQTT_PACKET_TYPE_UNSUBSCRIBE )
+        {
+            status = MQTT_ValidateUnsubscribeProperties( pPropertyBuilder );
+        }
+        else if( ( packetType == MQTT_PACKET_TYPE_PUBACK ) ||
+                 ( packetType == MQTT_PACKET_TYPE_PUBREC ) ||
+                 ( packetType == MQTT_PACKET_TYPE_PUBREL ) ||
+                 ( packetType == MQTT_PACKET_TYPE_PUBCOMP ) )
+        {
+            status = MQTT_ValidatePublishAckProperties( pPropertyBuilder );
+        }
+        else
+        {
+            LogError( ( "Properties cannot be sealed for packet type 0x%02x.",
+                        ( unsigned int ) packetType ) );
+            status = MQTTBadParameter;
+        }
+    }
+
+    if( status == MQTTSuccess )
+    {
+        pPropertyBuilder->seal.packetType = packetType;
+        pPropertyBuilder->seal.length = pPropertyBuilder->currentIndex;
+        pPropertyBuilder->seal.fieldSet = pPropertyBuilder->fieldSet;
+        pPropertyBuilder->seal.topicAlias = topicAlias;
     }
 
     return status;
@@ -6083,7 +6356,7 @@ static MQTTStatus_t validateIncomingDisconnectProperties( uint8_t * pIndex,
         switch( propertyId )
         {
             case MQTT_REASON_STRING_ID:
-                status = decodeUtf8( &pReasonString, &reasonStringLength, &propertyLength, &reasonString, &pLocalIndex );
+                status = decodeUtf8String( &pReasonString, &reasonStringLength, &propertyLength, &reasonString, &pLocalIndex );
                 break;
 
             case MQTT_USER_PROPERTY_ID:
@@ -6095,7 +6368,7 @@ static MQTTStatus_t validateIncomingDisconnectProperties( uint8_t * pIndex,
                break;
 
             case MQTT_SERVER_REF_ID:
-                status = decodeUtf8( &pServerRef, &pServerRefLength, &propertyLength, &serverRef, &pLocalIndex );
+                status = decodeUtf8String( &pServerRef, &pServerRefLength, &propertyLength, &serverRef, &pLocalIndex );
                 break;
 
             default:
@@ -42,11 +42,52 @@
 /* Include config defaults header to get default values of configs. */
 #include "core_mqtt_config_defaults.h"
 
+/* Select the vector instructions used to skip blocks of ASCII characters. */
+#if ( MQTT_UTF8_VALIDATION_SIMD != 0 )
+    #if defined( __AVX2__ )
+        #include <immintrin.h>
+        #define MQTT_UTF8_SIMD_AVX2
+        #define MQTT_UTF8_SIMD_BLOCK_SIZE    ( 32U )
+    #elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+        #include <emmintrin.h>
+        #define MQTT_UTF8_SIMD_SSE2
+        #define MQTT_UTF8_SIMD_BLOCK_SIZE    ( 16U )
+    #elif defined( __ARM_NEON ) && defined( __aarch64__ )
+        #include <arm_neon.h>
+        #define MQTT_UTF8_SIMD_NEON
+        #define MQTT_UTF8_SIMD_BLOCK_SIZE    ( 16U )
+    #endif
+#endif
+
 /**
  * @brief Version 5 has the value 5.
  */
 #define MQTT_VERSION_5    ( 5U )
 
+/**
+ * @brief Count the leading bytes of a string which are ASCII characters other
+ * than the null character, a whole block of bytes at a time.
+ *
+ * @param[in] pBytes The string.
+ * @param[in] length Length of the string.
+ *
+ * @return The number of bytes of the leading blocks holding only such
+ * characters. Always 0 when no vector instructions are used.
+ */
+static size_t skipAsciiBlocks( const uint8_t * pBytes,
+                               size_t length );
+
+/**
+ * @brief Get the length of the UTF-8 sequence of a non-ASCII character.
+ *
+ * @param[in] pBytes The first byte of the sequence.
+ * @param[in] remaining Number of bytes left in the string.
+ *
+ * @return The length of the sequence, or 0 if the sequence is malformed.
+ */
+static size_t utf8SequenceLength( const uint8_t * pBytes,
+                                  size_t remaining );
+
 /*-----------------------------------------------------------*/
 
 uint32_t variableLengthEncodedSize( uint32_t length )
@@ -137,14 +178,14 @@ MQTTStatus_t decodeUserProp( const char ** pPropertyKey,
     assert( pIndex != NULL );
     assert( pPropertyLength != NULL );
 
-    /* Decode the user property key using decodeUtf8. */
-    status = decodeUtf8( &pKey, &keyLength, pPropertyLength, &used, pIndex );
+    /* Decode the user property key using decodeUtf8String. */
+    status = decodeUtf8String( &pKey, &keyLength, pPropertyLength, &used, pIndex );
 
     if( status == MQTTSuccess )
     {
         used = false;
-        /* Decode the user property value using decodeUtf8. */
-        status = decodeUtf8( &pValue, &valueLength, pPropertyLength, &used, pIndex );
+        /* Decode the user property value using decodeUtf8String. */
+        status = decodeUtf8String( &pValue, &valueLength, pPropertyLength, &used, pIndex );
     }
 
     if( status == MQTTSuccess )
@@ -338,6 +379,237 @@ MQTTStatus_t decodeUtf8( const char ** pProperty,
 
 /*-----------------------------------------------------------*/
 
+MQTTStatus_t decodeUtf8String( const char ** pProperty,
+                               size_t * pLength,
+                               uint32_t * pPropertyLength,
+                               bool * pUsed,
+                               uint8_t ** pIndex )
+{
+    MQTTStatus_t status;
+    const char * pString = NULL;
+    size_t length = 0U;
+
+    status = decodeUtf8( &pString, &length, pPropertyLength, pUsed, pIndex );
+
+    #if ( MQTT_VALIDATE_UTF8 != 0 )
+        if( ( status == MQTTSuccess ) && ( isValidUtf8String( pString, length ) == false ) )
+        {
+            LogError( ( "Protocol Error: String is not well-formed UTF-8." ) );
+            status = MQTTBadResponse;
+        }
+    #endif
+
+    if( ( status == MQTTSuccess ) && ( pProperty != NULL ) && ( pLength != NULL ) )
+    {
+        *pProperty = pString;
+        *pLength = length;
+    }
+
+    return status;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t skipAsciiBlocks( const uint8_t * pBytes,
+                               size_t length )
+{
+    size_t index = 0U;
+
+    #if defined( MQTT_UTF8_SIMD_AVX2 )
+        bool ascii = true;
+        const __m256i zero = _mm256_setzero_si256();
+
+        while( ascii && ( ( length - index ) >= MQTT_UTF8_SIMD_BLOCK_SIZE ) )
+        {
+            __m256i block = _mm256_loadu_si256( ( const __m256i * ) &pBytes[ index ] );
+
+            /* The sign bit of a byte is set for non-ASCII bytes. */
+            if( ( _mm256_movemask_epi8( block ) | _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, zero ) ) ) == 0 )
+            {
+                index += MQTT_UTF8_SIMD_BLOCK_SIZE;
+            }
+            else
+            {
+                ascii = false;
+            }
+        }
+    #elif defined( MQTT_UTF8_SIMD_SSE2 )
+        bool ascii = true;
+        const __m128i zero = _mm_setzero_si128();
+
+        while( ascii && ( ( length - index ) >= MQTT_UTF8_SIMD_BLOCK_SIZE ) )
+        {
+            __m128i block = _mm_loadu_si128( ( const __m128i * ) &pBytes[ index ] );
+
+            /* The sign bit of a byte is set for non-ASCII bytes. */
+            if( ( _mm_movemask_epi8( block ) | _mm_movemask_epi8( _mm_cmpeq_epi8( block, zero ) ) ) == 0 )
+            {
+                index += MQTT_UTF8_SIMD_BLOCK_SIZE;
+            }
+            else
+            {
+                ascii = false;
+            }
+        }
+    #elif defined( MQTT_UTF8_SIMD_NEON )
+        bool ascii = true;
+
+        while( ascii && ( ( length - index ) >= MQTT_UTF8_SIMD_BLOCK_SIZE ) )
+        {
+            uint8x16_t block = vld1q_u8( &pBytes[ index ] );
+
+            if( ( vmaxvq_u8( block ) < 0x80U ) && ( vminvq_u8( block ) != 0U ) )
+            {
+                index += MQTT_UTF8_SIMD_BLOCK_SIZE;
+            }
+            else
+            {
+                ascii = false;
+            }
+        }
+    #else /* if defined( MQTT_UTF8_SIMD_AVX2 ) */
+        ( void ) pBytes;
+        ( void ) length;
+    #endif /* if defined( MQTT_UTF8_SIMD_AVX2 ) */
+
+    return index;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t utf8SequenceLength( const uint8_t * pBytes,
+                                  size_t remaining )
+{
+    const uint8_t leadByte = pBytes[ 0 ];
+    uint8_t secondMin = 0x80U;
+    uint8_t secondMax = 0xBFU;
+    size_t sequenceLength = 0U;
+    size_t i;
+
+    /* The ranges of the second byte exclude overlong encodings, surrogates
+     * and code points above U+10FFFF, as in table 3-7 of the Unicode
+     * standard. */
+    if( ( leadByte >= 0xC2U ) && ( leadByte <= 0xDFU ) )
+    {
+        sequenceLength = 2U;
+    }
+    else if( ( leadByte >= 0xE0U ) && ( leadByte <= 0xEFU ) )
+    {
+        sequenceLength = 3U;
+
+        if( leadByte == 0xE0U )
+        {
+            secondMin = 0xA0U;
+        }
+        else if( leadByte == 0xEDU )
+        {
+            secondMax = 0x9FU;
+        }
+        else
+        {
+            /* Empty else MISRA 15.7 */
+        }
+    }
+    else if( ( leadByte >= 0xF0U ) && ( leadByte <= 0xF4U ) )
+    {
+        sequenceLength = 4U;
+
+        if( leadByte == 0xF0U )
+        {
+            secondMin = 0x90U;
+        }
+        else if( leadByte == 0xF4U )
+        {
+            secondMax = 0x8FU;
+        }
+        else
+        {
+            /* Empty else MISRA 15.7 */
+        }
+    }
+    else
+    {
+        /* Continuation bytes and invalid lead bytes. */
+    }
+
+    if( sequenceLength > remaining )
+    {
+        sequenceLength = 0U;
+    }
+    else if( sequenceLength > 0U )
+    {
+        if( ( pBytes[ 1 ] < secondMin ) || ( pBytes[ 1 ] > secondMax ) )
+        {
+            sequenceLength = 0U;
+        }
+
+        for( i = 2U; i < sequenceLength; i++ )
+        {
+            if( ( pBytes[ i ] & 0xC0U ) != 0x80U )
+            {
+                sequenceLength = 0U;
+            }
+        }
+    }
+    else
+    {
+        /* Empty else MISRA 15.7 */
+    }
+
+    return sequenceLength;
+}
+
+/*-----------------------------------------------------------*/
+
+bool isValidUtf8String( const char * pString,
+                        size_t length )
+{
+    const uint8_t * pBytes = ( const uint8_t * ) pString;
+    size_t index = 0U;
+    size_t sequenceLength;
+    bool valid = true;
+
+    assert( ( pString != NULL ) || ( length == 0U ) );
+
+    if( length > 0U )
+    {
+        index = skipAsciiBlocks( pBytes, length );
+    }
+
+    while( valid && ( index < length ) )
+    {
+        if( pBytes[ index ] == 0U )
+        {
+            /* U+0000 is not allowed in MQTT strings. */
+            valid = false;
+        }
+        else if( pBytes[ index ] < 0x80U )
+        {
+            index++;
+        }
+        else
+        {
+            sequenceLength = utf8SequenceLength( &pBytes[ index ], length - index );
+
+            if( sequenceLength == 0U )
+            {
+                valid = false;
+            }
+            else
+            {
+                index += sequenceLength;
+
+                /* Go back to whole blocks once past the non-ASCII character. */
+                index += skipAsciiBlocks( &pBytes[ index ], length - index );
+            }
+        }
+    }
+
+    return valid;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t decodeVariableLength( const uint8_t * pBuffer,
                                    size_t bufferLength,
                                    uint32_t * pLength )
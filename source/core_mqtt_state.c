@@ -69,6 +69,20 @@ static const size_t ZERO_SIZE_T = 0U;
  */
 #define UINT16_CHECK_BIT( x, position )         ( ( ( x ) & ( UINT16_BITMAP_BIT_SET_AT( position ) ) ) == ( UINT16_BITMAP_BIT_SET_AT( position ) ) )
 
+/**
+ * @brief Index of the word of a packet ID bitmap holding a packet ID.
+ *
+ * @param[in] packetId The packet ID.
+ */
+#define PACKET_ID_WORD( packetId )              ( ( size_t ) ( packetId ) >> 5U )
+
+/**
+ * @brief Mask of the bit of a packet ID bitmap word holding a packet ID.
+ *
+ * @param[in] packetId The packet ID.
+ */
+#define PACKET_ID_BIT( packetId )               ( ( uint32_t ) 1U << ( ( uint32_t ) ( packetId ) & 31U ) )
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -113,11 +127,63 @@ static bool validateTransitionAck( MQTTPublishState_t currentState,
 static bool isPublishOutgoing( MQTTPubAckType_t packetType,
                                MQTTStateOperation_t opType );
 
+/**
+ * @brief Get the bucket at which the search for a packet ID starts in an
+ * index.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] packetId The packet ID.
+ *
+ * @return The home bucket of the packet ID.
+ */
+static size_t indexHome( const MQTTPubAckIndex_t * pIndex,
+                         uint16_t packetId );
+
+/**
+ * @brief Find a packet ID in an index.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] records State record array.
+ * @param[in] packetId packet ID to search for.
+ * @param[out] pBucket The bucket holding the packet ID if it is found, else
+ * the free bucket which ended the search.
+ *
+ * @return index of the packet id in the record if it exists, else
+ * #MQTT_INVALID_STATE_COUNT.
+ */
+static size_t indexFind( const MQTTPubAckIndex_t * pIndex,
+                         const MQTTPubAckInfo_t * records,
+                         uint16_t packetId,
+                         size_t * pBucket );
+
+/**
+ * @brief Remove the packet ID in a bucket from an index.
+ *
+ * Entries after the bucket are shifted back so that no search ends early.
+ *
+ * @param[in] pIndex The index.
+ * @param[in] records State record array.
+ * @param[in] bucket The bucket to empty.
+ */
+static void indexRemove( MQTTPubAckIndex_t * pIndex,
+                         const MQTTPubAckInfo_t * records,
+                         size_t bucket );
+
+/**
+ * @brief Find the position of the lowest clear bit of a packet ID bitmap word.
+ *
+ * @param[in] word The bitmap word, which must have a clear bit.
+ *
+ * @return The position of the lowest clear bit, from 0 to 31.
+ */
+static uint32_t lowestClearBit( uint32_t word );
+
 /**
  * @brief Find a packet ID in the state record.
  *
  * @param[in] records State record array.
  * @param[in] recordCount Length of record array.
+ * @param[in] pIndex Index of the record array, or NULL.
  * @param[in] packetId packet ID to search for.
  * @param[out] pQos QoS retrieved from record.
  * @param[out] pCurrentState state retrieved from record.
@@ -126,6 +192,7 @@ static bool isPublishOutgoing( MQTTPubAckType_t packetType,
  */
 static size_t findInRecord( const MQTTPubAckInfo_t * records,
                             size_t recordCount,
+                            const MQTTPubAckIndex_t * pIndex,
                             uint16_t packetId,
                             MQTTQoS_t * pQos,
                             MQTTPublishState_t * pCurrentState );
@@ -139,15 +206,18 @@ static size_t findInRecord( const MQTTPubAckInfo_t * records,
  *
  * @param[in] records State record array.
  * @param[in] recordCount Length of record array.
+ * @param[in] pIndex Index of the record array, or NULL.
  */
 static void compactRecords( MQTTPubAckInfo_t * records,
-                            size_t recordCount );
+                            size_t recordCount,
+                            MQTTPubAckIndex_t * pIndex );
 
 /**
  * @brief Store a new entry in the state record.
  *
  * @param[in] records State record array.
  * @param[in] recordCount Length of record array.
+ * @param[in] pIndex Index of the record array, or NULL.
  * @param[in] packetId Packet ID of new entry.
  * @param[in] qos QoS of new entry.
  * @param[in] publishState State of new entry.
@@ -156,6 +226,7 @@ static void compactRecords( MQTTPubAckInfo_t * records,
  */
 static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
                                size_t recordCount,
+                               MQTTPubAckIndex_t * pIndex,
                                uint16_t packetId,
                                MQTTQoS_t qos,
                                MQTTPublishState_t publishState );
@@ -164,11 +235,13 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
  * @brief Update and possibly delete an entry in the state record.
  *
  * @param[in] records State record array.
+ * @param[in] pIndex Index of the record array, or NULL.
  * @param[in] recordIndex index of record to update.
  * @param[in] newState New state to update.
  * @param[in] shouldDelete Whether an existing entry should be deleted.
  */
 static void updateRecord( MQTTPubAckInfo_t * records,
+                          MQTTPubAckIndex_t * pIndex,
                           size_t recordIndex,
                           MQTTPublishState_t newState,
                           bool shouldDelete );
@@ -193,6 +266,7 @@ static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
  *
  * @param[in] records State records pointer.
  * @param[in] maxRecordCount The maximum number of records.
+ * @param[in] pIndex Index of the records, or NULL.
  * @param[in] recordIndex Index at which the record is stored.
  * @param[in] packetId Packet id of the packet.
  * @param[in] currentState Current state of the publish record.
@@ -202,6 +276,7 @@ static uint16_t stateSelect( const MQTTContext_t * pMqttContext,
  */
 static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
                                     size_t maxRecordCount,
+                                    MQTTPubAckIndex_t * pIndex,
                                     size_t recordIndex,
                                     uint16_t packetId,
                                     MQTTPublishState_t currentState,
@@ -437,31 +512,240 @@ static bool isPublishOutgoing( MQTTPubAckType_t packetType,
 
 /*-----------------------------------------------------------*/
 
+static size_t indexHome( const MQTTPubAckIndex_t * pIndex,
+                         uint16_t packetId )
+{
+    /* Packet IDs are mostly handed out in sequence, so their low bits spread
+     * them over the buckets. */
+    return ( size_t ) packetId & ( pIndex->bucketCount - 1U );
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t indexFind( const MQTTPubAckIndex_t * pIndex,
+                         const MQTTPubAckInfo_t * records,
+                         uint16_t packetId,
+                         size_t * pBucket )
+{
+    size_t index = MQTT_INVALID_STATE_COUNT;
+    size_t bucket = indexHome( pIndex, packetId );
+
+    /* There is always a free bucket, as there are more buckets than records. */
+    while( ( pIndex->pBuckets[ bucket ] != 0U ) && ( index == MQTT_INVALID_STATE_COUNT ) )
+    {
+        if( records[ pIndex->pBuckets[ bucket ] - 1U ].packetId == packetId )
+        {
+            index = ( size_t ) pIndex->pBuckets[ bucket ] - 1U;
+        }
+        else
+        {
+            bucket = ( bucket + 1U ) & ( pIndex->bucketCount - 1U );
+        }
+    }
+
+    *pBucket = bucket;
+
+    return index;
+}
+
+/*-----------------------------------------------------------*/
+
+static void indexRemove( MQTTPubAckIndex_t * pIndex,
+                         const MQTTPubAckInfo_t * records,
+                         size_t bucket )
+{
+    const size_t mask = pIndex->bucketCount - 1U;
+    size_t hole = bucket;
+    size_t next = ( bucket + 1U ) & mask;
+    size_t home;
+
+    pIndex->pBuckets[ hole ] = 0U;
+
+    while( pIndex->pBuckets[ next ] != 0U )
+    {
+        home = indexHome( pIndex, records[ pIndex->pBuckets[ next ] - 1U ].packetId );
+
+        /* The entry can fill the hole only if the hole lies between its home
+         * bucket and its current bucket. */
+        if( ( ( next - home ) & mask ) >= ( ( next - hole ) & mask ) )
+        {
+            pIndex->pBuckets[ hole ] = pIndex->pBuckets[ next ];
+            pIndex->pBuckets[ next ] = 0U;
+            hole = next;
+        }
+
+        next = ( next + 1U ) & mask;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MQTT_ResetStateIndex( MQTTPubAckIndex_t * pIndex,
+                           const MQTTPubAckInfo_t * pRecords,
+                           size_t recordCount )
+{
+    size_t index;
+    size_t bucket;
+
+    assert( pIndex != NULL );
+    assert( pIndex->pBuckets != NULL );
+    assert( recordCount < pIndex->bucketCount );
+
+    ( void ) memset( pIndex->pBuckets, 0x00, pIndex->bucketCount * sizeof( *pIndex->pBuckets ) );
+    pIndex->recordEnd = 0U;
+
+    for( index = 0U; index < recordCount; index++ )
+    {
+        if( pRecords[ index ].packetId != MQTT_PACKET_ID_INVALID )
+        {
+            ( void ) indexFind( pIndex, pRecords, pRecords[ index ].packetId, &bucket );
+            pIndex->pBuckets[ bucket ] = ( uint16_t ) ( index + 1U );
+            pIndex->recordEnd = index + 1U;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t lowestClearBit( uint32_t word )
+{
+    /* De Bruijn sequence and table for finding the position of a single set
+     * bit with one multiplication. */
+    static const uint8_t bitPositions[ 32 ] =
+    {
+        0U,  1U,  28U, 2U,  29U, 14U, 24U, 3U,  30U, 22U, 20U, 15U, 25U, 17U, 4U,  8U,
+        31U, 27U, 13U, 23U, 21U, 19U, 16U, 7U,  26U, 12U, 18U, 6U,  11U, 5U,  10U, 9U
+    };
+    uint32_t lowestClear;
+
+    assert( word != UINT32_MAX );
+
+    /* Isolate the lowest clear bit as the only set bit. */
+    lowestClear = ( ~word ) & ( word + 1U );
+
+    return ( uint32_t ) bitPositions[ ( uint32_t ) ( lowestClear * 0x077CB531U ) >> 27U ];
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t MQTT_AllocatePacketId( const MQTTContext_t * pMqttContext,
+                                uint16_t startId )
+{
+    uint16_t packetId = MQTT_PACKET_ID_INVALID;
+    uint32_t * pBitmap;
+    size_t wordIndex;
+    size_t wordsSearched;
+    uint32_t word;
+
+    assert( pMqttContext != NULL );
+    assert( pMqttContext->pPacketIdBitmap != NULL );
+
+    pBitmap = pMqttContext->pPacketIdBitmap;
+    wordIndex = PACKET_ID_WORD( startId );
+
+    /* IDs below the start ID in its word are searched last, when the search
+     * wraps around to that word again. */
+    word = pBitmap[ wordIndex ] | ( PACKET_ID_BIT( startId ) - 1U );
+
+    for( wordsSearched = 0U;
+         ( wordsSearched <= MQTT_PACKET_ID_BITMAP_WORDS ) && ( packetId == MQTT_PACKET_ID_INVALID );
+         wordsSearched++ )
+    {
+        if( word != UINT32_MAX )
+        {
+            packetId = ( uint16_t ) ( ( wordIndex << 5U ) + lowestClearBit( word ) );
+            pBitmap[ wordIndex ] |= PACKET_ID_BIT( packetId );
+        }
+        else
+        {
+            wordIndex = ( wordIndex + 1U ) % MQTT_PACKET_ID_BITMAP_WORDS;
+            word = pBitmap[ wordIndex ];
+        }
+    }
+
+    return packetId;
+}
+
+/*-----------------------------------------------------------*/
+
+void MQTT_FreePacketId( const MQTTContext_t * pMqttContext,
+                        uint16_t packetId )
+{
+    assert( pMqttContext != NULL );
+    assert( pMqttContext->pPacketIdBitmap != NULL );
+
+    if( packetId != MQTT_PACKET_ID_INVALID )
+    {
+        pMqttContext->pPacketIdBitmap[ PACKET_ID_WORD( packetId ) ] &= ~PACKET_ID_BIT( packetId );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void MQTT_ResetPacketIds( const MQTTContext_t * pMqttContext )
+{
+    size_t index;
+    uint16_t packetId;
+
+    assert( pMqttContext != NULL );
+    assert( pMqttContext->pPacketIdBitmap != NULL );
+
+    ( void ) memset( pMqttContext->pPacketIdBitmap,
+                     0x00,
+                     MQTT_PACKET_ID_BITMAP_WORDS * sizeof( *pMqttContext->pPacketIdBitmap ) );
+
+    /* Zero is never a valid packet ID, so it is never handed out. */
+    pMqttContext->pPacketIdBitmap[ 0 ] = PACKET_ID_BIT( MQTT_PACKET_ID_INVALID );
+
+    for( index = 0U; index < pMqttContext->outgoingPublishRecordMaxCount; index++ )
+    {
+        packetId = pMqttContext->outgoingPublishRecords[ index ].packetId;
+        pMqttContext->pPacketIdBitmap[ PACKET_ID_WORD( packetId ) ] |= PACKET_ID_BIT( packetId );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static size_t findInRecord( const MQTTPubAckInfo_t * records,
                             size_t recordCount,
+                            const MQTTPubAckIndex_t * pIndex,
                             uint16_t packetId,
                             MQTTQoS_t * pQos,
                             MQTTPublishState_t * pCurrentState )
 {
     size_t index = 0;
+    size_t bucket;
 
     assert( packetId != MQTT_PACKET_ID_INVALID );
 
     *pCurrentState = MQTTStateNull;
 
-    for( index = 0; index < recordCount; index++ )
+    if( pIndex != NULL )
     {
-        if( records[ index ].packetId == packetId )
+        index = indexFind( pIndex, records, packetId, &bucket );
+
+        if( index != MQTT_INVALID_STATE_COUNT )
         {
             *pQos = records[ index ].qos;
             *pCurrentState = records[ index ].publishState;
-            break;
         }
     }
-
-    if( index == recordCount )
+    else
     {
-        index = MQTT_INVALID_STATE_COUNT;
+        for( index = 0; index < recordCount; index++ )
+        {
+            if( records[ index ].packetId == packetId )
+            {
+                *pQos = records[ index ].qos;
+                *pCurrentState = records[ index ].publishState;
+                break;
+            }
+        }
+
+        if( index == recordCount )
+        {
+            index = MQTT_INVALID_STATE_COUNT;
+        }
     }
 
     return index;
@@ -470,10 +754,12 @@ static size_t findInRecord( const MQTTPubAckInfo_t * records,
 /*-----------------------------------------------------------*/
 
 static void compactRecords( MQTTPubAckInfo_t * records,
-                            size_t recordCount )
+                            size_t recordCount,
+                            MQTTPubAckIndex_t * pIndex )
 {
     size_t index = 0;
     size_t emptyIndex = MQTT_INVALID_STATE_COUNT;
+    size_t bucket;
 
     assert( records != NULL );
 
@@ -492,6 +778,13 @@ static void compactRecords( MQTTPubAckInfo_t * records,
         {
             if( emptyIndex != MQTT_INVALID_STATE_COUNT )
             {
+                /* Point the index at the new position of the record. */
+                if( pIndex != NULL )
+                {
+                    ( void ) indexFind( pIndex, records, records[ index ].packetId, &bucket );
+                    pIndex->pBuckets[ bucket ] = ( uint16_t ) ( emptyIndex + 1U );
+                }
+
                 /* Copy over the contents at non empty index to empty index. */
                 records[ emptyIndex ].packetId = records[ index ].packetId;
                 records[ emptyIndex ].qos = records[ index ].qos;
@@ -507,12 +800,18 @@ static void compactRecords( MQTTPubAckInfo_t * records,
             }
         }
     }
+
+    if( ( pIndex != NULL ) && ( emptyIndex != MQTT_INVALID_STATE_COUNT ) )
+    {
+        pIndex->recordEnd = emptyIndex;
+    }
 }
 
 /*-----------------------------------------------------------*/
 
 static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
                                size_t recordCount,
+                               MQTTPubAckIndex_t * pIndex,
                                uint16_t packetId,
                                MQTTQoS_t qos,
                                MQTTPublishState_t publishState )
@@ -521,6 +820,7 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
     int32_t index = 0;
     size_t availableIndex = recordCount;
     bool validEntryFound = false;
+    size_t bucket = 0U;
 
     assert( packetId != MQTT_PACKET_ID_INVALID );
     assert( qos != MQTTQoS0 );
@@ -529,38 +829,57 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
      * the last spot in the array is filled. */
     if( records[ recordCount - 1U ].packetId != MQTT_PACKET_ID_INVALID )
     {
-        compactRecords( records, recordCount );
+        compactRecords( records, recordCount, pIndex );
     }
 
-    /* Start from end so first available index will be populated.
-     * Available index is always found after the last element in the records.
-     * This is to make sure the relative order of the records in order to meet
-     * the message ordering requirement of MQTT spec 5.0. */
-    for( index = ( ( int32_t ) recordCount - 1 ); index >= 0; index-- )
+    if( pIndex != NULL )
     {
-        /* Available index is only found after packet at the highest index. */
-        if( records[ index ].packetId == MQTT_PACKET_ID_INVALID )
+        /* The index finds collisions, and the end of the records, without a
+         * scan. */
+        if( indexFind( pIndex, records, packetId, &bucket ) != MQTT_INVALID_STATE_COUNT )
         {
-            if( validEntryFound == false )
-            {
-                availableIndex = ( size_t ) index;
-            }
+            LogError( ( "Collision when adding PacketID=%u.",
+                        ( unsigned int ) packetId ) );
+
+            status = MQTTStateCollision;
         }
         else
         {
-            /* A non-empty spot found in the records. */
-            validEntryFound = true;
-
-            if( records[ index ].packetId == packetId )
+            availableIndex = pIndex->recordEnd;
+        }
+    }
+    else
+    {
+        /* Start from end so first available index will be populated.
+         * Available index is always found after the last element in the records.
+         * This is to make sure the relative order of the records in order to meet
+         * the message ordering requirement of MQTT spec 5.0. */
+        for( index = ( ( int32_t ) recordCount - 1 ); index >= 0; index-- )
+        {
+            /* Available index is only found after packet at the highest index. */
+            if( records[ index ].packetId == MQTT_PACKET_ID_INVALID )
             {
-                /* Collision. */
-                LogError( ( "Collision when adding PacketID=%u at index=%d.",
-                            ( unsigned int ) packetId,
-                            ( int ) index ) );
-
-                status = MQTTStateCollision;
-                availableIndex = recordCount;
-                break;
+                if( validEntryFound == false )
+                {
+                    availableIndex = ( size_t ) index;
+                }
+            }
+            else
+            {
+                /* A non-empty spot found in the records. */
+                validEntryFound = true;
+
+                if( records[ index ].packetId == packetId )
+                {
+                    /* Collision. */
+                    LogError( ( "Collision when adding PacketID=%u at index=%d.",
+                                ( unsigned int ) packetId,
+                                ( int ) index ) );
+
+                    status = MQTTStateCollision;
+                    availableIndex = recordCount;
+                    break;
+                }
             }
         }
     }
@@ -571,6 +890,12 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
         records[ availableIndex ].qos = qos;
         records[ availableIndex ].publishState = publishState;
         status = MQTTSuccess;
+
+        if( pIndex != NULL )
+        {
+            pIndex->pBuckets[ bucket ] = ( uint16_t ) ( availableIndex + 1U );
+            pIndex->recordEnd = availableIndex + 1U;
+        }
     }
 
     return status;
@@ -579,18 +904,35 @@ static MQTTStatus_t addRecord( MQTTPubAckInfo_t * records,
 /*-----------------------------------------------------------*/
 
 static void updateRecord( MQTTPubAckInfo_t * records,
+                          MQTTPubAckIndex_t * pIndex,
                           size_t recordIndex,
                           MQTTPublishState_t newState,
                           bool shouldDelete )
 {
+    size_t bucket;
+
     assert( records != NULL );
 
     if( shouldDelete == true )
     {
+        if( pIndex != NULL )
+        {
+            ( void ) indexFind( pIndex, records, records[ recordIndex ].packetId, &bucket );
+            indexRemove( pIndex, records, bucket );
+        }
+
         /* Mark the record as invalid. */
         records[ recordIndex ].packetId = MQTT_PACKET_ID_INVALID;
         records[ recordIndex ].qos = MQTTQoS0;
         records[ recordIndex ].publishState = MQTTStateNull;
+
+        /* Keep the end of the records after the last one in use. */
+        while( ( pIndex != NULL ) &&
+               ( pIndex->recordEnd > 0U ) &&
+               ( records[ pIndex->recordEnd - 1U ].packetId == MQTT_PACKET_ID_INVALID ) )
+        {
+            pIndex->recordEnd--;
+        }
     }
     else
     {
@@ -699,6 +1041,7 @@ MQTTPublishState_t MQTT_CalculateStateAck( MQTTPubAckType_t packetType,
 
 static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
                                     size_t maxRecordCount,
+                                    MQTTPubAckIndex_t * pIndex,
                                     size_t recordIndex,
                                     uint16_t packetId,
                                     MQTTPublishState_t currentState,
@@ -727,6 +1070,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
         if( currentState != newState )
         {
             updateRecord( records,
+                          pIndex,
                           recordIndex,
                           newState,
                           shouldDeleteRecord );
@@ -739,6 +1083,7 @@ static MQTTStatus_t updateStateAck( MQTTPubAckInfo_t * records,
             {
                 status = addRecord( records,
                                     maxRecordCount,
+                                    pIndex,
                                     packetId,
                                     MQTTQoS2,
                                     MQTTPubRelSend );
@@ -785,6 +1130,7 @@ static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
         {
             status = addRecord( pMqttContext->incomingPublishRecords,
                                 pMqttContext->incomingPublishRecordMaxCount,
+                                pMqttContext->pIncomingPublishIndex,
                                 packetId,
                                 qos,
                                 newState );
@@ -797,6 +1143,7 @@ static MQTTStatus_t updateStatePublish( const MQTTContext_t * pMqttContext,
             if( currentState != newState )
             {
                 updateRecord( pMqttContext->outgoingPublishRecords,
+                              pMqttContext->pOutgoingPublishIndex,
                               recordIndex,
                               newState,
                               false );
@@ -835,9 +1182,17 @@ MQTTStatus_t MQTT_ReserveState( const MQTTContext_t * pMqttContext,
         /* Collisions are detected when adding the record. */
         status = addRecord( pMqttContext->outgoingPublishRecords,
                             pMqttContext->outgoingPublishRecordMaxCount,
+                            pMqttContext->pOutgoingPublishIndex,
                             packetId,
                             qos,
                             MQTTPublishSend );
+
+        /* The ID is held until the publish is acknowledged, whether or not it
+         * was handed out by the packet ID allocator. */
+        if( ( status == MQTTSuccess ) && ( pMqttContext->pPacketIdBitmap != NULL ) )
+        {
+            pMqttContext->pPacketIdBitmap[ PACKET_ID_WORD( packetId ) ] |= PACKET_ID_BIT( packetId );
+        }
     }
 
     return status;
@@ -909,6 +1264,7 @@ MQTTStatus_t MQTT_UpdateStatePublish( const MQTTContext_t * pMqttContext,
         /* Search record for entry so we can check QoS. */
         recordIndex = findInRecord( pMqttContext->outgoingPublishRecords,
                                     pMqttContext->outgoingPublishRecordMaxCount,
+                                    pMqttContext->pOutgoingPublishIndex,
                                     packetId,
                                     &foundQoS,
                                     &currentState );
@@ -948,6 +1304,29 @@ MQTTStatus_t MQTT_UpdateStatePublish( const MQTTContext_t * pMqttContext,
 
 /*-----------------------------------------------------------*/
 
+MQTTPublishState_t MQTT_IncomingPublishState( const MQTTContext_t * pMqttContext,
+                                              uint16_t packetId )
+{
+    MQTTPublishState_t currentState = MQTTStateNull;
+    MQTTQoS_t qos = MQTTQoS0;
+
+    if( ( pMqttContext != NULL ) &&
+        ( pMqttContext->incomingPublishRecords != NULL ) &&
+        ( packetId != MQTT_PACKET_ID_INVALID ) )
+    {
+        ( void ) findInRecord( pMqttContext->incomingPublishRecords,
+                               pMqttContext->incomingPublishRecordMaxCount,
+                               pMqttContext->pIncomingPublishIndex,
+                               packetId,
+                               &qos,
+                               &currentState );
+    }
+
+    return currentState;
+}
+
+/*-----------------------------------------------------------*/
+
 MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
                                      uint16_t packetId )
 {
@@ -969,6 +1348,7 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
 
         recordIndex = findInRecord( records,
                                     pMqttContext->outgoingPublishRecordMaxCount,
+                                    pMqttContext->pOutgoingPublishIndex,
                                     packetId,
                                     &qos,
                                     &currentState );
@@ -985,9 +1365,15 @@ MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext,
         {
             /* Delete the record. */
             updateRecord( records,
+                          pMqttContext->pOutgoingPublishIndex,
                           recordIndex,
                           MQTTStateNull,
                           true );
+
+            if( pMqttContext->pPacketIdBitmap != NULL )
+            {
+                MQTT_FreePacketId( pMqttContext, packetId );
+            }
         }
     }
 
@@ -1010,6 +1396,7 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
     size_t recordIndex = MQTT_INVALID_STATE_COUNT;
 
     MQTTPubAckInfo_t * records = NULL;
+    MQTTPubAckIndex_t * pIndex = NULL;
     MQTTStatus_t status = MQTTBadResponse;
 
     if( ( pMqttContext == NULL ) || ( pNewState == NULL ) )
@@ -1035,15 +1422,18 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
         {
             records = pMqttContext->outgoingPublishRecords;
             maxRecordCount = pMqttContext->outgoingPublishRecordMaxCount;
+            pIndex = pMqttContext->pOutgoingPublishIndex;
         }
         else
         {
             records = pMqttContext->incomingPublishRecords;
             maxRecordCount = pMqttContext->incomingPublishRecordMaxCount;
+            pIndex = pMqttContext->pIncomingPublishIndex;
         }
 
         recordIndex = findInRecord( records,
                                     maxRecordCount,
+                                    pIndex,
                                     packetId,
                                     &qos,
                                     &currentState );
@@ -1056,6 +1446,7 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
         /* Validate state transition and update state record. */
         status = updateStateAck( records,
                                  maxRecordCount,
+                                 pIndex,
                                  recordIndex,
                                  packetId,
                                  currentState,
@@ -1065,6 +1456,14 @@ MQTTStatus_t MQTT_UpdateStateAck( const MQTTContext_t * pMqttContext,
         if( status == MQTTSuccess )
         {
             *pNewState = newState;
+
+            /* An acknowledged outgoing publish no longer holds its packet ID. */
+            if( ( isOutgoingPublish == true ) &&
+                ( newState == MQTTPublishDone ) &&
+                ( pMqttContext->pPacketIdBitmap != NULL ) )
+            {
+                MQTT_FreePacketId( pMqttContext, packetId );
+            }
         }
     }
     else
@@ -59,6 +59,14 @@
  */
 #define MQTT_PACKET_ID_INVALID    ( ( uint16_t ) 0U )
 
+/**
+ * @ingroup mqtt_constants
+ * @brief Number of 32-bit words in the bitmap of a packet ID allocator.
+ *
+ * There is one bit for each 16-bit packet ID, including the invalid ID zero.
+ */
+#define MQTT_PACKET_ID_BITMAP_WORDS    ( 2048U )
+
 /* Structures defined in this file. */
 struct MQTTPubAckInfo;
 struct MQTTContext;
@@ -234,6 +242,163 @@ typedef void ( * MQTTClearPacketForRetransmit )( struct MQTTContext * pContext,
                                                  uint32_t handle );
 /* @[define_mqtt_retransmitclearpacket] */
 
+/**
+ * @brief User defined callback used to retrieve several stored packets at once
+ * for resend operation when a session is resumed.
+ *
+ * @param[in] pContext Initialised MQTT Context.
+ * @param[in] pHandles Handles of the packets to retrieve, as given to the
+ *                #MQTTStorePacketForRetransmit callback.
+ * @param[in] handleCount Number of handles in @p pHandles.
+ * @param[out] pPackets Array of @p handleCount entries, in which the callback
+ *                stores the pointer to and the length of each serialized
+ *                MQTTVec_t, in the order of @p pHandles. The memory must
+ *                stay valid until the next call of the callback.
+ *
+ * @return True if all the packets were retrieved else false.
+ */
+/* @[define_mqtt_retransmitretrievepackets] */
+typedef bool ( * MQTTRetrievePacketsForRetransmit )( struct MQTTContext * pContext,
+                                                     const uint32_t * pHandles,
+                                                     size_t handleCount,
+                                                     TransportOutVector_t * pPackets );
+/* @[define_mqtt_retransmitretrievepackets] */
+
+/**
+ * @brief Largest number of vectors in which a PUBLISH packet is returned by
+ * the #MQTTRetrievePublishByReference callback.
+ */
+#define MQTT_RETRIEVED_PUBLISH_MAX_VECTORS    ( 2U )
+
+/**
+ * @ingroup mqtt_callback_types
+ * @brief Callback taking or giving back a reference to the payload of an
+ * outgoing PUBLISH, kept by a retransmit store instead of a copy.
+ *
+ * @param[in] pPayloadContext The #MQTTPayloadReference_t.pPayloadContext
+ * given with the PUBLISH, such as the reference-counted buffer holding the
+ * payload.
+ * @param[in] retain true when the store starts referring to the payload,
+ * false when it stops.
+ */
+typedef void ( * MQTTPayloadReferenceCallback_t )( void * pPayloadContext,
+                                                   bool retain );
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief How the payload of a PUBLISH sent with #MQTT_PublishByReference is
+ * kept valid while a retransmit store refers to it.
+ */
+typedef struct MQTTPayloadReference
+{
+    /**
+     * @brief Callback taking or giving back a reference to the payload.
+     */
+    MQTTPayloadReferenceCallback_t payloadReference;
+
+    /**
+     * @brief Context passed to #MQTTPayloadReference_t.payloadReference.
+     */
+    void * pPayloadContext;
+} MQTTPayloadReference_t;
+
+/**
+ * @brief User defined callback used to store an outgoing PUBLISH for
+ * retransmits, keeping its payload by reference instead of copying it.
+ *
+ * Once #MQTT_InitRetransmitReferences is called, this callback is used
+ * instead of #MQTTStorePacketForRetransmit for the PUBLISH packets sent with
+ * #MQTT_PublishByReference. The store copies @p pHeaderVec, which holds the
+ * packet up to its payload, with MQTT_GetBytesInMQTTVec and
+ * MQTT_SerializeMQTTVec. It keeps the payload of @p pPublishInfo by
+ * reference, calling the payloadReference callback of @p pPayloadReference
+ * with true before returning true, and with false once the packet is cleared.
+ *
+ * @param[in] pContext Initialised MQTT Context.
+ * @param[in] handle Unique 32-bit handle to distinguish the packets, as for
+ *                #MQTTStorePacketForRetransmit.
+ * @param[in] pHeaderVec Pointer to the opaque mqtt vector structure holding
+ *                the fixed header, topic name, packet ID and properties of
+ *                the PUBLISH.
+ * @param[in] pPublishInfo The PUBLISH. Its pPayload and payloadLength are the
+ *                ones to keep.
+ * @param[in] pPayloadReference The reference given to
+ *                #MQTT_PublishByReference, which the store copies.
+ *
+ * @return True if the store is successful else false.
+ */
+/* @[define_mqtt_retransmitstorepublishbyreference] */
+typedef bool ( * MQTTStorePublishByReference )( struct MQTTContext * pContext,
+                                                uint32_t handle,
+                                                MQTTVec_t * pHeaderVec,
+                                                const MQTTPublishInfo_t * pPublishInfo,
+                                                const MQTTPayloadReference_t * pPayloadReference );
+/* @[define_mqtt_retransmitstorepublishbyreference] */
+
+/**
+ * @brief User defined callback used to retrieve a stored PUBLISH for resend
+ * operation, without joining the parts kept by reference.
+ *
+ * Once #MQTT_InitRetransmitReferences is called, this callback is used
+ * instead of #MQTTRetrievePacketForRetransmit for the PUBLISH packets. A
+ * packet stored by #MQTTStorePublishByReference is returned as its copied
+ * header and its payload; one stored by #MQTTStorePacketForRetransmit as a
+ * single vector.
+ *
+ * @param[in] pContext Initialised MQTT Context.
+ * @param[in] handle Unique 32-bit handle to distinguish the packets, as for
+ *                #MQTTStorePacketForRetransmit.
+ * @param[out] pPacketVectors Array of #MQTT_RETRIEVED_PUBLISH_MAX_VECTORS
+ *                entries, in which the callback stores the parts of the
+ *                packet in order.
+ * @param[out] pVectorCount Number of entries of @p pPacketVectors used.
+ *
+ * @return True if the retrieve is successful else false.
+ */
+/* @[define_mqtt_retransmitretrievepublishbyreference] */
+typedef bool ( * MQTTRetrievePublishByReference )( struct MQTTContext * pContext,
+                                                   uint32_t handle,
+                                                   TransportOutVector_t * pPacketVectors,
+                                                   size_t * pVectorCount );
+/* @[define_mqtt_retransmitretrievepublishbyreference] */
+
+/**
+ * @ingroup mqtt_callback_types
+ * @brief Application callback for receiving the payload of an incoming PUBLISH
+ * that does not fit in the network buffer.
+ *
+ * The payload is delivered in order, in pieces of at most the space left in
+ * the network buffer after the fixed and variable headers of the PUBLISH.
+ * Once the last piece has been delivered, the #MQTTEventCallback_t is invoked
+ * for the PUBLISH as usual, except that #MQTTPublishInfo_t.pPayload is NULL,
+ * and the QoS state is updated and the acknowledgment sent.
+ *
+ * @note The payload of a duplicate QoS 2 PUBLISH, whose packet identifier
+ * is still held by the state engine, is not delivered through this callback.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo Deserialized PUBLISH. The topic name and properties
+ *                remain valid until the PUBLISH has been fully received;
+ *                #MQTTPublishInfo_t.payloadLength is the total payload length
+ *                and #MQTTPublishInfo_t.pPayload must not be used.
+ * @param[in] packetId Packet identifier of the PUBLISH; 0 for QoS 0.
+ * @param[in] offset Offset of this piece within the payload.
+ * @param[in] pChunk Pointer to this piece of the payload.
+ * @param[in] chunkLength Length of this piece of the payload.
+ *
+ * @return true if the piece was processed; false to abort the reception, in
+ * which case #MQTT_ProcessLoop and #MQTT_ReceiveLoop return
+ * #MQTTEventCallbackFailed.
+ */
+/* @[define_mqtt_publishchunkcallback] */
+typedef bool ( * MQTTPublishChunkCallback_t )( struct MQTTContext * pContext,
+                                               const struct MQTTPublishInfo * pPublishInfo,
+                                               uint16_t packetId,
+                                               size_t offset,
+                                               const uint8_t * pChunk,
+                                               size_t chunkLength );
+/* @[define_mqtt_publishchunkcallback] */
+
 /**
  * @ingroup mqtt_enum_types
  * @brief Values indicating if an MQTT connection exists.
@@ -299,6 +464,131 @@ typedef struct MQTTPubAckInfo
     MQTTPublishState_t publishState; /**< @brief The current state of the publish process. */
 } MQTTPubAckInfo_t;
 
+/**
+ * @ingroup mqtt_struct_types
+ * @brief An index from packet ID to position in an array of state engine
+ * records, set up by #MQTT_InitStatefulQoSIndex.
+ *
+ * The index is an open addressing hash table. Its buckets hold the position
+ * of a record plus one, with zero marking a free bucket.
+ */
+typedef struct MQTTPubAckIndex
+{
+    uint16_t * pBuckets; /**< @brief The hash table buckets. */
+    size_t bucketCount;  /**< @brief Number of buckets, a power of 2 larger than the number of records. */
+    size_t recordEnd;    /**< @brief One past the position of the last record in use. */
+} MQTTPubAckIndex_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A topic alias of the topic alias tables set up by
+ * #MQTT_InitOutgoingTopicAliases and #MQTT_InitIncomingTopicAliases.
+ *
+ * The topic name itself is kept in the topic name buffer of the table. The
+ * incoming table only uses the topic name length, and the use counter to
+ * tell whether the broker set the alias.
+ */
+typedef struct MQTTTopicAlias
+{
+    uint32_t topicHash;       /**< @brief Hash of the topic name, compared before the topic name. */
+    uint32_t lastUsed;        /**< @brief Use counter of the table when the alias was last used. */
+    uint16_t topicNameLength; /**< @brief Length of the topic name, or 0 if the alias is not set. */
+} MQTTTopicAlias_t;
+
+/**
+ * @ingroup mqtt_callback_types
+ * @brief Handler of the incoming PUBLISH packets carrying a Subscription
+ * Identifier, registered with #MQTT_SubscribeWithHandler.
+ *
+ * @param[in] pContext The MQTT context which received the PUBLISH.
+ * @param[in] pDeserializedInfo The incoming PUBLISH.
+ * @param[in] pUserData The user data registered with the handler.
+ */
+typedef void (* MQTTSubscriptionCallback_t )( struct MQTTContext * pContext,
+                                              struct MQTTDeserializedInfo * pDeserializedInfo,
+                                              void * pUserData );
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A handler of the table set up by #MQTT_InitSubscriptionHandlers.
+ */
+typedef struct MQTTSubscriptionHandler
+{
+    MQTTSubscriptionCallback_t callback; /**< @brief The handler, or NULL if the entry is free. */
+    void * pUserData;                    /**< @brief User data passed to the handler. */
+    uint16_t failedPacketId;             /**< @brief Packet ID of the SUBSCRIBE which failed after part of it was sent, or 0. */
+} MQTTSubscriptionHandler_t;
+
+/**
+ * @ingroup mqtt_enum_types
+ * @brief The kinds of levels of a topic filter compiled by
+ * #MQTT_CompileTopicFilter.
+ */
+typedef enum MQTTTopicLevelType
+{
+    MQTTTopicLevelLiteral,    /**< @brief A level matching only the same level of a topic name. */
+    MQTTTopicLevelSingleWild, /**< @brief The '+' wildcard, matching any one level. */
+    MQTTTopicLevelMultiWild   /**< @brief The '#' wildcard, matching the parent level and any number of child levels. */
+} MQTTTopicLevelType_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A level of a topic filter compiled by #MQTT_CompileTopicFilter.
+ */
+typedef struct MQTTTopicFilterLevel
+{
+    const char * pLevel;       /**< @brief The level, pointing into the topic filter. */
+    uint16_t levelLength;      /**< @brief Length of the level. */
+    MQTTTopicLevelType_t type; /**< @brief Whether the level is literal or a wildcard. */
+} MQTTTopicFilterLevel_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A topic filter split into levels by #MQTT_CompileTopicFilter.
+ */
+typedef struct MQTTCompiledTopicFilter
+{
+    const MQTTTopicFilterLevel_t * pLevels; /**< @brief The levels of the topic filter. */
+    size_t levelCount;                      /**< @brief Number of levels of the topic filter. */
+} MQTTCompiledTopicFilter_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A PUBLISH packet without its payload and packet ID, prepared by
+ * #MQTT_PreparePublish and sent by #MQTT_PublishPrepared.
+ *
+ * The topic name and the properties are not copied.
+ */
+typedef struct MQTTPublishTemplate
+{
+    MQTTPublishInfo_t publishInfo; /**< @brief The PUBLISH packet parameters, without the payload. */
+    const uint8_t * pProperties;   /**< @brief The serialized properties, or NULL. */
+    size_t propertiesLength;       /**< @brief Length of the serialized properties. */
+    uint32_t remainingLength;      /**< @brief Remaining length of the packet without its payload. */
+    uint16_t topicAlias;           /**< @brief The Topic Alias set in the properties, or 0. */
+    uint8_t headerByte;            /**< @brief The first byte of the fixed header. */
+    uint8_t propertyLength[ 4 ];   /**< @brief The encoded length of the properties. */
+    uint8_t propertyLengthSize;    /**< @brief Number of bytes of the encoded length of the properties. */
+} MQTTPublishTemplate_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief State of an incoming PUBLISH streamed to the
+ * #MQTTPublishChunkCallback_t, provided to #MQTT_InitPublishStreaming.
+ *
+ * The topic name and properties of #MQTTPublishStream_t.publishInfo point
+ * into the headers kept at the start of the network buffer.
+ */
+typedef struct MQTTPublishStream
+{
+    MQTTPublishInfo_t publishInfo; /**< @brief The streamed PUBLISH, deserialized once with its topic alias resolved. */
+    MQTTPropBuilder_t propBuffer;  /**< @brief Properties of the streamed PUBLISH. */
+    size_t headLength;             /**< @brief Length of the fixed and variable headers, or 0 if they have not been deserialized yet. */
+    size_t payloadOffset;          /**< @brief Number of payload bytes already received. */
+    uint16_t packetIdentifier;     /**< @brief Packet identifier of the streamed PUBLISH. */
+    bool duplicate;                /**< @brief Whether the PUBLISH is a QoS 2 retransmission whose payload is dropped. */
+} MQTTPublishStream_t;
+
 /**
  * @ingroup mqtt_struct_types
  * @brief A struct representing an MQTT connection.
@@ -325,11 +615,45 @@ typedef struct MQTTContext
      */
     size_t incomingPublishRecordMaxCount;
 
+    /**
+     * @brief Optional index of the outgoing publish records.
+     */
+    MQTTPubAckIndex_t * pOutgoingPublishIndex;
+
+    /**
+     * @brief Optional index of the incoming publish records.
+     */
+    MQTTPubAckIndex_t * pIncomingPublishIndex;
+
     /**
      * @brief The transport interface used by the MQTT connection.
      */
     TransportInterface_t transportInterface;
 
+    /**
+     * @brief Transport function lending received data, set by
+     * #MQTT_InitRecvLease, or NULL if data is copied into the network buffer.
+     */
+    TransportRecvLease_t recvLease;
+
+    /**
+     * @brief Transport function handing back the data lent by
+     * #MQTTContext_t.recvLease.
+     */
+    TransportRelease_t release;
+
+    /**
+     * @brief Transport function waiting until data can be received, set by
+     * #MQTT_InitWaitReadable, or NULL if the transport is polled.
+     */
+    TransportWaitReadable_t waitReadable;
+
+    /**
+     * @brief Maximum time #MQTT_ProcessLoop waits in
+     * #MQTTContext_t.waitReadable.
+     */
+    uint32_t waitReadableTimeoutMs;
+
     /**
      * @brief The buffer used in receiving packets from the network.
      */
@@ -345,6 +669,11 @@ typedef struct MQTTContext
      */
     uint16_t nextPacketId;
 
+    /**
+     * @brief Optional bitmap of the packet IDs held by outgoing packets.
+     */
+    uint32_t * pPacketIdBitmap;
+
     /**
      * @brief Whether the context currently has a connection to the broker.
      */
@@ -381,6 +710,170 @@ typedef struct MQTTContext
      */
     size_t index;
 
+    /**
+     * @brief Offset of the first unprocessed byte in the network buffer.
+     *
+     * Only used when ring receive mode is enabled by #MQTT_InitRingReceive;
+     * it is always 0 otherwise. #MQTTContext_t.index bytes starting at this
+     * offset are pending processing.
+     */
+    size_t headIndex;
+
+    /**
+     * @brief Whether processed packets are consumed by advancing
+     * #MQTTContext_t.headIndex instead of moving the unprocessed bytes to the
+     * start of the network buffer.
+     */
+    bool ringReceiveEnabled;
+
+    /**
+     * @brief Callback used to deliver the payload of incoming PUBLISH packets
+     * larger than the network buffer, or NULL if such packets are rejected.
+     */
+    MQTTPublishChunkCallback_t publishChunkCallback;
+
+    /**
+     * @brief State of the PUBLISH being streamed to
+     * #MQTTContext_t.publishChunkCallback.
+     */
+    MQTTPublishStream_t * pPublishStream;
+
+    /**
+     * @brief Buffer in which PUBACK, PUBREC and PUBCOMP packets are gathered
+     * before being sent together, or NULL if acks are sent one by one.
+     */
+    uint8_t * pAckStagingBuffer;
+
+    /**
+     * @brief Maximum number of acks in #MQTTContext_t.pAckStagingBuffer.
+     */
+    size_t ackStagingCapacity;
+
+    /**
+     * @brief Number of acks in #MQTTContext_t.pAckStagingBuffer waiting to be
+     * sent.
+     */
+    size_t ackStagedCount;
+
+    /**
+     * @brief Buffer keeping the bytes of packets which the transport could not
+     * accept without blocking, or a NULL buffer if sends block until they
+     * complete.
+     */
+    MQTTFixedBuffer_t pendingSendBuffer;
+
+    /**
+     * @brief Offset of the first byte of #MQTTContext_t.pendingSendBuffer not
+     * yet sent.
+     */
+    size_t pendingSendOffset;
+
+    /**
+     * @brief Number of bytes of #MQTTContext_t.pendingSendBuffer not yet sent.
+     */
+    size_t pendingSendLength;
+
+    /**
+     * @brief Whether bytes were written to the transport or kept in
+     * #MQTTContext_t.pendingSendBuffer since it was last cleared.
+     *
+     * #MQTT_SubscribeWithHandler clears it before sending, to know whether any
+     * of a SUBSCRIBE which failed to send may still reach the broker.
+     */
+    bool packetBytesSent;
+
+    /**
+     * @brief Buffer SUBSCRIBE and UNSUBSCRIBE packets are serialized in before
+     * being sent with one transport write, or a NULL buffer if they are sent
+     * from the subscription list.
+     */
+    MQTTFixedBuffer_t subscribeBuffer;
+
+    /**
+     * @brief Topic aliases assigned to outgoing PUBLISH packets, or NULL if
+     * #MQTT_Publish does not assign topic aliases. Alias N is at position N - 1.
+     */
+    MQTTTopicAlias_t * pOutgoingTopicAliases;
+
+    /**
+     * @brief Number of entries in #MQTTContext_t.pOutgoingTopicAliases.
+     */
+    size_t outgoingTopicAliasCapacity;
+
+    /**
+     * @brief Number of aliases the broker accepts on this connection, at most
+     * #MQTTContext_t.outgoingTopicAliasCapacity.
+     */
+    size_t outgoingTopicAliasCount;
+
+    /**
+     * @brief Buffer holding the topic name of each outgoing topic alias.
+     */
+    char * pOutgoingTopicAliasNames;
+
+    /**
+     * @brief Room for one topic name in #MQTTContext_t.pOutgoingTopicAliasNames.
+     */
+    size_t outgoingTopicAliasNameLength;
+
+    /**
+     * @brief Counter incremented each time an outgoing topic alias is used,
+     * ordering the aliases from least to most recently used.
+     */
+    uint32_t outgoingTopicAliasClock;
+
+    /**
+     * @brief Topic aliases set by the broker in incoming PUBLISH packets, or
+     * NULL if incoming topic aliases are not resolved. Alias N is at position
+     * N - 1.
+     */
+    MQTTTopicAlias_t * pIncomingTopicAliases;
+
+    /**
+     * @brief Number of entries in #MQTTContext_t.pIncomingTopicAliases.
+     */
+    size_t incomingTopicAliasCapacity;
+
+    /**
+     * @brief Number of aliases the broker may set on this connection, at most
+     * #MQTTContext_t.incomingTopicAliasCapacity.
+     */
+    size_t incomingTopicAliasCount;
+
+    /**
+     * @brief Buffer holding the topic name of each incoming topic alias.
+     */
+    char * pIncomingTopicAliasNames;
+
+    /**
+     * @brief Room for one topic name in #MQTTContext_t.pIncomingTopicAliasNames.
+     */
+    size_t incomingTopicAliasNameLength;
+
+    /**
+     * @brief Handlers of incoming PUBLISH packets, or NULL if PUBLISH packets
+     * are not dispatched by Subscription Identifier. The handler of
+     * identifier N is at position N - 1.
+     */
+    MQTTSubscriptionHandler_t * pSubscriptionHandlers;
+
+    /**
+     * @brief Number of entries in #MQTTContext_t.pSubscriptionHandlers.
+     */
+    size_t subscriptionHandlerCount;
+
+    /**
+     * @brief Index of the properties of incoming PUBLISH packets, or NULL if
+     * they are not indexed.
+     */
+    MQTTPropIndex_t * pIncomingPropIndex;
+
+    /**
+     * @brief Where the properties of incoming PUBLISH packets are decoded, or
+     * NULL if they are not.
+     */
+    MQTTPublishProperties_t * pIncomingPublishProperties;
+
     /* Keep alive members. */
     uint16_t keepAliveIntervalSec; /**< @brief Keep Alive interval. */
     uint32_t pingReqSendTimeMs;    /**< @brief Timestamp of the last sent PINGREQ. */
@@ -405,6 +898,24 @@ typedef struct MQTTContext
      * @brief User defined API used to clear a particular copied publish packet.
      */
     MQTTClearPacketForRetransmit clearFunction;
+
+    /**
+     * @brief User defined API used to retrieve several copied packets at once
+     * on session resumption, or NULL to retrieve them one by one.
+     */
+    MQTTRetrievePacketsForRetransmit retrieveBatchFunction;
+
+    /**
+     * @brief User defined API used to store publishes whose payload is kept
+     * by reference, or NULL to copy all of them.
+     */
+    MQTTStorePublishByReference storeReferenceFunction;
+
+    /**
+     * @brief User defined API used to retrieve publishes in parts on session
+     * resumption, or NULL.
+     */
+    MQTTRetrievePublishByReference retrieveReferenceFunction;
 } MQTTContext_t;
 
 /**
@@ -418,6 +929,12 @@ typedef struct MQTTDeserializedInfo
     MQTTPublishInfo_t * pPublishInfo;   /**< @brief Pointer to deserialized publish info. */
     MQTTStatus_t deserializationResult; /**< @brief Return code of deserialization. */
     MQTTReasonCodeInfo_t * pReasonCode; /**< @brief Pointer to deserialized ack info. */
+
+    /**
+     * @brief Properties of a PUBLISH, decoded when set up by
+     * #MQTT_InitIncomingPublishProperties, or NULL.
+     */
+    MQTTPublishProperties_t * pPublishProperties;
 } MQTTDeserializedInfo_t;
 
 /**
@@ -595,103 +1112,965 @@ MQTTStatus_t MQTT_InitStatefulQoS( MQTTContext_t * pContext,
 /* @[declare_mqtt_initstatefulqos] */
 
 /**
- * @brief Initialize an MQTT context for publish retransmits for QoS > 0.
+ * @brief Index the QoS > 0 state records of an MQTT context by packet ID.
  *
- * This function must be called on an #MQTTContext_t after MQTT_InitstatefulQoS and before any other function.
+ * Without an index, finding and adding a state record scans the record array,
+ * which takes time proportional to the number of records. With an index, it
+ * takes constant time on average, which matters when many publishes are in
+ * flight. The order of the records, which #MQTT_PublishToResend and
+ * #MQTT_PubrelToResend rely on, is the same with or without an index.
  *
- * @param[in] pContext The context to initialize.
- * @param[in] storeFunction User defined API used to store outgoing publishes.
- * @param[in] retrieveFunction User defined API used to retreive a copied publish for resend operation.
- * @param[in] clearFunction User defined API used to clear a particular copied publish packet.
+ * This function must be called after #MQTT_InitStatefulQoS, which removes any
+ * index. Records already present are added to the index.
  *
- * @return #MQTTBadParameter if invalid parameters are passed;
- * #MQTTSuccess otherwise.
+ * @param[in] pContext The context to initialize.
+ * @param[out] pOutgoingPublishIndex The index of the outgoing publish records,
+ * or NULL to not index them.
+ * @param[in] pOutgoingBuckets Memory for the buckets of @p pOutgoingPublishIndex.
+ * @param[in] outgoingBucketCount Number of buckets pointed to by
+ * @p pOutgoingBuckets. It must be a power of 2 larger than the number of
+ * outgoing publish records; twice that number keeps lookups short.
+ * @param[out] pIncomingPublishIndex The index of the incoming publish records,
+ * or NULL to not index them.
+ * @param[in] pIncomingBuckets Memory for the buckets of @p pIncomingPublishIndex.
+ * @param[in] incomingBucketCount Number of buckets pointed to by
+ * @p pIncomingBuckets, with the same constraints as @p outgoingBucketCount.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed, or if there are
+ * more than 65535 records of a kind to index;<br>
+ * #MQTTSuccess otherwise.<br>
  *
  * <b>Example</b>
  * @code{c}
  *
- * // Function for obtaining a timestamp.
- * uint32_t getTimeStampMs();
- * // Callback function for receiving packets.
- * bool eventCallback(
- *      MQTTContext_t * pContext,
- *      MQTTPacketInfo_t * pPacketInfo,
- *      MQTTDeserializedInfo_t * pDeserializedInfo,
- *      MQTTSuccessFailReasonCode_t * pReasonCode,
- *      MQTTPropBuilder_t * pSendPropsBuffer,
- *      MQTTPropBuilder_t * pGetPropsBuffer
- * );
- * // Network send.
- * int32_t networkSend( NetworkContext_t * pContext, const void * pBuffer, size_t bytes );
- * // Network receive.
- * int32_t networkRecv( NetworkContext_t * pContext, void * pBuffer, size_t bytes );
- * // User defined callback used to store outgoing publishes
- * bool publishStoreCallback(struct MQTTContext* pContext,
- *                           uint16_t packetId,
- *                           MQTTVec_t* pIoVec);
- * // User defined callback used to retreive a copied publish for resend operation
- * bool publishRetrieveCallback(struct MQTTContext* pContext,
- *                              uint16_t packetId,
- *                              TransportOutVector_t** pIoVec,
- *                              size_t* ioVecCount);
- * // User defined callback used to clear a particular copied publish packet
- * bool publishClearCallback(struct MQTTContext* pContext,
- *                           uint16_t packetId);
- * // User defined callback used to clear all copied publish packets
- * bool publishClearAllCallback(struct MQTTContext* pContext);
+ * // Records and index buckets for 4096 outgoing publishes.
+ * MQTTPubAckInfo_t outgoingPublishes[ 4096 ];
+ * MQTTPubAckIndex_t outgoingIndex;
+ * uint16_t outgoingBuckets[ 8192 ];
  *
- * MQTTContext_t mqttContext;
- * TransportInterface_t transport;
- * MQTTFixedBuffer_t fixedBuffer;
- * uint8_t buffer[ 1024 ];
- * const size_t outgoingPublishCount = 30;
- * MQTTPubAckInfo_t outgoingPublishes[ outgoingPublishCount ];
+ * status = MQTT_InitStatefulQoS( &mqttContext,
+ *                                outgoingPublishes,
+ *                                4096,
+ *                                NULL,
+ *                                0,
+ *                                NULL,
+ *                                0 );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTT_InitStatefulQoSIndex( &mqttContext,
+ *                                          &outgoingIndex,
+ *                                          outgoingBuckets,
+ *                                          8192,
+ *                                          NULL,
+ *                                          NULL,
+ *                                          0 );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initstatefulqosindex] */
+MQTTStatus_t MQTT_InitStatefulQoSIndex( MQTTContext_t * pContext,
+                                        MQTTPubAckIndex_t * pOutgoingPublishIndex,
+                                        uint16_t * pOutgoingBuckets,
+                                        size_t outgoingBucketCount,
+                                        MQTTPubAckIndex_t * pIncomingPublishIndex,
+                                        uint16_t * pIncomingBuckets,
+                                        size_t incomingBucketCount );
+/* @[declare_mqtt_initstatefulqosindex] */
+
+/**
+ * @brief Track the packet IDs held by outgoing packets of an MQTT context.
+ *
+ * Without an allocator, #MQTT_GetPacketId increments a counter, and once the
+ * counter wraps around it can return the ID of a publish which is still
+ * waiting for its acknowledgement. With an allocator, #MQTT_GetPacketId only
+ * returns IDs which are free. An ID is held from the time it is handed out or
+ * used for a QoS > 0 publish until the publish is acknowledged, or for a
+ * SUBSCRIBE or UNSUBSCRIBE until its SUBACK or UNSUBACK is received.
+ *
+ * This function must be called after #MQTT_InitStatefulQoS when QoS > 0
+ * publishes are used. The IDs of existing outgoing publish records are held.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pBitmap Memory for the bitmap of held packet IDs.
+ * @param[in] bitmapWordCount Number of words pointed to by @p pBitmap, which
+ * must be at least #MQTT_PACKET_ID_BITMAP_WORDS.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // 8 KB of memory for the bitmap.
+ * uint32_t packetIdBitmap[ MQTT_PACKET_ID_BITMAP_WORDS ];
+ *
+ * status = MQTT_InitPacketIdAllocator( &mqttContext,
+ *                                      packetIdBitmap,
+ *                                      MQTT_PACKET_ID_BITMAP_WORDS );
+ * @endcode
+ */
+/* @[declare_mqtt_initpacketidallocator] */
+MQTTStatus_t MQTT_InitPacketIdAllocator( MQTTContext_t * pContext,
+                                         uint32_t * pBitmap,
+                                         size_t bitmapWordCount );
+/* @[declare_mqtt_initpacketidallocator] */
+
+/**
+ * @brief Let #MQTT_Publish assign topic aliases to the topics it publishes to.
+ *
+ * When a topic has an alias, #MQTT_Publish sends the alias instead of the
+ * topic name, which saves bandwidth when publishing repeatedly to long topics.
+ * The first publish to a topic sends both the topic name and a new alias. When
+ * all aliases are taken, the least recently used one is reassigned.
+ *
+ * The broker sets the number of aliases it accepts in the Topic Alias Maximum
+ * property of the CONNACK, so at most that many aliases are used. Aliases only
+ * last as long as a connection; the table is emptied by #MQTT_Connect.
+ *
+ * Topics are not aliased when:
+ * - the properties of the publish already contain a Topic Alias;
+ * - the topic name is longer than @p topicNameLength;
+ * - they are published with #MQTT_PublishBatch.
+ *
+ * A QoS > 0 publish that is stored by #MQTTStorePacketForRetransmit always
+ * contains its topic name, as it may be resent on a connection where its
+ * alias is not set.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pAliases Memory for the aliases.
+ * @param[in] aliasCount Number of entries in @p pAliases.
+ * @param[in] pTopicNames Memory for the topic names of the aliases, of at
+ * least @p aliasCount times @p topicNameLength bytes.
+ * @param[in] topicNameLength Longest topic name that is aliased.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Aliases for up to 64 topics of up to 128 bytes.
+ * MQTTTopicAlias_t topicAliases[ 64 ];
+ * char topicAliasNames[ 64 * 128 ];
+ *
+ * status = MQTT_InitOutgoingTopicAliases( &mqttContext,
+ *                                         topicAliases,
+ *                                         64,
+ *                                         topicAliasNames,
+ *                                         128 );
+ * @endcode
+ */
+/* @[declare_mqtt_initoutgoingtopicaliases] */
+MQTTStatus_t MQTT_InitOutgoingTopicAliases( MQTTContext_t * pContext,
+                                            MQTTTopicAlias_t * pAliases,
+                                            size_t aliasCount,
+                                            char * pTopicNames,
+                                            size_t topicNameLength );
+/* @[declare_mqtt_initoutgoingtopicaliases] */
+
+/**
+ * @brief Resolve the topic aliases of incoming PUBLISH packets, so that
+ * #MQTTEventCallback_t receives the topic name of every PUBLISH.
+ *
+ * When a PUBLISH contains a topic name and a Topic Alias, the topic name is
+ * kept for the alias. When a later PUBLISH contains only the alias, its topic
+ * name is set to the kept one, which stays valid until the callback returns.
+ * #MQTTPublishInfo_t.topicAlias holds the alias in both cases.
+ *
+ * The broker only uses aliases up to the Topic Alias Maximum property sent in
+ * the CONNECT, which #MQTT_Connect lowers to @p aliasCount if it is larger.
+ * Aliases only last as long as a connection; the table is emptied by
+ * #MQTT_Connect.
+ *
+ * A PUBLISH still reaches the callback without a topic name if its alias was
+ * set to a topic name longer than @p topicNameLength. A PUBLISH with an alias
+ * the broker never set is a protocol error: the connection is closed with a
+ * DISCONNECT with reason code Topic Alias invalid.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pAliases Memory for the aliases.
+ * @param[in] aliasCount Number of entries in @p pAliases.
+ * @param[in] pTopicNames Memory for the topic names of the aliases, of at
+ * least @p aliasCount times @p topicNameLength bytes.
+ * @param[in] topicNameLength Longest topic name that is kept.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Aliases for up to 32 topics of up to 128 bytes.
+ * MQTTTopicAlias_t topicAliases[ 32 ];
+ * char topicAliasNames[ 32 * 128 ];
+ *
+ * status = MQTT_InitIncomingTopicAliases( &mqttContext,
+ *                                         topicAliases,
+ *                                         32,
+ *                                         topicAliasNames,
+ *                                         128 );
+ *
+ * // Let the broker use all of them.
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTTPropAdd_TopicAliasMax( &connectPropertyBuilder, 32, NULL );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initincomingtopicaliases] */
+MQTTStatus_t MQTT_InitIncomingTopicAliases( MQTTContext_t * pContext,
+                                            MQTTTopicAlias_t * pAliases,
+                                            size_t aliasCount,
+                                            char * pTopicNames,
+                                            size_t topicNameLength );
+/* @[declare_mqtt_initincomingtopicaliases] */
+
+/**
+ * @brief Dispatch incoming PUBLISH packets to handlers by Subscription
+ * Identifier.
+ *
+ * Each handler registered with #MQTT_SubscribeWithHandler gets its own
+ * Subscription Identifier, which the broker sends back in every PUBLISH
+ * matching the subscription. The handler is then found by a table lookup
+ * instead of by matching the topic name against topic filters. Handlers are
+ * called before the #MQTTEventCallback_t of the context, which still receives
+ * every PUBLISH and sets the reason code of its acknowledgment.
+ *
+ * The handlers last across connections, as the subscriptions of a session do.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pHandlers Memory for the handlers.
+ * @param[in] handlerCount Number of entries in @p pHandlers, which is also
+ * the largest Subscription Identifier used.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Up to 16 subscriptions with their own handler.
+ * MQTTSubscriptionHandler_t subscriptionHandlers[ 16 ];
+ *
+ * status = MQTT_InitSubscriptionHandlers( &mqttContext,
+ *                                         subscriptionHandlers,
+ *                                         16 );
+ * @endcode
+ */
+/* @[declare_mqtt_initsubscriptionhandlers] */
+MQTTStatus_t MQTT_InitSubscriptionHandlers( MQTTContext_t * pContext,
+                                            MQTTSubscriptionHandler_t * pHandlers,
+                                            size_t handlerCount );
+/* @[declare_mqtt_initsubscriptionhandlers] */
+
+/**
+ * @brief Index the properties of incoming PUBLISH packets, so that
+ * #MQTT_FindProperty finds any of them in the properties passed to the
+ * #MQTTEventCallback_t with a single lookup.
+ *
+ * The index is filled while the properties are validated, and describes the
+ * properties of the PUBLISH being handled by the callback. The callback passes
+ * it to #MQTT_FindProperty with the properties it is given.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pIndex Memory for the index.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * MQTTPropIndex_t propertyIndex;
+ *
+ * status = MQTT_InitIncomingPropertyIndex( &mqttContext, &propertyIndex );
+ *
+ * // In the event callback, for an incoming PUBLISH.
+ * status = MQTT_FindProperty( pGetPropsBuffer, &propertyIndex,
+ *                             MQTT_RESPONSE_TOPIC_ID, &currentIndex );
+ * @endcode
+ */
+/* @[declare_mqtt_initincomingpropertyindex] */
+MQTTStatus_t MQTT_InitIncomingPropertyIndex( MQTTContext_t * pContext,
+                                             MQTTPropIndex_t * pIndex );
+/* @[declare_mqtt_initincomingpropertyindex] */
+
+/**
+ * @brief Decode the properties of incoming PUBLISH packets while they are
+ * validated, and pass them to the #MQTTEventCallback_t in
+ * #MQTTDeserializedInfo_t.pPublishProperties.
+ *
+ * The properties are then decoded once, instead of once to validate them and
+ * once more by the MQTTPropGet_* functions. The strings and data point into
+ * the network buffer, and stay valid until the callback returns.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] pProperties Memory for the decoded properties.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * MQTTPublishProperties_t publishProperties;
+ *
+ * status = MQTT_InitIncomingPublishProperties( &mqttContext, &publishProperties );
+ *
+ * // In the event callback, for an incoming PUBLISH.
+ * if( pDeserializedInfo->pPublishProperties->pResponseTopic != NULL )
+ * {
+ *      // Publish the response to the response topic.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initincomingpublishproperties] */
+MQTTStatus_t MQTT_InitIncomingPublishProperties( MQTTContext_t * pContext,
+                                                 MQTTPublishProperties_t * pProperties );
+/* @[declare_mqtt_initincomingpublishproperties] */
+
+/**
+ * @brief Initialize an MQTT context for publish retransmits for QoS > 0.
+ *
+ * This function must be called on an #MQTTContext_t after MQTT_InitstatefulQoS and before any other function.
+ *
+ * The callbacks may be implemented over the store of core_mqtt_retransmit_store.h,
+ * which keeps the packets in memory given by the application, such as a
+ * mapped file.
+ *
+ * @param[in] pContext The context to initialize.
+ * @param[in] storeFunction User defined API used to store outgoing publishes.
+ * @param[in] retrieveFunction User defined API used to retreive a copied publish for resend operation.
+ * @param[in] clearFunction User defined API used to clear a particular copied publish packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Function for obtaining a timestamp.
+ * uint32_t getTimeStampMs();
+ * // Callback function for receiving packets.
+ * bool eventCallback(
+ *      MQTTContext_t * pContext,
+ *      MQTTPacketInfo_t * pPacketInfo,
+ *      MQTTDeserializedInfo_t * pDeserializedInfo,
+ *      MQTTSuccessFailReasonCode_t * pReasonCode,
+ *      MQTTPropBuilder_t * pSendPropsBuffer,
+ *      MQTTPropBuilder_t * pGetPropsBuffer
+ * );
+ * // Network send.
+ * int32_t networkSend( NetworkContext_t * pContext, const void * pBuffer, size_t bytes );
+ * // Network receive.
+ * int32_t networkRecv( NetworkContext_t * pContext, void * pBuffer, size_t bytes );
+ * // User defined callback used to store outgoing publishes
+ * bool publishStoreCallback(struct MQTTContext* pContext,
+ *                           uint16_t packetId,
+ *                           MQTTVec_t* pIoVec);
+ * // User defined callback used to retreive a copied publish for resend operation
+ * bool publishRetrieveCallback(struct MQTTContext* pContext,
+ *                              uint16_t packetId,
+ *                              TransportOutVector_t** pIoVec,
+ *                              size_t* ioVecCount);
+ * // User defined callback used to clear a particular copied publish packet
+ * bool publishClearCallback(struct MQTTContext* pContext,
+ *                           uint16_t packetId);
+ * // User defined callback used to clear all copied publish packets
+ * bool publishClearAllCallback(struct MQTTContext* pContext);
+ *
+ * MQTTContext_t mqttContext;
+ * TransportInterface_t transport;
+ * MQTTFixedBuffer_t fixedBuffer;
+ * uint8_t buffer[ 1024 ];
+ * const size_t outgoingPublishCount = 30;
+ * MQTTPubAckInfo_t outgoingPublishes[ outgoingPublishCount ];
+ *
+ * // Clear context.
+ * memset( ( void * ) &mqttContext, 0x00, sizeof( MQTTContext_t ) );
+ *
+ * // Set transport interface members.
+ * transport.pNetworkContext = &someTransportContext;
+ * transport.send = networkSend;
+ * transport.recv = networkRecv;
+ * transport.writev = NULL;
+ *
+ * // Set buffer members.
+ * fixedBuffer.pBuffer = buffer;
+ * fixedBuffer.size = 1024;
+ *
+ * status = MQTT_Init( &mqttContext, &transport, getTimeStampMs, eventCallback, &fixedBuffer );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // We do not expect any incoming publishes in this example, therefore the incoming
+ *      // publish pointer is NULL and the count is zero.
+ *      uint8_t ackPropsBuf[ 500 ];
+ *      size_t ackPropsBufLength = sizeof( ackPropsBuf );
+ *      status = MQTT_InitStatefulQoS( &mqttContext, outgoingPublishes, outgoingPublishCount,
+ *                                     NULL, 0, ackPropsBuf, ackPropsBufLength );
+ *
+ *      // Now QoS1 and/or QoS2 publishes can be sent with this context.
+ * }
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTT_InitRetransmits( &mqttContext, publishStoreCallback,
+ *                                                   publishRetrieveCallback,
+ *                                                   publishClearCallback,
+ *                                                   publishClearAllCallback );
+ *
+ *      // Now unacked Publishes can be resent on an unclean session resumption.
+ * }
+ * @endcode
+ */
+
+/* @[declare_mqtt_initretransmits] */
+MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
+                                   MQTTStorePacketForRetransmit storeFunction,
+                                   MQTTRetrievePacketForRetransmit retrieveFunction,
+                                   MQTTClearPacketForRetransmit clearFunction );
+/* @[declare_mqtt_initretransmits] */
+
+/**
+ * @brief Resend stored packets in batches when a session is resumed.
+ *
+ * By default, #MQTT_Connect retrieves the PUBREL and PUBLISH packets to
+ * resend on a resumed session one by one, and sends each of them with its
+ * own transport write. Once this function is called, up to
+ * #MQTT_PUBLISH_BATCH_MAX_VECTORS packets are retrieved with one call of
+ * @p retrieveBatchFunction and sent with one transport write, which shortens
+ * reconnects with many unacknowledged publishes. The PUBREL packets are
+ * still sent before the PUBLISH packets, in the same order as before.
+ *
+ * This function must be called on an #MQTTContext_t after
+ * #MQTT_InitRetransmits and before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] retrieveBatchFunction User defined API used to retrieve several
+ * copied packets for resend operation.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // User defined callback used to retrieve several copied packets.
+ * bool publishRetrieveBatchCallback( struct MQTTContext * pContext,
+ *                                    const uint32_t * pHandles,
+ *                                    size_t handleCount,
+ *                                    TransportOutVector_t * pPackets );
+ *
+ * // This context is assumed to be initialized by MQTT_Init,
+ * // MQTT_InitStatefulQoS and MQTT_InitRetransmits.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitRetransmitBatch( &mqttContext, publishRetrieveBatchCallback );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Unacked publishes are now resent in batches on an unclean session
+ *      // resumption.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initretransmitbatch] */
+MQTTStatus_t MQTT_InitRetransmitBatch( MQTTContext_t * pContext,
+                                       MQTTRetrievePacketsForRetransmit retrieveBatchFunction );
+/* @[declare_mqtt_initretransmitbatch] */
+
+/**
+ * @brief Store publishes for retransmits without copying their payload.
+ *
+ * By default, the #MQTTStorePacketForRetransmit callback is given the whole
+ * PUBLISH and must copy it, payload included, as the packet is partly held
+ * in the stack of the library. Once this function is called, the PUBLISH
+ * packets sent with #MQTT_PublishByReference are given to
+ * @p storeReferenceFunction instead, which copies the bytes before the
+ * payload and keeps the payload by reference. This removes the copy of the
+ * payload for applications whose payloads already live in
+ * reference-counted buffers.
+ *
+ * On a resumed session, #MQTT_Connect then retrieves the PUBLISH packets
+ * with @p retrieveReferenceFunction and sends the parts of each with one
+ * transport write. The batches set up by #MQTT_InitRetransmitBatch are not
+ * used, as they hold one vector per packet. The PUBREL packets are still
+ * retrieved with the #MQTTRetrievePacketForRetransmit callback, and all
+ * packets are still cleared with the #MQTTClearPacketForRetransmit callback.
+ *
+ * This function must be called on an #MQTTContext_t after
+ * #MQTT_InitRetransmits.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] storeReferenceFunction User defined API used to store
+ * publishes whose payload is kept by reference.
+ * @param[in] retrieveReferenceFunction User defined API used to retrieve
+ * stored publishes in parts.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // User defined callbacks keeping payloads by reference.
+ * bool publishStoreByReference( struct MQTTContext * pContext,
+ *                               uint32_t handle,
+ *                               MQTTVec_t * pHeaderVec,
+ *                               const MQTTPublishInfo_t * pPublishInfo,
+ *                               const MQTTPayloadReference_t * pPayloadReference );
+ * bool publishRetrieveByReference( struct MQTTContext * pContext,
+ *                                  uint32_t handle,
+ *                                  TransportOutVector_t * pPacketVectors,
+ *                                  size_t * pVectorCount );
+ *
+ * // Callback of the application's reference-counted buffers.
+ * void bufferReference( void * pPayloadContext,
+ *                       bool retain );
+ *
+ * // This context is assumed to be initialized by MQTT_Init,
+ * // MQTT_InitStatefulQoS and MQTT_InitRetransmits.
+ * MQTTContext_t mqttContext;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * MQTTPayloadReference_t payloadReference = { 0 };
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitRetransmitReferences( &mqttContext,
+ *                                         publishStoreByReference,
+ *                                         publishRetrieveByReference );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      publishInfo.qos = MQTTQoS1;
+ *      publishInfo.pTopicName = "/some/topic/name";
+ *      publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ *      publishInfo.pPayload = pBuffer->pData;
+ *      publishInfo.payloadLength = pBuffer->length;
+ *      payloadReference.payloadReference = bufferReference;
+ *      payloadReference.pPayloadContext = pBuffer;
+ *
+ *      status = MQTT_PublishByReference( &mqttContext, &publishInfo,
+ *                                        MQTT_GetPacketId( &mqttContext ), NULL,
+ *                                        &payloadReference );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initretransmitreferences] */
+MQTTStatus_t MQTT_InitRetransmitReferences( MQTTContext_t * pContext,
+                                            MQTTStorePublishByReference storeReferenceFunction,
+                                            MQTTRetrievePublishByReference retrieveReferenceFunction );
+/* @[declare_mqtt_initretransmitreferences] */
+
+/**
+ * @brief Receive packets in place from buffers lent by the transport.
+ *
+ * By default, #MQTT_ProcessLoop and #MQTT_ReceiveLoop copy received data from
+ * the transport into the network buffer. Once this function is called, they
+ * borrow the transport's own receive buffer through @p recvLease instead,
+ * handle every complete packet directly from it, and hand it back through
+ * @p release before returning. Only packets spanning two lent buffers, or
+ * whose handling failed, are copied to the network buffer, and must fit in
+ * it. Ring receive mode and publish streaming do not apply in that case.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] recvLease Transport function lending received data.
+ * @param[in] release Transport function handing back the lent data.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Functions lending the decrypted records held by the TLS stack.
+ * int32_t tlsRecvLease( NetworkContext_t * pNetworkContext,
+ *                       void ** ppBuffer );
+ * void tlsRelease( NetworkContext_t * pNetworkContext,
+ *                  void * pBuffer );
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitRecvLease( &mqttContext, tlsRecvLease, tlsRelease );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Packets received by MQTT_ProcessLoop are now handled in the
+ *      // records of the TLS stack.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initrecvlease] */
+MQTTStatus_t MQTT_InitRecvLease( MQTTContext_t * pContext,
+                                 TransportRecvLease_t recvLease,
+                                 TransportRelease_t release );
+/* @[declare_mqtt_initrecvlease] */
+
+/**
+ * @brief Block until data can be received instead of polling the transport.
+ *
+ * By default, #MQTT_ProcessLoop returns immediately when the transport has
+ * nothing to receive, and the library polls the transport while waiting for
+ * the rest of a packet or for the CONNACK. Once this function is called, the
+ * library blocks in @p waitReadable instead:
+ * - #MQTT_ProcessLoop, when no received data or bytes kept by
+ *   #MQTT_InitNonBlockingSend are pending, waits for up to @p timeoutMs, or
+ *   less if the next keep alive action (sending a PINGREQ or detecting a
+ *   missing PINGRESP) is due sooner. Bytes kept by non-blocking sends made
+ *   meanwhile are sent once the wait returns.
+ * - The rest of a packet is waited for up to #MQTT_RECV_POLLING_TIMEOUT_MS.
+ * - The CONNACK is waited for up to the timeout passed to #MQTT_Connect.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] waitReadable Transport function waiting until data can be
+ * received.
+ * @param[in] timeoutMs Maximum time in milliseconds #MQTT_ProcessLoop waits
+ * for data.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Function polling the socket of the connection, see
+ * // TransportWaitReadable_t.
+ * int32_t networkWaitReadable( NetworkContext_t * pNetworkContext,
+ *                              uint32_t timeoutMs );
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitWaitReadable( &mqttContext, networkWaitReadable, 100U );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // MQTT_ProcessLoop now blocks for up to 100 ms when idle.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initwaitreadable] */
+MQTTStatus_t MQTT_InitWaitReadable( MQTTContext_t * pContext,
+                                    TransportWaitReadable_t waitReadable,
+                                    uint32_t timeoutMs );
+/* @[declare_mqtt_initwaitreadable] */
+
+/**
+ * @brief Enable ring receive mode on an MQTT context.
+ *
+ * By default, after each incoming packet is processed by #MQTT_ProcessLoop or
+ * #MQTT_ReceiveLoop, the unprocessed bytes in the network buffer are moved to
+ * the start of the buffer. When a single network read returns many small
+ * packets, the same bytes are therefore copied once per packet.
+ *
+ * In ring receive mode, processed packets are consumed by advancing a head
+ * offset and every packet is handed to the application in place. The
+ * unprocessed bytes are moved to the start of the buffer only when the packet
+ * at the head does not fit in the space left before the end of the buffer, so
+ * the copying cost does not depend on the number of packets read at once.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitRingReceive( &mqttContext );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Packets received by MQTT_ProcessLoop are now consumed in place.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initringreceive] */
+MQTTStatus_t MQTT_InitRingReceive( MQTTContext_t * pContext );
+/* @[declare_mqtt_initringreceive] */
+
+/**
+ * @brief Enable streaming reception of PUBLISH packets larger than the network
+ * buffer.
+ *
+ * By default, #MQTT_ProcessLoop and #MQTT_ReceiveLoop return #MQTTRecvFailed
+ * when an incoming packet does not fit in the network buffer. Once this
+ * function is called, the topic, properties and packet identifier of such a
+ * PUBLISH are parsed from the head of the packet, which is kept at the start
+ * of the network buffer, and its payload is handed to @p chunkCallback in
+ * pieces that fill the rest of the buffer. See #MQTTPublishChunkCallback_t.
+ * The state of the PUBLISH being received is kept in @p pPublishStream, which
+ * must remain valid as long as the context is used.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @note The fixed and variable headers of the PUBLISH must fit in the network
+ * buffer with at least one byte to spare, otherwise #MQTTRecvFailed is still
+ * returned.
+ *
+ * @note The broker only sends packets up to the Maximum Packet Size announced
+ * in the CONNECT packet. When no CONNECT properties are provided, it defaults
+ * to the size of the network buffer, so the application must add a larger
+ * #MQTTPropAdd_MaxPacketSize to make use of streaming.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishStream Memory for the state of the streamed PUBLISH.
+ * @param[in] chunkCallback Callback used to deliver payload pieces.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Callback writing a firmware image to flash as it is received.
+ * bool firmwareChunkCallback( MQTTContext_t * pContext,
+ *                             const MQTTPublishInfo_t * pPublishInfo,
+ *                             uint16_t packetId,
+ *                             size_t offset,
+ *                             const uint8_t * pChunk,
+ *                             size_t chunkLength );
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * // State of the PUBLISH being streamed, kept as long as the context.
+ * MQTTPublishStream_t publishStream;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitPublishStreaming( &mqttContext, &publishStream, firmwareChunkCallback );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Publishes larger than the network buffer are now streamed to
+ *      // firmwareChunkCallback by MQTT_ProcessLoop.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initpublishstreaming] */
+MQTTStatus_t MQTT_InitPublishStreaming( MQTTContext_t * pContext,
+                                        MQTTPublishStream_t * pPublishStream,
+                                        MQTTPublishChunkCallback_t chunkCallback );
+/* @[declare_mqtt_initpublishstreaming] */
+
+/**
+ * @brief Enable coalescing of the acks sent for incoming publishes.
+ *
+ * By default, every PUBACK, PUBREC and PUBCOMP without properties is sent
+ * with its own transport call as soon as the corresponding packet has been
+ * handled. Once this function is called, these acks are gathered in
+ * @p pAckBuffer while one call of #MQTT_ProcessLoop or #MQTT_ReceiveLoop
+ * processes the received data, and are sent together at the end of that call,
+ * or earlier when @p pAckBuffer is full. Acks with a reason code or properties
+ * are still sent immediately, after the acks gathered so far.
+ *
+ * The state of a publish is only updated once its ack has been sent, so a
+ * failure to send the gathered acks leaves the publishes in the same state as
+ * a failure to send a single ack.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pAckBuffer Buffer to gather the acks in. Must remain valid for
+ * the lifetime of the context.
+ * @param[in] ackBufferSize Size of @p pAckBuffer in bytes. It holds
+ * `ackBufferSize / MQTT_PUBLISH_ACK_PACKET_SIZE` acks and must hold at least
+ * one.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Room for 32 acks.
+ * uint8_t ackBuffer[ 32 * MQTT_PUBLISH_ACK_PACKET_SIZE ];
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitAckCoalescing( &mqttContext, ackBuffer, sizeof( ackBuffer ) );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // The acks for the publishes received in one MQTT_ProcessLoop call
+ *      // are now sent together.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initackcoalescing] */
+MQTTStatus_t MQTT_InitAckCoalescing( MQTTContext_t * pContext,
+                                     uint8_t * pAckBuffer,
+                                     size_t ackBufferSize );
+/* @[declare_mqtt_initackcoalescing] */
+
+/**
+ * @brief Enable non-blocking sends.
+ *
+ * By default, a packet which the transport does not accept at once is sent
+ * again until all of it is sent, or #MQTT_SEND_TIMEOUT_MS expires, blocking
+ * the caller and every other sender of the context. Once this function is
+ * called, when the transport send or writev function returns 0, the bytes of
+ * the packet not yet sent are copied into @p pBuffer and the packet is
+ * handled as sent. The functions sending it return #MQTTSuccess, and the
+ * state of QoS 1 and QoS 2 publishes is updated.
+ *
+ * Packets sent while bytes are kept are added behind them, so that packets
+ * are sent in order. #MQTT_ProcessLoop and #MQTT_FlushPending send the kept
+ * bytes when the transport accepts them.
+ *
+ * A packet whose unsent bytes do not fit in the free space of @p pBuffer is
+ * sent as without this function, after the bytes already kept. Bytes are
+ * only kept while the context is connected, so #MQTT_Disconnect sends the
+ * kept bytes before the DISCONNECT packet, and #MQTT_Connect drops the bytes
+ * of an earlier connection.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init and
+ * before #MQTT_Connect.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pBuffer Buffer to keep the unsent bytes in. Must remain valid
+ * for the lifetime of the context.
+ * @param[in] bufferSize Size of @p pBuffer in bytes.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Room for the largest packets sent by the application.
+ * uint8_t pendingBuffer[ 4096 ];
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitNonBlockingSend( &mqttContext, pendingBuffer, sizeof( pendingBuffer ) );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Publishing no longer waits for a congested socket. Call
+ *      // MQTT_FlushPending when the socket is writable.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_initnonblockingsend] */
+MQTTStatus_t MQTT_InitNonBlockingSend( MQTTContext_t * pContext,
+                                       uint8_t * pBuffer,
+                                       size_t bufferSize );
+/* @[declare_mqtt_initnonblockingsend] */
+
+/**
+ * @brief Send the bytes kept by non-blocking sends, as far as the transport
+ * accepts them without blocking.
  *
- * // Clear context.
- * memset( ( void * ) &mqttContext, 0x00, sizeof( MQTTContext_t ) );
+ * See #MQTT_InitNonBlockingSend. #MQTT_ProcessLoop also sends the kept bytes
+ * before receiving.
  *
- * // Set transport interface members.
- * transport.pNetworkContext = &someTransportContext;
- * transport.send = networkSend;
- * transport.recv = networkRecv;
- * transport.writev = NULL;
+ * @param[in] pContext Initialized MQTT context.
  *
- * // Set buffer members.
- * fixedBuffer.pBuffer = buffer;
- * fixedBuffer.size = 1024;
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSendFailed if the transport send function failed;<br>
+ * #MQTTSendWouldBlock if some bytes are still kept, in which case the
+ * function should be called again once the transport is writable;<br>
+ * #MQTTSuccess if no bytes are kept.<br>
  *
- * status = MQTT_Init( &mqttContext, &transport, getTimeStampMs, eventCallback, &fixedBuffer );
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // This context is assumed to be initialized, with non-blocking sends
+ * // enabled, and connected.
+ * MQTTContext_t * pContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_Publish( pContext, &publishInfo, packetId, NULL );
  *
  * if( status == MQTTSuccess )
  * {
- *      // We do not expect any incoming publishes in this example, therefore the incoming
- *      // publish pointer is NULL and the count is zero.
- *      uint8_t ackPropsBuf[ 500 ];
- *      size_t ackPropsBufLength = sizeof( ackPropsBuf );
- *      status = MQTT_InitStatefulQoS( &mqttContext, outgoingPublishes, outgoingPublishCount,
- *                                     NULL, 0, ackPropsBuf, ackPropsBufLength );
+ *      status = MQTT_FlushPending( pContext );
  *
- *      // Now QoS1 and/or QoS2 publishes can be sent with this context.
+ *      if( status == MQTTSendWouldBlock )
+ *      {
+ *          // Wait for the socket to be writable, then call
+ *          // MQTT_FlushPending again.
+ *      }
  * }
+ * @endcode
+ */
+/* @[declare_mqtt_flushpending] */
+MQTTStatus_t MQTT_FlushPending( MQTTContext_t * pContext );
+/* @[declare_mqtt_flushpending] */
+
+/**
+ * @brief Serialize SUBSCRIBE and UNSUBSCRIBE packets in a buffer before
+ * sending them.
+ *
+ * By default, #MQTT_Subscribe and #MQTT_Unsubscribe send the topic filters
+ * from the subscription list without copying them, with a transport write
+ * for every few topic filters (see #MQTT_SUB_UNSUB_MAX_VECTORS). Once this
+ * function is called, a packet which fits in @p pBuffer is serialized in it
+ * and sent with a single transport write, which is faster for long
+ * subscription lists, such as the ones subscribed again after a reconnect.
+ * Packets which do not fit are still sent from the subscription list.
+ *
+ * The size of a packet is given by #MQTT_GetSubscribePacketSize and
+ * #MQTT_GetUnsubscribePacketSize.
+ *
+ * This function must be called on an #MQTTContext_t after #MQTT_Init.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pBuffer Buffer to serialize the packets in. Must remain valid
+ * for the lifetime of the context.
+ * @param[in] bufferSize Size of @p pBuffer in bytes.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;
+ * #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Room for the SUBSCRIBE packet of every subscription of the application.
+ * uint8_t subscribeBuffer[ 16384 ];
+ *
+ * // This context is assumed to be initialized by MQTT_Init.
+ * MQTTContext_t mqttContext;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_InitSubscribeBuffer( &mqttContext, subscribeBuffer, sizeof( subscribeBuffer ) );
  *
  * if( status == MQTTSuccess )
  * {
- *      status = MQTT_InitRetransmits( &mqttContext, publishStoreCallback,
- *                                                   publishRetrieveCallback,
- *                                                   publishClearCallback,
- *                                                   publishClearAllCallback );
- *
- *      // Now unacked Publishes can be resent on an unclean session resumption.
+ *      // SUBSCRIBE and UNSUBSCRIBE packets up to 16384 bytes are now sent
+ *      // with one transport write.
  * }
  * @endcode
  */
-
-/* @[declare_mqtt_initretransmits] */
-MQTTStatus_t MQTT_InitRetransmits( MQTTContext_t * pContext,
-                                   MQTTStorePacketForRetransmit storeFunction,
-                                   MQTTRetrievePacketForRetransmit retrieveFunction,
-                                   MQTTClearPacketForRetransmit clearFunction );
-/* @[declare_mqtt_initretransmits] */
+/* @[declare_mqtt_initsubscribebuffer] */
+MQTTStatus_t MQTT_InitSubscribeBuffer( MQTTContext_t * pContext,
+                                       uint8_t * pBuffer,
+                                       size_t bufferSize );
+/* @[declare_mqtt_initsubscribebuffer] */
 
 /**
  * @brief Checks the MQTT connection status with the broker.
@@ -955,6 +2334,88 @@ MQTTStatus_t MQTT_Subscribe( MQTTContext_t * pContext,
 
 /* @[declare_mqtt_subscribe] */
 
+/**
+ * @brief Sends MQTT SUBSCRIBE for the given list of topic filters, with a
+ * handler for the PUBLISH packets they match.
+ *
+ * A free Subscription Identifier of the table set up by
+ * #MQTT_InitSubscriptionHandlers is added to the SUBSCRIBE, and the handler
+ * is registered for it unless the SUBSCRIBE cannot be sent. The handler stays
+ * registered until #MQTT_RemoveSubscriptionHandler is called, which should
+ * be done when the broker rejects the subscription or after unsubscribing.
+ *
+ * If sending fails after part of the SUBSCRIBE was written to the transport
+ * or kept to be sent later, the broker may still subscribe, so the handler
+ * is kept and @p pSubscriptionId is set. It is then unregistered by the
+ * library when the SUBACK of @p packetId is received or the next connection
+ * is established.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pSubscriptionList Array of MQTT subscription info.
+ * @param[in] subscriptionCount The number of elements in @p pSubscriptionList
+ * array.
+ * @param[in] packetId Packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the SUBSCRIBE, without
+ * a Subscription Identifier. May be NULL. The identifier is added to it for
+ * the time of the call, so it needs room for 5 more bytes.
+ * @param[in] callback The handler.
+ * @param[in] pUserData User data passed to the handler.
+ * @param[out] pSubscriptionId The Subscription Identifier of the handler.
+ * Set on success, and on failure if the handler is kept.
+ *
+ * @return #MQTTNoMemory if the table has no free Subscription Identifier or
+ * @p pPropertyBuilder has no room for it; otherwise the return values of
+ * #MQTT_Subscribe.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static void handleTemperature( MQTTContext_t * pContext,
+ *                                MQTTDeserializedInfo_t * pDeserializedInfo,
+ *                                void * pUserData )
+ * {
+ *      // Handle the temperature of a room.
+ * }
+ *
+ * uint32_t subscriptionId;
+ *
+ * subscription.qos = MQTTQoS1;
+ * subscription.pTopicFilter = "home/+/temperature";
+ * subscription.topicFilterLength = strlen( "home/+/temperature" );
+ *
+ * status = MQTT_SubscribeWithHandler( pContext, &subscription, 1,
+ *                                     MQTT_GetPacketId( pContext ), NULL,
+ *                                     handleTemperature, NULL,
+ *                                     &subscriptionId );
+ * @endcode
+ */
+/* @[declare_mqtt_subscribewithhandler] */
+MQTTStatus_t MQTT_SubscribeWithHandler( MQTTContext_t * pContext,
+                                        const MQTTSubscribeInfo_t * pSubscriptionList,
+                                        size_t subscriptionCount,
+                                        uint16_t packetId,
+                                        MQTTPropBuilder_t * pPropertyBuilder,
+                                        MQTTSubscriptionCallback_t callback,
+                                        void * pUserData,
+                                        uint32_t * pSubscriptionId );
+/* @[declare_mqtt_subscribewithhandler] */
+
+/**
+ * @brief Unregister a handler registered with #MQTT_SubscribeWithHandler,
+ * freeing its Subscription Identifier.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] subscriptionId The Subscription Identifier of the handler.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no handler
+ * is registered for @p subscriptionId;<br>
+ * #MQTTSuccess otherwise.<br>
+ */
+/* @[declare_mqtt_removesubscriptionhandler] */
+MQTTStatus_t MQTT_RemoveSubscriptionHandler( MQTTContext_t * pContext,
+                                             uint32_t subscriptionId );
+/* @[declare_mqtt_removesubscriptionhandler] */
+
 /**
  * @brief Publishes a message to the given topic name.
  *
@@ -1032,6 +2493,304 @@ MQTTStatus_t MQTT_Publish( MQTTContext_t * pContext,
                            const MQTTPropBuilder_t * pPropertyBuilder );
 /* @[declare_mqtt_publish] */
 
+/**
+ * @brief Publishes a batch of messages, writing as many PUBLISH packets as
+ * possible with each transport write.
+ *
+ * The packets are gathered into one IO vector of up to
+ * #MQTT_PUBLISH_BATCH_MAX_VECTORS entries, which is written with a single
+ * call to the transport writev function. Larger batches take several writes.
+ * The state of the QoS 1 and QoS 2 packets is reserved and updated while the
+ * #MQTT_PRE_STATE_UPDATE_HOOK is held once for the whole batch.
+ *
+ * Each packet is validated and sent as by #MQTT_Publish, and its result is
+ * written to @p pPublishStatus. A packet that fails validation does not stop
+ * the others. Once a transport write fails, the remaining packets are not
+ * sent and report #MQTTSendFailed.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo Array of @p publishCount MQTT PUBLISH packet
+ * parameters.
+ * @param[in] pPacketIds Array of @p publishCount packet IDs generated by
+ * #MQTT_GetPacketId. The IDs of QoS 0 packets are ignored. May be NULL if all
+ * packets are QoS 0.
+ * @param[in] pPropertyBuilders Array of @p publishCount properties to be sent
+ * in the outgoing packets, whose entries may be NULL. May be NULL if no packet
+ * has properties.
+ * @param[in] publishCount Number of packets in the batch.
+ * @param[out] pPublishStatus Array of @p publishCount results, one for each
+ * packet, with the same values as returned by #MQTT_Publish.
+ *
+ * @return
+ * #MQTTBadParameter if @p pContext, @p pPublishInfo or @p pPublishStatus is
+ * NULL or @p publishCount is 0, in which case @p pPublishStatus is not
+ * written;<br>
+ * #MQTTSuccess if all packets were sent;<br>
+ * the result of the first packet that was not sent otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo[ 2 ] = { 0 };
+ * uint16_t packetIds[ 2 ];
+ * MQTTStatus_t publishStatus[ 2 ];
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo[ 0 ].qos = MQTTQoS1;
+ * publishInfo[ 0 ].pTopicName = "/some/topic/name";
+ * publishInfo[ 0 ].topicNameLength = strlen( publishInfo[ 0 ].pTopicName );
+ * publishInfo[ 0 ].pPayload = "Hello World!";
+ * publishInfo[ 0 ].payloadLength = strlen( "Hello World!" );
+ * packetIds[ 0 ] = MQTT_GetPacketId( pContext );
+ *
+ * publishInfo[ 1 ] = publishInfo[ 0 ];
+ * publishInfo[ 1 ].qos = MQTTQoS0;
+ *
+ * status = MQTT_PublishBatch( pContext, publishInfo, packetIds, NULL, 2, publishStatus );
+ *
+ * if( status != MQTTSuccess )
+ * {
+ *      // Check publishStatus to find out which packets were not sent.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_publishbatch] */
+MQTTStatus_t MQTT_PublishBatch( MQTTContext_t * pContext,
+                                const MQTTPublishInfo_t * pPublishInfo,
+                                const uint16_t * pPacketIds,
+                                const MQTTPropBuilder_t * const * pPropertyBuilders,
+                                size_t publishCount,
+                                MQTTStatus_t * pPublishStatus );
+/* @[declare_mqtt_publishbatch] */
+
+/**
+ * @brief Publishes a message whose payload is split across several buffers.
+ *
+ * The packet is sent as by #MQTT_Publish, except that the payload is taken
+ * from @p pPayloadSegments instead of the pPayload member of @p pPublishInfo,
+ * which is ignored. The segments are written in order with the rest of the
+ * packet in a single call to the transport writev function, so the payload is
+ * never copied into one buffer. For QoS 1 and QoS 2 packets, the
+ * #MQTTStorePacketForRetransmit callback receives the same segments in its
+ * #MQTTVec_t.
+ *
+ * @note The segment descriptors are copied, and may be reused once this
+ * function returns. The payload they point to must stay valid until then.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters. Its payloadLength
+ * must be the total length of the segments.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pPayloadSegments Array of @p payloadSegmentCount payload segments.
+ * Segments of length 0 are skipped.
+ * @param[in] payloadSegmentCount Number of payload segments, from 1 to
+ * #MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS.
+ *
+ * @return
+ * #MQTTBadParameter if the segments are invalid or their total length is not
+ * the payloadLength of @p pPublishInfo;<br>
+ * the same values as #MQTT_Publish otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * TransportOutVector_t payloadSegments[ 2 ];
+ * uint16_t packetId;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * // The payload is a header and a body held in separate buffers.
+ * payloadSegments[ 0 ].iov_base = pReadingHeader;
+ * payloadSegments[ 0 ].iov_len = readingHeaderLength;
+ * payloadSegments[ 1 ].iov_base = pReadings;
+ * payloadSegments[ 1 ].iov_len = readingsLength;
+ *
+ * publishInfo.qos = MQTTQoS1;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ * publishInfo.payloadLength = readingHeaderLength + readingsLength;
+ *
+ * // Packet ID is needed for QoS > 0.
+ * packetId = MQTT_GetPacketId( pContext );
+ *
+ * status = MQTT_PublishSegmented( pContext, &publishInfo, packetId, NULL,
+ *                                 payloadSegments, 2 );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // Both buffers may now be reused.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_publishsegmented] */
+MQTTStatus_t MQTT_PublishSegmented( MQTTContext_t * pContext,
+                                    const MQTTPublishInfo_t * pPublishInfo,
+                                    uint16_t packetId,
+                                    const MQTTPropBuilder_t * pPropertyBuilder,
+                                    const TransportOutVector_t * pPayloadSegments,
+                                    size_t payloadSegmentCount );
+/* @[declare_mqtt_publishsegmented] */
+
+/**
+ * @brief Publishes a message whose payload a retransmit store keeps by
+ * reference instead of copying it.
+ *
+ * The packet is sent as by #MQTT_Publish. On a context initialized with
+ * #MQTT_InitRetransmitReferences, a QoS 1 or QoS 2 packet is stored with the
+ * #MQTTStorePublishByReference callback, which keeps the payload of
+ * @p pPublishInfo valid through @p pPayloadReference instead of copying it.
+ * Otherwise, the packet is stored with the #MQTTStorePacketForRetransmit
+ * callback, and @p pPayloadReference is not used.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packet.
+ * @param[in] pPayloadReference The callback keeping the payload valid, and
+ * its context. It is copied by the store, and may be reused once this
+ * function returns.
+ *
+ * @return
+ * #MQTTBadParameter if @p pPayloadReference or its callback is NULL;<br>
+ * the same values as #MQTT_Publish otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Callback of the application's reference-counted buffers.
+ * void bufferReference( void * pPayloadContext,
+ *                       bool retain );
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * MQTTPayloadReference_t payloadReference = { 0 };
+ * // This context is assumed to be initialized by MQTT_InitRetransmitReferences
+ * // and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS1;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ * publishInfo.pPayload = pBuffer->pData;
+ * publishInfo.payloadLength = pBuffer->length;
+ *
+ * payloadReference.payloadReference = bufferReference;
+ * payloadReference.pPayloadContext = pBuffer;
+ *
+ * status = MQTT_PublishByReference( pContext, &publishInfo,
+ *                                   MQTT_GetPacketId( pContext ), NULL,
+ *                                   &payloadReference );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // The store holds a reference to pBuffer until the packet is
+ *      // acknowledged.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_publishbyreference] */
+MQTTStatus_t MQTT_PublishByReference( MQTTContext_t * pContext,
+                                      const MQTTPublishInfo_t * pPublishInfo,
+                                      uint16_t packetId,
+                                      const MQTTPropBuilder_t * pPropertyBuilder,
+                                      const MQTTPayloadReference_t * pPayloadReference );
+/* @[declare_mqtt_publishbyreference] */
+
+/**
+ * @brief Prepares a template for publishing many messages to the same topic
+ * with the same properties.
+ *
+ * The topic name and properties are validated, and the parts of the PUBLISH
+ * packet which do not depend on the payload are serialized once, so that
+ * #MQTT_PublishPrepared only encodes the remaining length and the packet ID.
+ *
+ * The pPayload and payloadLength members of @p pPublishInfo are ignored.
+ * Topic aliases are not assigned automatically to prepared packets, but a
+ * Topic Alias set in @p pPropertyBuilder is sent.
+ *
+ * @note The template points to the topic name of @p pPublishInfo and to the
+ * buffer of @p pPropertyBuilder, which must not change while it is used.
+ * The template remains valid across connections, as #MQTT_PublishPrepared
+ * checks it against the properties of the current connection.
+ *
+ * @param[in] pContext Initialized MQTT context, whose connection the packet
+ * is validated against.
+ * @param[in] pPublishInfo MQTT PUBLISH packet parameters.
+ * @param[in] pPropertyBuilder Properties to be sent in the outgoing packets.
+ * @param[out] pTemplate The prepared template.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * MQTTPublishTemplate_t publishTemplate;
+ * // This context is assumed to be initialized and connected.
+ * MQTTContext_t * pContext;
+ *
+ * publishInfo.qos = MQTTQoS0;
+ * publishInfo.pTopicName = "/some/topic/name";
+ * publishInfo.topicNameLength = strlen( publishInfo.pTopicName );
+ *
+ * status = MQTT_PreparePublish( pContext, &publishInfo, NULL, &publishTemplate );
+ *
+ * while( status == MQTTSuccess )
+ * {
+ *      // Read a sensor into the buffer of the payload.
+ *      readingLength = readSensor( readingBuffer, sizeof( readingBuffer ) );
+ *
+ *      status = MQTT_PublishPrepared( pContext, &publishTemplate,
+ *                                     readingBuffer, readingLength, 0 );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_preparepublish] */
+MQTTStatus_t MQTT_PreparePublish( const MQTTContext_t * pContext,
+                                  const MQTTPublishInfo_t * pPublishInfo,
+                                  const MQTTPropBuilder_t * pPropertyBuilder,
+                                  MQTTPublishTemplate_t * pTemplate );
+/* @[declare_mqtt_preparepublish] */
+
+/**
+ * @brief Publishes a message from a template prepared by
+ * #MQTT_PreparePublish.
+ *
+ * The packet is sent as by #MQTT_Publish, including its storage for
+ * retransmission, without validating or serializing the topic name and
+ * properties again. The packet is only checked against the properties of the
+ * current connection.
+ *
+ * @param[in] pContext Initialized MQTT context.
+ * @param[in] pTemplate Template prepared by #MQTT_PreparePublish.
+ * @param[in] pPayload The payload of the message.
+ * @param[in] payloadLength Length of @p pPayload.
+ * @param[in] packetId packet ID generated by #MQTT_GetPacketId. Ignored for
+ * QoS 0 templates.
+ *
+ * @return The same values as #MQTT_Publish.
+ *
+ * See #MQTT_PreparePublish for an example.
+ */
+/* @[declare_mqtt_publishprepared] */
+MQTTStatus_t MQTT_PublishPrepared( MQTTContext_t * pContext,
+                                   const MQTTPublishTemplate_t * pTemplate,
+                                   const void * pPayload,
+                                   size_t payloadLength,
+                                   uint16_t packetId );
+/* @[declare_mqtt_publishprepared] */
+
 /**
  * @brief Cancels an outgoing publish callback (only for QoS > QoS0) by
  * removing it from the pending ACK list.
@@ -1219,6 +2978,18 @@ MQTTStatus_t MQTT_Disconnect( MQTTContext_t * pContext,
  * #MQTTEventCallback_t callback does not contain blocking operations to prevent potential
  * non-deterministic blocking period of the #MQTT_ProcessLoop API call.
  *
+ * @note If lent receive buffers are enabled by #MQTT_InitRecvLease, packets
+ * are handled directly in the buffers lent by the transport, which are
+ * handed back once the #MQTTEventCallback_t returns. Only packets spanning two
+ * lent buffers are copied to the network buffer, and must fit in it. Ring
+ * receive mode and publish streaming do not apply in that case.
+ *
+ * @note If waiting for data is enabled by #MQTT_InitWaitReadable and no
+ * received data is pending, this function first blocks until data arrives,
+ * the timeout given to #MQTT_InitWaitReadable expires or the next keep alive
+ * action (sending a PINGREQ or detecting a missing PINGRESP) is due, instead
+ * of returning immediately when there is nothing to receive.
+ *
  * @return #MQTTSuccess on success;
  * #MQTTNeedMoreBytes if an incomplete packet has been received. The caller
  * should call this function again (probably after a delay) to receive the
@@ -1288,6 +3059,8 @@ MQTTStatus_t MQTT_ProcessLoop( MQTTContext_t * pContext );
  * #MQTTEventCallback_t callback does not contain blocking operations to prevent potential
  * non-deterministic blocking period of the #MQTT_ReceiveLoop API call.
  *
+ * @note See #MQTT_ProcessLoop for the handling of transport lent buffers.
+ *
  * @return #MQTTSuccess on success;
  * #MQTTNeedMoreBytes if an incomplete packet has been received. The caller
  * should call this function again (probably after a delay) to receive the
@@ -1348,14 +3121,40 @@ MQTTStatus_t MQTT_ReceiveLoop( MQTTContext_t * pContext );
 /**
  * @brief Get a packet ID that is valid according to the MQTT 5.0 spec.
  *
+ * Packet IDs are handed out in sequence. If a packet ID allocator was set up
+ * with #MQTT_InitPacketIdAllocator, IDs still held by outgoing packets are
+ * skipped, and the returned ID is held until it is released.
+ *
  * @param[in] pContext Initialized MQTT context.
  *
- * @return A non-zero packet ID, or zero if @p pContext is NULL.
+ * @return A non-zero packet ID, or zero if @p pContext is NULL or if all
+ * packet IDs are held.
  */
 /* @[declare_mqtt_getpacketid] */
 uint16_t MQTT_GetPacketId( MQTTContext_t * pContext );
 /* @[declare_mqtt_getpacketid] */
 
+/**
+ * @brief Release a packet ID handed out by the packet ID allocator.
+ *
+ * The library releases the packet ID of a QoS > 0 publish when the publish is
+ * acknowledged or its state record is removed, and the packet ID of a
+ * SUBSCRIBE or UNSUBSCRIBE when its SUBACK or UNSUBACK is received. This
+ * function releases a packet ID that the application obtained from
+ * #MQTT_GetPacketId but did not use in a packet that was sent.
+ *
+ * @param[in] pContext Initialized MQTT context with a packet ID allocator.
+ * @param[in] packetId The packet ID to release.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or
+ * @p pContext has no packet ID allocator;<br>
+ * #MQTTSuccess otherwise.
+ */
+/* @[declare_mqtt_releasepacketid] */
+MQTTStatus_t MQTT_ReleasePacketId( MQTTContext_t * pContext,
+                                   uint16_t packetId );
+/* @[declare_mqtt_releasepacketid] */
+
 /**
  * @brief A utility function that determines whether the passed topic filter and
  * topic name match according to the MQTT 5.0 protocol specification.
@@ -1406,6 +3205,90 @@ MQTTStatus_t MQTT_MatchTopic( const char * pTopicName,
                               const size_t topicFilterLength,
                               bool * pIsMatch );
 
+/**
+ * @brief Split a topic filter into levels, to be matched with
+ * #MQTT_MatchCompiledTopic.
+ *
+ * Matching a compiled topic filter compares whole literal levels, without
+ * validating the topic filter or looking for its wildcards again. This is
+ * meant for topic filters matched against many topic names.
+ *
+ * The compiled topic filter keeps pointers into the topic filter, which must
+ * therefore stay valid while the compiled topic filter is used.
+ *
+ * @param[in] pTopicFilter The topic filter to compile.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] pLevels Memory for the levels of the topic filter.
+ * @param[in] levelCount Number of entries in @p pLevels.
+ * @param[out] pCompiledFilter The compiled topic filter.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or the topic
+ * filter is invalid, such as with a wildcard sharing its level with other
+ * characters or a '#' which is not the last level;<br>
+ * #MQTTNoMemory if the topic filter has more than @p levelCount levels;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * const char * pFilter = "home/+/temperature";
+ * MQTTTopicFilterLevel_t levels[ 8 ];
+ * MQTTCompiledTopicFilter_t compiledFilter;
+ * MQTTStatus_t status;
+ *
+ * status = MQTT_CompileTopicFilter( pFilter, strlen( pFilter ), levels, 8, &compiledFilter );
+ * @endcode
+ */
+/* @[declare_mqtt_compiletopicfilter] */
+MQTTStatus_t MQTT_CompileTopicFilter( const char * pTopicFilter,
+                                      size_t topicFilterLength,
+                                      MQTTTopicFilterLevel_t * pLevels,
+                                      size_t levelCount,
+                                      MQTTCompiledTopicFilter_t * pCompiledFilter );
+/* @[declare_mqtt_compiletopicfilter] */
+
+/**
+ * @brief Match a topic name with a topic filter compiled by
+ * #MQTT_CompileTopicFilter.
+ *
+ * The result is the same as that of #MQTT_MatchTopic with the topic filter,
+ * except for two cases where this function follows the MQTT specification
+ * instead: a '+' followed by a final '#' also matches the topic names ending
+ * at the level of the '+', such as "sport/tennis" for "sport/+/#", and a '+'
+ * in the last level also matches an empty last level, such as "a/" for "+/+".
+ *
+ * @param[in] pTopicName The topic name to check.
+ * @param[in] topicNameLength Length of the topic name.
+ * @param[in] pCompiledFilter The compiled topic filter.
+ * @param[out] pIsMatch Whether the topic name matches the topic filter. Only
+ * set when #MQTTSuccess is returned.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * const char * pTopic = "home/kitchen/temperature";
+ * bool match = false;
+ *
+ * status = MQTT_MatchCompiledTopic( pTopic, strlen( pTopic ), &compiledFilter, &match );
+ *
+ * if( ( status == MQTTSuccess ) && match )
+ * {
+ *      // Handle the kitchen temperature.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_matchcompiledtopic] */
+MQTTStatus_t MQTT_MatchCompiledTopic( const char * pTopicName,
+                                      size_t topicNameLength,
+                                      const MQTTCompiledTopicFilter_t * pCompiledFilter,
+                                      bool * pIsMatch );
+/* @[declare_mqtt_matchcompiledtopic] */
+
 /**
  * @brief Parses the payload of an MQTT SUBACK packet that contains status codes
  * corresponding to topic filter subscription requests from the original
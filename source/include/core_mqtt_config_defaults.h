@@ -76,6 +76,40 @@
     #define MQTT_SUB_UNSUB_MAX_VECTORS    ( 4U )
 #endif
 
+/**
+ * @ingroup mqtt_constants
+ * @brief Maximum number of vectors written with one transport write by
+ * #MQTT_PublishBatch, and when resending stored packets retrieved by a
+ * #MQTTRetrievePacketsForRetransmit callback.
+ *
+ * A PUBLISH packet takes up to 6 vectors, and a stored packet takes one. The
+ * vectors are kept on the stack, and the transport writev function must
+ * accept this many of them (see IOV_MAX for POSIX writev).
+ *
+ * <b>Possible values:</b> Any integer of at least 6. <br>
+ * <b>Default value:</b> `24`
+ */
+#ifndef MQTT_PUBLISH_BATCH_MAX_VECTORS
+    #define MQTT_PUBLISH_BATCH_MAX_VECTORS    ( 24U )
+#endif
+
+/**
+ * @ingroup mqtt_constants
+ * @brief Maximum number of payload segments of a PUBLISH packet sent with
+ * #MQTT_PublishSegmented.
+ *
+ * A vector is used for each segment, in addition to the 5 vectors of the rest
+ * of the packet. The vectors are kept on the stack of #MQTT_Publish and
+ * #MQTT_PublishSegmented, and the transport writev function must accept this
+ * many of them plus 5 (see IOV_MAX for POSIX writev).
+ *
+ * <b>Possible values:</b> Any positive integer. <br>
+ * <b>Default value:</b> `8`
+ */
+#ifndef MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS
+    #define MQTT_PUBLISH_MAX_PAYLOAD_SEGMENTS    ( 8U )
+#endif
+
 /**
  * @brief The number of retries for receiving CONNACK.
  *
@@ -195,6 +229,56 @@
     #error MQTT_SEND_RETRY_TIMEOUT_MS is deprecated. Instead use MQTT_SEND_TIMEOUT_MS.
 #endif
 
+/**
+ * @brief The number of branches #MQTT_RouterDispatch can keep pending while
+ * it walks over the levels of a topic name.
+ *
+ * A branch is left pending at a level when the router has both a topic
+ * filter continuing with that level and one continuing with '+'. At most one
+ * branch is pending per level of the topic name, so topic names with no more
+ * levels than this value are always routed completely. The branches are kept
+ * on the stack of #MQTT_RouterDispatch.
+ *
+ * <b>Possible values:</b> Any positive integer up to 65535. <br>
+ * <b>Default value:</b> `16`
+ */
+#ifndef MQTT_ROUTER_MAX_TOPIC_LEVELS
+    #define MQTT_ROUTER_MAX_TOPIC_LEVELS    ( 16U )
+#endif
+
+/**
+ * @brief Check that topic names and string properties are well-formed UTF-8.
+ *
+ * The MQTT specification requires UTF-8 encoded strings to be well-formed and
+ * to not contain the null character U+0000. When this config is enabled, the
+ * topic name of incoming PUBLISH packets and the string properties of incoming
+ * packets are checked when they are deserialized, as are the strings given to
+ * the MQTTPropAdd_* functions. Binary data, such as the correlation data, is
+ * not checked.
+ *
+ * <b>Possible values:</b> `0` (no check) or `1` (check). <br>
+ * <b>Default value:</b> `0`
+ */
+#ifndef MQTT_VALIDATE_UTF8
+    #define MQTT_VALIDATE_UTF8    ( 0 )
+#endif
+
+/**
+ * @brief Use vector instructions to skip over blocks of ASCII characters when
+ * checking UTF-8 strings.
+ *
+ * When enabled, AVX2 or SSE2 on x86 and NEON on AArch64 are used if the
+ * compiler targets them, checking 32 or 16 characters at a time. Other
+ * targets, or a value of `0`, check the strings one character at a time.
+ * This config only matters when #MQTT_VALIDATE_UTF8 is enabled.
+ *
+ * <b>Possible values:</b> `0` (never use vector instructions) or `1`. <br>
+ * <b>Default value:</b> `1`
+ */
+#ifndef MQTT_UTF8_VALIDATION_SIMD
+    #define MQTT_UTF8_VALIDATION_SIMD    ( 1 )
+#endif
+
 /**
  * @brief Macro that is called in the MQTT library for logging "Error" level
  * messages.
@@ -0,0 +1,404 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_retransmit_store.h
+ * @brief A store of the packets kept for retransmission, written as an
+ * append-only log into memory given by the application.
+ */
+#ifndef CORE_MQTT_RETRANSMIT_STORE_H
+#define CORE_MQTT_RETRANSMIT_STORE_H
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+#include "core_mqtt.h"
+
+/**
+ * @brief Size of the header written before each packet in the log of an
+ * #MQTTRetransmitStore_t.
+ */
+#define MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE    ( 20U )
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief An entry of the index of an #MQTTRetransmitStore_t, giving the
+ * position of the packet stored for a handle.
+ */
+typedef struct MQTTRetransmitStoreEntry
+{
+    uint32_t handle; /**< @brief The handle of the packet, or 0 if the entry is free. */
+    size_t offset;   /**< @brief Position of the record of the packet in the memory of the store. */
+} MQTTRetransmitStoreEntry_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Bookkeeping of a segment of the log of an #MQTTRetransmitStore_t.
+ */
+typedef struct MQTTRetransmitStoreSegment
+{
+    size_t used; /**< @brief Number of bytes written in the segment. */
+    size_t live; /**< @brief Number of bytes of the records not cleared. */
+} MQTTRetransmitStoreSegment_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Store of packets kept for retransmission, set up by
+ * #MQTT_RetransmitStoreInit or #MQTT_RetransmitStoreRecover.
+ *
+ * The memory of the store is split into segments of equal size, each holding
+ * a log of records. A record is a header followed by the packet, and is
+ * never moved once written: a cleared packet is only marked as such in its
+ * header. When no segment has room for a packet, the live records of the
+ * segment with the fewest live bytes are copied into a free segment, which
+ * frees the former. One segment is therefore always kept free.
+ *
+ * The position of the record of each handle is found through an open
+ * addressing hash table, whose entries hold the handle, with zero marking a
+ * free entry.
+ */
+typedef struct MQTTRetransmitStore
+{
+    uint8_t * pMemory;                        /**< @brief The log. */
+    size_t segmentSize;                       /**< @brief Size of each segment of the log. */
+    MQTTRetransmitStoreSegment_t * pSegments; /**< @brief The bookkeeping of the segments. */
+    size_t segmentCount;                      /**< @brief Number of segments of the log. */
+    size_t currentSegment;                    /**< @brief The segment records are appended to. */
+    MQTTRetransmitStoreEntry_t * pEntries;    /**< @brief The hash table of the stored handles. */
+    size_t entryCount;                        /**< @brief Number of entries, a power of 2. */
+    size_t entriesUsed;                       /**< @brief Number of stored handles. */
+    uint32_t nextSequence;                    /**< @brief Sequence number of the next stored packet. */
+} MQTTRetransmitStore_t;
+
+/**
+ * @brief Initialize an empty store of packets kept for retransmission.
+ *
+ * The store keeps the packets given to the #MQTTStorePacketForRetransmit
+ * callback of a context in a log written into @p pMemory, and hands them back
+ * to the #MQTTRetrievePacketForRetransmit and
+ * #MQTTRetrievePacketsForRetransmit callbacks without copying them. Storing
+ * a packet copies it once, straight into the log, and takes no memory from
+ * the heap.
+ *
+ * When @p pMemory is a shared memory mapping of a file, the packets outlive
+ * the process and are found again by #MQTT_RetransmitStoreRecover. The
+ * library does not map, flush or synchronize the memory itself; doing so is
+ * left to the application.
+ *
+ * Any content of @p pMemory is discarded.
+ *
+ * @param[out] pStore The store to initialize.
+ * @param[in] pMemory Memory for the log.
+ * @param[in] memorySize Size of @p pMemory. It is split into
+ * @p segmentCount segments, each of which must hold the largest packet
+ * stored, plus #MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE bytes, and be no
+ * larger than 4 GB.
+ * @param[in] pSegments Memory for the bookkeeping of the segments.
+ * @param[in] segmentCount Number of entries in @p pSegments, at least 2.
+ * @param[in] pEntries Memory for the index of the stored handles.
+ * @param[in] entryCount Number of entries in @p pEntries, a power of 2
+ * larger than the number of packets stored at once.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // A store of up to 255 packets in a 1 MB file, in 8 segments.
+ * MQTTRetransmitStore_t store;
+ * MQTTRetransmitStoreSegment_t storeSegments[ 8 ];
+ * MQTTRetransmitStoreEntry_t storeEntries[ 256 ];
+ * int fd = open( "retransmit.log", O_RDWR | O_CREAT, 0600 );
+ * uint8_t * pLog;
+ *
+ * ( void ) ftruncate( fd, 1024 * 1024 );
+ * pLog = mmap( NULL, 1024 * 1024, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+ *
+ * status = MQTT_RetransmitStoreInit( &store,
+ *                                    pLog,
+ *                                    1024 * 1024,
+ *                                    storeSegments,
+ *                                    8,
+ *                                    storeEntries,
+ *                                    256 );
+ * @endcode
+ */
+/* @[declare_mqtt_retransmitstoreinit] */
+MQTTStatus_t MQTT_RetransmitStoreInit( MQTTRetransmitStore_t * pStore,
+                                       uint8_t * pMemory,
+                                       size_t memorySize,
+                                       MQTTRetransmitStoreSegment_t * pSegments,
+                                       size_t segmentCount,
+                                       MQTTRetransmitStoreEntry_t * pEntries,
+                                       size_t entryCount );
+/* @[declare_mqtt_retransmitstoreinit] */
+
+/**
+ * @brief Initialize a store of packets kept for retransmission from the log
+ * left in its memory by a previous store.
+ *
+ * The segments of the log are read up to their first incomplete or corrupted
+ * record, so a store whose process stopped while writing a record loses at
+ * most that record. When two records hold the same handle, the most recent
+ * one is kept. A compaction which the process did not complete is undone, so
+ * that a segment is again free for the next one.
+ *
+ * The parameters are those of #MQTT_RetransmitStoreInit, and @p memorySize
+ * and @p segmentCount must be those of the store which wrote the log.
+ *
+ * @param[out] pStore The store to initialize.
+ * @param[in] pMemory The log.
+ * @param[in] memorySize Size of @p pMemory.
+ * @param[in] pSegments Memory for the bookkeeping of the segments.
+ * @param[in] segmentCount Number of entries in @p pSegments, at least 2.
+ * @param[in] pEntries Memory for the index of the stored handles.
+ * @param[in] entryCount Number of entries in @p pEntries, a power of 2.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTNoMemory if the log holds more packets than @p pEntries can index;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // On startup, find the packets stored before the process stopped, and
+ * // the publishes they belong to.
+ * status = MQTT_RetransmitStoreRecover( &store,
+ *                                       pLog,
+ *                                       1024 * 1024,
+ *                                       storeSegments,
+ *                                       8,
+ *                                       storeEntries,
+ *                                       256 );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTT_RetransmitStoreRestoreRecords( &store,
+ *                                                   outgoingPublishRecords,
+ *                                                   OUTGOING_PUBLISH_RECORD_COUNT,
+ *                                                   incomingPublishRecords,
+ *                                                   INCOMING_PUBLISH_RECORD_COUNT );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_retransmitstorerecover] */
+MQTTStatus_t MQTT_RetransmitStoreRecover( MQTTRetransmitStore_t * pStore,
+                                          uint8_t * pMemory,
+                                          size_t memorySize,
+                                          MQTTRetransmitStoreSegment_t * pSegments,
+                                          size_t segmentCount,
+                                          MQTTRetransmitStoreEntry_t * pEntries,
+                                          size_t entryCount );
+/* @[declare_mqtt_retransmitstorerecover] */
+
+/**
+ * @brief Store a packet for retransmission.
+ *
+ * The packet is serialized with #MQTT_SerializeMQTTVec straight into the log.
+ * A packet already stored for the handle is replaced. This function is meant
+ * to be called from the #MQTTStorePacketForRetransmit callback of a context.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[in] handle The handle given to the callback. Must not be 0.
+ * @param[in] pMqttVec The packet given to the callback.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or the packet
+ * does not fit in a segment;<br>
+ * #MQTTNoMemory if the store has no room left for the packet;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static bool storePacket( MQTTContext_t * pContext,
+ *                          uint32_t handle,
+ *                          MQTTVec_t * pMqttVec )
+ * {
+ *      return MQTT_RetransmitStoreAppend( &store, handle, pMqttVec ) == MQTTSuccess;
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_retransmitstoreappend] */
+MQTTStatus_t MQTT_RetransmitStoreAppend( MQTTRetransmitStore_t * pStore,
+                                         uint32_t handle,
+                                         const MQTTVec_t * pMqttVec );
+/* @[declare_mqtt_retransmitstoreappend] */
+
+/**
+ * @brief Find a packet stored for retransmission.
+ *
+ * The packet is not copied: @p ppPacket points into the log, and stays valid
+ * until the next call to #MQTT_RetransmitStoreAppend or
+ * #MQTT_RetransmitStoreCompact. This function is meant to be called from the
+ * #MQTTRetrievePacketForRetransmit callback of a context.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[in] handle The handle given to the callback.
+ * @param[out] ppPacket The stored packet.
+ * @param[out] pPacketLength Length of the stored packet.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no packet is
+ * stored for the handle;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static bool retrievePacket( MQTTContext_t * pContext,
+ *                             uint32_t handle,
+ *                             uint8_t ** pSerializedMqttVec,
+ *                             size_t * pSerializedMqttVecLen )
+ * {
+ *      return MQTT_RetransmitStoreRetrieve( &store,
+ *                                           handle,
+ *                                           pSerializedMqttVec,
+ *                                           pSerializedMqttVecLen ) == MQTTSuccess;
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_retransmitstoreretrieve] */
+MQTTStatus_t MQTT_RetransmitStoreRetrieve( const MQTTRetransmitStore_t * pStore,
+                                           uint32_t handle,
+                                           uint8_t ** ppPacket,
+                                           size_t * pPacketLength );
+/* @[declare_mqtt_retransmitstoreretrieve] */
+
+/**
+ * @brief Find several packets stored for retransmission.
+ *
+ * This is #MQTT_RetransmitStoreRetrieve for each handle, meant to be called
+ * from the #MQTTRetrievePacketsForRetransmit callback of a context.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[in] pHandles The handles given to the callback.
+ * @param[in] handleCount Number of handles.
+ * @param[out] pPackets The stored packets, one for each handle.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no packet is
+ * stored for one of the handles;<br>
+ * #MQTTSuccess otherwise.<br>
+ */
+/* @[declare_mqtt_retransmitstoreretrievebatch] */
+MQTTStatus_t MQTT_RetransmitStoreRetrieveBatch( const MQTTRetransmitStore_t * pStore,
+                                                const uint32_t * pHandles,
+                                                size_t handleCount,
+                                                TransportOutVector_t * pPackets );
+/* @[declare_mqtt_retransmitstoreretrievebatch] */
+
+/**
+ * @brief Remove a packet stored for retransmission.
+ *
+ * The record of the packet is marked as cleared in the log. Its room is
+ * taken back when no record of its segment is left, or when the segment is
+ * compacted. This function is meant to be called from the
+ * #MQTTClearPacketForRetransmit callback of a context.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[in] handle The handle given to the callback.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or no packet is
+ * stored for the handle;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static void clearPacket( MQTTContext_t * pContext,
+ *                          uint32_t handle )
+ * {
+ *      ( void ) MQTT_RetransmitStoreClear( &store, handle );
+ * }
+ *
+ * status = MQTT_InitRetransmits( &context, storePacket, retrievePacket, clearPacket );
+ * @endcode
+ */
+/* @[declare_mqtt_retransmitstoreclear] */
+MQTTStatus_t MQTT_RetransmitStoreClear( MQTTRetransmitStore_t * pStore,
+                                        uint32_t handle );
+/* @[declare_mqtt_retransmitstoreclear] */
+
+/**
+ * @brief Compact the segment of the log with the most cleared bytes.
+ *
+ * #MQTT_RetransmitStoreAppend compacts a segment when it finds no room for a
+ * packet. Calling this function while the application is idle moves that
+ * work off the publish path. A segment is compacted only when doing so takes
+ * back room.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[out] pCompacted Whether a segment was compacted. May be NULL.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ */
+/* @[declare_mqtt_retransmitstorecompact] */
+MQTTStatus_t MQTT_RetransmitStoreCompact( MQTTRetransmitStore_t * pStore,
+                                          bool * pCompacted );
+/* @[declare_mqtt_retransmitstorecompact] */
+
+/**
+ * @brief Fill the state records of a context from the packets of a recovered
+ * store.
+ *
+ * The state records of a context are not kept across restarts, while the
+ * packets of the store are. This function writes, in the order the packets
+ * were first stored, a record for each of them:
+ * - a PUBLISH gives an outgoing record awaiting its PUBACK or PUBREC;
+ * - a PUBREL gives an outgoing record awaiting its PUBCOMP;
+ * - a PUBREC gives an incoming record awaiting its PUBREL.
+ *
+ * It is meant to be called before #MQTT_InitStatefulQoS is given the records,
+ * and before #MQTT_Connect resumes the session.
+ *
+ * @param[in] pStore Initialized store.
+ * @param[out] pOutgoingPublishRecords The outgoing records to fill. Any
+ * previous content is discarded.
+ * @param[in] outgoingPublishCount Number of outgoing records.
+ * @param[out] pIncomingPublishRecords The incoming records to fill. Any
+ * previous content is discarded. May be NULL if @p incomingPublishCount is 0.
+ * @param[in] incomingPublishCount Number of incoming records.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTNoMemory if the store holds more packets than there are records;<br>
+ * #MQTTSuccess otherwise.<br>
+ */
+/* @[declare_mqtt_retransmitstorerestorerecords] */
+MQTTStatus_t MQTT_RetransmitStoreRestoreRecords( const MQTTRetransmitStore_t * pStore,
+                                                 MQTTPubAckInfo_t * pOutgoingPublishRecords,
+                                                 size_t outgoingPublishCount,
+                                                 MQTTPubAckInfo_t * pIncomingPublishRecords,
+                                                 size_t incomingPublishCount );
+/* @[declare_mqtt_retransmitstorerestorerecords] */
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef CORE_MQTT_RETRANSMIT_STORE_H */
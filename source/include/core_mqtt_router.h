@@ -0,0 +1,291 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_router.h
+ * @brief Routing of incoming PUBLISH packets to handlers registered per topic
+ * filter.
+ */
+#ifndef CORE_MQTT_ROUTER_H
+#define CORE_MQTT_ROUTER_H
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    extern "C" {
+#endif
+/* *INDENT-ON* */
+
+#include "core_mqtt.h"
+
+/**
+ * @ingroup mqtt_callback_types
+ * @brief Handler of the incoming PUBLISH packets matching a topic filter,
+ * registered with #MQTT_RouterAdd.
+ *
+ * @param[in] pContext The MQTT context passed to #MQTT_RouterDispatch.
+ * @param[in] pDeserializedInfo The incoming PUBLISH passed to
+ * #MQTT_RouterDispatch.
+ * @param[in] pUserData The user data registered with the handler.
+ */
+typedef void (* MQTTRouteCallback_t )( MQTTContext_t * pContext,
+                                       MQTTDeserializedInfo_t * pDeserializedInfo,
+                                       void * pUserData );
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A topic filter level in the trie of an #MQTTRouter_t.
+ *
+ * Node 0 is the root, so a child index of 0 means there is no such child.
+ * The level itself is kept in the level buffer of the router. A free node
+ * links to the next free node through its parent.
+ */
+typedef struct MQTTRouterNode
+{
+    uint16_t levelLength; /**< @brief Length of the level. */
+    uint16_t parent;      /**< @brief Index of the parent node, or of the next free node. */
+    uint16_t plusChild;   /**< @brief Index of the '+' child node, or 0. */
+    uint16_t hashChild;   /**< @brief Index of the '#' child node, or 0. */
+    uint16_t childCount;  /**< @brief Number of children, including the '+' and '#' children. */
+    uint16_t firstRoute;  /**< @brief Position plus one of the first route ending at the node, or 0. */
+} MQTTRouterNode_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief A handler registered with #MQTT_RouterAdd.
+ */
+typedef struct MQTTRoute
+{
+    MQTTRouteCallback_t callback; /**< @brief The handler, or NULL if the route is free. */
+    void * pUserData;             /**< @brief User data passed to the handler. */
+    uint16_t nextRoute;           /**< @brief Position plus one of the next route of the node, or 0. */
+} MQTTRoute_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Trie of topic filters, set up by #MQTT_RouterInit.
+ *
+ * The levels of the topic filters are the nodes of the trie. The literal
+ * children of all nodes are found through an open addressing hash table
+ * keyed by parent and level, whose buckets hold the node index, with zero
+ * marking a free bucket.
+ */
+typedef struct MQTTRouter
+{
+    MQTTRouterNode_t * pNodes; /**< @brief The nodes of the trie. */
+    size_t nodeCount;          /**< @brief Number of nodes pointed to by #MQTTRouter_t.pNodes. */
+    size_t nodesUsed;          /**< @brief Number of nodes taken from #MQTTRouter_t.pNodes so far. */
+    uint16_t freeNode;         /**< @brief Index of the first free node taken before, or 0. */
+    char * pLevels;            /**< @brief The levels of the nodes, #MQTTRouter_t.levelLength bytes each. */
+    size_t levelLength;        /**< @brief Longest level kept. */
+    uint16_t * pBuckets;       /**< @brief The hash table buckets. */
+    size_t bucketCount;        /**< @brief Number of buckets, a power of 2 larger than the number of nodes. */
+    MQTTRoute_t * pRoutes;     /**< @brief The registered handlers. */
+    size_t routeCount;         /**< @brief Number of routes pointed to by #MQTTRouter_t.pRoutes. */
+    uint16_t freeRoute;        /**< @brief Position plus one of the first free route, or 0. */
+} MQTTRouter_t;
+
+/**
+ * @brief Initialize a router of incoming PUBLISH packets.
+ *
+ * A router finds the handlers of all topic filters matching a topic name in
+ * a single walk over the levels of the topic name, whatever the number of
+ * topic filters. Its memory is given by the application.
+ *
+ * @param[out] pRouter The router to initialize.
+ * @param[in] pNodes Memory for the levels of the topic filters.
+ * @param[in] nodeCount Number of entries in @p pNodes, at most 65535. A
+ * topic filter takes one node per level which it does not share with another
+ * topic filter, and one node is taken by the router.
+ * @param[in] pLevels Memory for the levels of the topic filters, of at least
+ * @p nodeCount times @p levelLength bytes.
+ * @param[in] levelLength Longest level of a topic filter, at most 65535.
+ * @param[in] pBuckets Memory for the hash table of the levels.
+ * @param[in] bucketCount Number of entries in @p pBuckets, a power of 2
+ * larger than @p nodeCount.
+ * @param[in] pRoutes Memory for the handlers.
+ * @param[in] routeCount Number of entries in @p pRoutes, at most 65535.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // A router for up to 64 topic filters of up to 4 levels of up to 16
+ * // bytes each.
+ * MQTTRouter_t router;
+ * MQTTRouterNode_t routerNodes[ 257 ];
+ * char routerLevels[ 257 * 16 ];
+ * uint16_t routerBuckets[ 512 ];
+ * MQTTRoute_t routes[ 64 ];
+ *
+ * status = MQTT_RouterInit( &router,
+ *                           routerNodes,
+ *                           257,
+ *                           routerLevels,
+ *                           16,
+ *                           routerBuckets,
+ *                           512,
+ *                           routes,
+ *                           64 );
+ * @endcode
+ */
+/* @[declare_mqtt_routerinit] */
+MQTTStatus_t MQTT_RouterInit( MQTTRouter_t * pRouter,
+                              MQTTRouterNode_t * pNodes,
+                              size_t nodeCount,
+                              char * pLevels,
+                              size_t levelLength,
+                              uint16_t * pBuckets,
+                              size_t bucketCount,
+                              MQTTRoute_t * pRoutes,
+                              size_t routeCount );
+/* @[declare_mqtt_routerinit] */
+
+/**
+ * @brief Register a handler for the incoming PUBLISH packets matching a topic
+ * filter.
+ *
+ * The topic filter may contain the wildcards '+' and '#', and may be a shared
+ * subscription starting with "$share/". Its levels are copied into the
+ * router, so it need not stay valid after the call.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] pTopicFilter The topic filter.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback The handler.
+ * @param[in] pUserData User data passed to the handler.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed, the topic
+ * filter is invalid, or one of its levels is longer than the router
+ * keeps;<br>
+ * #MQTTNoMemory if the router has no free route or node left;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static void handleTemperature( MQTTContext_t * pContext,
+ *                                MQTTDeserializedInfo_t * pDeserializedInfo,
+ *                                void * pUserData )
+ * {
+ *      // Handle the temperature of a room.
+ * }
+ *
+ * status = MQTT_RouterAdd( &router,
+ *                          "home/+/temperature",
+ *                          strlen( "home/+/temperature" ),
+ *                          handleTemperature,
+ *                          NULL );
+ * @endcode
+ */
+/* @[declare_mqtt_routeradd] */
+MQTTStatus_t MQTT_RouterAdd( MQTTRouter_t * pRouter,
+                             const char * pTopicFilter,
+                             size_t topicFilterLength,
+                             MQTTRouteCallback_t callback,
+                             void * pUserData );
+/* @[declare_mqtt_routeradd] */
+
+/**
+ * @brief Unregister a handler registered with #MQTT_RouterAdd.
+ *
+ * The levels of the topic filter which no other topic filter uses are freed.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] pTopicFilter The topic filter of the handler.
+ * @param[in] topicFilterLength Length of the topic filter.
+ * @param[in] callback The handler.
+ * @param[in] pUserData User data registered with the handler.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or the handler
+ * is not registered for the topic filter;<br>
+ * #MQTTSuccess otherwise.<br>
+ */
+/* @[declare_mqtt_routerremove] */
+MQTTStatus_t MQTT_RouterRemove( MQTTRouter_t * pRouter,
+                                const char * pTopicFilter,
+                                size_t topicFilterLength,
+                                MQTTRouteCallback_t callback,
+                                const void * pUserData );
+/* @[declare_mqtt_routerremove] */
+
+/**
+ * @brief Call the handlers of all topic filters matching the topic name of
+ * an incoming PUBLISH.
+ *
+ * This function is meant to be called from the #MQTTEventCallback_t of the
+ * context. The handlers are called in no particular order, and must not add
+ * or remove handlers of the router.
+ *
+ * As with #MQTT_MatchTopic, a topic name starting with '$' is not matched by
+ * topic filters starting with a wildcard.
+ *
+ * @param[in] pRouter Initialized router.
+ * @param[in] pContext The MQTT context passed to the handlers.
+ * @param[in] pDeserializedInfo The incoming PUBLISH.
+ * @param[out] pMatchCount Number of handlers called. May be NULL.
+ *
+ * @return #MQTTBadParameter if invalid parameters are passed or the PUBLISH
+ * has no topic name;<br>
+ * #MQTTNoMemory if the walk over the topic levels needed more than
+ * #MQTT_ROUTER_MAX_TOPIC_LEVELS pending branches, in which case some
+ * handlers may not have been called;<br>
+ * #MQTTSuccess otherwise.<br>
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * static bool eventCallback( MQTTContext_t * pContext,
+ *                            MQTTPacketInfo_t * pPacketInfo,
+ *                            MQTTDeserializedInfo_t * pDeserializedInfo,
+ *                            MQTTSuccessFailReasonCode_t * pReasonCode,
+ *                            MQTTPropBuilder_t * pSendPropsBuffer,
+ *                            MQTTPropBuilder_t * pGetPropsBuffer )
+ * {
+ *      size_t matchCount;
+ *
+ *      if( ( pPacketInfo->type & 0xF0U ) == MQTT_PACKET_TYPE_PUBLISH )
+ *      {
+ *          ( void ) MQTT_RouterDispatch( &router, pContext, pDeserializedInfo, &matchCount );
+ *      }
+ *
+ *      return true;
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_routerdispatch] */
+MQTTStatus_t MQTT_RouterDispatch( const MQTTRouter_t * pRouter,
+                                  MQTTContext_t * pContext,
+                                  MQTTDeserializedInfo_t * pDeserializedInfo,
+                                  size_t * pMatchCount );
+/* @[declare_mqtt_routerdispatch] */
+
+/* *INDENT-OFF* */
+#ifdef __cplusplus
+    }
+#endif
+/* *INDENT-ON* */
+
+#endif /* ifndef CORE_MQTT_ROUTER_H */
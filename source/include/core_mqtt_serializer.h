@@ -107,6 +107,13 @@ static const uint8_t MQTT_PACKET_TYPE_DISCONNECT_VAL  = ( uint8_t ) 0xE0U;  /**<
  */
 #define MQTT_PUBLISH_ACK_PACKET_SIZE    ( 4UL )
 
+/**
+ * @ingroup mqtt_constants
+ * @brief The maximum size of an MQTT fixed header: one byte of packet type and
+ * flags followed by up to four bytes of remaining length, per MQTT spec.
+ */
+#define MQTT_FIXED_HEADER_MAX_SIZE      ( 5UL )
+
 #define MQTT_SUBSCRIBE_QOS1                    ( 0U ) /**< @brief MQTT SUBSCRIBE QoS1 flag. */
 #define MQTT_SUBSCRIBE_QOS2                    ( 1U ) /**< @brief MQTT SUBSCRIBE QoS2 flag. */
 #define MQTT_SUBSCRIBE_NO_LOCAL                ( 2U ) /**< @brief MQTT SUBSCRIBE no local flag. */
@@ -258,6 +265,12 @@ static const uint8_t MQTT_PACKET_TYPE_DISCONNECT_VAL  = ( uint8_t ) 0xE0U;  /**<
 */
 #define MQTT_SUBSCRIPTION_ID_ID          ( 0x0BU )
 
+/**
+ * @brief Number of entries of #MQTTPropIndex_t.offsets, one per property
+ * identifier up to the largest one, #MQTT_SHARED_SUB_ID.
+ */
+#define MQTT_PROPERTY_INDEX_LENGTH       ( 0x2BU )
+
 /* Structures defined in this file. */
 struct MQTTFixedBuffer;
 struct MQTTConnectInfo;
@@ -293,7 +306,9 @@ typedef enum MQTTStatus
                                     has failed. */
     MQTTPublishRetrieveFailed,       /**< User provided API to retrieve the copy of a publish while reconnecting
                                     with an unclean session has failed. */
-    MQTTEventCallbackFailed         /**< Error in the user provided event callback function. */
+    MQTTEventCallbackFailed,        /**< Error in the user provided event callback function. */
+    MQTTSendWouldBlock              /**< Bytes kept by a non-blocking send could not be sent yet, see
+                                    #MQTT_InitNonBlockingSend. */
 } MQTTStatus_t;
 
 /**
@@ -421,6 +436,30 @@ typedef struct MQTTSubscribeInfo
 
 } MQTTSubscribeInfo_t;
 
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Properties of a received PUBLISH packet, decoded by
+ * #MQTT_DeserializePublishWithProperties or
+ * #MQTT_DeserializePublishPropertiesInto.
+ *
+ * The strings and data point into the received packet. The Topic Alias and
+ * Subscription Identifiers are in #MQTTPublishInfo_t.
+ */
+typedef struct MQTTPublishProperties
+{
+    bool payloadFormatPresent;      /**< @brief Whether the PUBLISH has a Payload Format Indicator. */
+    uint8_t payloadFormat;          /**< @brief Payload Format Indicator: 1 for a UTF-8 payload, 0 otherwise. */
+    bool messageExpiryPresent;      /**< @brief Whether the PUBLISH has a Message Expiry Interval. */
+    uint32_t messageExpiryInterval; /**< @brief Message Expiry Interval in seconds. */
+    const char * pContentType;      /**< @brief Content Type, or NULL if the PUBLISH has none. */
+    size_t contentTypeLength;       /**< @brief Length of the Content Type. */
+    const char * pResponseTopic;    /**< @brief Response Topic, or NULL if the PUBLISH has none. */
+    size_t responseTopicLength;     /**< @brief Length of the Response Topic. */
+    const char * pCorrelationData;  /**< @brief Correlation Data, or NULL if the PUBLISH has none. */
+    size_t correlationDataLength;   /**< @brief Length of the Correlation Data. */
+    size_t userPropertyCount;       /**< @brief Number of User Properties, read with #MQTTPropGet_UserProp. */
+} MQTTPublishProperties_t;
+
 /**
  * @ingroup mqtt_struct_types
  * @brief MQTT PUBLISH packet parameters.
@@ -467,6 +506,30 @@ typedef struct MQTTPublishInfo
      */
     size_t propertyLength;
 
+    /**
+     * @brief Topic Alias of a received PUBLISH, or 0 if it has none.
+     *
+     * Set by #MQTT_DeserializePublish. It is not sent; outgoing topic aliases
+     * are set with #MQTTPropAdd_TopicAlias.
+     */
+    uint16_t topicAlias;
+
+    /**
+     * @brief First Subscription Identifier of a received PUBLISH, or 0 if it
+     * has none.
+     *
+     * Set by #MQTT_DeserializePublish. It is not sent.
+     */
+    uint32_t subscriptionId;
+
+    /**
+     * @brief Number of Subscription Identifiers of a received PUBLISH.
+     *
+     * Set by #MQTT_DeserializePublish. A PUBLISH matching several
+     * subscriptions may carry one identifier per subscription.
+     */
+    size_t subscriptionIdCount;
+
 } MQTTPublishInfo_t;
 
 /**
@@ -496,6 +559,34 @@ typedef struct MQTTPacketInfo
     size_t headerLength;
 } MQTTPacketInfo_t;
 
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Positions of the properties of a received packet, letting
+ * #MQTT_FindProperty find a property without decoding the ones before it.
+ *
+ * An index is filled by #MQTT_DeserializePublishWithProperties, in the same walk
+ * which validates the properties, and is passed to #MQTT_FindProperty with
+ * the property builder filled by the same call.
+ */
+typedef struct MQTTPropIndex
+{
+    const uint8_t * pBuffer;                        /**< @brief Properties the index was filled from. */
+    size_t length;                                  /**< @brief Length of the properties the index was filled from. */
+    uint32_t offsets[ MQTT_PROPERTY_INDEX_LENGTH ]; /**< @brief Position plus one of the first property of each identifier, or 0. */
+} MQTTPropIndex_t;
+
+/**
+ * @ingroup mqtt_struct_types
+ * @brief Result of validating a property builder with #MQTTPropertyBuilder_Seal.
+ */
+typedef struct MQTTPropBuilderSeal
+{
+    uint8_t packetType;  /**< @brief Packet type the properties were validated for, or 0 if not sealed. */
+    size_t length;       /**< @brief Length of the properties when sealed. */
+    uint32_t fieldSet;   /**< @brief Properties added to the builder when sealed. */
+    uint16_t topicAlias; /**< @brief Topic Alias in sealed PUBLISH properties, or 0. */
+} MQTTPropBuilderSeal_t;
+
 /**
  * @ingroup mqtt_struct_types
  * @brief Property builder for MQTT packets.
@@ -506,6 +597,7 @@ typedef struct MQTTPropBuilder
     size_t bufferLength;         /**< @brief Total length of the buffer available for properties. */
     size_t currentIndex;       /**< @brief Current position in the buffer where next property will be written. */
     uint32_t fieldSet;           /**< @brief Bitfield tracking which properties have been added. */
+    MQTTPropBuilderSeal_t seal;  /**< @brief Cached validation of the properties, set by #MQTTPropertyBuilder_Seal. */
 } MQTTPropBuilder_t;
 
  /**
@@ -1706,7 +1798,7 @@ MQTTStatus_t MQTT_SerializePingreq( const MQTTFixedBuffer_t * pFixedBuffer );
  * MQTTStatus_t status;
  * MQTTPacketInfo_t incomingPacket;
  * MQTTPublishInfo_t publishInfo = { 0 };
- * MQTTPropBuilder_t propBuffer ;
+ * MQTTPropBuilder_t propBuffer = { 0 };
  * uint16_t packetId;
  * uint32_t maxPacketSize = pContext->connectionProperties.maxPacketSize;
  * uint16_t topicAliasMax = pContext->connectionProperties.topicAliasMax;
@@ -1751,6 +1843,72 @@ MQTTStatus_t MQTT_DeserializePublish( const MQTTPacketInfo_t * pIncomingPacket,
                                       uint16_t topicAliasMax );
 /* @[declare_mqtt_deserializepublish] */
 
+/**
+ * @brief Deserialize an MQTT PUBLISH packet, with optional outputs describing
+ * its properties.
+ *
+ * This is #MQTT_DeserializePublish, also filling the outputs which are not
+ * NULL in the walk which validates the properties. #MQTT_DeserializePublish
+ * is this function with every optional output NULL; use this one only when
+ * one of the outputs is wanted.
+ *
+ * - @p pPropIndex is filled with the positions of the properties, and is then
+ *   passed to #MQTT_FindProperty along with @p propBuffer.
+ * - @p pProperties is filled with the decoded properties, so that they are
+ *   decoded once instead of once to validate them and once more by the
+ *   MQTTPropGet_* functions.
+ *
+ * @param[in] pIncomingPacket #MQTTPacketInfo_t containing the buffer.
+ * @param[out] pPacketId The packet ID obtained from the buffer.
+ * @param[out] pPublishInfo Struct containing information about the publish.
+ * @param[in] propBuffer Buffer to hold the properties.
+ * @param[out] pPropIndex The index of the properties, or NULL.
+ * @param[out] pProperties The decoded properties, or NULL.
+ * @param[in] maxPacketSize Maximum packet size.
+ * @param[in] topicAliasMax Maximum topic alias specified in the CONNECT packet.
+ *
+ * @return
+ * - #MQTTBadParameter if invalid parameters are passed
+ * - #MQTTBadResponse if invalid packet is read
+ * - #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishInfo_t publishInfo = { 0 };
+ * MQTTPropBuilder_t propBuffer;
+ * MQTTPropIndex_t propIndex;
+ * MQTTPublishProperties_t publishProperties;
+ * size_t currentIndex = 0;
+ * uint16_t packetId;
+ *
+ * // The incoming packet is read as for MQTT_DeserializePublish.
+ * status = MQTT_DeserializePublishWithProperties( &incomingPacket, &packetId, &publishInfo,
+ *                                                 &propBuffer, &propIndex, &publishProperties,
+ *                                                 maxPacketSize, topicAliasMax );
+ *
+ * if( ( status == MQTTSuccess ) && ( publishProperties.pResponseTopic != NULL ) )
+ * {
+ *      // Publish the response to publishProperties.pResponseTopic, with the
+ *      // Correlation Data found through the index.
+ *      status = MQTT_FindProperty( &propBuffer, &propIndex,
+ *                                  MQTT_CORRELATION_DATA_ID, &currentIndex );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_deserializepublishwithproperties] */
+MQTTStatus_t MQTT_DeserializePublishWithProperties( const MQTTPacketInfo_t * pIncomingPacket,
+                                                    uint16_t * pPacketId,
+                                                    MQTTPublishInfo_t * pPublishInfo,
+                                                    MQTTPropBuilder_t * propBuffer,
+                                                    MQTTPropIndex_t * pPropIndex,
+                                                    MQTTPublishProperties_t * pProperties,
+                                                    uint32_t maxPacketSize,
+                                                    uint16_t topicAliasMax );
+/* @[declare_mqtt_deserializepublishwithproperties] */
+
 /**
  * @brief Deserialize an MQTT PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK, UNSUBACK, or PINGRESP.
  *
@@ -1887,6 +2045,80 @@ MQTTStatus_t MQTT_GetIncomingPacketTypeAndLength( TransportRecv_t readFunc,
                                                   MQTTPacketInfo_t * pIncomingPacket );
 /* @[declare_mqtt_getincomingpackettypeandlength] */
 
+/**
+ * @brief Get the packet type and length of an incoming packet by reading
+ * ahead into a staging buffer.
+ *
+ * Unlike #MQTT_GetIncomingPacketTypeAndLength, which reads the fixed header
+ * one byte at a time, this function requests as many bytes as fit in
+ * @p pStagingBuffer from the transport, so a complete fixed header normally
+ * takes a single call to @p readFunc.
+ *
+ * Any bytes read beyond the fixed header are returned in the staging buffer:
+ * on success, the fixed header occupies the first
+ * #MQTTPacketInfo_t.headerLength bytes of @p pStagingBuffer and the
+ * following `*pStagedBytes - headerLength` bytes are the first bytes of the
+ * packet's remaining data (or, for a packet shorter than the staging buffer,
+ * of the packets after it). The caller owns these bytes and must consume them
+ * before reading further from the transport.
+ *
+ * @param[in] readFunc Transport layer read function pointer.
+ * @param[in] pNetworkContext The network context pointer provided by the application.
+ * @param[in] pStagingBuffer Buffer to read the fixed header into. Must be at
+ * least #MQTT_FIXED_HEADER_MAX_SIZE bytes.
+ * @param[in] stagingBufferSize Size of @p pStagingBuffer.
+ * @param[in,out] pStagedBytes Number of bytes already present at the start of
+ * @p pStagingBuffer on input, which are parsed before reading (pass 0 for a new
+ * packet). Updated with the number of valid bytes in the staging buffer on
+ * return.
+ * @param[out] pIncomingPacket Pointer to MQTTPacketInfo_t structure. This is
+ * where type, remaining length and header length of the packet are stored.
+ *
+ * @return #MQTTSuccess on successful extraction of type and length,
+ * #MQTTBadParameter if any parameter is invalid,
+ * #MQTTBadResponse if an invalid packet is read,
+ * #MQTTRecvFailed if transport read failed,
+ * #MQTTNeedMoreBytes if only part of the fixed header has been read (the
+ * staged bytes are kept and the function can be called again), and
+ * #MQTTNoDataAvailable if there is nothing to read.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Staging buffer for the fixed header and any bytes read ahead.
+ * uint8_t staging[ 16 ];
+ * size_t stagedBytes = 0;
+ * MQTTPacketInfo_t incomingPacket;
+ * MQTTStatus_t status;
+ *
+ * do
+ * {
+ *      status = MQTT_GetIncomingPacketTypeAndLengthBuffered(
+ *          socket_recv,
+ *          &networkContext,
+ *          staging,
+ *          sizeof( staging ),
+ *          &stagedBytes,
+ *          &incomingPacket
+ *      );
+ * } while( ( status == MQTTNoDataAvailable ) || ( status == MQTTNeedMoreBytes ) );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      // staging[ incomingPacket.headerLength ] to staging[ stagedBytes - 1 ]
+ *      // already hold the start of the remaining data.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_getincomingpackettypeandlengthbuffered] */
+MQTTStatus_t MQTT_GetIncomingPacketTypeAndLengthBuffered( TransportRecv_t readFunc,
+                                                          NetworkContext_t * pNetworkContext,
+                                                          uint8_t * pStagingBuffer,
+                                                          size_t stagingBufferSize,
+                                                          size_t * pStagedBytes,
+                                                          MQTTPacketInfo_t * pIncomingPacket );
+/* @[declare_mqtt_getincomingpackettypeandlengthbuffered] */
+
 /**
  * @brief Extract the MQTT packet type and length from incoming packet.
  *
@@ -1959,6 +2191,61 @@ MQTTStatus_t MQTTPropertyBuilder_Init( MQTTPropBuilder_t * pPropertyBuilder,
                                        size_t length );
 /* @[declare_mqttpropertybuilder_init] */
 
+/**
+ * @brief Validate the properties of a builder once, so that they are not
+ * validated again each time they are sent.
+ *
+ * The builder can then be passed to #MQTT_Publish, #MQTT_Subscribe or
+ * #MQTT_Unsubscribe, or be used for the properties of the publish
+ * acknowledgements, without its properties being decoded again. Adding a
+ * property to the builder unseals it. The checks depending on the connection,
+ * such as the Topic Alias being at most the Topic Alias Maximum of the server,
+ * are still made on each send.
+ *
+ * @note Properties written directly into the buffer of the builder are not
+ * detected, and require the builder to be sealed again.
+ *
+ * @param[in,out] pPropertyBuilder Property builder to seal.
+ * @param[in] packetType Type of the packets the properties are sent with. One of
+ * #MQTT_PACKET_TYPE_PUBLISH, #MQTT_PACKET_TYPE_SUBSCRIBE,
+ * #MQTT_PACKET_TYPE_UNSUBSCRIBE, #MQTT_PACKET_TYPE_PUBACK,
+ * #MQTT_PACKET_TYPE_PUBREC, #MQTT_PACKET_TYPE_PUBREL or
+ * #MQTT_PACKET_TYPE_PUBCOMP.
+ *
+ * @return
+ * - #MQTTBadParameter if invalid parameters are passed, or the properties are
+ *   not valid for @p packetType.
+ * - #MQTTBadResponse if the properties are malformed.
+ * - #MQTTSuccess otherwise.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTPropBuilder_t propertyBuilder;
+ * uint8_t propertyBuffer[ 64 ];
+ * MQTTStatus_t status;
+ *
+ * status = MQTTPropertyBuilder_Init( &propertyBuilder, propertyBuffer, sizeof( propertyBuffer ) );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTTPropAdd_ContentType( &propertyBuilder, "text/plain", 10, NULL );
+ * }
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *      status = MQTTPropertyBuilder_Seal( &propertyBuilder, MQTT_PACKET_TYPE_PUBLISH );
+ * }
+ *
+ * // The properties are not validated again when publishing.
+ * @endcode
+ */
+/* @[declare_mqttpropertybuilder_seal] */
+MQTTStatus_t MQTTPropertyBuilder_Seal( MQTTPropBuilder_t * pPropertyBuilder,
+                                       uint8_t packetType );
+/* @[declare_mqttpropertybuilder_seal] */
+
 /**
  * @brief Validates the properties specified for WILL Properties in the MQTT CONNECT packet.
  *
@@ -2571,6 +2858,92 @@ MQTTStatus_t MQTT_GetNextPropertyType( const MQTTPropBuilder_t * pPropertyBuilde
 MQTTStatus_t MQTT_SkipNextProperty( const MQTTPropBuilder_t * pPropertyBuilder,
                                     size_t * currentIndex );
 
+/**
+ * @brief Find the next property with a given identifier in the property
+ * builder.
+ *
+ * When @p pPropIndex was filled from the properties by
+ * #MQTT_DeserializePublishWithProperties, the first property with the identifier is
+ * found with a single lookup, whatever the number of properties before it.
+ * Otherwise, and for a User Property or Subscription Identifier after the
+ * first one, the properties from @p currentIndex are walked as with
+ * #MQTT_SkipNextProperty.
+ *
+ * @param[in] pPropertyBuilder Property builder containing the properties.
+ * @param[in] pPropIndex Index of the properties, or NULL.
+ * @param[in] propertyId Identifier of the property, such as
+ * #MQTT_CORRELATION_DATA_ID.
+ * @param[in,out] currentIndex Index in the property buffer from which to
+ * look for the property. On success, updated to the index of the property,
+ * to be passed to the MQTTPropGet_* function of the property.
+ *
+ * @return #MQTTSuccess if the property is found;
+ * #MQTTEndOfProperties if there is no such property from @p currentIndex;
+ * #MQTTBadParameter if invalid parameters are passed or a property is invalid.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * size_t currentIndex = 0;
+ * const char * pCorrelationData;
+ * size_t correlationDataLength;
+ *
+ * // Called with the properties of an incoming PUBLISH, indexed in the
+ * // propertyIndex given to MQTT_InitIncomingPropertyIndex.
+ * status = MQTT_FindProperty( pGetPropsBuffer, &propertyIndex,
+ *                             MQTT_CORRELATION_DATA_ID, &currentIndex );
+ *
+ * if( status == MQTTSuccess )
+ * {
+ *     status = MQTTPropGet_CorrelationData( pGetPropsBuffer,
+ *                                           &currentIndex,
+ *                                           &pCorrelationData,
+ *                                           &correlationDataLength );
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_findproperty] */
+MQTTStatus_t MQTT_FindProperty( const MQTTPropBuilder_t * pPropertyBuilder,
+                                const MQTTPropIndex_t * pPropIndex,
+                                uint8_t propertyId,
+                                size_t * currentIndex );
+/* @[declare_mqtt_findproperty] */
+
+/**
+ * @brief Decode all properties of a received PUBLISH in a single walk.
+ *
+ * This replaces one MQTTPropGet_* call per property. The strings and data
+ * point into the property buffer, and nothing is copied.
+ *
+ * @param[in] pPropertyBuilder Properties of a received PUBLISH.
+ * @param[out] pProperties The decoded properties.
+ *
+ * @return #MQTTSuccess if the properties are decoded;
+ * #MQTTBadParameter if invalid parameters are passed or a property is invalid.
+ *
+ * <b>Example</b>
+ * @code{c}
+ *
+ * // Variables used in this example.
+ * MQTTStatus_t status;
+ * MQTTPublishProperties_t publishProperties;
+ *
+ * // Called with the properties of an incoming PUBLISH.
+ * status = MQTT_DeserializePublishPropertiesInto( pGetPropsBuffer, &publishProperties );
+ *
+ * if( ( status == MQTTSuccess ) && ( publishProperties.pResponseTopic != NULL ) )
+ * {
+ *     // Publish the response to publishProperties.pResponseTopic.
+ * }
+ * @endcode
+ */
+/* @[declare_mqtt_deserializepublishpropertiesinto] */
+MQTTStatus_t MQTT_DeserializePublishPropertiesInto( const MQTTPropBuilder_t * pPropertyBuilder,
+                                                    MQTTPublishProperties_t * pProperties );
+/* @[declare_mqtt_deserializepublishpropertiesinto] */
+
 /**
  * @brief Get User Property from property builder.
  *
@@ -83,6 +83,73 @@ MQTTStatus_t MQTT_ReserveState( const MQTTContext_t * pMqttContext,
                                 MQTTQoS_t qos );
 /** @endcond */
 
+/**
+ * @fn void MQTT_ResetStateIndex( MQTTPubAckIndex_t * pIndex, const MQTTPubAckInfo_t * pRecords, size_t recordCount );
+ * @brief Rebuild an index of state records from the records.
+ *
+ * @param[in] pIndex The index, with its buckets set.
+ * @param[in] pRecords The records to index.
+ * @param[in] recordCount Number of records in @p pRecords.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+void MQTT_ResetStateIndex( MQTTPubAckIndex_t * pIndex,
+                           const MQTTPubAckInfo_t * pRecords,
+                           size_t recordCount );
+/** @endcond */
+
+/**
+ * @fn uint16_t MQTT_AllocatePacketId( const MQTTContext_t * pMqttContext, uint16_t startId );
+ * @brief Hand out the first free packet ID at or after a start ID.
+ *
+ * @param[in] pMqttContext MQTT context with a packet ID allocator.
+ * @param[in] startId The packet ID to start searching from.
+ *
+ * @return The packet ID, which is now held, or #MQTT_PACKET_ID_INVALID if
+ * all packet IDs are held.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+uint16_t MQTT_AllocatePacketId( const MQTTContext_t * pMqttContext,
+                                uint16_t startId );
+/** @endcond */
+
+/**
+ * @fn void MQTT_FreePacketId( const MQTTContext_t * pMqttContext, uint16_t packetId );
+ * @brief Return a packet ID to the packet ID allocator.
+ *
+ * @param[in] pMqttContext MQTT context with a packet ID allocator.
+ * @param[in] packetId The packet ID to free.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+void MQTT_FreePacketId( const MQTTContext_t * pMqttContext,
+                        uint16_t packetId );
+/** @endcond */
+
+/**
+ * @fn void MQTT_ResetPacketIds( const MQTTContext_t * pMqttContext );
+ * @brief Free all packet IDs except those of the outgoing publish records.
+ *
+ * @param[in] pMqttContext MQTT context with a packet ID allocator.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+void MQTT_ResetPacketIds( const MQTTContext_t * pMqttContext );
+/** @endcond */
+
 /**
  * @fn MQTTPublishState_t MQTT_CalculateStatePublish( MQTTStateOperation_t opType, MQTTQoS_t qos )
  * @brief Calculate the new state for a publish from its qos and operation type.
@@ -126,6 +193,25 @@ MQTTStatus_t MQTT_UpdateStatePublish( const MQTTContext_t * pMqttContext,
                                       MQTTPublishState_t * pNewState );
 /** @endcond */
 
+/**
+ * @fn MQTTPublishState_t MQTT_IncomingPublishState( const MQTTContext_t * pMqttContext, uint16_t packetId );
+ * @brief Look up the state record of an incoming PUBLISH packet without
+ * updating it.
+ *
+ * @param[in] pMqttContext Initialized MQTT context.
+ * @param[in] packetId ID of the PUBLISH packet.
+ *
+ * @return The state of the publish, or #MQTTStateNull if it has no record.
+ */
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+MQTTPublishState_t MQTT_IncomingPublishState( const MQTTContext_t * pMqttContext,
+                                              uint16_t packetId );
+/** @endcond */
+
 /**
  * @fn MQTTStatus_t MQTT_RemoveStateRecord( const MQTTContext_t * pMqttContext, uint16_t packetId );
  * @brief Remove the state record for a PUBLISH packet.
@@ -562,6 +562,57 @@ MQTTStatus_t decodeUtf8( const char ** pProperty,
                          uint8_t ** pIndex );
 /** @endcond */
 
+/**
+ * @fn MQTTStatus_t decodeUtf8String( const char ** pProperty, size_t * pLength, uint32_t * pPropertyLength, bool * pUsed, uint8_t ** pIndex );
+ *
+ * @brief Validate the length and decode a utf 8 string which must hold text.
+ *
+ * Same as #decodeUtf8, but when #MQTT_VALIDATE_UTF8 is enabled the string is
+ * also checked to be well-formed UTF-8. Use #decodeUtf8 for binary data.
+ *
+ * @param[out] pProperty To store the decoded string.
+ * @param[out] pLength  Size of the decoded utf-8 string.
+ * @param[in, out] pPropertyLength  Value of the remaining property length.
+ * @param[in, out] pUsed Whether the property is decoded before.
+ * @param[in, out]  pIndex Pointer to the current index of the buffer.
+ *
+ * @return #MQTTSuccess, #MQTTBadResponse
+ **/
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+MQTTStatus_t decodeUtf8String( const char ** pProperty,
+                               size_t * pLength,
+                               uint32_t * pPropertyLength,
+                               bool * pUsed,
+                               uint8_t ** pIndex );
+/** @endcond */
+
+/**
+ * @fn bool isValidUtf8String( const char * pString, size_t length );
+ *
+ * @brief Check that a string is well-formed UTF-8 without the null character.
+ *
+ * Overlong encodings, surrogates, code points above U+10FFFF and truncated
+ * sequences are rejected. Blocks of ASCII characters are skipped with vector
+ * instructions when #MQTT_UTF8_VALIDATION_SIMD allows it.
+ *
+ * @param[in] pString The string to check. May be NULL if @p length is 0.
+ * @param[in] length Length of the string in bytes.
+ *
+ * @return true if the string is valid, false otherwise.
+ **/
+
+/**
+ * @cond DOXYGEN_IGNORE
+ * Doxygen should ignore this definition, this function is private.
+ */
+bool isValidUtf8String( const char * pString,
+                        size_t length );
+/** @endcond */
+
 /**
  * @fn MQTTStatus_t decodeVariableLength( const uint8_t * pBuffer, size_t bufferLength, uint32_t * pLength );
  *
@@ -294,6 +294,102 @@ typedef int32_t ( * TransportWritev_t )( NetworkContext_t * pNetworkContext,
                                          size_t ioVecCount );
 /* @[define_transportwritev] */
 
+/**
+ * @transportcallback
+ * @brief Optional transport function for receiving data without copying it
+ * into a caller supplied buffer.
+ *
+ * Transport stacks that already hold received data in their own memory, such
+ * as a TLS stack holding decrypted records, can implement this function to
+ * lend that memory to the caller. The lent buffer remains owned by the
+ * transport and MUST stay valid and unchanged until it is handed back with
+ * @ref TransportRelease_t. At most one buffer is lent at a time.
+ *
+ * This function is not a member of @ref TransportInterface_t; protocol
+ * libraries supporting it take it through a separate opt-in function.
+ *
+ * @note Like @ref TransportRecv_t, it is HIGHLY RECOMMENDED that this function
+ * does NOT block.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ * @param[out] ppBuffer Set to the start of the lent buffer.
+ *
+ * @return The number of bytes in the lent buffer, zero if no data is
+ * available, or a negative value to indicate error. No buffer is lent when
+ * zero or a negative value is returned.
+ */
+/* @[define_transportrecvlease] */
+typedef int32_t ( * TransportRecvLease_t )( NetworkContext_t * pNetworkContext,
+                                            void ** ppBuffer );
+/* @[define_transportrecvlease] */
+
+/**
+ * @transportcallback
+ * @brief Transport function for handing back a buffer lent by
+ * @ref TransportRecvLease_t.
+ *
+ * All the bytes of the lent buffer are consumed by the caller when this
+ * function is called.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ * @param[in] pBuffer The buffer returned by @ref TransportRecvLease_t.
+ */
+/* @[define_transportrelease] */
+typedef void ( * TransportRelease_t )( NetworkContext_t * pNetworkContext,
+                                       void * pBuffer );
+/* @[define_transportrelease] */
+
+/**
+ * @transportcallback
+ * @brief Optional transport function for waiting until data can be received.
+ *
+ * When provided, the protocol library calls this function instead of
+ * repeatedly polling a non-blocking @ref TransportRecv_t that has no data, so
+ * an idle connection does not keep the CPU busy. The function blocks until
+ * data is available to receive, the timeout expires or an error occurs.
+ *
+ * This function is not a member of @ref TransportInterface_t; protocol
+ * libraries supporting it take it through a separate opt-in function.
+ *
+ * For TLS, data already decrypted and buffered by the TLS stack MUST be
+ * reported as readable without waiting on the socket.
+ *
+ * @param[in] pNetworkContext Implementation-defined network context.
+ * @param[in] timeoutMs Maximum time to wait in milliseconds. The
+ * implementation may return earlier.
+ *
+ * @return A positive value if data can be received, zero if the timeout
+ * expired, or a negative value to indicate error.
+ *
+ * <b>Example code:</b>
+ * @code{c}
+ * int32_t myNetworkWaitReadableImplementation( NetworkContext_t * pNetworkContext,
+ *                                              uint32_t timeoutMs )
+ * {
+ *     int32_t result = 1;
+ *     struct pollfd fds = { 0 };
+ *
+ *     if( TLSRecvCount( pNetworkContext->tlsContext ) == 0 )
+ *     {
+ *         fds.fd = pNetworkContext->tcpSocketContext.socket;
+ *         fds.events = POLLIN;
+ *         result = poll( &fds, 1, ( int ) timeoutMs );
+ *
+ *         if( ( result > 0 ) && ( ( fds.revents & ( POLLERR | POLLNVAL ) ) != 0 ) )
+ *         {
+ *             result = -1;
+ *         }
+ *     }
+ *
+ *     return result;
+ * }
+ * @endcode
+ */
+/* @[define_transportwaitreadable] */
+typedef int32_t ( * TransportWaitReadable_t )( NetworkContext_t * pNetworkContext,
+                                               uint32_t timeoutMs );
+/* @[define_transportwaitreadable] */
+
 /**
  * @transportstruct
  * @brief The transport layer interface.
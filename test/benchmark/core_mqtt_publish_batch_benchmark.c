@@ -0,0 +1,283 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_publish_batch_benchmark.c
+ * @brief Compares sending QoS 0 messages with one call to #MQTT_Publish each
+ * and with #MQTT_PublishBatch.
+ *
+ * The transport only counts its calls and the bytes given to it, so that the
+ * time measured is the time spent in the library.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core_mqtt.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Number of messages sent for each batch size.
+ */
+#define BENCHMARK_TOTAL_MESSAGES    ( 2000000UL )
+
+/**
+ * @brief Largest batch measured.
+ */
+#define BENCHMARK_MAX_BATCH         ( 64U )
+
+/**
+ * @brief Size of the network buffer of the context.
+ */
+#define BENCHMARK_BUFFER_SIZE       ( 1024U )
+
+/**
+ * @brief The transport has no state.
+ */
+struct NetworkContext
+{
+    int unused; /**< @brief Unused. */
+};
+
+/**
+ * @brief Number of calls to the send and writev functions of the transport.
+ */
+static unsigned long writeCount = 0UL;
+
+/**
+ * @brief Number of bytes given to the transport.
+ */
+static unsigned long long bytesWritten = 0ULL;
+
+/**
+ * @brief Keeps the results alive so that the publishes are not optimized out.
+ */
+static volatile unsigned long successCount = 0UL;
+
+/**
+ * @brief Transport send function counting the bytes sent.
+ */
+static int32_t transportSend( NetworkContext_t * pNetworkContext,
+                              const void * pBuffer,
+                              size_t bytesToSend )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+
+    writeCount++;
+    bytesWritten += bytesToSend;
+
+    return ( int32_t ) bytesToSend;
+}
+
+/**
+ * @brief Transport writev function counting the bytes sent.
+ */
+static int32_t transportWritev( NetworkContext_t * pNetworkContext,
+                                TransportOutVector_t * pIoVec,
+                                size_t ioVecCount )
+{
+    size_t bytesToSend = 0U;
+    size_t i;
+
+    ( void ) pNetworkContext;
+
+    for( i = 0U; i < ioVecCount; i++ )
+    {
+        bytesToSend += pIoVec[ i ].iov_len;
+    }
+
+    writeCount++;
+    bytesWritten += bytesToSend;
+
+    return ( int32_t ) bytesToSend;
+}
+
+/**
+ * @brief Transport receive function with no data to receive.
+ */
+static int32_t transportRecv( NetworkContext_t * pNetworkContext,
+                              void * pBuffer,
+                              size_t bytesToRecv )
+{
+    ( void ) pNetworkContext;
+    ( void ) pBuffer;
+    ( void ) bytesToRecv;
+
+    return 0;
+}
+
+/**
+ * @brief Time function of the context.
+ */
+static uint32_t getTime( void )
+{
+    return 0U;
+}
+
+/**
+ * @brief Event callback of the context, which receives no packets.
+ */
+static bool eventCallback( MQTTContext_t * pContext,
+                           MQTTPacketInfo_t * pPacketInfo,
+                           MQTTDeserializedInfo_t * pDeserializedInfo,
+                           MQTTSuccessFailReasonCode_t * pReasonCode,
+                           MQTTPropBuilder_t * pSendPropsBuffer,
+                           MQTTPropBuilder_t * pGetPropsBuffer )
+{
+    ( void ) pContext;
+    ( void ) pPacketInfo;
+    ( void ) pDeserializedInfo;
+    ( void ) pReasonCode;
+    ( void ) pSendPropsBuffer;
+    ( void ) pGetPropsBuffer;
+
+    return true;
+}
+
+/**
+ * @brief Print the transport writes and the time taken to send the messages.
+ */
+static void printResult( const char * pName,
+                         size_t batchSize,
+                         clock_t start,
+                         unsigned long messages )
+{
+    double seconds = ( double ) ( clock() - start ) / ( double ) CLOCKS_PER_SEC;
+
+    if( seconds <= 0.0 )
+    {
+        seconds = 1.0 / ( double ) CLOCKS_PER_SEC;
+    }
+
+    printf( "%-24s %4u messages %10lu writes %6.1f bytes/write %8.1f ns/message\n",
+            pName,
+            ( unsigned ) batchSize,
+            writeCount,
+            ( double ) bytesWritten / ( double ) writeCount,
+            ( seconds * 1000000000.0 ) / ( double ) messages );
+}
+
+/**
+ * @brief Send the messages in groups of @p batchSize, with #MQTT_Publish and
+ * with #MQTT_PublishBatch.
+ */
+static void runBenchmark( MQTTContext_t * pContext,
+                          const MQTTPublishInfo_t * pPublishInfo,
+                          size_t batchSize )
+{
+    MQTTStatus_t publishStatus[ BENCHMARK_MAX_BATCH ];
+    unsigned long batches = BENCHMARK_TOTAL_MESSAGES / ( unsigned long ) batchSize;
+    unsigned long messages = batches * ( unsigned long ) batchSize;
+    unsigned long i;
+    size_t j;
+    clock_t start;
+
+    writeCount = 0UL;
+    bytesWritten = 0ULL;
+    start = clock();
+
+    for( i = 0UL; i < batches; i++ )
+    {
+        for( j = 0U; j < batchSize; j++ )
+        {
+            if( MQTT_Publish( pContext, &pPublishInfo[ j ], 0U, NULL ) == MQTTSuccess )
+            {
+                successCount++;
+            }
+        }
+    }
+
+    printResult( "MQTT_Publish", batchSize, start, messages );
+
+    writeCount = 0UL;
+    bytesWritten = 0ULL;
+    start = clock();
+
+    for( i = 0UL; i < batches; i++ )
+    {
+        if( MQTT_PublishBatch( pContext, pPublishInfo, NULL, NULL, batchSize, publishStatus ) == MQTTSuccess )
+        {
+            successCount += batchSize;
+        }
+    }
+
+    printResult( "MQTT_PublishBatch", batchSize, start, messages );
+}
+
+int main( void )
+{
+    static uint8_t buffer[ BENCHMARK_BUFFER_SIZE ];
+    static MQTTPublishInfo_t publishInfo[ BENCHMARK_MAX_BATCH ];
+    const char * pTopic = "devices/3f2a9c1e/telemetry/temperature";
+    const char * pPayload = "{\"temperature\":21.5,\"unit\":\"C\"}";
+    MQTTContext_t context;
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer;
+    NetworkContext_t networkContext;
+    MQTTStatus_t status;
+    size_t i;
+
+    ( void ) memset( &context, 0, sizeof( context ) );
+    ( void ) memset( &transport, 0, sizeof( transport ) );
+    transport.pNetworkContext = &networkContext;
+    transport.send = transportSend;
+    transport.recv = transportRecv;
+    transport.writev = transportWritev;
+    networkBuffer.pBuffer = buffer;
+    networkBuffer.size = sizeof( buffer );
+
+    for( i = 0U; i < BENCHMARK_MAX_BATCH; i++ )
+    {
+        publishInfo[ i ].qos = MQTTQoS0;
+        publishInfo[ i ].pTopicName = pTopic;
+        publishInfo[ i ].topicNameLength = ( uint16_t ) strlen( pTopic );
+        publishInfo[ i ].pPayload = pPayload;
+        publishInfo[ i ].payloadLength = strlen( pPayload );
+    }
+
+    status = MQTT_Init( &context, &transport, getTime, eventCallback, &networkBuffer );
+
+    if( status == MQTTSuccess )
+    {
+        /* The connection is not established through the stub transport. */
+        context.connectStatus = MQTTConnected;
+
+        printf( "QoS 0 messages of %u bytes, up to %u IO vectors per write\n",
+                ( unsigned ) strlen( pPayload ),
+                ( unsigned ) MQTT_PUBLISH_BATCH_MAX_VECTORS );
+
+        runBenchmark( &context, publishInfo, 1U );
+        runBenchmark( &context, publishInfo, 8U );
+        runBenchmark( &context, publishInfo, BENCHMARK_MAX_BATCH );
+    }
+    else
+    {
+        printf( "MQTT_Init failed: %s\n", MQTT_Status_strerror( status ) );
+    }
+
+    return ( successCount > 0UL ) ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_router_benchmark.c
+ * @brief Compares the dispatch of incoming PUBLISH packets by a router with a
+ * loop calling #MQTT_MatchTopic for each topic filter.
+ *
+ * Half of the topic filters end with a '+' level and half with a '#' level,
+ * and each topic name matches exactly one of them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core_mqtt_router.h"
+
+/**
+ * @brief Largest number of topic filters measured.
+ */
+#define BENCHMARK_MAX_FILTERS        ( 10000U )
+
+/**
+ * @brief Number of levels of a topic filter which are not shared with
+ * another topic filter.
+ */
+#define BENCHMARK_FILTER_LEVELS      ( 3U )
+
+/**
+ * @brief Number of nodes of the router, one per level and one for the root.
+ */
+#define BENCHMARK_NODE_COUNT         ( ( BENCHMARK_MAX_FILTERS * BENCHMARK_FILTER_LEVELS ) + 2U )
+
+/**
+ * @brief Longest level of a topic filter.
+ */
+#define BENCHMARK_LEVEL_LENGTH       ( 16U )
+
+/**
+ * @brief Number of hash table buckets of the router.
+ */
+#define BENCHMARK_BUCKET_COUNT       ( 65536U )
+
+/**
+ * @brief Longest topic filter or topic name.
+ */
+#define BENCHMARK_MAX_LENGTH         ( 32U )
+
+/**
+ * @brief Number of topic names dispatched in a loop.
+ */
+#define BENCHMARK_TOPIC_COUNT        ( 64U )
+
+/**
+ * @brief Number of topic filters compared by the linear loop for each
+ * number of topic filters, which sets the number of dispatches.
+ */
+#define BENCHMARK_TOTAL_COMPARES     ( 20000000UL )
+
+/**
+ * @brief Fewest dispatches measured.
+ */
+#define BENCHMARK_MIN_DISPATCHES     ( 10000UL )
+
+static MQTTRouterNode_t routerNodes[ BENCHMARK_NODE_COUNT ];
+static char routerLevels[ BENCHMARK_NODE_COUNT * BENCHMARK_LEVEL_LENGTH ];
+static uint16_t routerBuckets[ BENCHMARK_BUCKET_COUNT ];
+static MQTTRoute_t routes[ BENCHMARK_MAX_FILTERS ];
+static char topicFilters[ BENCHMARK_MAX_FILTERS ][ BENCHMARK_MAX_LENGTH ];
+static size_t topicFilterLengths[ BENCHMARK_MAX_FILTERS ];
+static char topicNames[ BENCHMARK_TOPIC_COUNT ][ BENCHMARK_MAX_LENGTH ];
+static MQTTPublishInfo_t publishInfos[ BENCHMARK_TOPIC_COUNT ];
+
+/**
+ * @brief Keeps the results alive so that the matching is not optimized out.
+ */
+static volatile size_t matchCount = 0U;
+
+/**
+ * @brief Handler of all topic filters.
+ */
+static void countMatch( MQTTContext_t * pContext,
+                        MQTTDeserializedInfo_t * pDeserializedInfo,
+                        void * pUserData )
+{
+    ( void ) pContext;
+    ( void ) pDeserializedInfo;
+    ( void ) pUserData;
+
+    matchCount++;
+}
+
+/**
+ * @brief Print the time taken by a number of dispatches.
+ */
+static void printResult( const char * pName,
+                         size_t filterCount,
+                         unsigned long dispatches,
+                         clock_t start,
+                         size_t matches )
+{
+    double seconds = ( double ) ( clock() - start ) / ( double ) CLOCKS_PER_SEC;
+
+    if( seconds <= 0.0 )
+    {
+        seconds = 1.0 / ( double ) CLOCKS_PER_SEC;
+    }
+
+    printf( "%-24s %6u filters %12.1f ns/dispatch %10lu matches\n",
+            pName,
+            ( unsigned ) filterCount,
+            ( seconds * 1000000000.0 ) / ( double ) dispatches,
+            ( unsigned long ) matches );
+}
+
+/**
+ * @brief Dispatch the topic names to the handlers of the first topic filters,
+ * with a router and with a linear loop.
+ */
+static void runBenchmark( size_t filterCount )
+{
+    MQTTRouter_t router;
+    MQTTContext_t context;
+    MQTTDeserializedInfo_t deserializedInfo;
+    MQTTStatus_t status;
+    unsigned long dispatches = BENCHMARK_TOTAL_COMPARES / ( unsigned long ) filterCount;
+    unsigned long i;
+    size_t filter;
+    size_t topic;
+    size_t startCount;
+    bool isMatch = false;
+    clock_t start;
+
+    ( void ) memset( &context, 0, sizeof( context ) );
+    ( void ) memset( &deserializedInfo, 0, sizeof( deserializedInfo ) );
+
+    if( dispatches < BENCHMARK_MIN_DISPATCHES )
+    {
+        dispatches = BENCHMARK_MIN_DISPATCHES;
+    }
+
+    status = MQTT_RouterInit( &router,
+                              routerNodes,
+                              BENCHMARK_NODE_COUNT,
+                              routerLevels,
+                              BENCHMARK_LEVEL_LENGTH,
+                              routerBuckets,
+                              BENCHMARK_BUCKET_COUNT,
+                              routes,
+                              filterCount );
+
+    for( filter = 0U; ( filter < filterCount ) && ( status == MQTTSuccess ); filter++ )
+    {
+        status = MQTT_RouterAdd( &router,
+                                 topicFilters[ filter ],
+                                 topicFilterLengths[ filter ],
+                                 countMatch,
+                                 NULL );
+    }
+
+    if( status != MQTTSuccess )
+    {
+        printf( "Router setup failed for %u filters.\n", ( unsigned ) filterCount );
+    }
+    else
+    {
+        /* The topic names are spread over the topic filters. */
+        for( topic = 0U; topic < BENCHMARK_TOPIC_COUNT; topic++ )
+        {
+            filter = ( topic * filterCount ) / BENCHMARK_TOPIC_COUNT;
+            ( void ) snprintf( topicNames[ topic ],
+                               BENCHMARK_MAX_LENGTH,
+                               ( ( filter % 2U ) == 0U ) ? "fleet/%u/dev7/status" : "fleet/%u/telemetry/temp",
+                               ( unsigned ) filter );
+            publishInfos[ topic ].pTopicName = topicNames[ topic ];
+            publishInfos[ topic ].topicNameLength = ( uint16_t ) strlen( topicNames[ topic ] );
+        }
+
+        startCount = matchCount;
+        start = clock();
+
+        for( i = 0UL; i < dispatches; i++ )
+        {
+            deserializedInfo.pPublishInfo = &publishInfos[ i % BENCHMARK_TOPIC_COUNT ];
+            ( void ) MQTT_RouterDispatch( &router, &context, &deserializedInfo, NULL );
+        }
+
+        printResult( "MQTT_RouterDispatch", filterCount, dispatches, start, matchCount - startCount );
+
+        startCount = matchCount;
+        start = clock();
+
+        for( i = 0UL; i < dispatches; i++ )
+        {
+            deserializedInfo.pPublishInfo = &publishInfos[ i % BENCHMARK_TOPIC_COUNT ];
+
+            for( filter = 0U; filter < filterCount; filter++ )
+            {
+                ( void ) MQTT_MatchTopic( deserializedInfo.pPublishInfo->pTopicName,
+                                          deserializedInfo.pPublishInfo->topicNameLength,
+                                          topicFilters[ filter ],
+                                          topicFilterLengths[ filter ],
+                                          &isMatch );
+
+                if( isMatch )
+                {
+                    countMatch( &context, &deserializedInfo, NULL );
+                }
+            }
+        }
+
+        printResult( "MQTT_MatchTopic loop", filterCount, dispatches, start, matchCount - startCount );
+    }
+}
+
+int main( void )
+{
+    size_t filter;
+
+    for( filter = 0U; filter < BENCHMARK_MAX_FILTERS; filter++ )
+    {
+        ( void ) snprintf( topicFilters[ filter ],
+                           BENCHMARK_MAX_LENGTH,
+                           ( ( filter % 2U ) == 0U ) ? "fleet/%u/+/status" : "fleet/%u/telemetry/#",
+                           ( unsigned ) filter );
+        topicFilterLengths[ filter ] = strlen( topicFilters[ filter ] );
+    }
+
+    printf( "Dispatch of incoming PUBLISH packets to topic filter handlers\n" );
+
+    runBenchmark( 10U );
+    runBenchmark( 100U );
+    runBenchmark( BENCHMARK_MAX_FILTERS );
+
+    return ( matchCount > 0U ) ? 0 : 1;
+}
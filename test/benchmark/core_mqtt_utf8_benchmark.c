@@ -0,0 +1,131 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_utf8_benchmark.c
+ * @brief Measures the throughput of the UTF-8 validation of topic names and
+ * string properties.
+ *
+ * The benchmark is built twice, with and without #MQTT_UTF8_VALIDATION_SIMD,
+ * so that both executables can be compared on the same machine.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core_mqtt_serializer.h"
+#include "core_mqtt_serializer_private.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Number of bytes validated for each string.
+ */
+#define BENCHMARK_TOTAL_BYTES    ( 256UL * 1024UL * 1024UL )
+
+/**
+ * @brief Largest string measured.
+ */
+#define BENCHMARK_MAX_LENGTH     ( 1024U )
+
+/**
+ * @brief Keeps the results alive so that the validation is not optimized out.
+ */
+static volatile size_t validCount = 0U;
+
+/**
+ * @brief Validate a string repeatedly and print its throughput.
+ */
+static void runBenchmark( const char * pName,
+                          const char * pString,
+                          size_t length )
+{
+    unsigned long iterations = BENCHMARK_TOTAL_BYTES / ( unsigned long ) length;
+    unsigned long i;
+    clock_t start;
+    double seconds;
+
+    start = clock();
+
+    for( i = 0UL; i < iterations; i++ )
+    {
+        if( isValidUtf8String( pString, length ) )
+        {
+            validCount++;
+        }
+    }
+
+    seconds = ( double ) ( clock() - start ) / ( double ) CLOCKS_PER_SEC;
+
+    if( seconds <= 0.0 )
+    {
+        seconds = 1.0 / ( double ) CLOCKS_PER_SEC;
+    }
+
+    printf( "%-24s %6u bytes %10.1f MB/s %8.2f ns/string\n",
+            pName,
+            ( unsigned ) length,
+            ( ( double ) iterations * ( double ) length ) / ( seconds * 1000000.0 ),
+            ( seconds * 1000000000.0 ) / ( double ) iterations );
+}
+
+int main( void )
+{
+    static char asciiString[ BENCHMARK_MAX_LENGTH ];
+    static char mixedString[ BENCHMARK_MAX_LENGTH ];
+    const char * pTopic = "devices/3f2a9c1e-55b1-4c1f-9d7e-0a4b6c2f1e88/telemetry/temperature";
+    size_t i;
+
+    ( void ) memset( asciiString, 'a', sizeof( asciiString ) );
+
+    /* One two-byte character every 16 bytes. */
+    for( i = 0U; i < sizeof( mixedString ); i++ )
+    {
+        if( ( i % 16U ) == 14U )
+        {
+            mixedString[ i ] = ( char ) 0xC3;
+        }
+        else if( ( i % 16U ) == 15U )
+        {
+            mixedString[ i ] = ( char ) 0xA9;
+        }
+        else
+        {
+            mixedString[ i ] = 'a';
+        }
+    }
+
+    printf( "UTF-8 validation, vector instructions %s\n",
+            ( MQTT_UTF8_VALIDATION_SIMD != 0 ) ? "allowed" : "disabled" );
+
+    runBenchmark( "topic name", pTopic, strlen( pTopic ) );
+    runBenchmark( "ASCII", asciiString, 16U );
+    runBenchmark( "ASCII", asciiString, 64U );
+    runBenchmark( "ASCII", asciiString, BENCHMARK_MAX_LENGTH );
+    runBenchmark( "mixed", mixedString, 64U );
+    runBenchmark( "mixed", mixedString, BENCHMARK_MAX_LENGTH );
+
+    return ( validCount > 0U ) ? 0 : 1;
+}
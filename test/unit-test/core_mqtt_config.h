@@ -71,6 +71,8 @@
 
 #define MQTT_SUB_UNSUB_MAX_VECTORS              ( 6U )
 
+#define MQTT_PUBLISH_BATCH_MAX_VECTORS          ( 12U )
+
 #define MQTT_SEND_TIMEOUT_MS                    ( 200U )
 
 #endif /* ifndef CORE_MQTT_CONFIG_H_ */
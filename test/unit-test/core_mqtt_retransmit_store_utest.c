@@ -0,0 +1,674 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_retransmit_store_utest.c
+ * @brief Unit tests for functions in core_mqtt_retransmit_store.h.
+ */
+#include <string.h>
+#include "unity.h"
+
+#include "core_mqtt_retransmit_store.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Size of each segment of the stores under test.
+ */
+#define STORE_SEGMENT_SIZE     ( 128U )
+
+/**
+ * @brief Number of segments of the stores under test.
+ */
+#define STORE_SEGMENT_COUNT    ( 4U )
+
+/**
+ * @brief Number of index entries of the stores under test.
+ */
+#define STORE_ENTRY_COUNT      ( 16U )
+
+/**
+ * @brief Length of the packets stored by #appendFilledPacket, which take 64
+ * bytes of a segment with their record header.
+ */
+#define PACKET_LENGTH          ( 44U )
+
+/**
+ * @brief Handle under which the library stores the PUBREL or PUBREC of a
+ * packet ID.
+ */
+#define ACK_HANDLE( packetId )    ( ( uint32_t ) ( packetId ) | 0x10000U )
+
+/**
+ * @brief An opaque structure provided by the library to the #MQTTStorePacketForRetransmit function when using #MQTTStorePacketForRetransmit.
+ */
+struct MQTTVec
+{
+    TransportOutVector_t * pVector; /**< Pointer to transport vector. USER SHOULD NOT ACCESS THIS DIRECTLY - IT IS AN INTERNAL DETAIL AND CAN CHANGE. */
+    size_t vectorLen;               /**< Length of the transport vector. USER SHOULD NOT ACCESS THIS DIRECTLY - IT IS AN INTERNAL DETAIL AND CAN CHANGE. */
+};
+
+static MQTTRetransmitStore_t store;
+static uint8_t storeMemory[ STORE_SEGMENT_SIZE * STORE_SEGMENT_COUNT ];
+static MQTTRetransmitStoreSegment_t storeSegments[ STORE_SEGMENT_COUNT ];
+static MQTTRetransmitStoreEntry_t storeEntries[ STORE_ENTRY_COUNT ];
+
+/* ============================   UNITY FIXTURES ============================ */
+void setUp( void )
+{
+    MQTTStatus_t status;
+
+    ( void ) memset( storeMemory, 0xFF, sizeof( storeMemory ) );
+
+    status = MQTT_RetransmitStoreInit( &store,
+                                       storeMemory,
+                                       sizeof( storeMemory ),
+                                       storeSegments,
+                                       STORE_SEGMENT_COUNT,
+                                       storeEntries,
+                                       STORE_ENTRY_COUNT );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+/* called before each testcase */
+void tearDown( void )
+{
+}
+
+/* called at the beginning of the whole suite */
+void suiteSetUp()
+{
+}
+
+/* called at the end of the whole suite */
+int suiteTearDown( int numFailures )
+{
+    return numFailures;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Store a packet given in two vectors, the way the library stores a
+ * PUBLISH header and its payload.
+ */
+static MQTTStatus_t appendPacket( uint32_t handle,
+                                  const uint8_t * pPacket,
+                                  size_t packetLength )
+{
+    TransportOutVector_t vectors[ 2 ];
+    MQTTVec_t mqttVec;
+
+    vectors[ 0 ].iov_base = pPacket;
+    vectors[ 0 ].iov_len = packetLength / 2U;
+    vectors[ 1 ].iov_base = &pPacket[ packetLength / 2U ];
+    vectors[ 1 ].iov_len = packetLength - ( packetLength / 2U );
+    mqttVec.pVector = vectors;
+    mqttVec.vectorLen = 2U;
+
+    return MQTT_RetransmitStoreAppend( &store, handle, &mqttVec );
+}
+
+/**
+ * @brief Store a packet of #PACKET_LENGTH bytes, all set to @p fill.
+ */
+static MQTTStatus_t appendFilledPacket( uint32_t handle,
+                                        uint8_t fill )
+{
+    uint8_t packet[ PACKET_LENGTH ];
+
+    ( void ) memset( packet, fill, sizeof( packet ) );
+
+    return appendPacket( handle, packet, sizeof( packet ) );
+}
+
+/**
+ * @brief Check that the packet stored for a handle is a packet of
+ * #PACKET_LENGTH bytes, all set to @p fill.
+ */
+static void expectFilledPacket( uint32_t handle,
+                                uint8_t fill )
+{
+    uint8_t expected[ PACKET_LENGTH ];
+    uint8_t * pPacket = NULL;
+    size_t packetLength = 0U;
+    MQTTStatus_t status;
+
+    ( void ) memset( expected, fill, sizeof( expected ) );
+
+    status = MQTT_RetransmitStoreRetrieve( &store, handle, &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( PACKET_LENGTH, packetLength );
+    TEST_ASSERT_EQUAL_MEMORY( expected, pPacket, PACKET_LENGTH );
+}
+
+/**
+ * @brief Initialize the store again from the content of its memory.
+ */
+static MQTTStatus_t recoverStore( void )
+{
+    return MQTT_RetransmitStoreRecover( &store,
+                                        storeMemory,
+                                        sizeof( storeMemory ),
+                                        storeSegments,
+                                        STORE_SEGMENT_COUNT,
+                                        storeEntries,
+                                        STORE_ENTRY_COUNT );
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that MQTT_RetransmitStoreInit and MQTT_RetransmitStoreRecover
+ * reject invalid parameters.
+ */
+void test_MQTT_RetransmitStoreInit_Invalid_Params( void )
+{
+    MQTTRetransmitStore_t newStore = { 0 };
+    MQTTStatus_t status;
+
+    status = MQTT_RetransmitStoreInit( NULL, storeMemory, 512, storeSegments, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreInit( &newStore, NULL, 512, storeSegments, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 512, NULL, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 512, storeSegments, 4, NULL, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A single segment leaves none to compact into. */
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 512, storeSegments, 1, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Entry count not a power of 2. */
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 512, storeSegments, 4, storeEntries, 12 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 512, storeSegments, 4, storeEntries, 1 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Segments too small for a record header. */
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 80, storeSegments, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRecover( &newStore, storeMemory, 80, storeSegments, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    TEST_ASSERT_NULL( newStore.pMemory );
+
+    status = MQTT_RetransmitStoreInit( &newStore, storeMemory, 84, storeSegments, 4, storeEntries, 16 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 21U, newStore.segmentSize );
+    TEST_ASSERT_EQUAL( 0U, storeMemory[ 21 ] );
+}
+
+/**
+ * @brief Test storing, replacing, retrieving and clearing packets.
+ */
+void test_MQTT_RetransmitStore_AppendRetrieveClear( void )
+{
+    MQTTRetransmitStore_t emptyStore = { 0 };
+    const uint8_t pubrel[ 4 ] = { MQTT_PACKET_TYPE_PUBREL, 2U, 0U, 1U };
+    uint8_t largePacket[ STORE_SEGMENT_SIZE ] = { 0 };
+    const uint32_t handles[ 2 ] = { 1U, ACK_HANDLE( 1U ) };
+    uint32_t missingHandles[ 2 ] = { 1U, 2U };
+    TransportOutVector_t packets[ 2 ];
+    uint8_t * pPacket = NULL;
+    size_t packetLength = 0U;
+    MQTTVec_t mqttVec;
+    MQTTStatus_t status;
+
+    /* Invalid parameters. */
+    mqttVec.pVector = packets;
+    mqttVec.vectorLen = 0U;
+    status = MQTT_RetransmitStoreAppend( NULL, 1U, &mqttVec );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreAppend( &emptyStore, 1U, &mqttVec );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreAppend( &store, 1U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreAppend( &store, 0U, &mqttVec );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Empty packets, and packets larger than a segment. */
+    status = MQTT_RetransmitStoreAppend( &store, 1U, &mqttVec );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = appendPacket( 1U, largePacket, STORE_SEGMENT_SIZE - MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE + 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = appendFilledPacket( 1U, 0xA1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( ACK_HANDLE( 1U ), pubrel, sizeof( pubrel ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    expectFilledPacket( 1U, 0xA1U );
+
+    /* The packet points into the log. */
+    status = MQTT_RetransmitStoreRetrieve( &store, ACK_HANDLE( 1U ), &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( sizeof( pubrel ), packetLength );
+    TEST_ASSERT_EQUAL_MEMORY( pubrel, pPacket, sizeof( pubrel ) );
+    TEST_ASSERT_EQUAL_PTR( &storeMemory[ ( 2U * MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) + PACKET_LENGTH ], pPacket );
+
+    status = MQTT_RetransmitStoreRetrieveBatch( &store, handles, 2U, packets );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( pPacket, packets[ 1 ].iov_base );
+    TEST_ASSERT_EQUAL( PACKET_LENGTH, packets[ 0 ].iov_len );
+
+    /* Replacing a packet clears the previous one. */
+    status = appendFilledPacket( 1U, 0xB1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    expectFilledPacket( 1U, 0xB1U );
+    TEST_ASSERT_EQUAL( 1U, store.currentSegment );
+    TEST_ASSERT_EQUAL( ( 2U * MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE ) + PACKET_LENGTH + sizeof( pubrel ),
+                       storeSegments[ 0 ].used );
+    TEST_ASSERT_EQUAL( MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE + sizeof( pubrel ),
+                       storeSegments[ 0 ].live );
+
+    /* Packets which are not stored. */
+    status = MQTT_RetransmitStoreRetrieve( &store, 2U, &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieve( &store, 0U, &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieve( &emptyStore, 1U, &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieve( &store, 1U, NULL, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieve( &store, 1U, &pPacket, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieveBatch( &store, missingHandles, 2U, packets );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieveBatch( &store, NULL, 2U, packets );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRetrieveBatch( &store, handles, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTT_RetransmitStoreClear( &store, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RetransmitStoreRetrieve( &store, 1U, &pPacket, &packetLength );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreClear( &store, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreClear( &store, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreClear( NULL, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Clearing the last live record of a segment empties it. */
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 1 ].used );
+    status = MQTT_RetransmitStoreClear( &store, ACK_HANDLE( 1U ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, store.entriesUsed );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 0 ].used );
+    TEST_ASSERT_EQUAL( 0U, storeMemory[ 0 ] );
+}
+
+/**
+ * @brief Test that the index keeps an entry free, and still finds handles
+ * whose searches went past removed ones.
+ */
+void test_MQTT_RetransmitStore_IndexFull( void )
+{
+    const uint8_t packet[ 1 ] = { MQTT_PACKET_TYPE_PINGREQ };
+    uint8_t * pPacket = NULL;
+    size_t packetLength = 0U;
+    uint32_t packetId;
+    uint32_t remaining;
+    MQTTStatus_t status;
+
+    /* The acknowledgment of packet ID n starts its search at the home entry
+     * of packet ID n ^ 1. */
+    for( packetId = 1U; packetId <= 8U; packetId++ )
+    {
+        status = appendPacket( packetId, packet, sizeof( packet ) );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+        if( packetId < 8U )
+        {
+            status = appendPacket( ACK_HANDLE( packetId ), packet, sizeof( packet ) );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+        }
+    }
+
+    status = appendPacket( 9U, packet, sizeof( packet ) );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    /* Replacing a stored packet takes no entry. */
+    status = appendPacket( 1U, packet, sizeof( packet ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    for( packetId = 1U; packetId < 8U; packetId++ )
+    {
+        status = MQTT_RetransmitStoreClear( &store, packetId );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+        for( remaining = packetId + 1U; remaining <= 8U; remaining++ )
+        {
+            status = MQTT_RetransmitStoreRetrieve( &store, remaining, &pPacket, &packetLength );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+        }
+
+        for( remaining = 1U; remaining < 8U; remaining++ )
+        {
+            status = MQTT_RetransmitStoreRetrieve( &store, ACK_HANDLE( remaining ), &pPacket, &packetLength );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+        }
+    }
+
+    TEST_ASSERT_EQUAL( 8U, store.entriesUsed );
+}
+
+/**
+ * @brief Test that storing compacts a segment when no segment has room,
+ * and fails when compaction cannot make room.
+ */
+void test_MQTT_RetransmitStoreAppend_Compacts( void )
+{
+    uint32_t handle;
+    MQTTStatus_t status;
+
+    /* Two records of 64 bytes fill a segment. Three segments are filled, and
+     * the fourth is kept free. */
+    for( handle = 1U; handle <= 6U; handle++ )
+    {
+        status = appendFilledPacket( handle, ( uint8_t ) handle );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    }
+
+    TEST_ASSERT_EQUAL( 2U, store.currentSegment );
+    status = appendFilledPacket( 7U, 7U );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    /* Half of segment 1 is cleared, so it is moved to segment 3. */
+    status = MQTT_RetransmitStoreClear( &store, 3U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 7U, 7U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 3U, store.currentSegment );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 1 ].used );
+    TEST_ASSERT_EQUAL( 128U, storeSegments[ 3 ].used );
+
+    for( handle = 1U; handle <= 7U; handle++ )
+    {
+        if( handle != 3U )
+        {
+            expectFilledPacket( handle, ( uint8_t ) handle );
+        }
+    }
+
+    /* Clearing both records of a segment frees it. */
+    status = MQTT_RetransmitStoreClear( &store, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RetransmitStoreClear( &store, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 0 ].used );
+    status = appendFilledPacket( 8U, 8U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, store.currentSegment );
+}
+
+/**
+ * @brief Test compacting the segment with the most cleared bytes on request.
+ */
+void test_MQTT_RetransmitStoreCompact( void )
+{
+    MQTTRetransmitStore_t emptyStore = { 0 };
+    bool compacted = true;
+    MQTTStatus_t status;
+
+    status = MQTT_RetransmitStoreCompact( NULL, &compacted );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreCompact( &emptyStore, &compacted );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Nothing to take back. */
+    status = MQTT_RetransmitStoreCompact( &store, &compacted );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_FALSE( compacted );
+
+    status = appendFilledPacket( 1U, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 2U, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 3U, 3U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RetransmitStoreClear( &store, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Segment 0 is compacted into segment 2, while segment 1 stays current. */
+    status = MQTT_RetransmitStoreCompact( &store, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 0 ].used );
+    TEST_ASSERT_EQUAL( 64U, storeSegments[ 2 ].used );
+    TEST_ASSERT_EQUAL( 1U, store.currentSegment );
+    expectFilledPacket( 2U, 2U );
+    expectFilledPacket( 3U, 3U );
+
+    /* The current segment is compacted into the first free segment, which
+     * becomes current. */
+    status = MQTT_RetransmitStoreClear( &store, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 3U, 4U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RetransmitStoreCompact( &store, &compacted );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_TRUE( compacted );
+    TEST_ASSERT_EQUAL( 0U, store.currentSegment );
+    TEST_ASSERT_EQUAL( 64U, storeSegments[ 0 ].live );
+    expectFilledPacket( 3U, 4U );
+}
+
+/**
+ * @brief Test recovering the packets of a store from its memory, up to an
+ * incomplete or corrupted record.
+ */
+void test_MQTT_RetransmitStoreRecover( void )
+{
+    MQTTRetransmitStoreEntry_t smallEntries[ 2 ];
+    uint32_t nextSequence;
+    size_t offset;
+    MQTTStatus_t status;
+
+    status = appendFilledPacket( 1U, 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 2U, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 3U, 3U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 2U, 4U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RetransmitStoreClear( &store, 3U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    nextSequence = store.nextSequence;
+
+    ( void ) memset( storeSegments, 0xFF, sizeof( storeSegments ) );
+    ( void ) memset( storeEntries, 0xFF, sizeof( storeEntries ) );
+    status = recoverStore();
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    TEST_ASSERT_EQUAL( nextSequence, store.nextSequence );
+    TEST_ASSERT_EQUAL( 1U, store.currentSegment );
+    expectFilledPacket( 1U, 1U );
+    expectFilledPacket( 2U, 4U );
+    TEST_ASSERT_EQUAL( 128U, storeSegments[ 1 ].used );
+    TEST_ASSERT_EQUAL( 64U, storeSegments[ 1 ].live );
+
+    /* A packet replaced just before the process stopped is found twice,
+     * and its most recent record is kept. */
+    TEST_ASSERT_EQUAL( 0x00U, storeMemory[ 64U + 2U ] );
+    storeMemory[ 64U + 2U ] = 0xA5U;
+    status = recoverStore();
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    expectFilledPacket( 2U, 4U );
+    TEST_ASSERT_EQUAL( 0x00U, storeMemory[ 64U + 2U ] );
+    TEST_ASSERT_EQUAL( 64U, storeSegments[ 0 ].live );
+
+    /* A copy left by compaction next to its original is kept once. */
+    ( void ) memcpy( &storeMemory[ 2U * STORE_SEGMENT_SIZE ], &storeMemory[ 0 ], 64U );
+    status = recoverStore();
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    TEST_ASSERT_EQUAL( 64U, storeSegments[ 0 ].live + storeSegments[ 2 ].live );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 2 ].used );
+
+    /* A record whose packet was not completely written is dropped, along
+     * with the records after it. */
+    status = appendFilledPacket( 5U, 5U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendFilledPacket( 4U, 6U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    offset = ( store.currentSegment * STORE_SEGMENT_SIZE ) + MQTT_RETRANSMIT_STORE_RECORD_HEADER_SIZE;
+    storeMemory[ offset ] ^= 0x01U;
+    status = recoverStore();
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, store.entriesUsed );
+    expectFilledPacket( 1U, 1U );
+    expectFilledPacket( 2U, 4U );
+
+    /* An index too small for the packets. */
+    status = MQTT_RetransmitStoreRecover( &store,
+                                          storeMemory,
+                                          sizeof( storeMemory ),
+                                          storeSegments,
+                                          STORE_SEGMENT_COUNT,
+                                          smallEntries,
+                                          2U );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+}
+
+/**
+ * @brief Test recovering a store whose process stopped while compacting a
+ * segment, which leaves no segment free.
+ */
+void test_MQTT_RetransmitStoreRecover_InterruptedCompaction( void )
+{
+    uint8_t packet[ 12 ];
+    uint8_t * pPacket = NULL;
+    size_t packetLength = 0U;
+    uint32_t handle;
+    MQTTStatus_t status;
+
+    /* Records of 32 bytes, four of which fill a segment. */
+    for( handle = 1U; handle <= 12U; handle++ )
+    {
+        ( void ) memset( packet, ( int ) handle, sizeof( packet ) );
+        status = appendPacket( handle, packet, sizeof( packet ) );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    }
+
+    status = MQTT_RetransmitStoreClear( &store, 5U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* Compacting segment 1 into segment 3 stops after copying the record of
+     * handle 6 and clearing its original. */
+    ( void ) memcpy( &storeMemory[ 3U * STORE_SEGMENT_SIZE ], &storeMemory[ STORE_SEGMENT_SIZE + 32U ], 32U );
+    storeMemory[ ( 3U * STORE_SEGMENT_SIZE ) + 32U ] = 0x00U;
+    storeMemory[ ( 3U * STORE_SEGMENT_SIZE ) + 33U ] = 0x00U;
+    storeMemory[ STORE_SEGMENT_SIZE + 32U + 2U ] = 0x00U;
+
+    status = recoverStore();
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 11U, store.entriesUsed );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 3 ].used );
+    TEST_ASSERT_EQUAL( 96U, storeSegments[ 1 ].live );
+
+    for( handle = 1U; handle <= 12U; handle++ )
+    {
+        if( handle != 5U )
+        {
+            ( void ) memset( packet, ( int ) handle, sizeof( packet ) );
+            status = MQTT_RetransmitStoreRetrieve( &store, handle, &pPacket, &packetLength );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+            TEST_ASSERT_EQUAL( sizeof( packet ), packetLength );
+            TEST_ASSERT_EQUAL_MEMORY( packet, pPacket, sizeof( packet ) );
+        }
+    }
+
+    /* The free segment is used to compact segment 1 again. */
+    ( void ) memset( packet, 13, sizeof( packet ) );
+    status = appendPacket( 13U, packet, sizeof( packet ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, storeSegments[ 1 ].used );
+    TEST_ASSERT_EQUAL( 128U, storeSegments[ 3 ].used );
+}
+
+/**
+ * @brief Test filling the state records of a context from the stored
+ * packets, in the order they were first stored.
+ */
+void test_MQTT_RetransmitStoreRestoreRecords( void )
+{
+    const uint8_t publishQoS1[ 4 ] = { MQTT_PACKET_TYPE_PUBLISH | 0x02U, 2U, 0U, 0U };
+    const uint8_t publishQoS2[ 4 ] = { MQTT_PACKET_TYPE_PUBLISH | 0x04U, 2U, 0U, 0U };
+    const uint8_t pubrel[ 4 ] = { MQTT_PACKET_TYPE_PUBREL, 2U, 0U, 3U };
+    const uint8_t pubrec[ 4 ] = { MQTT_PACKET_TYPE_PUBREC, 2U, 0U, 4U };
+    const uint8_t pingreq[ 2 ] = { MQTT_PACKET_TYPE_PINGREQ, 0U };
+    MQTTPubAckInfo_t outgoingRecords[ 4 ];
+    MQTTPubAckInfo_t incomingRecords[ 2 ];
+    MQTTStatus_t status;
+
+    status = appendPacket( 5U, publishQoS1, sizeof( publishQoS1 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( ACK_HANDLE( 3U ), pubrel, sizeof( pubrel ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( 1U, publishQoS2, sizeof( publishQoS2 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( ACK_HANDLE( 4U ), pubrec, sizeof( pubrec ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( 9U, pingreq, sizeof( pingreq ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = appendPacket( 2U, publishQoS1, sizeof( publishQoS1 ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    status = MQTT_RetransmitStoreRestoreRecords( NULL, outgoingRecords, 4U, incomingRecords, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRestoreRecords( &store, NULL, 4U, incomingRecords, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRestoreRecords( &store, outgoingRecords, 4U, NULL, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RetransmitStoreRestoreRecords( &store, outgoingRecords, 3U, incomingRecords, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+    status = MQTT_RetransmitStoreRestoreRecords( &store, outgoingRecords, 4U, NULL, 0U );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+
+    status = MQTT_RetransmitStoreRestoreRecords( &store, outgoingRecords, 4U, incomingRecords, 2U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    TEST_ASSERT_EQUAL( 5U, outgoingRecords[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTQoS1, outgoingRecords[ 0 ].qos );
+    TEST_ASSERT_EQUAL( MQTTPubAckPending, outgoingRecords[ 0 ].publishState );
+    TEST_ASSERT_EQUAL( 3U, outgoingRecords[ 1 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTQoS2, outgoingRecords[ 1 ].qos );
+    TEST_ASSERT_EQUAL( MQTTPubCompPending, outgoingRecords[ 1 ].publishState );
+    TEST_ASSERT_EQUAL( 1U, outgoingRecords[ 2 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTQoS2, outgoingRecords[ 2 ].qos );
+    TEST_ASSERT_EQUAL( MQTTPubRecPending, outgoingRecords[ 2 ].publishState );
+    TEST_ASSERT_EQUAL( 2U, outgoingRecords[ 3 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTPubAckPending, outgoingRecords[ 3 ].publishState );
+
+    TEST_ASSERT_EQUAL( 4U, incomingRecords[ 0 ].packetId );
+    TEST_ASSERT_EQUAL( MQTTQoS2, incomingRecords[ 0 ].qos );
+    TEST_ASSERT_EQUAL( MQTTPubRelPending, incomingRecords[ 0 ].publishState );
+    TEST_ASSERT_EQUAL( 0U, incomingRecords[ 1 ].packetId );
+}
@@ -0,0 +1,601 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_router_utest.c
+ * @brief Unit tests for functions in core_mqtt_router.h.
+ */
+#include <string.h>
+#include "unity.h"
+
+#include "core_mqtt_router.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Number of nodes of the routers under test.
+ */
+#define ROUTER_NODE_COUNT      ( 256U )
+
+/**
+ * @brief Longest level kept by the routers under test.
+ */
+#define ROUTER_LEVEL_LENGTH    ( 8U )
+
+/**
+ * @brief Number of buckets of the routers under test.
+ */
+#define ROUTER_BUCKET_COUNT    ( 512U )
+
+/**
+ * @brief Number of routes of the routers under test.
+ */
+#define ROUTER_ROUTE_COUNT     ( 128U )
+
+/**
+ * @brief Maximum length of the generated topic names and filters.
+ */
+#define TOPIC_BUFFER_LENGTH    ( 16U )
+
+static MQTTRouter_t router;
+static MQTTRouterNode_t routerNodes[ ROUTER_NODE_COUNT ];
+static char routerLevels[ ROUTER_NODE_COUNT * ROUTER_LEVEL_LENGTH ];
+static uint16_t routerBuckets[ ROUTER_BUCKET_COUNT ];
+static MQTTRoute_t routes[ ROUTER_ROUTE_COUNT ];
+
+/* ============================   UNITY FIXTURES ============================ */
+void setUp( void )
+{
+    MQTTStatus_t status;
+
+    status = MQTT_RouterInit( &router,
+                              routerNodes,
+                              ROUTER_NODE_COUNT,
+                              routerLevels,
+                              ROUTER_LEVEL_LENGTH,
+                              routerBuckets,
+                              ROUTER_BUCKET_COUNT,
+                              routes,
+                              ROUTER_ROUTE_COUNT );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+/* called before each testcase */
+void tearDown( void )
+{
+}
+
+/* called at the beginning of the whole suite */
+void suiteSetUp()
+{
+}
+
+/* called at the end of the whole suite */
+int suiteTearDown( int numFailures )
+{
+    return numFailures;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Route handler counting its calls in the size_t its user data points
+ * to.
+ */
+static void countingHandler( MQTTContext_t * pContext,
+                             MQTTDeserializedInfo_t * pDeserializedInfo,
+                             void * pUserData )
+{
+    ( void ) pContext;
+    ( void ) pDeserializedInfo;
+
+    ( *( ( size_t * ) pUserData ) )++;
+}
+
+/**
+ * @brief Dispatch a topic name and return the number of handlers called.
+ */
+static size_t dispatchTopic( const char * pTopicName )
+{
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    MQTTStatus_t status;
+    size_t matchCount = 0U;
+
+    publishInfo.pTopicName = pTopicName;
+    publishInfo.topicNameLength = strlen( pTopicName );
+    deserializedInfo.pPublishInfo = &publishInfo;
+
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    return matchCount;
+}
+
+/**
+ * @brief Write the topic made of the levels given by the base 4 digits of
+ * @p number, using @p pLevels for the digits.
+ */
+static void makeTopic( char * pTopic,
+                       size_t levelCount,
+                       size_t number,
+                       const char * const * pLevels )
+{
+    size_t level;
+    size_t digits = number;
+
+    pTopic[ 0 ] = '\0';
+
+    for( level = 0U; level < levelCount; level++ )
+    {
+        if( level > 0U )
+        {
+            ( void ) strcat( pTopic, "/" );
+        }
+
+        ( void ) strcat( pTopic, pLevels[ digits % 4U ] );
+        digits /= 4U;
+    }
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that MQTT_RouterInit rejects invalid parameters.
+ */
+void test_MQTT_RouterInit_Invalid_Params( void )
+{
+    MQTTRouter_t newRouter = { 0 };
+    MQTTStatus_t status;
+
+    status = MQTT_RouterInit( NULL, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, NULL, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, NULL, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, NULL, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, NULL, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Too few or too many nodes. */
+    status = MQTT_RouterInit( &newRouter, routerNodes, 1, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, ( size_t ) UINT16_MAX + 1U, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 131072, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Level length of 0 or too large. */
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, 0, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ( size_t ) UINT16_MAX + 1U, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Bucket count not larger than node count, or not a power of 2. */
+    status = MQTT_RouterInit( &newRouter, routerNodes, 8, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 12, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Too few or too many routes. */
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 0 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, ( size_t ) UINT16_MAX + 1U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    TEST_ASSERT_NULL( newRouter.pNodes );
+
+    status = MQTT_RouterInit( &newRouter, routerNodes, 4, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 8, routes, 4 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, newRouter.nodesUsed );
+    TEST_ASSERT_EQUAL( 1U, newRouter.freeRoute );
+    TEST_ASSERT_EQUAL( 0U, routes[ 3 ].nextRoute );
+}
+
+/**
+ * @brief Test that MQTT_RouterAdd rejects invalid parameters and topic
+ * filters, and fails when the router is full.
+ */
+void test_MQTT_RouterAdd_Invalid_Params( void )
+{
+    MQTTRouter_t smallRouter = { 0 };
+    MQTTStatus_t status;
+    size_t count = 0U;
+
+    status = MQTT_RouterAdd( NULL, "a", 1, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &smallRouter, "a", 1, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "a", 1, NULL, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, NULL, 1, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "a", 0, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Wildcards which are not whole levels, and '#' before the last level. */
+    status = MQTT_RouterAdd( &router, "a+", 2, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "+a", 2, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "a/#/b", 5, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "a#", 2, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A level longer than the router keeps. */
+    status = MQTT_RouterAdd( &router, "a/level_9ch", 11, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Shared subscriptions without a valid share name or topic filter. */
+    status = MQTT_RouterAdd( &router, "$share//a", 9, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "$share/g", 8, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "$share/g/", 9, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterAdd( &router, "$share/g+/a", 11, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    TEST_ASSERT_EQUAL( 1U, router.nodesUsed );
+
+    /* A router with 3 nodes holds 2 levels, and one with 1 route holds one
+     * handler. The levels added for a topic filter which does not fit are
+     * freed again. */
+    status = MQTT_RouterInit( &smallRouter, routerNodes, 3, routerLevels, ROUTER_LEVEL_LENGTH, routerBuckets, 4, routes, 1 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RouterAdd( &smallRouter, "a/b/c", 5, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+    TEST_ASSERT_EQUAL( 0U, routerNodes[ 0 ].childCount );
+    TEST_ASSERT_EQUAL( 1U, smallRouter.freeNode );
+    status = MQTT_RouterAdd( &smallRouter, "a/b", 3, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RouterAdd( &smallRouter, "a/b", 3, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+}
+
+/**
+ * @brief Test the matching of wildcards, shared subscriptions and topic names
+ * starting with '$'.
+ */
+void test_MQTT_RouterDispatch_Wildcards( void )
+{
+    size_t counts[ 8 ] = { 0 };
+    size_t plusCount = 0U;
+    const char * const filters[ 8 ] =
+    {
+        "sport/tennis/player1",
+        "sport/tennis/+",
+        "sport/#",
+        "+/+/player1",
+        "#",
+        "$share/group/sport/+/player1",
+        "$SYS/#",
+        "sport/+"
+    };
+    size_t i;
+    MQTTStatus_t status;
+
+    for( i = 0U; i < 8U; i++ )
+    {
+        status = MQTT_RouterAdd( &router, filters[ i ], strlen( filters[ i ] ), countingHandler, &counts[ i ] );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    }
+
+    TEST_ASSERT_EQUAL( 6U, dispatchTopic( "sport/tennis/player1" ) );
+    TEST_ASSERT_EQUAL( 1U, counts[ 0 ] );
+    TEST_ASSERT_EQUAL( 1U, counts[ 5 ] );
+    TEST_ASSERT_EQUAL( 0U, counts[ 6 ] );
+    TEST_ASSERT_EQUAL( 0U, counts[ 7 ] );
+
+    /* "sport/#" and "sport/+" also match the parent level. */
+    TEST_ASSERT_EQUAL( 3U, dispatchTopic( "sport/" ) );
+    TEST_ASSERT_EQUAL( 2U, dispatchTopic( "sport" ) );
+    TEST_ASSERT_EQUAL( 1U, counts[ 7 ] );
+
+    /* Wildcards starting a topic filter do not match "$SYS". */
+    TEST_ASSERT_EQUAL( 1U, dispatchTopic( "$SYS/tennis/player1" ) );
+    TEST_ASSERT_EQUAL( 1U, counts[ 6 ] );
+    TEST_ASSERT_EQUAL( 1U, counts[ 3 ] );
+    TEST_ASSERT_EQUAL( 3U, counts[ 4 ] );
+
+    /* An empty level is matched by '+'. */
+    status = MQTT_RouterAdd( &router, "+/+", 3, countingHandler, &plusCount );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, dispatchTopic( "/finance" ) );
+    TEST_ASSERT_EQUAL( 2U, dispatchTopic( "/" ) );
+    TEST_ASSERT_EQUAL( 1U, dispatchTopic( "//" ) );
+    TEST_ASSERT_EQUAL( 2U, plusCount );
+}
+
+/**
+ * @brief Test that the router calls the same handlers as MQTT_MatchTopic,
+ * over all topic filters and topic names of up to 3 non-empty levels.
+ *
+ * Unlike MQTT_MatchTopic, the router also matches "+/#" with the parent
+ * level of "+", as it does "sport/#" with "sport".
+ */
+void test_MQTT_RouterDispatch_MatchesMatchTopic( void )
+{
+    const char * const filterLevels[ 4 ] = { "a", "b", "c", "+" };
+    const char * const nameLevels[ 4 ] = { "a", "b", "c", "d" };
+    static char filters[ ROUTER_ROUTE_COUNT ][ TOPIC_BUFFER_LENGTH ];
+    size_t counts[ ROUTER_ROUTE_COUNT ];
+    char topicName[ TOPIC_BUFFER_LENGTH ];
+    size_t filterCount = 0U;
+    size_t levelCount;
+    size_t number;
+    size_t end;
+    size_t i;
+    size_t expectedCount;
+    size_t filterLength;
+    bool isMatch;
+    bool isParentMatch;
+    MQTTStatus_t status;
+
+    /* Topic filters of 1 or 2 levels, and the same followed by "/#". */
+    for( levelCount = 1U; levelCount <= 2U; levelCount++ )
+    {
+        end = ( levelCount == 1U ) ? 4U : 16U;
+
+        for( number = 0U; number < end; number++ )
+        {
+            makeTopic( filters[ filterCount ], levelCount, number, filterLevels );
+            ( void ) strcpy( filters[ filterCount + 1U ], filters[ filterCount ] );
+            ( void ) strcat( filters[ filterCount + 1U ], "/#" );
+            filterCount += 2U;
+        }
+    }
+
+    ( void ) strcpy( filters[ filterCount ], "#" );
+    filterCount++;
+
+    for( i = 0U; i < filterCount; i++ )
+    {
+        counts[ i ] = 0U;
+        status = MQTT_RouterAdd( &router, filters[ i ], strlen( filters[ i ] ), countingHandler, &counts[ i ] );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    }
+
+    for( levelCount = 1U; levelCount <= 3U; levelCount++ )
+    {
+        end = ( levelCount == 1U ) ? 4U : ( ( levelCount == 2U ) ? 16U : 64U );
+
+        for( number = 0U; number < end; number++ )
+        {
+            makeTopic( topicName, levelCount, number, nameLevels );
+
+            expectedCount = 0U;
+
+            for( i = 0U; i < filterCount; i++ )
+            {
+                counts[ i ] = 0U;
+            }
+
+            ( void ) dispatchTopic( topicName );
+
+            for( i = 0U; i < filterCount; i++ )
+            {
+                filterLength = strlen( filters[ i ] );
+                status = MQTT_MatchTopic( topicName, strlen( topicName ),
+                                          filters[ i ], filterLength,
+                                          &isMatch );
+                TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+                if( ( isMatch == false ) && ( filterLength > 2U ) && ( filters[ i ][ filterLength - 1U ] == '#' ) )
+                {
+                    status = MQTT_MatchTopic( topicName, strlen( topicName ),
+                                              filters[ i ], filterLength - 2U,
+                                              &isParentMatch );
+                    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+                    isMatch = isParentMatch;
+                }
+
+                TEST_ASSERT_EQUAL( isMatch ? 1U : 0U, counts[ i ] );
+                expectedCount += counts[ i ];
+            }
+
+            TEST_ASSERT_EQUAL( expectedCount, dispatchTopic( topicName ) );
+        }
+    }
+}
+
+/**
+ * @brief Test that removed handlers are no longer called, and that their
+ * routes are used again.
+ */
+void test_MQTT_RouterRemove( void )
+{
+    size_t countA = 0U;
+    size_t countB = 0U;
+    size_t countC = 0U;
+    MQTTStatus_t status;
+
+    status = MQTT_RouterAdd( &router, "a/+", 3, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTT_RouterAdd( &router, "$share/g/a/+", 12, countingHandler, &countB );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, dispatchTopic( "a/b" ) );
+
+    /* Invalid parameters, or handlers which are not registered. */
+    status = MQTT_RouterRemove( NULL, "a/+", 3, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, NULL, 3, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, "a/+", 3, NULL, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, "a/b", 3, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, "a/+/c", 5, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, "a/+", 3, countingHandler, &countC );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterRemove( &router, "a/+b", 4, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The shared subscription is removed through its topic filter. */
+    status = MQTT_RouterRemove( &router, "a/+", 3, countingHandler, &countB );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, dispatchTopic( "a/b" ) );
+    TEST_ASSERT_EQUAL( 2U, countA );
+    TEST_ASSERT_EQUAL( 1U, countB );
+
+    status = MQTT_RouterRemove( &router, "a/+", 3, countingHandler, &countA );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, dispatchTopic( "a/b" ) );
+
+    /* The last removed route is the first to be used again, and so are the
+     * nodes freed with it. */
+    status = MQTT_RouterAdd( &router, "a/+", 3, countingHandler, &countB );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, router.pNodes[ router.nodesUsed - 1U ].firstRoute );
+    TEST_ASSERT_EQUAL( 3U, router.nodesUsed );
+    TEST_ASSERT_EQUAL( 0U, router.freeNode );
+    TEST_ASSERT_EQUAL( 1U, dispatchTopic( "a/b" ) );
+}
+
+/**
+ * @brief Test that adding and removing topic filters many times neither
+ * leaks nodes nor depends on the memory of the topic filters.
+ */
+void test_MQTT_RouterRemove_Churn( void )
+{
+    const char * const levels[ 4 ] = { "a", "bb", "+", "ccc" };
+    char topicFilter[ TOPIC_BUFFER_LENGTH ];
+    size_t count = 0U;
+    size_t round;
+    size_t number;
+    size_t bucket;
+    size_t bucketsUsed;
+    MQTTStatus_t status;
+
+    /* "x/y" stays registered while the others come and go. */
+    ( void ) strcpy( topicFilter, "x/y" );
+    status = MQTT_RouterAdd( &router, topicFilter, 3, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    for( round = 0U; round < 50U; round++ )
+    {
+        /* 64 topic filters of 3 levels take more nodes than the router has
+         * unless the nodes of removed topic filters are used again. */
+        for( number = 0U; number < 64U; number++ )
+        {
+            makeTopic( topicFilter, 3U, number + ( round * 7U ), levels );
+            status = MQTT_RouterAdd( &router, topicFilter, strlen( topicFilter ), countingHandler, &count );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+        }
+
+        /* The router keeps its own copy of the levels. */
+        ( void ) memset( topicFilter, '#', sizeof( topicFilter ) );
+        TEST_ASSERT_EQUAL( 1U, dispatchTopic( "x/y" ) );
+
+        for( number = 0U; number < 64U; number++ )
+        {
+            makeTopic( topicFilter, 3U, number + ( round * 7U ), levels );
+            status = MQTT_RouterRemove( &router, topicFilter, strlen( topicFilter ), countingHandler, &count );
+            TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+        }
+    }
+
+    /* At most the 84 levels of one round and those of "x/y" were in use at
+     * once, and only the two levels of "x/y" are left. */
+    TEST_ASSERT_LESS_OR_EQUAL( 87U, router.nodesUsed );
+    TEST_ASSERT_EQUAL( 1U, router.pNodes[ 0 ].childCount );
+    bucketsUsed = 0U;
+
+    for( bucket = 0U; bucket < ROUTER_BUCKET_COUNT; bucket++ )
+    {
+        bucketsUsed += ( routerBuckets[ bucket ] != 0U ) ? 1U : 0U;
+    }
+
+    TEST_ASSERT_EQUAL( 2U, bucketsUsed );
+    TEST_ASSERT_EQUAL( 1U, dispatchTopic( "x/y" ) );
+    TEST_ASSERT_EQUAL( 0U, dispatchTopic( "a/a/a" ) );
+
+    status = MQTT_RouterRemove( &router, "x/y", 3, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 0U, router.pNodes[ 0 ].childCount );
+}
+
+/**
+ * @brief Test MQTT_RouterDispatch with invalid parameters, and with more
+ * pending branches than #MQTT_ROUTER_MAX_TOPIC_LEVELS.
+ */
+void test_MQTT_RouterDispatch_Invalid_Params( void )
+{
+    MQTTRouter_t emptyRouter = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTDeserializedInfo_t deserializedInfo = { 0 };
+    static char filters[ MQTT_ROUTER_MAX_TOPIC_LEVELS + 1U ][ ( 2U * MQTT_ROUTER_MAX_TOPIC_LEVELS ) + 2U ];
+    static char topicName[ ( 2U * MQTT_ROUTER_MAX_TOPIC_LEVELS ) + 2U ];
+    size_t count = 0U;
+    size_t matchCount = 0U;
+    size_t i;
+    MQTTStatus_t status;
+
+    status = MQTT_RouterDispatch( NULL, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterDispatch( &emptyRouter, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterDispatch( &router, NULL, NULL, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A PUBLISH whose topic alias could not be resolved. */
+    deserializedInfo.pPublishInfo = &publishInfo;
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    publishInfo.pTopicName = "a";
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* The topic name is "a/a/.../a". With the topic filters "+", "a/+",
+     * "a/a/+" and so on, the walk leaves a '+' branch pending at each level. */
+    for( i = 0U; i <= MQTT_ROUTER_MAX_TOPIC_LEVELS; i++ )
+    {
+        topicName[ 2U * i ] = 'a';
+        topicName[ ( 2U * i ) + 1U ] = '/';
+        ( void ) memcpy( filters[ i ], topicName, 2U * i );
+        filters[ i ][ 2U * i ] = '+';
+
+        status = MQTT_RouterAdd( &router, filters[ i ], ( 2U * i ) + 1U, countingHandler, &count );
+        TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    }
+
+    status = MQTT_RouterAdd( &router, topicName, ( 2U * MQTT_ROUTER_MAX_TOPIC_LEVELS ) + 1U, countingHandler, &count );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    /* All branches fit for a topic name of MQTT_ROUTER_MAX_TOPIC_LEVELS
+     * levels, which matches one of the topic filters. */
+    publishInfo.pTopicName = topicName;
+    publishInfo.topicNameLength = ( 2U * MQTT_ROUTER_MAX_TOPIC_LEVELS ) - 1U;
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 1U, count );
+
+    /* One more level does not fit. */
+    publishInfo.topicNameLength = ( 2U * MQTT_ROUTER_MAX_TOPIC_LEVELS ) + 1U;
+    status = MQTT_RouterDispatch( &router, NULL, &deserializedInfo, &matchCount );
+    TEST_ASSERT_EQUAL_INT( MQTTNoMemory, status );
+}
@@ -3236,6 +3236,42 @@ void test_MQTTV5_DeserializeSuback( void )
     TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
 }
 
+void test_incoming_publish_subscriptionIds( void )
+{
+    MQTTPacketInfo_t mqttPacketInfo;
+    uint16_t packetIdentifier = 1;
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTPublishInfo_t publishIn;
+    uint8_t buffer[ 20 ] = { 0 };
+
+    buffer[ 0 ] = 0x00;
+    buffer[ 1 ] = 0x04;
+    buffer[ 2 ] = 't', buffer[ 3 ] = 'e', buffer[ 4 ] = 's', buffer[ 5 ] = 't';
+    buffer[ 6 ] = 5;
+    buffer[ 7 ] = MQTT_SUBSCRIPTION_ID_ID, buffer[ 8 ] = 5;
+    buffer[ 9 ] = MQTT_SUBSCRIPTION_ID_ID, buffer[ 10 ] = 0x81, buffer[ 11 ] = 0x01;
+    mqttPacketInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    mqttPacketInfo.pRemainingData = buffer;
+    mqttPacketInfo.remainingLength = 12;
+
+    ( void ) memset( &publishIn, 0x0, sizeof( publishIn ) );
+
+    /* The first identifier is kept, and all of them are counted. */
+    status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishIn, &propBuffer, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 5U, publishIn.subscriptionId );
+    TEST_ASSERT_EQUAL( 2U, publishIn.subscriptionIdCount );
+
+    /* Without properties, the identifiers of an earlier PUBLISH are cleared. */
+    buffer[ 6 ] = 0;
+    mqttPacketInfo.remainingLength = 7;
+    status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishIn, &propBuffer, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 0U, publishIn.subscriptionId );
+    TEST_ASSERT_EQUAL( 0U, publishIn.subscriptionIdCount );
+}
+
 void test_incoming_publish2( void )
 {
     MQTTPacketInfo_t mqttPacketInfo;
@@ -3269,6 +3305,8 @@ void test_incoming_publish2( void )
 
     status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishIn, &propBuffer, 100, 100 );
     TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT16( MQTT_TEST_UINT16, publishIn.topicAlias );
+    TEST_ASSERT_EQUAL( 1U, publishIn.subscriptionIdCount );
 
     /* Test with NULL Property Builder. */
     status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishIn, NULL, 100, 100 );
@@ -3726,6 +3764,91 @@ void test_MQTT_GetIncomingPacketTypeAndLength1( void )
     TEST_ASSERT_EQUAL( MQTTBadResponse, status );
 }
 
+/**
+ * @brief Tests that MQTT_GetIncomingPacketTypeAndLengthBuffered reads ahead
+ * into the staging buffer and returns the over-read bytes.
+ */
+void test_MQTT_GetIncomingPacketTypeAndLengthBuffered( void )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPacketInfo_t mqttPacket = { 0 };
+    NetworkContext_t networkContext;
+    uint8_t buffer[ 10 ] = { 0 };
+    uint8_t * bufPtr = buffer;
+    uint8_t staging[ MQTT_FIXED_HEADER_MAX_SIZE ] = { 0 };
+    size_t stagedBytes = 0;
+
+    /* Dummy network context - pointer to pointer to a buffer. */
+    networkContext.buffer = &bufPtr;
+
+    /* Bad parameters. */
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( NULL, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), &stagedBytes, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, NULL, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), NULL, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, MQTT_FIXED_HEADER_MAX_SIZE - 1U, &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    stagedBytes = sizeof( staging ) + 1U;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* A CONNACK header and its body are read in a single call. */
+    buffer[ 0 ] = MQTT_PACKET_TYPE_CONNACK;
+    buffer[ 1 ] = 0x03;
+    buffer[ 2 ] = 0x01;
+    buffer[ 3 ] = 0x02;
+    buffer[ 4 ] = 0x03;
+    stagedBytes = 0;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_INT( MQTT_PACKET_TYPE_CONNACK, mqttPacket.type );
+    TEST_ASSERT_EQUAL_INT( 3, mqttPacket.remainingLength );
+    TEST_ASSERT_EQUAL_INT( 2, mqttPacket.headerLength );
+    TEST_ASSERT_EQUAL_INT( sizeof( staging ), stagedBytes );
+    TEST_ASSERT_EQUAL_MEMORY( &buffer[ 2 ], &staging[ 2 ], 3 );
+
+    /* Staged bytes are parsed without reading from the transport. */
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceiveFailure, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_INT( 3, mqttPacket.remainingLength );
+
+    /* A partial header is kept for the next call. */
+    staging[ 0 ] = MQTT_PACKET_TYPE_PUBLISH;
+    staging[ 1 ] = 0x80;
+    stagedBytes = 2;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceiveNoData, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTNeedMoreBytes, status );
+    TEST_ASSERT_EQUAL_INT( 2, stagedBytes );
+
+    bufPtr = buffer;
+    buffer[ 0 ] = 0x01;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_INT( 128, mqttPacket.remainingLength );
+    TEST_ASSERT_EQUAL_INT( 3, mqttPacket.headerLength );
+    TEST_ASSERT_EQUAL_INT( sizeof( staging ), stagedBytes );
+
+    /* No data available. */
+    stagedBytes = 0;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceiveNoData, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTNoDataAvailable, status );
+
+    /* Transport failure. */
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceiveFailure, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTRecvFailed, status );
+
+    /* Invalid packet type. */
+    bufPtr = buffer;
+    buffer[ 0 ] = 0x10;
+    stagedBytes = 0;
+    status = MQTT_GetIncomingPacketTypeAndLengthBuffered( mockReceive, &networkContext, staging, sizeof( staging ), &stagedBytes, &mqttPacket );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+}
+
 void test_MQTT_SerializePublishHeaderWithoutTopic_BadInputs( void )
 {
     MQTTPublishInfo_t publishInfo = { 0 };
@@ -5605,6 +5728,141 @@ void test_ValidateUnsubscribeProperties( void )
     TEST_ASSERT_EQUAL( MQTTBadParameter, status );
 }
 
+void test_MQTTPropertyBuilder_Seal( void )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPropBuilder_t propBuilder;
+    uint8_t buf[ 50 ];
+    MQTTUserProperty_t userProp = { "key", 3, "value", 5 };
+
+    status = MQTTPropertyBuilder_Seal( NULL, MQTT_PACKET_TYPE_PUBLISH );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    /* Initializing the builder clears the seal. */
+    memset( &propBuilder, 0xFF, sizeof( propBuilder ) );
+    status = MQTTPropertyBuilder_Init( &propBuilder, buf, sizeof( buf ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+    TEST_ASSERT_EQUAL_UINT16( 0U, propBuilder.seal.topicAlias );
+
+    status = MQTTPropAdd_ContentType( &propBuilder, "text", 4, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropAdd_TopicAlias( &propBuilder, 300, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProp, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    /* The seal records the state of the builder and the Topic Alias, which is
+     * not checked against any Topic Alias Maximum. */
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBLISH );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PUBLISH, propBuilder.seal.packetType );
+    TEST_ASSERT_EQUAL( propBuilder.currentIndex, propBuilder.seal.length );
+    TEST_ASSERT_EQUAL_UINT32( propBuilder.fieldSet, propBuilder.seal.fieldSet );
+    TEST_ASSERT_EQUAL_UINT16( 300U, propBuilder.seal.topicAlias );
+
+    /* A failed validation leaves the builder unsealed. */
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBACK );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_CONNECT );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    /* The other packet types. */
+    status = MQTTPropertyBuilder_Init( &propBuilder, buf, sizeof( buf ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProp, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_SUBSCRIBE );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_SUBSCRIBE, propBuilder.seal.packetType );
+    TEST_ASSERT_EQUAL_UINT16( 0U, propBuilder.seal.topicAlias );
+
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_UNSUBSCRIBE );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_UNSUBSCRIBE, propBuilder.seal.packetType );
+
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBACK );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBREC );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBREL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBCOMP );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PUBCOMP, propBuilder.seal.packetType );
+
+    /* Subscription Identifiers are only valid in SUBSCRIBE properties. */
+    status = MQTTPropAdd_SubscriptionId( &propBuilder, 10, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_SUBSCRIBE );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_UNSUBSCRIBE );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+
+    /* A builder without a buffer. */
+    propBuilder.pBuffer = NULL;
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBLISH );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+}
+
+void test_MQTTPropertyBuilder_Seal_Reseal( void )
+{
+    MQTTStatus_t status = MQTTSuccess;
+    MQTTPropBuilder_t propBuilder;
+    uint8_t buf[ 50 ];
+    MQTTUserProperty_t userProp = { "key", 3, "value", 5 };
+
+    status = MQTTPropertyBuilder_Init( &propBuilder, buf, sizeof( buf ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropAdd_TopicAlias( &propBuilder, 1, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBLISH );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT16( 1U, propBuilder.seal.topicAlias );
+
+    /* Building the same properties again with another Topic Alias gives the
+     * same length and fields, but unseals the builder. */
+    propBuilder.currentIndex = 0U;
+    propBuilder.fieldSet = 0U;
+    status = MQTTPropAdd_TopicAlias( &propBuilder, 2, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    status = MQTTPropertyBuilder_Seal( &propBuilder, MQTT_PACKET_TYPE_PUBLISH );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( MQTT_PACKET_TYPE_PUBLISH, propBuilder.seal.packetType );
+    TEST_ASSERT_EQUAL_UINT16( 2U, propBuilder.seal.topicAlias );
+
+    /* Every kind of property unseals the builder. */
+    status = MQTTPropAdd_PayloadFormat( &propBuilder, true, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    propBuilder.seal.packetType = MQTT_PACKET_TYPE_PUBLISH;
+    status = MQTTPropAdd_MessageExpiry( &propBuilder, 10, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    propBuilder.seal.packetType = MQTT_PACKET_TYPE_PUBLISH;
+    status = MQTTPropAdd_ContentType( &propBuilder, "text", 4, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    propBuilder.seal.packetType = MQTT_PACKET_TYPE_PUBLISH;
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProp, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+
+    propBuilder.seal.packetType = MQTT_PACKET_TYPE_SUBSCRIBE;
+    status = MQTTPropAdd_SubscriptionId( &propBuilder, 10, NULL );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT8( 0U, propBuilder.seal.packetType );
+}
+
 void test_ValidateWillProperties( void )
 {
     MQTTStatus_t status = MQTTSuccess;
@@ -8165,3 +8423,271 @@ void test_MQTT_SkipNextProperty_AllPropertyTypes( void )
     TEST_ASSERT_EQUAL( MQTTSuccess, status );
     TEST_ASSERT_EQUAL( expectedIndex, currentIndex );
 }
+
+/* ========================================================================== */
+/* Property Index Tests */
+/* ========================================================================== */
+
+/**
+ * @brief Serialize a QoS 0 PUBLISH to topic "t" with a Payload Format
+ * Indicator, a User Property, a Correlation Data and a second User Property.
+ *
+ * @return Remaining length of the PUBLISH.
+ */
+static uint32_t serializeIndexedPublish( uint8_t * pBuffer )
+{
+    static const uint8_t publish[] =
+    {
+        0x00, 0x01, 't', 21,
+        MQTT_PAYLOAD_FORMAT_ID,   0x01,
+        MQTT_USER_PROPERTY_ID,    0x00, 0x01, 'k', 0x00, 0x01, 'v',
+        MQTT_CORRELATION_DATA_ID, 0x00, 0x02, 'a', 'b',
+        MQTT_USER_PROPERTY_ID,    0x00, 0x01, 'x', 0x00, 0x01, 'y'
+    };
+
+    ( void ) memcpy( pBuffer, publish, sizeof( publish ) );
+
+    return ( uint32_t ) sizeof( publish );
+}
+
+/**
+ * @brief Test that MQTT_DeserializePublishWithProperties fills the index, and that
+ * MQTT_FindProperty finds the properties with it.
+ */
+void test_MQTT_FindProperty_Indexed( void )
+{
+    MQTTPacketInfo_t mqttPacketInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTPropIndex_t propIndex;
+    MQTTUserProperty_t userProperty;
+    const char * pCorrelationData = NULL;
+    size_t correlationDataLength = 0U;
+    uint16_t packetIdentifier = 0U;
+    uint8_t buffer[ 32 ];
+    size_t currentIndex = 0U;
+    MQTTStatus_t status;
+
+    mqttPacketInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    mqttPacketInfo.pRemainingData = buffer;
+    mqttPacketInfo.remainingLength = serializeIndexedPublish( buffer );
+    ( void ) memset( &propIndex, 0xFF, sizeof( propIndex ) );
+
+    status = MQTT_DeserializePublishWithProperties( &mqttPacketInfo, &packetIdentifier, &publishInfo,
+                                                    &propBuffer, &propIndex, NULL, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( propBuffer.pBuffer, propIndex.pBuffer );
+    TEST_ASSERT_EQUAL( 21U, propIndex.length );
+    TEST_ASSERT_EQUAL_UINT32( 1U, propIndex.offsets[ MQTT_PAYLOAD_FORMAT_ID ] );
+    TEST_ASSERT_EQUAL_UINT32( 3U, propIndex.offsets[ MQTT_USER_PROPERTY_ID ] );
+    TEST_ASSERT_EQUAL_UINT32( 10U, propIndex.offsets[ MQTT_CORRELATION_DATA_ID ] );
+    TEST_ASSERT_EQUAL_UINT32( 0U, propIndex.offsets[ MQTT_CONTENT_TYPE_ID ] );
+
+    /* A single property is found directly. */
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_CORRELATION_DATA_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 9U, currentIndex );
+    status = MQTTPropGet_CorrelationData( &propBuffer, &currentIndex, &pCorrelationData, &correlationDataLength );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, correlationDataLength );
+    TEST_ASSERT_EQUAL_MEMORY( "ab", pCorrelationData, 2U );
+
+    /* A property is not found before the index it is looked for from. */
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_PAYLOAD_FORMAT_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTEndOfProperties, status );
+    TEST_ASSERT_EQUAL( 14U, currentIndex );
+
+    /* A missing property is not found. */
+    currentIndex = 0U;
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_CONTENT_TYPE_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTEndOfProperties, status );
+    TEST_ASSERT_EQUAL( 0U, currentIndex );
+
+    /* Each User Property is found in turn. */
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_USER_PROPERTY_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, currentIndex );
+    status = MQTTPropGet_UserProp( &propBuffer, &currentIndex, &userProperty );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_MEMORY( "k", userProperty.pKey, 1U );
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_USER_PROPERTY_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 14U, currentIndex );
+    status = MQTTPropGet_UserProp( &propBuffer, &currentIndex, &userProperty );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_MEMORY( "x", userProperty.pKey, 1U );
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_USER_PROPERTY_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTEndOfProperties, status );
+}
+
+/**
+ * @brief Test that MQTT_DeserializePublish only writes the property builder,
+ * whatever it holds when called.
+ */
+void test_MQTT_DeserializePublish_UninitializedPropBuilder( void )
+{
+    MQTTPacketInfo_t mqttPacketInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPropBuilder_t propBuffer;
+    uint16_t packetIdentifier = 0U;
+    uint8_t buffer[ 32 ];
+    MQTTStatus_t status;
+
+    mqttPacketInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    mqttPacketInfo.pRemainingData = buffer;
+    mqttPacketInfo.remainingLength = serializeIndexedPublish( buffer );
+    ( void ) memset( &propBuffer, 0xA5, sizeof( propBuffer ) );
+
+    status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishInfo, &propBuffer, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( &buffer[ 4 ], propBuffer.pBuffer );
+    TEST_ASSERT_EQUAL( 21U, propBuffer.currentIndex );
+}
+
+/**
+ * @brief Test that MQTT_FindProperty walks the properties when they have no
+ * index, or an index of other properties.
+ */
+void test_MQTT_FindProperty_NotIndexed( void )
+{
+    MQTTPacketInfo_t mqttPacketInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTPropIndex_t propIndex = { 0 };
+    uint16_t packetIdentifier = 0U;
+    uint8_t buffer[ 32 ];
+    uint8_t invalidProperty[ 2 ] = { 0x00, 0x00 };
+    size_t currentIndex = 0U;
+    MQTTStatus_t status;
+
+    mqttPacketInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    mqttPacketInfo.pRemainingData = buffer;
+    mqttPacketInfo.remainingLength = serializeIndexedPublish( buffer );
+
+    status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishInfo, &propBuffer, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    status = MQTT_FindProperty( &propBuffer, NULL, MQTT_CORRELATION_DATA_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 9U, currentIndex );
+
+    /* The index of other properties is not used. */
+    currentIndex = 0U;
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_USER_PROPERTY_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, currentIndex );
+
+    currentIndex = 0U;
+    status = MQTT_FindProperty( &propBuffer, &propIndex, MQTT_CONTENT_TYPE_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTEndOfProperties, status );
+
+    /* Invalid parameters. */
+    status = MQTT_FindProperty( NULL, NULL, MQTT_CONTENT_TYPE_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_FindProperty( &propBuffer, NULL, MQTT_CONTENT_TYPE_ID, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* An invalid property stops the walk. */
+    propBuffer.pBuffer = invalidProperty;
+    propBuffer.bufferLength = sizeof( invalidProperty );
+    propBuffer.currentIndex = sizeof( invalidProperty );
+    currentIndex = 0U;
+    status = MQTT_FindProperty( &propBuffer, NULL, MQTT_CONTENT_TYPE_ID, &currentIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
+
+/* ========================================================================== */
+/* Publish Properties Decoding Tests */
+/* ========================================================================== */
+
+/**
+ * @brief Test that MQTT_DeserializePublish and
+ * MQTT_DeserializePublishPropertiesInto decode the same properties.
+ */
+void test_MQTT_DeserializePublishPropertiesInto( void )
+{
+    static const uint8_t publish[] =
+    {
+        0x00, 0x01, 't', 30,
+        MQTT_PAYLOAD_FORMAT_ID,   0x01,
+        MQTT_MSG_EXPIRY_ID,       0x00, 0x00, 0x01, 0x00,
+        MQTT_CONTENT_TYPE_ID,     0x00, 0x01, 'c',
+        MQTT_RESPONSE_TOPIC_ID,   0x00, 0x02, 'r', '/',
+        MQTT_CORRELATION_DATA_ID, 0x00, 0x02, 'a', 'b',
+        MQTT_USER_PROPERTY_ID,    0x00, 0x01, 'k', 0x00, 0x01, 'v',
+        MQTT_SUBSCRIPTION_ID_ID,  0x05
+    };
+    MQTTPacketInfo_t mqttPacketInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    MQTTPublishProperties_t deserializedProperties;
+    MQTTPublishProperties_t decodedProperties;
+    uint16_t packetIdentifier = 0U;
+    uint8_t buffer[ sizeof( publish ) ];
+    uint8_t invalidProperty[ 2 ] = { 0x00, 0x00 };
+    MQTTStatus_t status;
+
+    ( void ) memcpy( buffer, publish, sizeof( publish ) );
+    mqttPacketInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    mqttPacketInfo.pRemainingData = buffer;
+    mqttPacketInfo.remainingLength = ( uint32_t ) sizeof( publish );
+    ( void ) memset( &deserializedProperties, 0xFF, sizeof( deserializedProperties ) );
+
+    status = MQTT_DeserializePublishWithProperties( &mqttPacketInfo, &packetIdentifier, &publishInfo, &propBuffer,
+                                                    NULL, &deserializedProperties, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_TRUE( deserializedProperties.payloadFormatPresent );
+    TEST_ASSERT_EQUAL_UINT8( 1U, deserializedProperties.payloadFormat );
+    TEST_ASSERT_TRUE( deserializedProperties.messageExpiryPresent );
+    TEST_ASSERT_EQUAL_UINT32( 256U, deserializedProperties.messageExpiryInterval );
+    TEST_ASSERT_EQUAL( 1U, deserializedProperties.contentTypeLength );
+    TEST_ASSERT_EQUAL_MEMORY( "c", deserializedProperties.pContentType, 1U );
+    TEST_ASSERT_EQUAL( 2U, deserializedProperties.responseTopicLength );
+    TEST_ASSERT_EQUAL_MEMORY( "r/", deserializedProperties.pResponseTopic, 2U );
+    TEST_ASSERT_EQUAL( 2U, deserializedProperties.correlationDataLength );
+    TEST_ASSERT_EQUAL_PTR( &buffer[ 23 ], deserializedProperties.pCorrelationData );
+    TEST_ASSERT_EQUAL( 1U, deserializedProperties.userPropertyCount );
+    TEST_ASSERT_EQUAL_UINT32( 5U, publishInfo.subscriptionId );
+
+    /* The same properties are decoded from the property builder. */
+    status = MQTT_DeserializePublishPropertiesInto( &propBuffer, &decodedProperties );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_MEMORY( &deserializedProperties, &decodedProperties, sizeof( decodedProperties ) );
+
+    /* Properties absent from a PUBLISH are cleared. */
+    buffer[ 3 ] = 0;
+    mqttPacketInfo.remainingLength = 4U;
+    status = MQTT_DeserializePublishWithProperties( &mqttPacketInfo, &packetIdentifier, &publishInfo, &propBuffer,
+                                                    NULL, &deserializedProperties, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_FALSE( deserializedProperties.payloadFormatPresent );
+    TEST_ASSERT_NULL( deserializedProperties.pResponseTopic );
+    TEST_ASSERT_EQUAL( 0U, deserializedProperties.userPropertyCount );
+
+    /* MQTT_DeserializePublish does not read anything from an uninitialized
+     * publish info. */
+    ( void ) memset( &publishInfo, 0xA5, sizeof( publishInfo ) );
+    ( void ) memcpy( buffer, publish, sizeof( publish ) );
+    mqttPacketInfo.remainingLength = ( uint32_t ) sizeof( publish );
+    status = MQTT_DeserializePublish( &mqttPacketInfo, &packetIdentifier, &publishInfo, &propBuffer, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_UINT32( 5U, publishInfo.subscriptionId );
+
+    /* Invalid parameters are rejected as by MQTT_DeserializePublish. */
+    status = MQTT_DeserializePublishWithProperties( NULL, &packetIdentifier, &publishInfo, &propBuffer,
+                                                    NULL, &deserializedProperties, 100, 100 );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* Invalid parameters. */
+    status = MQTT_DeserializePublishPropertiesInto( NULL, &decodedProperties );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTT_DeserializePublishPropertiesInto( &propBuffer, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    /* An invalid property stops the decoding. */
+    propBuffer.pBuffer = invalidProperty;
+    propBuffer.bufferLength = sizeof( invalidProperty );
+    propBuffer.currentIndex = sizeof( invalidProperty );
+    status = MQTT_DeserializePublishPropertiesInto( &propBuffer, &decodedProperties );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+}
@@ -372,6 +372,33 @@ void test_MQTT_RemoveStateRecord_RemoveQoS2Record( void )
 
 /* ========================================================================== */
 
+void test_MQTT_IncomingPublishState( void )
+{
+    MQTTContext_t context;
+    MQTTPubAckInfo_t incomingRecords[ 5 ];
+
+    memset( &context, 0, sizeof( MQTTContext_t ) );
+    memset( incomingRecords, 0, sizeof( incomingRecords ) );
+
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_IncomingPublishState( NULL, 12U ) );
+
+    /* No incoming records. */
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_IncomingPublishState( &context, 12U ) );
+
+    context.incomingPublishRecords = incomingRecords;
+    context.incomingPublishRecordMaxCount = 5;
+    addToRecord( incomingRecords, 2, 12U, MQTTQoS2, MQTTPubRelPending );
+
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_IncomingPublishState( &context, MQTT_PACKET_ID_INVALID ) );
+    TEST_ASSERT_EQUAL( MQTTStateNull, MQTT_IncomingPublishState( &context, 13U ) );
+    TEST_ASSERT_EQUAL( MQTTPubRelPending, MQTT_IncomingPublishState( &context, 12U ) );
+
+    /* The record is not updated. */
+    validateRecordAt( incomingRecords, 2, 12U, MQTTQoS2, MQTTPubRelPending );
+}
+
+/* ========================================================================== */
+
 void test_MQTT_ReserveState_compactRecords( void )
 {
     MQTTContext_t mqttContext = { 0 };
@@ -1133,6 +1160,257 @@ void test_MQTT_PublishToResend( void )
 
 /* ========================================================================== */
 
+void test_MQTT_InitStatefulQoSIndex( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTStatus_t status;
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPubAckInfo_t outgoingRecords[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckInfo_t incomingRecords[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckIndex_t outgoingIndex = { 0 };
+    MQTTPubAckIndex_t incomingIndex = { 0 };
+    uint16_t outgoingBuckets[ 16 ];
+    uint16_t incomingBuckets[ 16 ];
+    MQTTPublishState_t state;
+
+    transport.recv = transportRecvSuccess;
+    transport.send = transportSendSuccess;
+
+    status = MQTT_Init( &mqttContext, &transport,
+                        getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    status = MQTT_InitStatefulQoS( &mqttContext,
+                                   outgoingRecords, MQTT_STATE_ARRAY_MAX_COUNT,
+                                   incomingRecords, MQTT_STATE_ARRAY_MAX_COUNT, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    /* Bad parameters. */
+    status = MQTT_InitStatefulQoSIndex( NULL, &outgoingIndex, outgoingBuckets, 16, NULL, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    status = MQTT_InitStatefulQoSIndex( &mqttContext, &outgoingIndex, NULL, 16, NULL, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    /* Not a power of 2. */
+    status = MQTT_InitStatefulQoSIndex( &mqttContext, &outgoingIndex, outgoingBuckets, 12, NULL, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    /* Not more buckets than records. */
+    status = MQTT_InitStatefulQoSIndex( &mqttContext, NULL, NULL, 0, &incomingIndex, incomingBuckets, 8 );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    TEST_ASSERT_NULL( mqttContext.pOutgoingPublishIndex );
+    TEST_ASSERT_NULL( mqttContext.pIncomingPublishIndex );
+
+    /* Existing records are indexed. */
+    addToRecord( mqttContext.outgoingPublishRecords, 3, 7, MQTTQoS1, MQTTPubAckPending );
+    status = MQTT_InitStatefulQoSIndex( &mqttContext,
+                                        &outgoingIndex, outgoingBuckets, 16,
+                                        &incomingIndex, incomingBuckets, 16 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( &outgoingIndex, mqttContext.pOutgoingPublishIndex );
+    TEST_ASSERT_EQUAL_PTR( &incomingIndex, mqttContext.pIncomingPublishIndex );
+    TEST_ASSERT_EQUAL( 4U, outgoingIndex.recordEnd );
+    TEST_ASSERT_EQUAL( 0U, incomingIndex.recordEnd );
+
+    status = MQTT_UpdateStateAck( &mqttContext, 7, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( MQTTPublishDone, state );
+    TEST_ASSERT_EQUAL( 0U, outgoingIndex.recordEnd );
+
+    /* The records are added after the last one in use. */
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_ReserveState( &mqttContext, 7, MQTTQoS1 ) );
+    validateRecordAt( mqttContext.outgoingPublishRecords, 0, 7, MQTTQoS1, MQTTPublishSend );
+    TEST_ASSERT_EQUAL( MQTTStateCollision, MQTT_ReserveState( &mqttContext, 7, MQTTQoS1 ) );
+
+    /* Initializing the records again removes the index. */
+    status = MQTT_InitStatefulQoS( &mqttContext,
+                                   outgoingRecords, MQTT_STATE_ARRAY_MAX_COUNT,
+                                   incomingRecords, MQTT_STATE_ARRAY_MAX_COUNT, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_NULL( mqttContext.pOutgoingPublishIndex );
+    TEST_ASSERT_NULL( mqttContext.pIncomingPublishIndex );
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that indexed state records go through the same states, in the
+ * same order, as records that are not indexed.
+ */
+void test_MQTT_StateIndex_MatchesLinearRecords( void )
+{
+    MQTTContext_t linearContext = { 0 };
+    MQTTContext_t indexedContext = { 0 };
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPubAckInfo_t linearOutgoing[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckInfo_t linearIncoming[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckInfo_t indexedOutgoing[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckInfo_t indexedIncoming[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    MQTTPubAckIndex_t outgoingIndex;
+    MQTTPubAckIndex_t incomingIndex;
+    uint16_t outgoingBuckets[ 16 ];
+    uint16_t incomingBuckets[ 16 ];
+    MQTTStatus_t linearStatus;
+    MQTTStatus_t indexedStatus;
+    MQTTPublishState_t linearState;
+    MQTTPublishState_t indexedState;
+    MQTTStateCursor_t linearCursor;
+    MQTTStateCursor_t indexedCursor;
+    uint16_t linearId;
+    uint16_t indexedId;
+    uint32_t random = 1U;
+    uint16_t packetId;
+    MQTTQoS_t qos;
+    MQTTStateOperation_t opType;
+    MQTTPubAckType_t ackType;
+    size_t i;
+
+    transport.recv = transportRecvSuccess;
+    transport.send = transportSendSuccess;
+
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_Init( &linearContext, &transport, getTime, eventCallback, &networkBuffer ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_Init( &indexedContext, &transport, getTime, eventCallback, &networkBuffer ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_InitStatefulQoS( &linearContext,
+                                                          linearOutgoing, MQTT_STATE_ARRAY_MAX_COUNT,
+                                                          linearIncoming, MQTT_STATE_ARRAY_MAX_COUNT, NULL, 0 ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_InitStatefulQoS( &indexedContext,
+                                                          indexedOutgoing, MQTT_STATE_ARRAY_MAX_COUNT,
+                                                          indexedIncoming, MQTT_STATE_ARRAY_MAX_COUNT, NULL, 0 ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_InitStatefulQoSIndex( &indexedContext,
+                                                               &outgoingIndex, outgoingBuckets, 16,
+                                                               &incomingIndex, incomingBuckets, 16 ) );
+
+    for( i = 0; i < 20000; i++ )
+    {
+        /* A small linear congruential generator keeps the sequence fixed. */
+        random = ( random * 1103515245U ) + 12345U;
+        /* Few enough packet IDs for collisions, full records and compaction. */
+        packetId = ( uint16_t ) ( ( ( random >> 8 ) % 24U ) + 1U );
+        qos = ( ( random & 0x10000U ) != 0U ) ? MQTTQoS1 : MQTTQoS2;
+        opType = ( ( random & 0x20000U ) != 0U ) ? MQTT_SEND : MQTT_RECEIVE;
+        ackType = ( MQTTPubAckType_t ) ( ( random >> 18 ) % 4U );
+        linearState = MQTTStateNull;
+        indexedState = MQTTStateNull;
+
+        switch( ( random >> 24 ) % 5U )
+        {
+            case 0:
+                linearStatus = MQTT_ReserveState( &linearContext, packetId, qos );
+                indexedStatus = MQTT_ReserveState( &indexedContext, packetId, qos );
+                break;
+
+            case 1:
+                linearStatus = MQTT_UpdateStatePublish( &linearContext, packetId, opType, qos, &linearState );
+                indexedStatus = MQTT_UpdateStatePublish( &indexedContext, packetId, opType, qos, &indexedState );
+                break;
+
+            case 2:
+                linearStatus = MQTT_RemoveStateRecord( &linearContext, packetId );
+                indexedStatus = MQTT_RemoveStateRecord( &indexedContext, packetId );
+                break;
+
+            default:
+                linearStatus = MQTT_UpdateStateAck( &linearContext, packetId, ackType, opType, &linearState );
+                indexedStatus = MQTT_UpdateStateAck( &indexedContext, packetId, ackType, opType, &indexedState );
+                break;
+        }
+
+        TEST_ASSERT_EQUAL( linearStatus, indexedStatus );
+        TEST_ASSERT_EQUAL( linearState, indexedState );
+        TEST_ASSERT_EQUAL_MEMORY( linearOutgoing, indexedOutgoing, sizeof( linearOutgoing ) );
+        TEST_ASSERT_EQUAL_MEMORY( linearIncoming, indexedIncoming, sizeof( linearIncoming ) );
+    }
+
+    /* The resend order is the same. */
+    linearCursor = MQTT_STATE_CURSOR_INITIALIZER;
+    indexedCursor = MQTT_STATE_CURSOR_INITIALIZER;
+
+    do
+    {
+        linearId = MQTT_PublishToResend( &linearContext, &linearCursor );
+        indexedId = MQTT_PublishToResend( &indexedContext, &indexedCursor );
+        TEST_ASSERT_EQUAL( linearId, indexedId );
+    } while( linearId != MQTT_PACKET_ID_INVALID );
+}
+
+/* ========================================================================== */
+
+void test_MQTT_PacketIdAllocator( void )
+{
+    MQTTContext_t mqttContext = { 0 };
+    MQTTStatus_t status;
+    TransportInterface_t transport;
+    MQTTFixedBuffer_t networkBuffer = { 0 };
+    MQTTPubAckInfo_t outgoingRecords[ MQTT_STATE_ARRAY_MAX_COUNT ] = { 0 };
+    static uint32_t bitmap[ MQTT_PACKET_ID_BITMAP_WORDS ];
+    MQTTPublishState_t state;
+
+    transport.recv = transportRecvSuccess;
+    transport.send = transportSendSuccess;
+
+    status = MQTT_Init( &mqttContext, &transport,
+                        getTime, eventCallback, &networkBuffer );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    status = MQTT_InitStatefulQoS( &mqttContext,
+                                   outgoingRecords, MQTT_STATE_ARRAY_MAX_COUNT,
+                                   NULL, 0, NULL, 0 );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+
+    /* Bad parameters. */
+    status = MQTT_InitPacketIdAllocator( NULL, bitmap, MQTT_PACKET_ID_BITMAP_WORDS );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    status = MQTT_InitPacketIdAllocator( &mqttContext, NULL, MQTT_PACKET_ID_BITMAP_WORDS );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    status = MQTT_InitPacketIdAllocator( &mqttContext, bitmap, MQTT_PACKET_ID_BITMAP_WORDS - 1U );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, status );
+    TEST_ASSERT_NULL( mqttContext.pPacketIdBitmap );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, MQTT_ReleasePacketId( &mqttContext, 1 ) );
+
+    /* The IDs of existing records are held. */
+    addToRecord( mqttContext.outgoingPublishRecords, 0, 2, MQTTQoS1, MQTTPubAckPending );
+    status = MQTT_InitPacketIdAllocator( &mqttContext, bitmap, MQTT_PACKET_ID_BITMAP_WORDS );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( bitmap, mqttContext.pPacketIdBitmap );
+
+    TEST_ASSERT_EQUAL( 1, MQTT_GetPacketId( &mqttContext ) );
+    TEST_ASSERT_EQUAL( 3, MQTT_GetPacketId( &mqttContext ) );
+    TEST_ASSERT_EQUAL( 4, mqttContext.nextPacketId );
+
+    /* An ID chosen by the application is held once it is reserved. After the
+     * wrap-around, held IDs are skipped. */
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_ReserveState( &mqttContext, UINT16_MAX, MQTTQoS1 ) );
+    mqttContext.nextPacketId = UINT16_MAX;
+    TEST_ASSERT_EQUAL( 4, MQTT_GetPacketId( &mqttContext ) );
+
+    /* An acknowledged publish releases its ID. */
+    status = MQTT_UpdateStateAck( &mqttContext, 2, MQTTPuback, MQTT_RECEIVE, &state );
+    TEST_ASSERT_EQUAL( MQTTSuccess, status );
+    mqttContext.nextPacketId = UINT16_MAX;
+    TEST_ASSERT_EQUAL( 2, MQTT_GetPacketId( &mqttContext ) );
+
+    /* A removed publish releases its ID. */
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_RemoveStateRecord( &mqttContext, UINT16_MAX ) );
+    mqttContext.nextPacketId = UINT16_MAX;
+    TEST_ASSERT_EQUAL( UINT16_MAX, MQTT_GetPacketId( &mqttContext ) );
+    TEST_ASSERT_EQUAL( 1, mqttContext.nextPacketId );
+
+    /* An unused ID is released by the application. */
+    TEST_ASSERT_EQUAL( MQTTBadParameter, MQTT_ReleasePacketId( NULL, 1 ) );
+    TEST_ASSERT_EQUAL( MQTTBadParameter, MQTT_ReleasePacketId( &mqttContext, MQTT_PACKET_ID_INVALID ) );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_ReleasePacketId( &mqttContext, 1 ) );
+    TEST_ASSERT_EQUAL( 1, MQTT_GetPacketId( &mqttContext ) );
+
+    /* No ID is handed out when all are held. */
+    ( void ) memset( bitmap, 0xFF, sizeof( bitmap ) );
+    TEST_ASSERT_EQUAL( MQTT_PACKET_ID_INVALID, MQTT_GetPacketId( &mqttContext ) );
+    TEST_ASSERT_EQUAL( 2, mqttContext.nextPacketId );
+    TEST_ASSERT_EQUAL( MQTTSuccess, MQTT_ReleasePacketId( &mqttContext, 1000 ) );
+    TEST_ASSERT_EQUAL( 1000, MQTT_GetPacketId( &mqttContext ) );
+}
+
+/* ========================================================================== */
+
 void test_MQTT_State_strerror( void )
 {
     MQTTPublishState_t state;
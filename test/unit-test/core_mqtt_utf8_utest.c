@@ -0,0 +1,351 @@
+/*
+ * coreMQTT
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file core_mqtt_utf8_utest.c
+ * @brief Unit tests of the UTF-8 validation, built with #MQTT_VALIDATE_UTF8
+ * enabled.
+ */
+#include <string.h>
+#include "unity.h"
+
+#include "core_mqtt_serializer.h"
+#include "core_mqtt_serializer_private.h"
+
+/* Include config defaults header to get default values of configs. */
+#include "core_mqtt_config_defaults.h"
+
+/**
+ * @brief Length of the strings spanning several blocks of the vector
+ * instructions.
+ */
+#define LONG_STRING_LENGTH    ( 100U )
+
+/**
+ * @brief Length of the buffers of the incoming PUBLISH packets.
+ */
+#define PUBLISH_BUFFER_LENGTH    ( 32U )
+
+/* ============================   UNITY FIXTURES ============================ */
+
+/* Called before each test method. */
+void setUp( void )
+{
+}
+
+/* Called after each test method. */
+void tearDown( void )
+{
+}
+
+/* Called at the beginning of the whole suite. */
+void suiteSetUp()
+{
+}
+
+/* Called at the end of the whole suite. */
+int suiteTearDown( int numFailures )
+{
+    return numFailures;
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Check a string literal with #isValidUtf8String.
+ */
+static bool isValidLiteral( const char * pString )
+{
+    return isValidUtf8String( pString, strlen( pString ) );
+}
+
+/**
+ * @brief Set up an incoming QoS 0 PUBLISH with a topic name and properties.
+ *
+ * @return The remaining length of the PUBLISH.
+ */
+static uint32_t setupIncomingPublish( uint8_t * pBuffer,
+                                      const char * pTopicName,
+                                      size_t topicNameLength,
+                                      const uint8_t * pProperties,
+                                      size_t propertiesLength )
+{
+    uint8_t * pIndex = pBuffer;
+
+    TEST_ASSERT_TRUE( ( 3U + topicNameLength + propertiesLength ) <= PUBLISH_BUFFER_LENGTH );
+
+    *pIndex = 0U;
+    pIndex++;
+    *pIndex = ( uint8_t ) topicNameLength;
+    pIndex++;
+    ( void ) memcpy( pIndex, pTopicName, topicNameLength );
+    pIndex = &pIndex[ topicNameLength ];
+    *pIndex = ( uint8_t ) propertiesLength;
+    pIndex++;
+
+    if( propertiesLength > 0U )
+    {
+        ( void ) memcpy( pIndex, pProperties, propertiesLength );
+    }
+
+    return ( uint32_t ) ( 3U + topicNameLength + propertiesLength );
+}
+
+/* ========================================================================== */
+
+/**
+ * @brief Test that ASCII strings are valid, unless they hold U+0000, wherever
+ * it is relative to the blocks of the vector instructions.
+ */
+void test_isValidUtf8String_Ascii( void )
+{
+    char longString[ LONG_STRING_LENGTH ];
+    size_t i;
+
+    TEST_ASSERT_TRUE( isValidUtf8String( NULL, 0U ) );
+    TEST_ASSERT_TRUE( isValidLiteral( "home/kitchen/temperature" ) );
+    TEST_ASSERT_FALSE( isValidUtf8String( "a\0b", 3U ) );
+
+    ( void ) memset( longString, 'a', sizeof( longString ) );
+    TEST_ASSERT_TRUE( isValidUtf8String( longString, sizeof( longString ) ) );
+
+    for( i = 0U; i < LONG_STRING_LENGTH; i++ )
+    {
+        longString[ i ] = '\0';
+        TEST_ASSERT_FALSE( isValidUtf8String( longString, sizeof( longString ) ) );
+        longString[ i ] = 'a';
+    }
+}
+
+/**
+ * @brief Test that well-formed multi-byte sequences are valid, including the
+ * boundaries of the ranges of code points.
+ */
+void test_isValidUtf8String_MultiByte( void )
+{
+    char longString[ LONG_STRING_LENGTH ];
+
+    TEST_ASSERT_TRUE( isValidLiteral( "\xC2\x80" ) );             /* U+0080 */
+    TEST_ASSERT_TRUE( isValidLiteral( "caf\xC3\xA9" ) );          /* U+00E9 */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xDF\xBF" ) );             /* U+07FF */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xE0\xA0\x80" ) );         /* U+0800 */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xE2\x82\xAC" ) );         /* U+20AC */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xED\x9F\xBF" ) );         /* U+D7FF */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xEE\x80\x80" ) );         /* U+E000 */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xEF\xBF\xBF" ) );         /* U+FFFF */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xF0\x90\x80\x80" ) );     /* U+10000 */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xF0\x9F\x98\x80" ) );     /* U+1F600 */
+    TEST_ASSERT_TRUE( isValidLiteral( "\xF4\x8F\xBF\xBF" ) );     /* U+10FFFF */
+
+    /* A character in the middle of long ASCII strings, after which the whole
+     * blocks are checked again. */
+    ( void ) memset( longString, 'a', sizeof( longString ) );
+    longString[ 20 ] = ( char ) 0xC3;
+    longString[ 21 ] = ( char ) 0xA9;
+    TEST_ASSERT_TRUE( isValidUtf8String( longString, sizeof( longString ) ) );
+
+    longString[ 70 ] = '\0';
+    TEST_ASSERT_FALSE( isValidUtf8String( longString, sizeof( longString ) ) );
+
+    longString[ 70 ] = ( char ) 0xA9;
+    TEST_ASSERT_FALSE( isValidUtf8String( longString, sizeof( longString ) ) );
+}
+
+/**
+ * @brief Test that malformed sequences are not valid.
+ */
+void test_isValidUtf8String_Malformed( void )
+{
+    /* Continuation bytes without a lead byte, and bytes never in UTF-8. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\x80" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "a\xBF" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xFE" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xFF" ) );
+
+    /* Overlong encodings. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\xC0\xAF" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xC1\xBF" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xE0\x9F\xBF" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xF0\x8F\xBF\xBF" ) );
+
+    /* Surrogates. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\xED\xA0\x80" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xED\xBF\xBF" ) );
+
+    /* Code points above U+10FFFF. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\xF4\x90\x80\x80" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xF5\x80\x80\x80" ) );
+
+    /* Truncated sequences. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\xC3" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xE2\x82" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xF0\x9F\x98" ) );
+
+    /* Bad continuation bytes. */
+    TEST_ASSERT_FALSE( isValidLiteral( "\xC3\x28" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xE2\x28\xA1" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xE2\x82\x28" ) );
+    TEST_ASSERT_FALSE( isValidLiteral( "\xF0\x9F\x98\x28" ) );
+}
+
+/**
+ * @brief Test that decodeUtf8String rejects malformed strings while
+ * decodeUtf8 accepts them as binary data.
+ */
+void test_decodeUtf8String( void )
+{
+    uint8_t buffer[ 4 ] = { 0x00, 0x02, 0xC0, 0xAF };
+    uint8_t * pIndex = buffer;
+    uint32_t propertyLength = sizeof( buffer );
+    bool used = false;
+    const char * pString = NULL;
+    size_t length = 0U;
+    MQTTStatus_t status;
+
+    status = decodeUtf8String( &pString, &length, &propertyLength, &used, &pIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+    TEST_ASSERT_NULL( pString );
+
+    pIndex = buffer;
+    propertyLength = sizeof( buffer );
+    used = false;
+    status = decodeUtf8( &pString, &length, &propertyLength, &used, &pIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 2U, length );
+
+    buffer[ 2 ] = 0xC3;
+    buffer[ 3 ] = 0xA9;
+    pIndex = buffer;
+    propertyLength = sizeof( buffer );
+    used = false;
+    pString = NULL;
+    status = decodeUtf8String( &pString, &length, &propertyLength, &used, &pIndex );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL_PTR( &buffer[ 2 ], pString );
+    TEST_ASSERT_EQUAL( 2U, length );
+    TEST_ASSERT_EQUAL( 0U, propertyLength );
+}
+
+/**
+ * @brief Test that incoming PUBLISH packets with a malformed topic name or
+ * string property are rejected.
+ */
+void test_MQTT_DeserializePublish_Utf8( void )
+{
+    uint8_t buffer[ PUBLISH_BUFFER_LENGTH ];
+    MQTTPacketInfo_t packetInfo = { 0 };
+    MQTTPublishInfo_t publishInfo = { 0 };
+    MQTTPropBuilder_t propBuffer = { 0 };
+    uint16_t packetId = 0U;
+    MQTTStatus_t status;
+    const uint8_t badUserProperty[] = { MQTT_USER_PROPERTY_ID, 0x00, 0x01, 'k', 0x00, 0x01, 0x00 };
+    const uint8_t badResponseTopic[] = { MQTT_RESPONSE_TOPIC_ID, 0x00, 0x02, 0xED, 0xA0 };
+    const uint8_t badCorrelationData[] = { MQTT_CORRELATION_DATA_ID, 0x00, 0x02, 0xED, 0xA0 };
+
+    packetInfo.type = MQTT_PACKET_TYPE_PUBLISH;
+    packetInfo.pRemainingData = buffer;
+
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "t\xC3\xA9st", 5U, NULL, 0U );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    TEST_ASSERT_EQUAL( 5U, publishInfo.topicNameLength );
+
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "te\xFFt", 4U, NULL, 0U );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "a\0b", 3U, NULL, 0U );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "test", 4U,
+                                                       badUserProperty, sizeof( badUserProperty ) );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "test", 4U,
+                                                       badResponseTopic, sizeof( badResponseTopic ) );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTBadResponse, status );
+
+    /* Correlation data is binary data, and is not checked. */
+    packetInfo.remainingLength = setupIncomingPublish( buffer, "test", 4U,
+                                                       badCorrelationData, sizeof( badCorrelationData ) );
+    status = MQTT_DeserializePublish( &packetInfo, &packetId, &publishInfo, &propBuffer, 100U, 100U );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}
+
+/**
+ * @brief Test that the MQTTPropAdd_* functions reject malformed strings, but
+ * not malformed binary data.
+ */
+void test_MQTTPropAdd_Utf8( void )
+{
+    uint8_t buffer[ 64 ];
+    MQTTPropBuilder_t propBuilder;
+    MQTTUserProperty_t userProperty;
+    const char * pMalformed = "\xC0\xAF";
+    MQTTStatus_t status;
+
+    status = MQTTPropertyBuilder_Init( &propBuilder, buffer, sizeof( buffer ) );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+
+    userProperty.pKey = "key";
+    userProperty.keyLength = 3U;
+    userProperty.pValue = pMalformed;
+    userProperty.valueLength = 2U;
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProperty, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    userProperty.pKey = pMalformed;
+    userProperty.keyLength = 2U;
+    userProperty.pValue = "value";
+    userProperty.valueLength = 5U;
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProperty, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+
+    status = MQTTPropAdd_ResponseTopic( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTTPropAdd_ContentType( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTTPropAdd_ReasonString( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    status = MQTTPropAdd_AuthMethod( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTBadParameter, status );
+    TEST_ASSERT_EQUAL( 0U, propBuilder.currentIndex );
+
+    /* Well-formed strings and binary data are added. */
+    userProperty.pKey = "cl\xC3\xA9";
+    userProperty.keyLength = 4U;
+    status = MQTTPropAdd_UserProp( &propBuilder, &userProperty, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTTPropAdd_ContentType( &propBuilder, "text/plain", 10U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTTPropAdd_AuthMethod( &propBuilder, "SCRAM", 5U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTTPropAdd_AuthData( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+    status = MQTTPropAdd_CorrelationData( &propBuilder, pMalformed, 2U, NULL );
+    TEST_ASSERT_EQUAL_INT( MQTTSuccess, status );
+}